@@ -60,6 +60,167 @@ std::ostream &operator<<(std::ostream &os, MessageScope s)
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Compile the rule table for configured message types
+ */
+// ----------------------------------------------------------------------
+
+void MessageTypeRules::compile(const MessageTypes &theMessageTypes)
+{
+  try
+  {
+    itsMessageTypes = &theMessageTypes;
+    itsRules.clear();
+    itsNames.clear();
+
+    std::size_t group = 0;
+
+    for (auto const &messageType : theMessageTypes)
+    {
+      for (auto const &type : messageType.getMessageTypes())
+      {
+        MessageTypeRule rule;
+
+        rule.itsMessageType = &messageType;
+        rule.itsIndex = itsNames.size();
+        rule.itsGroup = group;
+
+        // The first configured type (group) is used for duplicate names
+
+        auto it = itsRules.insert(std::make_pair(type, rule));
+
+        if (it.second)
+          itsNames.push_back(&(it.first->first));
+      }
+
+      group++;
+    }
+
+    std::lock_guard<std::mutex> lock(itsFragmentMutex);
+
+    itsFragments.clear();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get rule for given message type name
+ */
+// ----------------------------------------------------------------------
+
+const MessageTypeRule *MessageTypeRules::getMessageTypeRule(const std::string &theMessageType) const
+{
+  auto it = itsRules.find(theMessageType);
+
+  return ((it != itsRules.end()) ? &(it->second) : nullptr);
+}
+
+const MessageType *MessageTypeRules::getMessageType(const std::string &theMessageType) const
+{
+  auto rule = getMessageTypeRule(theMessageType);
+
+  return (rule ? rule->itsMessageType : nullptr);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get (cached) sql fragment for given message types
+ *
+ * The fragment is built for the requested known types in configuration
+ * order; unknown and duplicate types are ignored, like they are by the
+ * fragment builders
+ */
+// ----------------------------------------------------------------------
+
+std::string MessageTypeRules::getFragment(Fragment theFragment,
+                                          const std::list<std::string> &theMessageTypeList,
+                                          unsigned int theTimeRangeTypeMask,
+                                          const FragmentBuilder &theBuilder) const
+{
+  try
+  {
+    // Max number of cached fragments; the cache is cleared if exceeded
+
+    const std::size_t maxFragments = 5000;
+
+    MessageTypeSet messageTypeSet(itsNames.size(), false);
+
+    for (auto const &messageType : theMessageTypeList)
+    {
+      auto rule = getMessageTypeRule(messageType);
+
+      if (rule)
+        messageTypeSet[rule->itsIndex] = true;
+    }
+
+    FragmentKey key(
+        theFragment, theTimeRangeTypeMask, theMessageTypeList.empty(), std::move(messageTypeSet));
+
+    {
+      std::lock_guard<std::mutex> lock(itsFragmentMutex);
+
+      auto it = itsFragments.find(key);
+
+      if (it != itsFragments.end())
+        return it->second;
+    }
+
+    std::list<std::string> messageTypeList;
+    auto const &typeSet = std::get<3>(key);
+
+    for (std::size_t index = 0; (index < typeSet.size()); index++)
+      if (typeSet[index])
+        messageTypeList.push_back(*itsNames[index]);
+
+    // If none of the given types is known, build with unknown type to get the fragment for
+    // "no types" instead of "all types"
+
+    if (messageTypeList.empty() && (!theMessageTypeList.empty()))
+      messageTypeList.push_back(theMessageTypeList.front());
+
+    auto fragment = theBuilder(messageTypeList);
+
+    std::lock_guard<std::mutex> lock(itsFragmentMutex);
+
+    if (itsFragments.size() >= maxFragments)
+      itsFragments.clear();
+
+    itsFragments.insert(std::make_pair(std::move(key), fragment));
+
+    return fragment;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get bitmask for time range type(s)
+ */
+// ----------------------------------------------------------------------
+
+unsigned int MessageTypeRules::timeRangeTypeMask(TimeRangeType theTimeRangeType)
+{
+  return (1U << static_cast<unsigned int>(theTimeRangeType));
+}
+
+unsigned int MessageTypeRules::timeRangeTypeMask(const std::list<TimeRangeType> &theTimeRangeTypes)
+{
+  unsigned int mask = 0;
+
+  for (auto timeRangeType : theTimeRangeTypes)
+    mask |= timeRangeTypeMask(timeRangeType);
+
+  return mask;
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief The only permitted constructor requires a configfile
@@ -195,6 +356,48 @@ Config::Config(const std::string &theConfigFileName) : ConfigBase(theConfigFileN
       throw exception;
     }
 
+    // Whether to execute station, FIR and global scope queries concurrently
+
+    itsParallelScopeQueries = get_optional_config_param<bool>(
+        theConfig.getRoot(), "message.parallelscopequeries", false);
+
+    // Length of time chunks (hours) for querying long time ranges concurrently; 0 disables
+
+    int historyChunkHours =
+        get_optional_config_param<int>(theConfig.getRoot(), "message.historychunkhours", 0);
+
+    if (historyChunkHours < 0)
+    {
+      Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+      exception.addDetail("The attribute value must be greater than or equal to 0.");
+      exception.addParameter("Configuration file", theConfigFileName);
+      exception.addParameter("Attribute", "message.historychunkhours");
+      throw exception;
+    }
+
+    itsHistoryChunkHours = historyChunkHours;
+
+    // Max number of connections used to query the time chunks concurrently
+
+    int historyChunkConnections = get_optional_config_param<int>(
+        theConfig.getRoot(), "message.historychunkconnections", 2);
+
+    if (historyChunkConnections < 1)
+    {
+      Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+      exception.addDetail("The attribute value must be greater than 0.");
+      exception.addParameter("Configuration file", theConfigFileName);
+      exception.addParameter("Attribute", "message.historychunkconnections");
+      throw exception;
+    }
+
+    itsHistoryChunkConnections = historyChunkConnections;
+
+    // Whether to execute identical concurrent message queries once
+
+    itsCoalesceQueries = get_optional_config_param<bool>(
+        theConfig.getRoot(), "message.coalescequeries", true);
+
     // Filtering of finnish METARs; if true/enabled, by default returning finnish METARs only when
     // they are LIKE "METAR%".
     // Stations can be excluded from filtering by their icao code
@@ -929,6 +1132,154 @@ Config::Config(const std::string &theConfigFileName) : ConfigBase(theConfigFileN
       itsMessageTypes.push_back(messageType);
     }
 
+    itsMessageTypeRules.compile(itsMessageTypes);
+
+    // Station catalog settings
+
+    itsStationCatalogEnabled =
+        get_optional_config_param<bool>(theConfig.getRoot(), "stationcatalog.enabled", true);
+
+    int refreshInterval = get_optional_config_param<int>(
+        theConfig.getRoot(), "stationcatalog.refreshinterval", 60);
+
+    if (refreshInterval <= 0)
+    {
+      Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+      exception.addDetail("The attribute value must be greater than 0.");
+      exception.addParameter("Configuration file", theConfigFileName);
+      exception.addParameter("Attribute", "stationcatalog.refreshinterval");
+      throw exception;
+    }
+
+    itsStationCatalogRefreshInterval = refreshInterval;
+
+    // FIR area settings
+
+    refreshInterval =
+        get_optional_config_param<int>(theConfig.getRoot(), "firareas.refreshinterval", 3600);
+
+    if (refreshInterval <= 0)
+    {
+      Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+      exception.addDetail("The attribute value must be greater than 0.");
+      exception.addParameter("Configuration file", theConfigFileName);
+      exception.addParameter("Attribute", "firareas.refreshinterval");
+      throw exception;
+    }
+
+    itsFIRAreaRefreshInterval = refreshInterval;
+
+    if (theConfig.exists("firareas.simplifytolerances"))
+    {
+      const libconfig::Setting &tolerancesSetting =
+          theConfig.lookup("firareas.simplifytolerances");
+
+      if (!tolerancesSetting.isArray())
+      {
+        Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+        exception.addDetail("The attribute value must contain an array of tolerances.");
+        exception.addParameter("Configuration file", theConfigFileName);
+        exception.addParameter("Attribute", "firareas.simplifytolerances");
+        throw exception;
+      }
+
+      std::set<double> tolerances;
+
+      for (int j = 0; (j < tolerancesSetting.getLength()); j++)
+      {
+        auto type = tolerancesSetting[j].getType();
+        double tolerance = 0;
+
+        if (type == libconfig::Setting::Type::TypeFloat)
+          tolerance = tolerancesSetting[j];
+        else if (type == libconfig::Setting::Type::TypeInt)
+          tolerance = static_cast<int>(tolerancesSetting[j]);
+
+        if (tolerance <= 0)
+        {
+          Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+          exception.addDetail("The attribute value must contain an array of positive tolerances.");
+          exception.addParameter("Configuration file", theConfigFileName);
+          exception.addParameter("Attribute", "firareas.simplifytolerances");
+          exception.addParameter("Array index", Fmi::to_string(j));
+          throw exception;
+        }
+
+        tolerances.insert(tolerance);
+      }
+
+      itsFIRAreaSimplifyTolerances.assign(tolerances.begin(), tolerances.end());
+    }
+
+    // Latest message cache settings
+
+    itsLatestMessageCacheEnabled =
+        get_optional_config_param<bool>(theConfig.getRoot(), "latestmessagecache.enabled", true);
+
+    int pollInterval = get_optional_config_param<int>(
+        theConfig.getRoot(), "latestmessagecache.pollinterval", 10);
+
+    if (pollInterval <= 0)
+    {
+      Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+      exception.addDetail("The attribute value must be greater than 0.");
+      exception.addParameter("Configuration file", theConfigFileName);
+      exception.addParameter("Attribute", "latestmessagecache.pollinterval");
+      throw exception;
+    }
+
+    itsLatestMessageCachePollInterval = pollInterval;
+
+    // Result cache settings
+
+    itsResultCacheEnabled =
+        get_optional_config_param<bool>(theConfig.getRoot(), "resultcache.enabled", false);
+
+    auto positiveSetting =
+        [this, &theConfig, &theConfigFileName](const char *theName, int theDefault)
+    {
+      int value = get_optional_config_param<int>(theConfig.getRoot(), theName, theDefault);
+
+      if (value <= 0)
+      {
+        Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+        exception.addDetail("The attribute value must be greater than 0.");
+        exception.addParameter("Configuration file", theConfigFileName);
+        exception.addParameter("Attribute", theName);
+        throw exception;
+      }
+
+      return value;
+    };
+
+    itsResultCacheMaxSize =
+        static_cast<std::size_t>(positiveSetting("resultcache.maxsize", 100)) * 1024 * 1024;
+    itsResultCacheTimeBucket = positiveSetting("resultcache.timebucket", 60);
+    itsResultCacheTTL = positiveSetting("resultcache.ttl", 600);
+    itsResultCachePollInterval = positiveSetting("resultcache.pollinterval", 10);
+    itsResultCacheCommitLag = positiveSetting("resultcache.commitlag", 60);
+
+    // Route cache settings
+
+    itsRouteCacheEnabled =
+        get_optional_config_param<bool>(theConfig.getRoot(), "routecache.enabled", true);
+    itsRouteCacheMaxSize = positiveSetting("routecache.maxsize", 10000);
+
+    // Coarser than 3 decimals (about 100 meters) would select stations noticeably off the route
+
+    int precision = get_optional_config_param<int>(theConfig.getRoot(), "routecache.precision", 3);
+
+    if ((precision < 3) || (precision > 10))
+    {
+      Fmi::Exception exception(BCP, "Invalid configuration attribute value!");
+      exception.addDetail("The attribute value must be between 3 and 10.");
+      exception.addParameter("Configuration file", theConfigFileName);
+      exception.addParameter("Attribute", "routecache.precision");
+      throw exception;
+    }
+
+    itsRouteCachePrecision = precision;
+
     itsFilterFIMETARxxx = (itsFilterFIMETARxxx &&
                            (find(knownMessageTypes.begin(), knownMessageTypes.end(), "METAR") !=
                             knownMessageTypes.end()));
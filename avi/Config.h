@@ -4,7 +4,12 @@
 
 #include <spine/ConfigBase.h>
 #include <algorithm>
+#include <functional>
 #include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
 
 namespace SmartMet
 {
@@ -113,6 +118,67 @@ class MessageType
 
 using MessageTypes = std::list<MessageType>;
 
+// Set of configured message type names; bit index is given by MessageTypeRule::itsIndex
+
+using MessageTypeSet = std::vector<bool>;
+
+struct MessageTypeRule
+{
+  const MessageType *itsMessageType = nullptr;  // Configured type (group) the name belongs to
+  std::size_t itsIndex = 0;                     // Index of the name (MessageTypeSet bit)
+  std::size_t itsGroup = 0;                     // Index of the type (group) in configuration
+};
+
+// Message type rule table compiled from the configured message types. Provides indexed
+// lookup of message types by name, and caches sql fragments built for requested message
+// type sets so that the configured types need not be traversed for each query
+
+class MessageTypeRules
+{
+ public:
+  enum class Fragment
+  {
+    MessageTypeIn,
+    MessageTypeGroupBy,
+    MessirHeadingGroupBy,
+    MessageTypeValidity
+  };
+
+  using FragmentBuilder = std::function<std::string(const std::list<std::string> &)>;
+
+  MessageTypeRules() = default;
+  MessageTypeRules(const MessageTypeRules &) = delete;
+  MessageTypeRules &operator=(const MessageTypeRules &) = delete;
+
+  void compile(const MessageTypes &theMessageTypes);
+
+  const MessageTypes &getMessageTypes() const { return *itsMessageTypes; }
+  const MessageTypeRule *getMessageTypeRule(const std::string &theMessageType) const;
+  const MessageType *getMessageType(const std::string &theMessageType) const;
+
+  // Get sql fragment for given message types (all types if empty), building it for the set of
+  // requested (known) types in configuration order if not cached. Time range types (if any)
+  // the fragment depends on are passed as a bitmask
+
+  std::string getFragment(Fragment theFragment,
+                          const std::list<std::string> &theMessageTypeList,
+                          unsigned int theTimeRangeTypeMask,
+                          const FragmentBuilder &theBuilder) const;
+
+  static unsigned int timeRangeTypeMask(TimeRangeType theTimeRangeType);
+  static unsigned int timeRangeTypeMask(const std::list<TimeRangeType> &theTimeRangeTypes);
+
+ private:
+  using FragmentKey = std::tuple<Fragment, unsigned int, bool, MessageTypeSet>;
+
+  const MessageTypes *itsMessageTypes = nullptr;
+  std::map<std::string, MessageTypeRule> itsRules;
+  std::vector<const std::string *> itsNames;  // Type names by index
+
+  mutable std::mutex itsFragmentMutex;
+  mutable std::map<FragmentKey, std::string> itsFragments;
+};
+
 class Config : public SmartMet::Spine::ConfigBase
 {
  public:
@@ -141,6 +207,40 @@ class Config : public SmartMet::Spine::ConfigBase
   }
 
   const MessageTypes &getMessageTypes() const { return itsMessageTypes; }
+  const MessageTypeRules &getMessageTypeRules() const { return itsMessageTypeRules; }
+
+  bool getStationCatalogEnabled() const { return itsStationCatalogEnabled; }
+  unsigned int getStationCatalogRefreshInterval() const
+  {
+    return itsStationCatalogRefreshInterval;
+  }
+  unsigned int getFIRAreaRefreshInterval() const { return itsFIRAreaRefreshInterval; }
+  const std::vector<double> &getFIRAreaSimplifyTolerances() const
+  {
+    return itsFIRAreaSimplifyTolerances;
+  }
+
+  bool getParallelScopeQueries() const { return itsParallelScopeQueries; }
+  bool getCoalesceQueries() const { return itsCoalesceQueries; }
+  unsigned int getHistoryChunkHours() const { return itsHistoryChunkHours; }
+  unsigned int getHistoryChunkConnections() const { return itsHistoryChunkConnections; }
+
+  bool getLatestMessageCacheEnabled() const { return itsLatestMessageCacheEnabled; }
+  unsigned int getLatestMessageCachePollInterval() const
+  {
+    return itsLatestMessageCachePollInterval;
+  }
+
+  bool getResultCacheEnabled() const { return itsResultCacheEnabled; }
+  std::size_t getResultCacheMaxSize() const { return itsResultCacheMaxSize; }
+  unsigned int getResultCacheTimeBucket() const { return itsResultCacheTimeBucket; }
+  unsigned int getResultCacheTTL() const { return itsResultCacheTTL; }
+  unsigned int getResultCachePollInterval() const { return itsResultCachePollInterval; }
+  unsigned int getResultCacheCommitLag() const { return itsResultCacheCommitLag; }
+
+  bool getRouteCacheEnabled() const { return itsRouteCacheEnabled; }
+  std::size_t getRouteCacheMaxSize() const { return itsRouteCacheMaxSize; }
+  unsigned int getRouteCachePrecision() const { return itsRouteCachePrecision; }
 
  private:
   std::string itsHost;
@@ -175,6 +275,7 @@ class Config : public SmartMet::Spine::ConfigBase
                                                   // time
 
   MessageTypes itsMessageTypes;
+  MessageTypeRules itsMessageTypeRules;  // Compiled from itsMessageTypes
 
   // Currently METARs from some finnish stations are stored twice into the database, with and
   // without "METAR" in the beginning of message.
@@ -185,6 +286,75 @@ class Config : public SmartMet::Spine::ConfigBase
 
   bool itsFilterFIMETARxxx;
   std::list<std::string> itsFilterFIMETARxxxExcludeIcaos;
+
+  // In-memory station catalog (snapshot of avidb_stations) used to validate and query stations
+  // with station id's, icao codes, country codes and places without database round-trips.
+  //
+  // The snapshot is reloaded when avidb_stations is found to be modified (the max modified_last
+  // or row count has changed); the check is done every 'refreshinterval' seconds
+
+  bool itsStationCatalogEnabled = true;
+  unsigned int itsStationCatalogRefreshInterval = 60;
+
+  // FIR areas (and their point-in-polygon index) are reloaded when the FIR table is found to be
+  // modified (the checksum of area id's and geometries has changed); the check is done every
+  // 'refreshinterval' seconds
+
+  unsigned int itsFIRAreaRefreshInterval = 3600;
+
+  // Tolerances (degrees, in increasing order) the FIR areas are simplified with when loaded
+
+  std::vector<double> itsFIRAreaSimplifyTolerances;
+
+  // Current time queries for 'latestmessage' types are answered using cached recent messages;
+  // the cache is polled for new messages every 'pollinterval' seconds (and caught up by queries)
+
+  bool itsLatestMessageCacheEnabled = true;
+  unsigned int itsLatestMessageCachePollInterval = 10;
+
+  // If set, station, FIR and global scope queries (route query) are executed concurrently,
+  // each using its own pooled connection
+
+  bool itsParallelScopeQueries = false;
+
+  // If set (> 0), valid messages time range queries longer than 'historychunkhours' are split
+  // into time chunks aligned to multiples of the chunk length (from epoch), and the chunks
+  // are queried concurrently using up to 'historychunkconnections' pooled connections
+
+  unsigned int itsHistoryChunkHours = 0;
+
+  // Max number of connections (including the caller's connection) used to query the time chunks
+  // of a query concurrently; never more than half of the connection pool
+
+  unsigned int itsHistoryChunkConnections = 2;
+
+  // If set, identical concurrent message queries are executed once and the callers share the
+  // result
+
+  bool itsCoalesceQueries = true;
+
+  // Message query results are cached up to 'maxsize' megabytes. Current time queries are cached
+  // for the current 'timebucket' (seconds); a result expires after the smallest 'validityhours'
+  // of the queried message types, or after 'ttl' seconds if any of the types (or all types) is
+  // queried without 'validityhours'. Results are invalidated when new messages of the queried
+  // types are found by polling every 'pollinterval' seconds. Messages are polled by creation
+  // time; since a message is committed after it was created, polling starts 'commitlag' seconds
+  // before the previous poll
+
+  bool itsResultCacheEnabled = false;
+  std::size_t itsResultCacheMaxSize = 100 * 1024 * 1024;
+  unsigned int itsResultCacheTimeBucket = 60;
+  unsigned int itsResultCacheTTL = 600;
+  unsigned int itsResultCachePollInterval = 10;
+  unsigned int itsResultCacheCommitLag = 60;
+
+  // Stations of route queries are cached for up to 'maxsize' routes. The routes are keyed by
+  // coordinates rounded to 'precision' decimals (and max distance and message scope); the cache
+  // is cleared when station catalog is reloaded
+
+  bool itsRouteCacheEnabled = true;
+  std::size_t itsRouteCacheMaxSize = 10000;
+  unsigned int itsRouteCachePrecision = 3;
 };  // class Config
 
 }  // namespace Avi
@@ -4,10 +4,15 @@
 
 #include <spine/SmartMetEngine.h>
 #include <timeseries/TimeSeries.h>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <list>
 #include <map>
+#include <memory>
 #include <pqxx/result>
 #include <utility>
+#include <vector>
 
 #define stationIdQueryColumn "stationid"
 #define messageQueryColumn "message"
@@ -379,9 +384,184 @@ struct StationQueryData
                                    // returned
 };
 
+// Result of asynchronous station query; query options are returned as validated and normalized
+// by the query, like the synchronous query modifies the options given by the caller
+
+struct StationQueryResult
+{
+  QueryOptions itsQueryOptions;
+  StationQueryData itsQueryData;
+};
+
+// Columnar query result; column schema, contiguous column value buffers and the row
+// range of each station. Rows are grouped by station in the order of appearance
+
+struct StationQueryTable
+{
+  struct StationRows
+  {
+    StationIdType itsStationId;
+    std::size_t itsFirstRow;
+    std::size_t itsRowCount;
+  };
+
+  std::size_t getRowCount() const { return itsRowCount; }
+
+  // Index of the column in itsColumns/itsColumnValues, -1 if the column is not selected
+
+  int getColumnIndex(const std::string &theColumnName) const
+  {
+    int index = 0;
+
+    for (auto const &column : itsColumns)
+    {
+      if (column.itsName == theColumnName)
+        return index;
+
+      index++;
+    }
+
+    return -1;
+  }
+
+  const TimeSeries::Value &getValue(std::size_t theRow, std::size_t theColumnIndex) const
+  {
+    return itsColumnValues[theColumnIndex][theRow];
+  }
+
+  // Compatibility view; returns the data as StationQueryData
+
+  StationQueryData getStationQueryData() const
+  {
+    StationQueryData stationQueryData;
+    stationQueryData.itsColumns = itsColumns;
+
+    for (auto const &station : itsStationRows)
+    {
+      auto &queryValues = stationQueryData.itsValues[station.itsStationId];
+      stationQueryData.itsStationIds.push_back(station.itsStationId);
+
+      auto column = itsColumns.begin();
+
+      for (auto const &values : itsColumnValues)
+      {
+        if (values.size() == itsRowCount)
+        {
+          auto first = values.begin() + station.itsFirstRow;
+          queryValues[column->itsName].assign(first, first + station.itsRowCount);
+        }
+
+        column++;
+      }
+    }
+
+    return stationQueryData;
+  }
+
+  Columns itsColumns;  // Column schema
+
+  // Values of each column in itsColumns order; the buffers of automatically selected columns
+  // (not requested by the caller) are empty
+
+  std::vector<ValueVector> itsColumnValues;
+  std::vector<StationRows> itsStationRows;  // Stations in the order returned by database query
+  std::size_t itsRowCount = 0;
+};
+
 using FIRAreaAndBBox = std::pair<std::string, BBox>;
 using FIRQueryData = std::map<int, FIRAreaAndBBox>;
 
+// FIR area geometry as GeoJSON and as flat coordinate arrays (lon,lat,lon,lat,...) of
+// its rings. At full resolution the GeoJSON is not copied; it shares the area's GeoJSON
+// returned by queryFIRAreas(), keeping the areas alive while the pointer is held
+
+struct FIRAreaGeometry
+{
+  std::shared_ptr<const std::string> itsGeoJSON;
+  std::vector<std::vector<double>> itsRings;
+  std::size_t itsVertexCount = 0;
+};
+
+using FIRAreaGeometries = std::map<int, FIRAreaGeometry>;
+
+// FIR areas simplified with given tolerance (degrees); tolerance 0 for full resolution
+
+struct FIRAreaResolution
+{
+  double itsTolerance = 0;
+  std::size_t itsVertexCount = 0;  // Total number of vertices of the areas
+  FIRAreaGeometries itsAreas;
+};
+
+using FIRAreaResolutions = std::vector<FIRAreaResolution>;
+
+// Latency histogram of a query stage over the metrics time window; times are in milliseconds
+
+struct LatencyHistogram
+{
+  std::vector<double> itsBucketLimits;  // Bucket upper limits; the last bucket is unbounded
+  std::vector<std::size_t> itsCounts;   // Bucket counts (itsBucketLimits.size() + 1)
+  std::size_t itsCount = 0;
+  double itsTotal = 0;
+  double itsMax = 0;
+};
+
+// Latencies of public api method calls querying given message types. Stage times are
+// exclusive (e.g. messagequery does not include resultdecoding); "total" is the call's
+// elapsed time
+
+struct QueryLatencies
+{
+  std::string itsMethod;
+  std::string itsMessageTypes;  // Comma separated (upper case) message types queried
+  std::map<std::string, LatencyHistogram> itsStages;
+};
+
+using QueryMetricsData = std::list<QueryLatencies>;
+
+// Continuation token for querying rejected messages by pages. Set page size for the first page;
+// the query clears the first page flag, sets the key of the last message returned and whether
+// it was the last page. The key is icao code, creation time and message; messages without icao
+// code are ordered last. Pages are read by range scans of an index on the rejected messages
+// table's (icao_code,created) columns. If a page ends between identical copies of a message
+// (having equal key), the remaining copies are skipped
+
+struct RejectedMessagePageToken
+{
+  unsigned int itsPageSize = 0;  // Max number of messages per page
+  bool itsFirstPage = true;      // Set until the first page has been queried
+  bool itsNullIcao = false;      // Set if the last message has no icao code
+  std::string itsIcao;           // Icao code of the last message
+  std::int64_t itsCreated = 0;   // Creation time of the last message (microseconds since epoch)
+  std::string itsMessage;        // The last message
+  bool itsLastPage = false;      // Set if there are no more messages
+};
+
+// Continuation token for querying accepted messages by pages. Set page size and leave the key
+// empty for the first page; the query sets the key of the last message returned and whether
+// it was the last page. The key follows the order of the messages (station's icao code or route
+// position, station id, [message type and message time,] message id); message type and time
+// are used when querying distinct messages. The hashes of the messages of the last message
+// group (station, message type and message time) are passed to the next page to skip duplicate
+// messages of the group
+
+struct MessagePageToken
+{
+  unsigned int itsPageSize = 0;                 // Max number of messages per page
+  std::string itsStationKey;                    // Icao code or route position of the last station
+  StationIdType itsStationId = 0;               // Station id of the last message
+  int itsTypeId = 0;                            // Message type id of the last message
+  std::int64_t itsMessageTime = 0;              // Message time of the last message (us since epoch)
+  std::int64_t itsMessageId = 0;                // Message id of the last message
+  std::vector<std::uint64_t> itsMessageHashes;  // Message hashes of the last message group
+  bool itsLastPage = false;                     // Set if there are no more messages
+};
+
+// Row batch callbacks for streamed queries; the batch is valid only during the call
+
+using MessageBatchCallback = std::function<void(const StationQueryTable &)>;
+using RejectedMessageBatchCallback = std::function<void(const QueryData &)>;
+
 /**
  * @brief Base class for AVI engine
  *
@@ -406,6 +586,35 @@ class Engine : public SmartMet::Spine::SmartMetEngine
   {
     unavailable(BCP);
   }
+  // Paged version of queryMessages(); returns the page of messages following the one stored in
+  // the token and updates the token. Concatenated pages are equal to the result of queryMessages().
+  // Max number of rows limit is not applied
+
+  virtual StationQueryData queryMessages(const StationIdList & /* stationIdList */,
+                                         const QueryOptions & /* queryOptions */,
+                                         MessagePageToken & /* pageToken */) const
+  {
+    unavailable(BCP);
+  }
+  // Columnar version of queryMessages(); StationQueryTable::getStationQueryData() returns
+  // the data as StationQueryData
+
+  virtual StationQueryTable queryMessageTable(const StationIdList & /* stationIdList */,
+                                              const QueryOptions & /* queryOptions */) const
+  {
+    unavailable(BCP);
+  }
+  // Streamed version of queryMessageTable(); rows are fetched with a database cursor and passed
+  // to the callback in batches. Duplicate messages are filtered over the batches, but the rows
+  // of a station may be split to multiple batches. If max number of rows is exceeded, an error
+  // is thrown after the preceding batches have been passed to the callback
+
+  virtual void streamMessages(const StationIdList & /* stationIdList */,
+                              const QueryOptions & /* queryOptions */,
+                              const MessageBatchCallback & /* callback */) const
+  {
+    unavailable(BCP);
+  }
   virtual StationQueryData &joinStationAndMessageData(const StationQueryData & /* stationData */,
                                                       StationQueryData & /*messageData*/) const
   {
@@ -417,13 +626,96 @@ class Engine : public SmartMet::Spine::SmartMetEngine
     unavailable(BCP);
   }
 
+  // Batch version of queryStationsAndMessages(); returns the data of each request in request
+  // order. Requests differing only by location are combined into single message query
+
+  virtual std::vector<StationQueryData> queryBatch(
+      std::vector<QueryOptions> & /*queryOptionsList*/) const
+  {
+    unavailable(BCP);
+  }
+
   virtual QueryData queryRejectedMessages(const QueryOptions & /*queryOptions*/) const
   {
     unavailable(BCP);
   }
 
+  // Paged version of queryRejectedMessages(); returns the page of messages following the one
+  // stored in the token and updates the token. Max number of rows limit is not applied
+
+  virtual QueryData queryRejectedMessages(const QueryOptions & /*queryOptions*/,
+                                          RejectedMessagePageToken & /*pageToken*/) const
+  {
+    unavailable(BCP);
+  }
+
+  // Streamed version of queryRejectedMessages(). As with streamMessages(), batches preceding
+  // the one exceeding max number of rows have been passed to the callback when error is thrown
+
+  virtual void streamRejectedMessages(const QueryOptions & /*queryOptions*/,
+                                      const RejectedMessageBatchCallback & /*callback*/) const
+  {
+    unavailable(BCP);
+  }
+
+  // FIR areas are reloaded when the FIR table changes. The references returned by
+  // queryFIRAreas() and queryFIRAreaResolutions() stay valid for the lifetime of the engine,
+  // but refer to the areas loaded at the time of the call; the shared versions release the
+  // areas when the pointer is no longer held
+
   virtual const FIRQueryData &queryFIRAreas() const { unavailable(BCP); }
 
+  virtual std::shared_ptr<const FIRQueryData> queryFIRAreasShared() const { unavailable(BCP); }
+
+  // FIR areas at full resolution and simplified with the configured tolerances, in increasing
+  // tolerance order. The geometries are simplified when the areas are loaded
+
+  virtual const FIRAreaResolutions &queryFIRAreaResolutions() const { unavailable(BCP); }
+
+  virtual std::shared_ptr<const FIRAreaResolutions> queryFIRAreaResolutionsShared() const
+  {
+    unavailable(BCP);
+  }
+
+  // FIR areas simplified with the largest configured tolerance not exceeding given tolerance
+
+  virtual const FIRAreaResolution &queryFIRAreas(double /* tolerance */) const
+  {
+    unavailable(BCP);
+  }
+
+  // Asynchronous versions of the query methods; the queries are executed by engine's worker
+  // threads. Query options are copied; the options modified by queryStations() and
+  // queryStationsAndMessages() are returned with the data
+
+  virtual std::future<StationQueryResult> queryStationsAsync(
+      const QueryOptions & /* queryOptions */) const
+  {
+    unavailable(BCP);
+  }
+
+  virtual std::future<StationQueryData> queryMessagesAsync(
+      const StationIdList & /* stationIdList */, const QueryOptions & /* queryOptions */) const
+  {
+    unavailable(BCP);
+  }
+
+  virtual std::future<StationQueryResult> queryStationsAndMessagesAsync(
+      const QueryOptions & /* queryOptions */) const
+  {
+    unavailable(BCP);
+  }
+
+  virtual std::future<QueryData> queryRejectedMessagesAsync(
+      const QueryOptions & /* queryOptions */) const
+  {
+    unavailable(BCP);
+  }
+
+  // Per stage latency histograms of the api calls for the admin/status interface
+
+  virtual QueryMetricsData getQueryMetrics() const { unavailable(BCP); }
+
  protected:
   void init() override {}
 
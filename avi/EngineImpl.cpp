@@ -1,15 +1,24 @@
 // ======================================================================
 
 #include "EngineImpl.h"
-#include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <macgyver/AnsiEscapeCodes.h>
 #include <macgyver/Exception.h>
 #include <macgyver/StringConversion.h>
 #include <macgyver/TimeParser.h>
 #include <spine/Convenience.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <limits>
 #include <memory>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 using namespace std;
 
@@ -62,14 +71,33 @@ string derivedExpression(const string& tableColumnName, const string& queryColum
 {
   // ST_X(geom) AS longitudes
   // ST_Y(geom) AS latitude
-  // ST_X(geom) || ',' || ST_Y(geom) AS lonlat
-  // ST_Y(geom) || ',' || ST_X(geom) AS latlon
   // ST_Distance(geom::geography,ST_SetSRID(coordinates.coordinate,4326)::geography) AS distance
   // DEGREES(ST_Azimuth(geom,ST_SetSRID(coordinates.coordinate,4326))) AS bearing
 
   return tableColumnName + " AS " + queryColumnName;
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Return coordinate pair select expression
+ *
+ * 'lonlat' and 'latlon' share separate numeric longitude and latitude
+ * columns, which are selected once; TimeSeries::LonLat is built from
+ * them when loading the result
+ */
+// ----------------------------------------------------------------------
+
+const char* coordinatePairLonQueryColumn = "pairlon";
+const char* coordinatePairLatQueryColumn = "pairlat";
+
+string coordinatePairExpression(const string& tableColumnName, const string& /* queryColumnName */)
+{
+  // ST_X(geom) AS pairlon,ST_Y(geom) AS pairlat
+
+  return "ST_X(" + tableColumnName + ") AS " + coordinatePairLonQueryColumn + ",ST_Y(" +
+         tableColumnName + ") AS " + coordinatePairLatQueryColumn;
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Return 'NULL' select expression
@@ -88,8 +116,7 @@ string nullExpression(const Column* queryColumn)
 
 const char* dfLongitude = "ST_X(geom)";
 const char* dfLatitude = "ST_Y(geom)";
-const char* dfLonLat = "('' || ST_X(geom) || ',' || ST_Y(geom))";
-const char* dfLatLon = "('' || ST_Y(geom) || ',' || ST_X(geom))";
+const char* dfGeom = "geom";
 const char* dfDistance =
     "ST_Distance(geom::geography,ST_SetSRID(coordinates.coordinate,4326)::geography) / 1000";
 const char* dfBearing = "DEGREES(ST_Azimuth(geom,ST_SetSRID(coordinates.coordinate,4326)))";
@@ -101,6 +128,8 @@ const char* firTableAlias = "fi";
 const char* firTableJoin = "ST_Contains(fi.areageom,st.geom)";
 const char* firIdTableColumn = "gid";
 const char* firIdQueryColumn = "firid";
+const char* firLonQueryColumn = "firlon";
+const char* firLatQueryColumn = "firlat";
 const char* stationTableName = "avidb_stations";
 const char* stationTableAlias = "st";
 const char* stationTableJoin = "st.station_id = me.station_id";
@@ -142,6 +171,16 @@ const char* messageValidityTableAlias = "mv";
 const char* messageValidityTableJoin = "mv.type = mt.type";
 const char* messageTimeRangeLatestMessagesTableName = "messagetimerangelatest_messages";
 
+// Automatically selected message order key columns for paged and time chunked message queries
+
+const char* messageOrderKeyQueryColumn = "orderkey";
+const char* messageOrderIdQueryColumn = "ordermessageid";
+
+// Automatically selected message group key columns for skipping duplicate messages
+
+const char* messageGroupTypeIdQueryColumn = "grouptypeid";
+const char* messageGroupTimeQueryColumn = "groupmessagetime";
+
 // Table/query column mapping
 
 Column firQueryColumns[] = {
@@ -174,8 +213,8 @@ Column stationQueryColumns[] = {
     //
     {ColumnType::Double, dfLongitude, "longitude", derivedExpression, nullptr},
     {ColumnType::Double, dfLatitude, "latitude", derivedExpression, nullptr},
-    {ColumnType::TS_LonLat, dfLonLat, stationLonLatQueryColumn, derivedExpression, nullptr},
-    {ColumnType::TS_LatLon, dfLatLon, stationLatLonQueryColumn, derivedExpression, nullptr},
+    {ColumnType::TS_LonLat, dfGeom, stationLonLatQueryColumn, coordinatePairExpression, nullptr},
+    {ColumnType::TS_LatLon, dfGeom, stationLatLonQueryColumn, coordinatePairExpression, nullptr},
     {ColumnType::Double, dfDistance, stationDistanceQueryColumn, nullptr, derivedExpression},
     {ColumnType::Double, dfBearing, stationBearingQueryColumn, nullptr, derivedExpression},
     {ColumnType::None, "", "", nullptr, nullptr}};
@@ -330,24 +369,17 @@ void buildStationQueryFromWhereClause(const LocationOptions& locationOptions,
  */
 // ----------------------------------------------------------------------
 
-void buildStationQueryWhereClause(const StationIdList& stationIdList, ostringstream& whereClause)
+void buildStationQueryWhereClause(const StationIdList& stationIdList,
+                                  QueryParameters& queryParameters,
+                                  ostringstream& whereClause)
 {
   try
   {
     if (stationIdList.empty())
       return;
 
-    whereClause << (whereClause.str().empty() ? "WHERE (" : " OR (");
-
-    size_t n = 0;
-
-    for (auto const& stationId : stationIdList)
-    {
-      whereClause << ((n == 0) ? "station_id IN (" : ",") << stationId;
-      n++;
-    }
-
-    whereClause << "))";
+    whereClause << (whereClause.str().empty() ? "WHERE (" : " OR (")
+                << "station_id = ANY(" << queryParameters.add(stationIdList) << "))";
   }
   catch (...)
   {
@@ -362,11 +394,11 @@ void buildStationQueryWhereClause(const StationIdList& stationIdList, ostringstr
  */
 // ----------------------------------------------------------------------
 
-void buildStationQueryWhereClause(const Fmi::Database::PostgreSQLConnection& connection,
-                                  const string& columnExpression,
+void buildStationQueryWhereClause(const string& columnExpression,
                                   const StringList& stringList,
                                   const string& filterColumnExpression,
                                   const StringList& filterStringList,
+                                  QueryParameters& queryParameters,
                                   ostringstream& whereClause)
 {
   try
@@ -374,33 +406,18 @@ void buildStationQueryWhereClause(const Fmi::Database::PostgreSQLConnection& con
     if (stringList.empty())
       return;
 
-    whereClause << (whereClause.str().empty() ? "WHERE ((" : " OR ((");
-
-    size_t n = 0;
-
-    whereClause << columnExpression << " IN (";
-
-    for (auto const& str : stringList)
-    {
-      whereClause << (n ? "," : "") << "UPPER(" << connection.quote(str) << ")";
-      n++;
-    }
-
-    whereClause << "))";
+    whereClause << (whereClause.str().empty() ? "WHERE ((" : " OR ((") << columnExpression
+                << " IN (SELECT UPPER(UNNEST(" << queryParameters.add(stringList) << "))))";
 
     if (!filterStringList.empty())
     {
-      n = 0;
-
-      whereClause << " AND " << filterColumnExpression << " NOT ILIKE ALL (ARRAY[";
+      StringList filters;
 
       for (auto const& str : filterStringList)
-      {
-        whereClause << (n ? "," : "") << connection.quote(str + ((str.size() < 4) ? "%" : ""));
-        n++;
-      }
+        filters.push_back(str + ((str.size() < 4) ? "%" : ""));
 
-      whereClause << "])";
+      whereClause << " AND " << filterColumnExpression << " NOT ILIKE ALL ("
+                  << queryParameters.add(filters) << ")";
     }
 
     whereClause << ")";
@@ -413,22 +430,19 @@ void buildStationQueryWhereClause(const Fmi::Database::PostgreSQLConnection& con
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Build from and where (and order by for route query) clause with given wkts for querying
- *        stations
+ * \brief Get message scope for querying stations with given wkts
+ *
+ * Station scope for nonroute query; for route query all given message
+ * types must have the same scope (station, fir or global)
  */
 // ----------------------------------------------------------------------
 
-void buildStationQueryFromWhereOrderByClause(const Fmi::Database::PostgreSQLConnection& connection,
-                                             const LocationOptions& locationOptions,
-                                             const StringList& messageTypeList,
-                                             const MessageTypes& knownMessageTypes,
-                                             ostringstream& fromWhereOrderByClause)
+MessageScope stationQueryScope(const LocationOptions& locationOptions,
+                               const StringList& messageTypeList,
+                               const MessageTypes& knownMessageTypes)
 {
   try
   {
-    if (locationOptions.itsWKTs.itsWKTs.empty())
-      return;
-
     StringList allMessageTypes = {""};
     const StringList& messageTypes = (messageTypeList.empty() ? allMessageTypes : messageTypeList);
 
@@ -463,11 +477,100 @@ void buildStationQueryFromWhereOrderByClause(const Fmi::Database::PostgreSQLConn
           }
 
         if (knownScope == MessageScope::NoScope)
-          throw Fmi::Exception::Trace(
-              BCP, "buildStationQueryFromWhereOrderByClause: internal: message scope unknown");
+          throw Fmi::Exception::Trace(BCP, "stationQueryScope: internal: message scope unknown");
       }
     }
 
+    return scope;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get route coordinates from LINESTRING wkt
+ *
+ * Returns false if the wkt is not a 2d linestring having at least 2 points
+ * with plain decimal coordinates
+ */
+// ----------------------------------------------------------------------
+
+bool parseRoute(const string& wkt, LonLatList& route)
+{
+  const char* linestring = "LINESTRING";
+  const char* c = wkt.c_str();
+
+  while (isspace(*c))
+    c++;
+
+  for (; *linestring; linestring++, c++)
+    if (toupper(*c) != *linestring)
+      return false;
+
+  while (isspace(*c))
+    c++;
+
+  if ((*c != '(') || (strspn(c, "()0123456789+-.eE, \t\r\n") != strlen(c)))
+    return false;
+
+  route.clear();
+
+  do
+  {
+    char* end = nullptr;
+    double lon = strtod(++c, &end);
+
+    if (end == c)
+      return false;
+
+    c = end;
+    double lat = strtod(c, &end);
+
+    if ((end == c) || (!std::isfinite(lon)) || (!std::isfinite(lat)))
+      return false;
+
+    c = end;
+
+    while (isspace(*c))
+      c++;
+
+    route.emplace_back(lon, lat);
+  } while (*c == ',');
+
+  if (*c != ')')
+    return false;
+
+  c++;
+
+  while (isspace(*c))
+    c++;
+
+  return ((*c == '\0') && (route.size() >= 2));
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build from and where (and order by for route query) clause with given wkts for querying
+ *        stations
+ */
+// ----------------------------------------------------------------------
+
+void buildStationQueryFromWhereOrderByClause(const Fmi::Database::PostgreSQLConnection& connection,
+                                             const LocationOptions& locationOptions,
+                                             const StringList& messageTypeList,
+                                             const MessageTypes& knownMessageTypes,
+                                             ostringstream& fromWhereOrderByClause)
+{
+  try
+  {
+    if (locationOptions.itsWKTs.itsWKTs.empty())
+      return;
+
+    MessageScope scope = stationQueryScope(locationOptions, messageTypeList, knownMessageTypes);
+
     string geom;
 
     if (scope == MessageScope::StationScope)
@@ -669,6 +772,7 @@ void buildStationQueryWhereClause(const BBoxList& bboxList,
 // ----------------------------------------------------------------------
 
 void buildMessageQueryWhereStationIdInClause(const StationIdList& stationIdList,
+                                             QueryParameters& queryParameters,
                                              ostringstream& whereClause)
 {
   try
@@ -676,19 +780,10 @@ void buildMessageQueryWhereStationIdInClause(const StationIdList& stationIdList,
     if (stationIdList.empty())
       return;
 
-    // { WHERE | AND } me.station_id IN (stationIdList)
-
-    string whereStationIdIn = (string(whereClause.str().empty() ? " WHERE " : " AND ") +
-                               messageTableAlias + ".station_id IN (");
-    size_t n = 0;
-
-    for (auto stationId : stationIdList)
-    {
-      whereClause << ((n == 0) ? whereStationIdIn : ",") << stationId;
-      n++;
-    }
+    // { WHERE | AND } me.station_id = ANY($n::integer[])
 
-    whereClause << ")";
+    whereClause << (whereClause.str().empty() ? " WHERE " : " AND ") << messageTableAlias
+                << ".station_id = ANY(" << queryParameters.add(stationIdList) << ")";
   }
   catch (...)
   {
@@ -703,14 +798,14 @@ void buildMessageQueryWhereStationIdInClause(const StationIdList& stationIdList,
  */
 // ----------------------------------------------------------------------
 
-string buildRequestStationsWithClause(const StationIdList& stationIdList, bool routeQuery)
+string buildRequestStationsWithClause(const string& stationIdArray, bool routeQuery)
 {
   try
   {
     /*
     WITH request_stations AS (
-            SELECT request_stations.station_id[,request_stations.position]
-            FROM (VALUES ((),...)) AS request_stations (station_id[,position])
+            SELECT request_stations.station_id[,request_stations.ordinality - 1 AS position]
+            FROM UNNEST($n::integer[]) WITH ORDINALITY AS request_stations (station_id,ordinality)
     )
     */
 
@@ -718,23 +813,11 @@ string buildRequestStationsWithClause(const StationIdList& stationIdList, bool r
 
     withClause << "WITH " << requestStationsTable.itsName
                << " AS (SELECT request_stations.station_id"
-               << (routeQuery ? string(",request_stations.") + requestStationsPositionColumn : "")
-               << " FROM (VALUES ";
-
-    size_t n = 0;
-
-    for (auto stationId : stationIdList)
-    {
-      withClause << ((n == 0) ? "(" : "),(") << stationId;
-
-      if (routeQuery)
-        withClause << "," << n;
-
-      n++;
-    }
-
-    withClause << ")) AS request_stations (station_id"
-               << (routeQuery ? string(",") + requestStationsPositionColumn : "") << "))";
+               << (routeQuery ? string(",request_stations.ordinality - 1 AS ") +
+                                    requestStationsPositionColumn
+                              : "")
+               << " FROM UNNEST(" << stationIdArray
+               << ") WITH ORDINALITY AS request_stations (station_id,ordinality))";
 
     return withClause.str();
   }
@@ -811,6 +894,33 @@ string buildMessageTypeValidityWithClause(const StringList& messageTypeList,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get (cached) 'message_validity' table (WITH clause) for given message types
+ */
+// ----------------------------------------------------------------------
+
+string buildMessageTypeValidityWithClause(const StringList& messageTypeList,
+                                          const MessageTypeRules& messageTypeRules)
+{
+  try
+  {
+    return messageTypeRules.getFragment(
+        MessageTypeRules::Fragment::MessageTypeValidity,
+        messageTypeList,
+        0,
+        [&messageTypeRules](const StringList& messageTypes)
+        {
+          return buildMessageTypeValidityWithClause(messageTypes,
+                                                    messageTypeRules.getMessageTypes());
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Extract message types by scope
@@ -963,6 +1073,49 @@ string buildMessageTypeInClause(const StringList& messageTypeList,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get (cached) message type IN clause with given message and time range type(s)
+ */
+// ----------------------------------------------------------------------
+
+string buildMessageTypeInClause(const StringList& messageTypeList,
+                                const MessageTypeRules& messageTypeRules,
+                                const list<TimeRangeType>& timeRangeTypes)
+{
+  try
+  {
+    return messageTypeRules.getFragment(
+        MessageTypeRules::Fragment::MessageTypeIn,
+        messageTypeList,
+        MessageTypeRules::timeRangeTypeMask(timeRangeTypes),
+        [&messageTypeRules, &timeRangeTypes](const StringList& messageTypes)
+        {
+          return buildMessageTypeInClause(
+              messageTypes, messageTypeRules.getMessageTypes(), timeRangeTypes);
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+string buildMessageTypeInClause(const StringList& messageTypeList,
+                                const MessageTypeRules& messageTypeRules,
+                                TimeRangeType timeRangeType)
+{
+  try
+  {
+    return buildMessageTypeInClause(
+        messageTypeList, messageTypeRules, list<TimeRangeType>{timeRangeType});
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Build 'record_set' table (WITH clause) for querying accepted messages
@@ -973,9 +1126,10 @@ string buildMessageTypeInClause(const StringList& messageTypeList,
 string buildRecordSetWithClause(bool bboxQuery,
                                 bool routeQuery,
                                 const StationIdList& stationIdList,
+                                QueryParameters& queryParameters,
                                 const string& messageFormat,
                                 const StringList& messageTypeList,
-                                const MessageTypes& knownMessageTypes,
+                                const MessageTypeRules& messageTypeRules,
                                 unsigned int startTimeOffsetHours,
                                 unsigned int endTimeOffsetHours,
                                 const string& obsOrRangeStartTime,
@@ -987,7 +1141,8 @@ string buildRecordSetWithClause(bool bboxQuery,
     record_set AS (
              SELECT *
              FROM avidb_messages me
-             WHERE { me.station_id IN (stationIdList | SELECT station_id FROM request_stations) }
+             WHERE { me.station_id = ANY($n::integer[]) |
+                     me.station_id IN (SELECT station_id FROM request_stations) }
     AND
                        {
                          me.message_time >= observation time - INTERVAL 'n hours' AND
@@ -1012,7 +1167,7 @@ string buildRecordSetWithClause(bool bboxQuery,
 
     if ((!bboxQuery) && (!stationIdList.empty()))
       if (!routeQuery)
-        buildMessageQueryWhereStationIdInClause(stationIdList, withClause);
+        buildMessageQueryWhereStationIdInClause(stationIdList, queryParameters, withClause);
       else
         withClause << " WHERE " << messageTableAlias << ".station_id IN (SELECT station_id FROM "
                    << requestStationsTable.itsName << ")";
@@ -1037,7 +1192,7 @@ string buildRecordSetWithClause(bool bboxQuery,
     if (!messageTypeList.empty())
     {
       string messageTypeIn =
-          buildMessageTypeInClause(messageTypeList, knownMessageTypes, list<TimeRangeType>());
+          buildMessageTypeInClause(messageTypeList, messageTypeRules, list<TimeRangeType>());
 
       withClause << " AND " << messageTypeTableJoin << " AND " << messageTypeIn;
     }
@@ -1155,6 +1310,35 @@ string buildMessageTypeGroupByExpr(const StringList& messageTypeList,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get (cached) GROUP BY expression for message type with given message types and
+ *        time range type
+ */
+// ----------------------------------------------------------------------
+
+string buildMessageTypeGroupByExpr(const StringList& messageTypeList,
+                                   const MessageTypeRules& messageTypeRules,
+                                   TimeRangeType timeRangeType)
+{
+  try
+  {
+    return messageTypeRules.getFragment(
+        MessageTypeRules::Fragment::MessageTypeGroupBy,
+        messageTypeList,
+        MessageTypeRules::timeRangeTypeMask(timeRangeType),
+        [&messageTypeRules, timeRangeType](const StringList& messageTypes)
+        {
+          return buildMessageTypeGroupByExpr(
+              messageTypes, messageTypeRules.getMessageTypes(), timeRangeType);
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Build GROUP BY expression for messir_heading with given message types
@@ -1255,6 +1439,35 @@ string buildMessirHeadingGroupByExpr(const StringList& messageTypeList,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get (cached) GROUP BY expression for messir_heading with given message types
+ *        and time range type
+ */
+// ----------------------------------------------------------------------
+
+string buildMessirHeadingGroupByExpr(const StringList& messageTypeList,
+                                     const MessageTypeRules& messageTypeRules,
+                                     TimeRangeType timeRangeType)
+{
+  try
+  {
+    return messageTypeRules.getFragment(
+        MessageTypeRules::Fragment::MessirHeadingGroupBy,
+        messageTypeList,
+        MessageTypeRules::timeRangeTypeMask(timeRangeType),
+        [&messageTypeRules, timeRangeType](const StringList& messageTypes)
+        {
+          return buildMessirHeadingGroupByExpr(
+              messageTypes, messageTypeRules.getMessageTypes(), timeRangeType);
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Build WHERE time and icao and country code(s) (when configured) conditions
@@ -1633,7 +1846,7 @@ string getStringList(const list<string>& stringList)
 // ----------------------------------------------------------------------
 
 string buildLatestMessagesWithClause(const StringList& messageTypes,
-                                     const MessageTypes& knownMessageTypes,
+                                     const MessageTypeRules& messageTypeRules,
                                      const string& observationTime,
                                      const string& messageCreatedTime,
                                      bool useCurrentTime,
@@ -1744,20 +1957,20 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     withClause << latestMessagesTable.itsName << " AS (";
 
     string messageTypeIn = buildMessageTypeInClause(
-        messageTypes, knownMessageTypes, TimeRangeType::ValidTimeRangeLatest);
+        messageTypes, messageTypeRules, TimeRangeType::ValidTimeRangeLatest);
 
     if (!messageTypeIn.empty())
     {
       // Depending on configuration the latest message for group(s) of types might be returned
       //
       string messageTypeGroupByExpr = buildMessageTypeGroupByExpr(
-          messageTypes, knownMessageTypes, TimeRangeType::ValidTimeRangeLatest);
+          messageTypes, messageTypeRules, TimeRangeType::ValidTimeRangeLatest);
 
       // Depending on configuration messir_heading LIKE pattern(s) might be used for additional
       // grouping
 
       string messirHeadingGroupByExpr = buildMessirHeadingGroupByExpr(
-          messageTypes, knownMessageTypes, TimeRangeType::ValidTimeRangeLatest);
+          messageTypes, messageTypeRules, TimeRangeType::ValidTimeRangeLatest);
 
       withClause << "SELECT " << latestMessageIdQueryExpr << messageTypeGroupByExpr
                  << messirHeadingGroupByExpr << latestMessageIdOrderByExpr << "AS message_id"
@@ -1771,16 +1984,20 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     }
 
     messageTypeIn = buildMessageTypeInClause(
-        messageTypes, knownMessageTypes, TimeRangeType::MessageValidTimeRangeLatest);
+        messageTypes, messageTypeRules, TimeRangeType::MessageValidTimeRangeLatest);
 
     if (!messageTypeIn.empty())
     {
       string messirHeadingGroupByExpr = buildMessirHeadingGroupByExpr(
-          messageTypes, knownMessageTypes, TimeRangeType::MessageValidTimeRangeLatest);
+          messageTypes, messageTypeRules, TimeRangeType::MessageValidTimeRangeLatest);
 
       bool bStationJoin;
-      string stationAndTimeCondition = buildMessageValidTimeRangeLatestTimeCondition(
-          messageTypes, knownMessageTypes, observationTime, messageCreatedTime, bStationJoin);
+      string stationAndTimeCondition =
+          buildMessageValidTimeRangeLatestTimeCondition(messageTypes,
+                                                        messageTypeRules.getMessageTypes(),
+                                                        observationTime,
+                                                        messageCreatedTime,
+                                                        bStationJoin);
 
       withClause << unionOrEmpty << "SELECT " << latestMessageIdQueryExpr << "mt.type_id"
                  << (distinct ? "" : ", me.route_id") << messirHeadingGroupByExpr
@@ -1796,14 +2013,14 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     }
 
     messageTypeIn = buildMessageTypeInClause(
-        messageTypes, knownMessageTypes, TimeRangeType::MessageTimeRangeLatest);
+        messageTypes, messageTypeRules, TimeRangeType::MessageTimeRangeLatest);
 
     if (!messageTypeIn.empty())
     {
       string messageTypeGroupByExpr = buildMessageTypeGroupByExpr(
-          messageTypes, knownMessageTypes, TimeRangeType::MessageTimeRangeLatest);
+          messageTypes, messageTypeRules, TimeRangeType::MessageTimeRangeLatest);
       string messirHeadingGroupByExpr = buildMessirHeadingGroupByExpr(
-          messageTypes, knownMessageTypes, TimeRangeType::MessageTimeRangeLatest);
+          messageTypes, messageTypeRules, TimeRangeType::MessageTimeRangeLatest);
       string whereOrAnd = " WHERE ";
 
       withClause << unionOrEmpty << "SELECT " << latestMessageIdQueryExpr << messageTypeGroupByExpr
@@ -1850,12 +2067,12 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     }
 
     messageTypeIn = buildMessageTypeInClause(
-        messageTypes, knownMessageTypes, TimeRangeType::CreationValidTimeRangeLatest);
+        messageTypes, messageTypeRules, TimeRangeType::CreationValidTimeRangeLatest);
 
     if (!messageTypeIn.empty())
     {
       string messirHeadingGroupByExpr = buildMessirHeadingGroupByExpr(
-          messageTypes, knownMessageTypes, TimeRangeType::CreationValidTimeRangeLatest);
+          messageTypes, messageTypeRules, TimeRangeType::CreationValidTimeRangeLatest);
 
       withClause << unionOrEmpty << "SELECT " << latestMessageIdQueryExpr << "mt.type_id"
                  << messirHeadingGroupByExpr << latestMessageIdOrderByExpr << "AS message_id"
@@ -1868,7 +2085,7 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     }
 
     messageTypeIn =
-        buildMessageTypeInClause(messageTypes, knownMessageTypes, TimeRangeType::ValidTimeRange);
+        buildMessageTypeInClause(messageTypes, messageTypeRules, TimeRangeType::ValidTimeRange);
 
     if (!messageTypeIn.empty())
     {
@@ -1883,7 +2100,7 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     }
 
     messageTypeIn =
-        buildMessageTypeInClause(messageTypes, knownMessageTypes, TimeRangeType::MessageTimeRange);
+        buildMessageTypeInClause(messageTypes, messageTypeRules, TimeRangeType::MessageTimeRange);
 
     if (!messageTypeIn.empty())
     {
@@ -1901,7 +2118,7 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
     }
 
     messageTypeIn = buildMessageTypeInClause(
-        messageTypes, knownMessageTypes, TimeRangeType::CreationValidTimeRange);
+        messageTypes, messageTypeRules, TimeRangeType::CreationValidTimeRange);
 
     if (!messageTypeIn.empty())
     {
@@ -1932,6 +2149,27 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build 'latest_messages' table (WITH clause) for given message id's
+ *        (selected from latest message cache)
+ */
+// ----------------------------------------------------------------------
+
+string buildLatestMessagesWithClause(const std::vector<long>& messageIds,
+                                     QueryParameters& queryParameters)
+{
+  try
+  {
+    return "latest_messages AS (SELECT UNNEST(" + queryParameters.add(messageIds) +
+           ") AS message_id)";
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Build 'messagetimerangelatest_messages' table (WITH clause) for
@@ -1941,7 +2179,7 @@ string buildLatestMessagesWithClause(const StringList& messageTypes,
 // ----------------------------------------------------------------------
 
 string buildMessageTimeRangeMessagesWithClause(const StringList& messageTypes,
-                                               const MessageTypes& knownMessageTypes,
+                                               const MessageTypeRules& messageTypeRules,
                                                const string& startTime,
                                                const string& endTime,
                                                bool filterFIMETARxxx,
@@ -1984,7 +2222,7 @@ string buildMessageTimeRangeMessagesWithClause(const StringList& messageTypes,
     */
 
     string messageTypeIn = buildMessageTypeInClause(
-        messageTypes, knownMessageTypes, TimeRangeType::MessageTimeRangeLatest);
+        messageTypes, messageTypeRules, TimeRangeType::MessageTimeRangeLatest);
 
     if (messageTypeIn.empty())
       return "";
@@ -2050,6 +2288,55 @@ string buildMessageTimeRangeMessagesWithClause(const StringList& messageTypes,
   }
 }
 
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the column the accepted messages are primarily ordered by
+ *
+ * Messages are ordered by station's icao code, or for route query by
+ * station's position on the route (or by station id if no stations)
+ */
+// ----------------------------------------------------------------------
+
+string messageQueryStationOrderColumn(const StationIdList& stationIdList,
+                                      const QueryOptions& queryOptions)
+{
+  try
+  {
+    if (!queryOptions.itsLocationOptions.itsWKTs.isRoute)
+      return string(stationTableAlias) + "." + stationIcaoTableColumn;
+
+    if (stationIdList.empty())
+      return string(messageTableAlias) + "." + messageStationIdTableColumn;
+
+    return string(requestStationsTableAlias) + "." + requestStationsPositionColumn;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get select expressions for accepted message order key columns
+ */
+// ----------------------------------------------------------------------
+
+string messageOrderKeySelectExpressions(const StationIdList& stationIdList,
+                                        const QueryOptions& queryOptions)
+{
+  try
+  {
+    return string(",") + messageQueryStationOrderColumn(stationIdList, queryOptions) + " AS " +
+           messageOrderKeyQueryColumn + "," + messageTableAlias + "." + messageIdTableColumn +
+           " AS " + messageOrderIdQueryColumn;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
 // ----------------------------------------------------------------------
 /*!
  * \brief Build from, where and order by clause with given station id's, message types,
@@ -2059,11 +2346,13 @@ string buildMessageTimeRangeMessagesWithClause(const StringList& messageTypes,
 
 void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
                                              const StationIdList& stationIdList,
+                                             QueryParameters& queryParameters,
                                              const QueryOptions& queryOptions,
                                              const TableMap& tableMap,
                                              const Config& config,
                                              const Column* timeRangeColumn,
                                              bool distinct,
+                                             const string& pageKeyCondition,
                                              ostringstream& fromWhereOrderByClause)
 {
   try
@@ -2078,7 +2367,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
     // outer joined with avidb_message_types in the main query for querying messages for other time
     // restriction types (when leftOuter is set for message_validity)
 
-    const auto& knownMessageTypes = config.getMessageTypes();
+    const auto& messageTypeRules = config.getMessageTypeRules();
     auto it = tableMap.find(messageValidityTableName);
     Table validityTable((it != tableMap.end()) ? it->second : Table());
     size_t n = 0;
@@ -2162,7 +2451,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
         timeRangeTypes.push_back(TimeRangeType::ValidTimeRangeLatest);
 
         string messageTypeIn = buildMessageTypeInClause(
-            queryOptions.itsMessageTypes, knownMessageTypes, timeRangeTypes);
+            queryOptions.itsMessageTypes, messageTypeRules, timeRangeTypes);
         string emptyOrOr;
 
         if (!messageTypeIn.empty())
@@ -2180,7 +2469,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
         timeRangeTypes.push_back(TimeRangeType::MessageValidTimeRangeLatest);
 
         messageTypeIn = buildMessageTypeInClause(
-            queryOptions.itsMessageTypes, knownMessageTypes, timeRangeTypes);
+            queryOptions.itsMessageTypes, messageTypeRules, timeRangeTypes);
 
         if (!messageTypeIn.empty())
         {
@@ -2193,7 +2482,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
           bool bStationJoin;
           string stationAndTimeRangeCondition =
               buildMessageValidTimeRangeTimeCondition(queryOptions.itsMessageTypes,
-                                                      knownMessageTypes,
+                                                      messageTypeRules.getMessageTypes(),
                                                       queryOptions.itsTimeOptions.itsStartTime,
                                                       queryOptions.itsTimeOptions.itsEndTime,
                                                       disableQueryRestriction,
@@ -2205,7 +2494,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
         }
 
         messageTypeIn = buildMessageTypeInClause(
-            queryOptions.itsMessageTypes, knownMessageTypes, TimeRangeType::MessageTimeRange);
+            queryOptions.itsMessageTypes, messageTypeRules, TimeRangeType::MessageTimeRange);
 
         if (!messageTypeIn.empty())
         {
@@ -2228,7 +2517,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
         // somehow fooled by the query)
 
         messageTypeIn = buildMessageTypeInClause(
-            queryOptions.itsMessageTypes, knownMessageTypes, TimeRangeType::MessageTimeRangeLatest);
+            queryOptions.itsMessageTypes, messageTypeRules, TimeRangeType::MessageTimeRangeLatest);
 
         if (!messageTypeIn.empty())
         {
@@ -2243,7 +2532,7 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
         timeRangeTypes.push_back(TimeRangeType::CreationValidTimeRangeLatest);
 
         messageTypeIn = buildMessageTypeInClause(
-            queryOptions.itsMessageTypes, knownMessageTypes, timeRangeTypes);
+            queryOptions.itsMessageTypes, messageTypeRules, timeRangeTypes);
 
         if (!messageTypeIn.empty())
           fromWhereOrderByClause << emptyOrOr << "(" << messageTypeIn << " AND "
@@ -2268,9 +2557,10 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
           throw Fmi::Exception(
               BCP, "buildMessageQueryFromWhereOrderByClause(): internal: time column is NULL");
 
-        buildMessageQueryWhereStationIdInClause(stationIdList, fromWhereOrderByClause);
+        buildMessageQueryWhereStationIdInClause(
+            stationIdList, queryParameters, fromWhereOrderByClause);
         string messageTypeIn = buildMessageTypeInClause(
-            queryOptions.itsMessageTypes, knownMessageTypes, list<TimeRangeType>());
+            queryOptions.itsMessageTypes, messageTypeRules, list<TimeRangeType>());
 
         auto ltORle = (queryOptions.itsTimeOptions.itsClosedTimeRange ? " <= " : " < ");
 
@@ -2357,26 +2647,34 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
       fromWhereOrderByClause << " AND (" << whereStationClause.str() << ")";
     }
 
-    // ORDER BY { st.icao_code | rs.position } [,me.message] [,me.message_id]
+    // [ AND (station order column,me.station_id,me.message_id) > (page key) ]
 
-    if (!queryOptions.itsLocationOptions.itsWKTs.isRoute)
-      fromWhereOrderByClause << " ORDER BY " << stationTableAlias << "." << stationIcaoTableColumn;
-    else if (stationIdList.empty())
-      fromWhereOrderByClause << " ORDER BY " << messageTableAlias << "."
-                             << messageStationIdTableColumn;
-    else
-      fromWhereOrderByClause << " ORDER BY " << requestStationsTableAlias << "."
-                             << requestStationsPositionColumn;
+    if (!pageKeyCondition.empty())
+      fromWhereOrderByClause << " AND " << pageKeyCondition;
+
+    // ORDER BY { st.icao_code | rs.position | me.station_id }
+    //          [,me.station_id[,me.type_id,me.message_time],me.message_id]
+
+    const string stationOrderColumn = messageQueryStationOrderColumn(stationIdList, queryOptions);
+    const string stationIdColumn = string(messageTableAlias) + "." + messageStationIdTableColumn;
+
+    fromWhereOrderByClause << " ORDER BY " << stationOrderColumn;
 
     if (!distinct)
     {
-      if (queryOptions.itsDistinctMessages)
-        // Using message for ordering too (needed to check/skip duplicates)
-        //
-        fromWhereOrderByClause << "," << messageTableAlias << "." << messageTableColumn
-                               << " COLLATE \"C\"";
+      // Using message id for ordering too (needed to ensure regression tests can succeed).
+      //
+      // Stations sharing an icao code are ordered by station id to keep each station's messages
+      // together. When querying distinct messages, the copies of a message (for different
+      // routes) are skipped when loading the result; the messages are ordered by message group
+      // (message type and message time) to keep the copies together
 
-      // Using message id for ordering too (needed to ensure regression tests can succeed)
+      if (stationOrderColumn != stationIdColumn)
+        fromWhereOrderByClause << "," << stationIdColumn;
+
+      if (queryOptions.itsDistinctMessages)
+        fromWhereOrderByClause << "," << messageTableAlias << ".type_id," << messageTableAlias
+                               << ".message_time";
 
       fromWhereOrderByClause << "," << messageTableAlias << "." << messageIdTableColumn;
     }
@@ -2402,6 +2700,8 @@ void buildMessageQueryFromWhereOrderByClause(int maxMessageRows,
 void buildRejectedMessageQueryFromWhereOrderByClause(int maxMessageRows,
                                                      const QueryOptions& queryOptions,
                                                      const TableMap& tableMap,
+                                                     bool pageQuery,
+                                                     const string& pageKeyCondition,
                                                      ostringstream& fromWhereOrderByClause)
 {
   try
@@ -2480,12 +2780,27 @@ void buildRejectedMessageQueryFromWhereOrderByClause(int maxMessageRows,
                            << rejectedMessageTableAlias << ".created < "
                            << queryOptions.itsTimeOptions.itsEndTime << ")";
 
+    // [ AND me.icao_code IS NOT NULL
+    //   [ AND (me.icao_code,me.created,me.message) > (<last icao>,<last created>,<last message>) ]
+    // | AND me.icao_code IS NULL
+    //   [ AND (me.created,me.message) > (<last created>,<last message>) ] ]
+
+    if (!pageKeyCondition.empty())
+      fromWhereOrderByClause << " AND " << pageKeyCondition;
+
     // ORDER BY me.icao_code,me.created
+    //
+    // or when querying by pages by the page key
+    //
+    // ORDER BY me.icao_code,me.created,me.message
 
     fromWhereOrderByClause << " ORDER BY " << rejectedMessageTableAlias << "."
                            << rejectedMessageIcaoTableColumn << "," << rejectedMessageTableAlias
                            << ".created";
 
+    if (pageQuery)
+      fromWhereOrderByClause << "," << rejectedMessageTableAlias << ".message";
+
     // [ LIMIT maxMessageRows ]
 
     if (maxMessageRows > 0)
@@ -2515,260 +2830,303 @@ void sortColumnList(Columns& columns)
   }
 }
 
-}  // anonymous namespace
-
 // ----------------------------------------------------------------------
 /*!
- * \brief The only permitted constructor requires a configfile
+ * \brief Check if given strings contain ascii characters only
  */
 // ----------------------------------------------------------------------
 
-EngineImpl::EngineImpl(std::string theConfigFileName)
-    : itsConfigFileName(std::move(theConfigFileName))
+bool isAscii(const StringList& stringList)
 {
+  for (auto const& str : stringList)
+    for (auto c : str)
+      if (static_cast<unsigned char>(c) > 127)
+        return false;
+
+  return true;
 }
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Initialize the engine
- *
- * Note: We do not wish to delay the initialization of other engines.
- * init() is done in its own thread, hence we read the configuration
- * files here, and hence itsConfig is a pointer instead of an object.
+ * \brief Get station column value from station catalog
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::init()
+TimeSeries::Value stationColumnValue(const StationInfo& station,
+                                     const StationDistance* stationDistance,
+                                     const Column& column)
 {
   try
   {
-    itsConfig = std::make_shared<Config>(itsConfigFileName);
-
-    itsConnectionPool = std::make_unique<Fmi::Database::PostgreSQLConnectionPool>(
-        itsConfig->getStartConnections(),
-        itsConfig->getMaxConnections(),
-        mk_connection_options(*itsConfig));
+    // Note: distance and bearing are available only when querying stations with coordinates
+
+    const auto& columnName = column.itsName;
+
+    if (columnName == stationDistanceQueryColumn)
+      return (stationDistance ? TimeSeries::Value(stationDistance->itsDistance)
+                              : TimeSeries::Value(TimeSeries::None()));
+    if (columnName == stationBearingQueryColumn)
+      return ((stationDistance && stationDistance->itsBearing)
+                  ? TimeSeries::Value(*stationDistance->itsBearing)
+                  : TimeSeries::Value(TimeSeries::None()));
+
+    if (columnName == stationIdQueryColumn)
+      return TimeSeries::Value(static_cast<int>(station.itsId));
+    if (columnName == stationIcaoQueryColumn)
+      return TimeSeries::Value(station.itsIcao);
+    if (columnName == "name")
+      return TimeSeries::Value(station.itsName);
+    if (columnName == "elevation")
+      return (station.itsElevation ? TimeSeries::Value(*station.itsElevation)
+                                   : TimeSeries::Value(TimeSeries::None()));
+    if (columnName == "stationvalidfrom")
+      return TimeSeries::Value(Fmi::LocalDateTime(station.itsValidFrom, tzUTC));
+    if (columnName == "stationvalidto")
+      return TimeSeries::Value(Fmi::LocalDateTime(station.itsValidTo, tzUTC));
+    if (columnName == "stationmodified")
+      return TimeSeries::Value(Fmi::LocalDateTime(station.itsModified, tzUTC));
+    if (columnName == "iso2")
+      return TimeSeries::Value(station.itsCountryCode);
+    if (columnName == "longitude")
+      return TimeSeries::Value(station.itsLongitude);
+    if (columnName == "latitude")
+      return TimeSeries::Value(station.itsLatitude);
+    if ((columnName == stationLonLatQueryColumn) || (columnName == stationLatLonQueryColumn))
+      return TimeSeries::Value(TimeSeries::LonLat(station.itsLongitude, station.itsLatitude));
+    if (columnName == firIdQueryColumn)
+      return (station.itsFIRId ? TimeSeries::Value(*station.itsFIRId)
+                               : TimeSeries::Value(TimeSeries::None()));
+
+    return TimeSeries::None();
   }
   catch (...)
   {
-    throw Fmi::Exception::Trace(BCP, "Init failed!");
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Shutdown the engine
+ * \brief Get select expression for datetime column
+ *
+ * Datetime columns are selected as (integer) microseconds since epoch
+ * instead of UTC datetime strings
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::shutdown()
+string timeColumnExpression(const string& tableColumn)
 {
-  std::cout << "  -- Shutdown requested (aviengine)\n";
+  return "(EXTRACT(EPOCH FROM " + tableColumn + ")*1000000)::bigint";
 }
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Get column mapping using query column name
+ * \brief Get select expressions for accepted message group key columns
+ *
+ * Message type and message time (with station id) group the copies of a
+ * message when skipping duplicate messages
  */
 // ----------------------------------------------------------------------
 
-const Column* EngineImpl::getQueryColumn(const ColumnTable& tableColumns,
-                                         Columns& columns,
-                                         const string& theQueryColumnName,
-                                         bool& duplicate,
-                                         int columnNumber)
+string messageGroupKeySelectExpressions()
 {
-  try
-  {
-    // Column can be selected only once.
-    //
-    // Note: stationid is and distance can be automatically selected; if they are
-    //       requested by the caller, set request column number
-
-    duplicate = false;
-
-    for (const Column* column = tableColumns; (!(column->itsName.empty())); column++)
-    {
-      if (column->itsName == theQueryColumnName)
-      {
-        for (auto& column : columns)
-          if (column.itsName == theQueryColumnName)
-          {
-            if (column.itsSelection == ColumnSelection::Automatic)
-            {
-              column.itsSelection = ColumnSelection::AutomaticRequested;
-              column.itsNumber = columnNumber;
-            }
+  return string(",") + messageTableAlias + ".type_id AS " + messageGroupTypeIdQueryColumn + "," +
+         timeColumnExpression(string(messageTableAlias) + ".message_time") + " AS " +
+         messageGroupTimeQueryColumn;
+}
 
-            duplicate = true;
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get (FNV-1a) hash of a message
+ *
+ * The hash is passed in message page tokens and must not change between
+ * processes, so std::hash is not used
+ */
+// ----------------------------------------------------------------------
 
-            return nullptr;
-          }
+std::uint64_t messageHash(const char* theMessage, std::size_t theSize)
+{
+  std::uint64_t hash = 14695981039346656037ULL;
 
-        return column;
-      }
-    }
-    return nullptr;
-  }
-  catch (...)
+  for (std::size_t n = 0; (n < theSize); n++)
   {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+    hash ^= static_cast<unsigned char>(theMessage[n]);
+    hash *= 1099511628211ULL;
   }
+
+  return hash;
 }
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Build select expressions for coordinate dependent derived fields
+ * \brief Column of query result with resolved column number(s) and decoder
  */
 // ----------------------------------------------------------------------
 
-string EngineImpl::buildStationQueryCoordinateExpressions(const Columns& columns)
-{
-  try
-  {
-    // ST_Distance(geom::geography,ST_SetSRID(coordinates.coordinate,4326)::geography) AS distance
-    // DEGREES(ST_Azimuth(geom,ST_SetSRID(coordinates.coordinate,4326))) AS bearing
+struct ResultColumn;
 
-    ostringstream selectExpressions;
+// Row type of dereferenced result iterator (pqxx::row, or pqxx::row_ref with libpqxx 8)
 
-    for (auto const& column : columns)
-      if (column.itsCoordinateExpression)
-        selectExpressions << ","
-                          << column.itsCoordinateExpression(column.itsTableColumnName,
-                                                            column.itsName);
+using ResultRow = std::decay_t<decltype(*std::declval<pqxx::result::const_iterator>())>;
+using ColumnDecoder = void (*)(const ResultRow&, const ResultColumn&, ValueVector&);
 
-    return selectExpressions.str();
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
+struct ResultColumn
+{
+  const Column* itsColumn;
+  int itsNumber;  // -1 if the column is not selected by the query
+  ColumnDecoder itsDecoder;
+  int itsLatitudeNumber = -1;  // Latitude column number for lonlat/latlon
+};
+
+using ResultColumns = std::vector<ResultColumn>;
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Build select clause for querying stations
+ * \brief Decode query result column value
+ *
+ * Integer, double, string, lonlat/latlon and datetime decoders store the
+ * field value (or None for NULL) into the column's value vector
  */
 // ----------------------------------------------------------------------
 
-Columns EngineImpl::buildStationQuerySelectClause(const StringList& paramList,
-                                                  bool selectStationListOnly,
-                                                  bool autoSelectDistance,
-                                                  string& selectClause,
-                                                  bool& firIdQuery)
+void decodeIntegerValue(const ResultRow& row, const ResultColumn& column, ValueVector& values)
 {
-  try
-  {
-    if (paramList.empty())
-      throw Fmi::Exception(BCP, "No parameters were given to station query");
-
-    // Selected columns
+  // Currently can't handle NULLs properly, but by setting kFloatMissing for NULL,
+  // TableFeeder (used by avi plugin) produces 'missing' (by default, 'nan') column value.
+  //
+  // Solution is poor, numeric column value 32700 cannot be returned by avi plugin
+  // (in practice through, only stationid or messageid could have value 32700).
+  //
+  const auto& field = row[column.itsNumber];
+
+  if (field.is_null())
+    values.emplace_back(TimeSeries::None());
+  else
+    values.emplace_back(field.as<int>());
+}
 
-    Columns columns;
-    bool duplicate;
+void decodeDoubleValue(const ResultRow& row, const ResultColumn& column, ValueVector& values)
+{
+  const auto& field = row[column.itsNumber];
 
-    selectClause.clear();
-    firIdQuery = false;
+  if (field.is_null())
+    values.emplace_back(TimeSeries::None());
+  else
+    values.emplace_back(field.as<double>());
+}
 
-    // Station id is automatically selected
+void decodeStringValue(const ResultRow& row, const ResultColumn& column, ValueVector& values)
+{
+  const auto& field = row[column.itsNumber];
 
-    const auto* queryColumn =
-        getQueryColumn(stationQueryColumns, columns, stationIdQueryColumn, duplicate);
+  if (field.is_null())
+    values.emplace_back(TimeSeries::None());
+  else
+  {
+    string value(field.c_str(), field.size());
+    boost::algorithm::trim(value);
 
-    if (!queryColumn)
-      throw Fmi::Exception(BCP,
-                           "buildStationQuerySelectClause(): internal: Unable to get id column");
+    values.emplace_back(std::move(value));
+  }
+}
 
-    Column column(*queryColumn);
-    column.itsSelection = ColumnSelection::Automatic;
-    columns.push_back(column);
+void decodeLonLatValue(const ResultRow& row, const ResultColumn& column, ValueVector& values)
+{
+  // 'latlon' and 'lonlat' share separately selected longitude and latitude columns (see
+  // coordinatePairExpression()). Return them as TimeSeries::LonLat for formatted output with
+  // TableFeeder
+  //
+  const auto& lon = row[column.itsNumber];
+  const auto& lat = row[column.itsLatitudeNumber];
+
+  if (lon.is_null() || lat.is_null())
+    throw Fmi::Exception(
+        BCP, string("Query returned invalid ") + column.itsColumn->itsName + " value");
 
-    selectClause =
-        string("SELECT ") + queryColumn->itsTableColumnName + " AS " + queryColumn->itsName;
+  values.emplace_back(TimeSeries::LonLat(lon.as<double>(), lat.as<double>()));
+}
 
-    // distance is automatically selected to apply max # of nearest stations
+void decodeTimeValue(const ResultRow& row, const ResultColumn& column, ValueVector& values)
+{
+  // Times are selected as microseconds since epoch (see timeColumnExpression()); converting the
+  // integer is much cheaper than parsing datetime strings
 
-    if (autoSelectDistance)
-    {
-      const auto* queryColumn =
-          getQueryColumn(stationQueryColumns, columns, stationDistanceQueryColumn, duplicate);
+  static const Fmi::DateTime epoch(Fmi::Date(1970, 1, 1));
+  const auto& field = row[column.itsNumber];
 
-      if (!queryColumn)
-        throw Fmi::Exception(
-            BCP, "buildStationQuerySelectClause(): internal: Unable to get distance column");
+  values.emplace_back(
+      Fmi::LocalDateTime(field.is_null() ? Fmi::DateTime()
+                                         : epoch + Fmi::Microseconds(field.as<long long>()),
+                         tzUTC));
+}
 
-      Column column(*queryColumn);
-      column.itsSelection = ColumnSelection::Automatic;
-      columns.push_back(column);
-    }
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get decoder for given column type
+ */
+// ----------------------------------------------------------------------
 
-    int columnNumber = 0;
+ColumnDecoder columnDecoder(ColumnType columnType)
+{
+  switch (columnType)
+  {
+    case ColumnType::Integer:
+      return decodeIntegerValue;
+    case ColumnType::Double:
+      return decodeDoubleValue;
+    case ColumnType::String:
+      return decodeStringValue;
+    case ColumnType::TS_LonLat:
+    case ColumnType::TS_LatLon:
+      return decodeLonLatValue;
+    default:
+      return decodeTimeValue;
+  }
+}
 
-    for (auto const& param : paramList)
-    {
-      // Note: If 'selectStationList' is set, scanning only for derived distance and bearing columns
-      // (they are not available in current message query), and setting 'AutomaticRequested'
-      // (instead of 'Automatic') type for the user requested fields (stationid) to indicate they
-      // shall be returned
-      //
-      const auto* queryColumn =
-          getQueryColumn(stationQueryColumns, columns, param, duplicate, columnNumber);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Resolve column number and decoder for requested column
+ *
+ * With station query distance and bearing are available only when querying
+ * stations with coordinates; for other station queries distance and bearing
+ * are not selected at all and NULL values are returned for them
+ */
+// ----------------------------------------------------------------------
 
-      if (queryColumn && ((!selectStationListOnly) || queryColumn->itsCoordinateExpression))
-      {
-        if (queryColumn->itsExpression)
-        {
-          // ST_X(geom) AS longitudes
-          // ST_Y(geom) AS latitude
-          // ST_X(geom) || ',' || ST_Y(geom) AS lonlat
-          // ST_Y(geom) || ',' || ST_X(geom) AS latlon
-          //
-          selectClause +=
-              (string(selectClause.empty() ? "SELECT " : ",") +
-               queryColumn->itsExpression(queryColumn->itsTableColumnName, queryColumn->itsName));
-        }
-        else if (queryColumn->itsCoordinateExpression)
-        {
-          // Parametrized expression for each given coordinate
-          //
-          // Note: Column expression is generated and added to the select clause only when querying
-          // with coordinates (queryStationsWithCoordinates())
-        }
-        else
-        {
-          selectClause +=
-              (string(selectClause.empty() ? "SELECT " : ",") + queryColumn->itsTableColumnName);
+ResultColumn resultColumn(const std::map<string, int>& columnNumbers, const Column& column)
+{
+  try
+  {
+    bool coordinatePair =
+        ((column.itsType == ColumnType::TS_LonLat) || (column.itsType == ColumnType::TS_LatLon));
 
-          if (queryColumn->itsType == ColumnType::DateTime)
-            selectClause += string(" AT TIME ZONE 'UTC'");
+    auto columnNumber = [&columnNumbers](const string& columnName)
+    {
+      auto it = columnNumbers.find(columnName);
+      return ((it != columnNumbers.end()) ? it->second : -1);
+    };
 
-          if ((queryColumn->itsType == ColumnType::DateTime) ||
-              (queryColumn->itsName != queryColumn->itsTableColumnName))
-            selectClause += (string(" AS ") + queryColumn->itsName);
-        }
+    if (coordinatePair)
+    {
+      ResultColumn resultColumn{&column,
+                                columnNumber(coordinatePairLonQueryColumn),
+                                columnDecoder(column.itsType),
+                                columnNumber(coordinatePairLatQueryColumn)};
 
-        columns.push_back(*queryColumn);
-        columns.back().itsNumber = columnNumber;
-      }
-      else if ((!queryColumn) && (!duplicate) && (!selectStationListOnly))
-      {
-        queryColumn = getQueryColumn(firQueryColumns, columns, param, duplicate, columnNumber);
+      if ((resultColumn.itsNumber < 0) || (resultColumn.itsLatitudeNumber < 0))
+        throw Fmi::Exception(BCP, "Query result has no column '" + column.itsName + "'");
 
-        if (queryColumn)
-        {
-          firIdQuery = true;
-          selectClause += (string(",") + firTableAlias + "." + firIdTableColumn + " AS " +
-                           queryColumn->itsName);
+      return resultColumn;
+    }
 
-          columns.push_back(*queryColumn);
-          columns.back().itsNumber = columnNumber;
-        }
-      }
+    int number = columnNumber(column.itsName);
 
-      columnNumber++;
-    }
+    if ((number < 0) && (column.itsType != ColumnType::Double) &&
+        (column.itsType != ColumnType::String))
+      throw Fmi::Exception(BCP, "Query result has no column '" + column.itsName + "'");
 
-    return columns;
+    return ResultColumn{&column, number, columnDecoder(column.itsType)};
   }
   catch (...)
   {
@@ -2778,254 +3136,3756 @@ Columns EngineImpl::buildStationQuerySelectClause(const StringList& paramList,
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Build select clause for querying accepted or rejected messages
+ * \brief Get query result column numbers by column name
  */
 // ----------------------------------------------------------------------
 
-TableMap EngineImpl::buildMessageQuerySelectClause(QueryTable* queryTables,
-                                                   const StationIdList& stationIdList,
-                                                   const StringList& messageTypeList,
-                                                   const StringList& paramList,
-                                                   bool routeQuery,
-                                                   string& selectClause,
-                                                   bool& messageColumnSelected,
-                                                   bool& distinct)
+std::map<string, int> resultColumnNumbers(const pqxx::result& result)
 {
   try
   {
-    // Selected tables/columns
+    std::map<string, int> columnNumbers;
 
-    TableMap tableMap;
-    bool leftOuter = true;
-    bool icaoSelected = false;
-    bool duplicate = false;
-    bool distinctMessages = distinct;
-    bool checkDuplicateMessages = false;
-    int columnNumber = 0;
+    for (pqxx::row::size_type n = 0; (n < result.columns()); n++)
+      columnNumbers.insert(std::make_pair(string(result.column_name(n)), n));
 
-    selectClause.clear();
-    messageColumnSelected = distinct = false;
+    return columnNumbers;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    // For accepted messages, station id is automatically selected for storing the data (station id
-    // is data map key) and for joining with station data (to get distance and bearing), and for non
-    // route query icao_code column is added to the list of query columns to join with station table
-    // for ordering the messages by icao code.
-    //
-    // Message column is automatically selected to check duplicates if any other message table
-    // column is selected
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get number of given (automatically selected) query result column
+ */
+// ----------------------------------------------------------------------
+
+int resultColumnNumber(const std::map<string, int>& columnNumbers, const char* columnName)
+{
+  auto it = columnNumbers.find(columnName);
+
+  if (it == columnNumbers.end())
+    throw Fmi::Exception(BCP, string("Query result has no column '") + columnName + "'");
+
+  return it->second;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get result row iterator for loading a result directly or rows
+ *        merged from multiple results
+ */
+// ----------------------------------------------------------------------
+
+const pqxx::result::const_iterator& resultRowIterator(const pqxx::result::const_iterator& row)
+{
+  return row;
+}
+
+const pqxx::result::const_iterator& resultRowIterator(
+    std::vector<pqxx::result::const_iterator>::const_iterator row)
+{
+  return *row;
+}
+
+}  // anonymous namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief The only permitted constructor requires a configfile
+ */
+// ----------------------------------------------------------------------
+
+EngineImpl::EngineImpl(std::string theConfigFileName)
+    : itsConfigFileName(std::move(theConfigFileName))
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Destructor; background tasks are stopped if shutdown was not called
+ */
+// ----------------------------------------------------------------------
+
+EngineImpl::~EngineImpl()
+{
+  stopBackgroundTasks();
+
+  if (itsWorkerPool)
+    itsWorkerPool->shutdown();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Initialize the engine
+ *
+ * Note: We do not wish to delay the initialization of other engines.
+ * init() is done in its own thread, hence we read the configuration
+ * files here, and hence itsConfig is a pointer instead of an object.
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::init()
+{
+  try
+  {
+    itsConfig = std::make_shared<Config>(itsConfigFileName);
+
+    itsConnectionPool = std::make_unique<Fmi::Database::PostgreSQLConnectionPool>(
+        itsConfig->getStartConnections(),
+        itsConfig->getMaxConnections(),
+        mk_connection_options(*itsConfig));
+
+    // Asynchronous queries are executed by as many workers as there are database connections
+
+    itsWorkerPool = std::make_unique<WorkerPool>(std::max(1U, itsConfig->getMaxConnections()));
+
+    // FIR areas are loaded and refreshed in the background
+
+    startBackgroundTask("FIR area refresh",
+                        itsConfig->getFIRAreaRefreshInterval(),
+                        [this]() { loadFIRAreas(); });
+
+    // Station catalog is loaded in the background; until then stations are queried from database
+
+    if (itsConfig->getStationCatalogEnabled())
+      startBackgroundTask("Station catalog refresh",
+                          itsConfig->getStationCatalogRefreshInterval(),
+                          [this]() { loadStationCatalog(); });
+
+    // Latest message cache is loaded in the background; until then latest messages are queried
+    // from database
+
+    if (itsConfig->getLatestMessageCacheEnabled())
+    {
+      itsLatestMessageCache = std::make_unique<LatestMessageCache>(*itsConfig);
+
+      startBackgroundTask("Latest message cache update",
+                          itsConfig->getLatestMessageCachePollInterval(),
+                          [this]() { updateLatestMessageCache(); });
+    }
+
+    // Route query stations are cached with station catalog
+
+    if (itsConfig->getStationCatalogEnabled() && itsConfig->getRouteCacheEnabled())
+      itsRouteCache = std::make_unique<RouteCache>(itsConfig->getRouteCacheMaxSize(),
+                                                   itsConfig->getRouteCachePrecision());
+
+    // Result cache is invalidated by polling for new messages
+
+    if (itsConfig->getResultCacheEnabled())
+    {
+      itsQueryResultCache = std::make_unique<QueryResultCache>(itsConfig->getResultCacheMaxSize());
+
+      startBackgroundTask("Result cache invalidation",
+                          itsConfig->getResultCachePollInterval(),
+                          [this]() { updateQueryResultCache(); });
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Init failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Shutdown the engine
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::shutdown()
+{
+  std::cout << "  -- Shutdown requested (aviengine)\n";
+
+  stopBackgroundTasks();
+
+  if (itsWorkerPool)
+    itsWorkerPool->shutdown();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start a task to be run periodically in the background until shutdown
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::startBackgroundTask(const string& taskName,
+                                     unsigned int intervalSeconds,
+                                     const std::function<void()>& task)
+{
+  try
+  {
+    itsBackgroundTasks.emplace_back(
+        [this, taskName, intervalSeconds, task]()
+        {
+          while (true)
+          {
+            try
+            {
+              task();
+            }
+            catch (...)
+            {
+              Fmi::Exception::Trace(BCP, taskName + " failed!").printError();
+            }
+
+            std::unique_lock<std::mutex> lock(itsShutdownMutex);
+
+            if (itsShutdownCondition.wait_for(lock,
+                                              std::chrono::seconds(intervalSeconds),
+                                              [this]() { return itsShutdownRequested; }))
+              return;
+          }
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Stop background tasks
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::stopBackgroundTasks()
+{
+  {
+    std::lock_guard<std::mutex> lock(itsShutdownMutex);
+    itsShutdownRequested = true;
+  }
+
+  itsShutdownCondition.notify_all();
+
+  for (auto& backgroundTask : itsBackgroundTasks)
+    if (backgroundTask.joinable())
+      backgroundTask.join();
+
+  itsBackgroundTasks.clear();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get pooled connection
+ */
+// ----------------------------------------------------------------------
+
+EngineImpl::PooledConnection EngineImpl::getConnection() const
+{
+  try
+  {
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::ConnectionWait);
+
+    // The connection is counted while waiting for it too; additional connections are not
+    // taken while anybody is waiting
+
+    itsConnectionsInUse++;
+
+    try
+    {
+      return PooledConnection(itsConnectionPool->get(), itsConnectionsInUse);
+    }
+    catch (...)
+    {
+      itsConnectionsInUse--;
+      throw;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get pooled connection if one is free right now
+ *
+ * Used to take additional connections for a query already holding a
+ * connection; returns nullptr instead of waiting for a connection
+ */
+// ----------------------------------------------------------------------
+
+std::unique_ptr<EngineImpl::PooledConnection> EngineImpl::tryGetConnection() const
+{
+  try
+  {
+    unsigned int maxConnections = itsConfig->getMaxConnections();
+    unsigned int connectionsInUse = itsConnectionsInUse.load();
+
+    do
+    {
+      if (connectionsInUse >= maxConnections)
+        return nullptr;
+    } while (
+        !itsConnectionsInUse.compare_exchange_weak(connectionsInUse, connectionsInUse + 1));
+
+    try
+    {
+      return std::make_unique<PooledConnection>(itsConnectionPool->get(), itsConnectionsInUse);
+    }
+    catch (...)
+    {
+      itsConnectionsInUse--;
+      throw;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get column mapping using query column name
+ */
+// ----------------------------------------------------------------------
+
+const Column* EngineImpl::getQueryColumn(const ColumnTable& tableColumns,
+                                         Columns& columns,
+                                         const string& theQueryColumnName,
+                                         bool& duplicate,
+                                         int columnNumber)
+{
+  try
+  {
+    // Column can be selected only once.
+    //
+    // Note: stationid is and distance can be automatically selected; if they are
+    //       requested by the caller, set request column number
+
+    duplicate = false;
+
+    for (const Column* column = tableColumns; (!(column->itsName.empty())); column++)
+    {
+      if (column->itsName == theQueryColumnName)
+      {
+        for (auto& column : columns)
+          if (column.itsName == theQueryColumnName)
+          {
+            if (column.itsSelection == ColumnSelection::Automatic)
+            {
+              column.itsSelection = ColumnSelection::AutomaticRequested;
+              column.itsNumber = columnNumber;
+            }
+
+            duplicate = true;
+
+            return nullptr;
+          }
+
+        return column;
+      }
+    }
+    return nullptr;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build select expressions for coordinate dependent derived fields
+ */
+// ----------------------------------------------------------------------
+
+string EngineImpl::buildStationQueryCoordinateExpressions(const Columns& columns)
+{
+  try
+  {
+    // ST_Distance(geom::geography,ST_SetSRID(coordinates.coordinate,4326)::geography) AS distance
+    // DEGREES(ST_Azimuth(geom,ST_SetSRID(coordinates.coordinate,4326))) AS bearing
+
+    ostringstream selectExpressions;
+
+    for (auto const& column : columns)
+      if (column.itsCoordinateExpression)
+        selectExpressions << ","
+                          << column.itsCoordinateExpression(column.itsTableColumnName,
+                                                            column.itsName);
+
+    return selectExpressions.str();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build select clause for querying stations
+ */
+// ----------------------------------------------------------------------
+
+Columns EngineImpl::buildStationQuerySelectClause(const StringList& paramList,
+                                                  bool selectStationListOnly,
+                                                  bool autoSelectDistance,
+                                                  string& selectClause,
+                                                  bool& firIdQuery)
+{
+  try
+  {
+    if (paramList.empty())
+      throw Fmi::Exception(BCP, "No parameters were given to station query");
+
+    // Selected columns
+
+    Columns columns;
+    bool duplicate;
+
+    selectClause.clear();
+    firIdQuery = false;
+
+    // Station id is automatically selected
+
+    const auto* queryColumn =
+        getQueryColumn(stationQueryColumns, columns, stationIdQueryColumn, duplicate);
+
+    if (!queryColumn)
+      throw Fmi::Exception(BCP,
+                           "buildStationQuerySelectClause(): internal: Unable to get id column");
+
+    Column column(*queryColumn);
+    column.itsSelection = ColumnSelection::Automatic;
+    columns.push_back(column);
+
+    selectClause =
+        string("SELECT ") + queryColumn->itsTableColumnName + " AS " + queryColumn->itsName;
+
+    // distance is automatically selected to apply max # of nearest stations
+
+    if (autoSelectDistance)
+    {
+      const auto* queryColumn =
+          getQueryColumn(stationQueryColumns, columns, stationDistanceQueryColumn, duplicate);
+
+      if (!queryColumn)
+        throw Fmi::Exception(
+            BCP, "buildStationQuerySelectClause(): internal: Unable to get distance column");
+
+      Column column(*queryColumn);
+      column.itsSelection = ColumnSelection::Automatic;
+      columns.push_back(column);
+    }
+
+    int columnNumber = 0;
+    bool coordinatePairSelected = false;
+
+    for (auto const& param : paramList)
+    {
+      // Note: If 'selectStationList' is set, scanning only for derived distance and bearing columns
+      // (they are not available in current message query), and setting 'AutomaticRequested'
+      // (instead of 'Automatic') type for the user requested fields (stationid) to indicate they
+      // shall be returned
+      //
+      const auto* queryColumn =
+          getQueryColumn(stationQueryColumns, columns, param, duplicate, columnNumber);
+
+      if (queryColumn && ((!selectStationListOnly) || queryColumn->itsCoordinateExpression))
+      {
+        if (queryColumn->itsExpression)
+        {
+          // ST_X(geom) AS longitudes
+          // ST_Y(geom) AS latitude
+          // ST_X(geom) AS pairlon,ST_Y(geom) AS pairlat (once for lonlat and latlon)
+          //
+          bool coordinatePair = (queryColumn->itsExpression == coordinatePairExpression);
+
+          if (!(coordinatePair && coordinatePairSelected))
+            selectClause +=
+                (string(selectClause.empty() ? "SELECT " : ",") +
+                 queryColumn->itsExpression(queryColumn->itsTableColumnName, queryColumn->itsName));
+
+          coordinatePairSelected = (coordinatePairSelected || coordinatePair);
+        }
+        else if (queryColumn->itsCoordinateExpression)
+        {
+          // Parametrized expression for each given coordinate
+          //
+          // Note: Column expression is generated and added to the select clause only when querying
+          // with coordinates (queryStationsWithCoordinates())
+        }
+        else
+        {
+          selectClause += (string(selectClause.empty() ? "SELECT " : ",") +
+                           ((queryColumn->itsType == ColumnType::DateTime)
+                                ? timeColumnExpression(queryColumn->itsTableColumnName)
+                                : queryColumn->itsTableColumnName));
+
+          if ((queryColumn->itsType == ColumnType::DateTime) ||
+              (queryColumn->itsName != queryColumn->itsTableColumnName))
+            selectClause += (string(" AS ") + queryColumn->itsName);
+        }
+
+        columns.push_back(*queryColumn);
+        columns.back().itsNumber = columnNumber;
+      }
+      else if ((!queryColumn) && (!duplicate) && (!selectStationListOnly))
+      {
+        queryColumn = getQueryColumn(firQueryColumns, columns, param, duplicate, columnNumber);
+
+        if (queryColumn)
+        {
+          // FIR id is set by station coordinates using FIR index; coordinates are selected
+          // automatically
+
+          firIdQuery = true;
+          selectClause += (string(",NULL::integer AS ") + queryColumn->itsName + ",ST_X(" +
+                           dfGeom + ") AS " + firLonQueryColumn + ",ST_Y(" + dfGeom + ") AS " +
+                           firLatQueryColumn);
+
+          columns.push_back(*queryColumn);
+          columns.back().itsNumber = columnNumber;
+        }
+      }
+
+      columnNumber++;
+    }
+
+    return columns;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build select clause for querying accepted or rejected messages
+ */
+// ----------------------------------------------------------------------
+
+TableMap EngineImpl::buildMessageQuerySelectClause(QueryTable* queryTables,
+                                                   const StationIdList& stationIdList,
+                                                   const StringList& messageTypeList,
+                                                   const StringList& paramList,
+                                                   bool routeQuery,
+                                                   string& selectClause,
+                                                   bool& messageColumnSelected,
+                                                   bool& distinct)
+{
+  try
+  {
+    // Selected tables/columns
+
+    TableMap tableMap;
+    bool leftOuter = true;
+    bool icaoSelected = false;
+    bool duplicate = false;
+    bool distinctMessages = distinct;
+    bool checkDuplicateMessages = false;
+    bool coordinatePairSelected = false;
+    int columnNumber = 0;
+
+    selectClause.clear();
+    messageColumnSelected = distinct = false;
+
+    // For accepted messages, station id is automatically selected for storing the data (station id
+    // is data map key) and for joining with station data (to get distance and bearing), and for non
+    // route query icao_code column is added to the list of query columns to join with station table
+    // for ordering the messages by icao code.
+    //
+    // Message column is automatically selected to check duplicates if any other message table
+    // column is selected
+
+    if (queryTables->itsName == messageTableName)
+    {
+      // Because queries like "param=name,messagetype,route" - selecting columns from
+      // avidb_stations, avidb_message_types and avidb_message_routes, but none from
+      // avidb_messages - are allowed, the select for accepted messages is distinct unless at
+      // least one avidb_messages column other than station id is selected
+      //
+      // No LEFT OUTER joins when querying accepted messages
+      //
+      distinct = true;
+      leftOuter = false;
+
+      for (QueryTable* qt = queryTables;; qt++)
+      {
+        const QueryTable& queryTable = *qt;
+
+        if (queryTable.itsName.empty())
+          break;
+
+        if (queryTable.itsName == messageTableName)
+        {
+          auto& table = tableMap[messageTableName];
+          table.itsAlias = queryTable.itsAlias;
+          table.itsJoin = queryTable.itsJoin;
+
+          const auto* queryColumn = getQueryColumn(
+              queryTable.itsColumns, table.itsSelectedColumns, stationIdQueryColumn, duplicate);
+
+          if (!queryColumn)
+            throw Fmi::Exception(
+                BCP, "buildMessageQuerySelectClause(): internal: Unable to get station id column");
+
+          Column column(*queryColumn);
+          column.itsSelection = ColumnSelection::Automatic;
+          table.itsSelectedColumns.push_back(column);
+
+          selectClause = queryTable.itsAlias + "." + queryColumn->itsTableColumnName + " AS " +
+                         queryColumn->itsName;
+        }
+        else if ((!routeQuery) && (queryTable.itsName == stationTableName))
+        {
+          auto& table = tableMap[stationTableName];
+          table.itsAlias = queryTable.itsAlias;
+          table.itsJoin = queryTable.itsJoin;
+
+          const auto* queryColumn = getQueryColumn(
+              queryTable.itsColumns, table.itsSelectedColumns, stationIcaoQueryColumn, duplicate);
+
+          if (!queryColumn)
+            throw Fmi::Exception(
+                BCP,
+                "buildMessageQuerySelectClause(): internal: Unable to get station icao column");
+
+          Column column(*queryColumn);
+          column.itsSelection = ColumnSelection::Automatic;
+          table.itsSelectedColumns.push_back(column);
+
+          // NOTE: Generate select expression if icao is requested by the caller too. When looping
+          // the parameters below, column's select expression is NOT generated if the column already
+          // exists in column list; it's type just gets changed to AutomaticRequested
+
+          if (find(paramList.begin(), paramList.end(), stationIcaoQueryColumn) != paramList.end())
+          {
+            selectClause += (string(selectClause.empty() ? "" : ",") + queryTable.itsAlias + "." +
+                             queryColumn->itsTableColumnName + " AS " + queryColumn->itsName);
+            icaoSelected = true;
+          }
+        }
+      }
+    }
+
+    for (auto const& param : paramList)
+    {
+      for (QueryTable* qt = queryTables;; qt++)
+      {
+        const QueryTable& queryTable = *qt;
+
+        if (queryTable.itsName.empty())
+          break;
+
+        auto& table = tableMap[queryTable.itsName];
+        const auto* queryColumn = getQueryColumn(
+            queryTable.itsColumns, table.itsSelectedColumns, param, duplicate, columnNumber);
+
+        if (queryColumn)
+        {
+          if (table.itsAlias.empty())
+            table.itsAlias = queryTable.itsAlias;
+
+          if (table.itsJoin.empty())
+            table.itsJoin = queryTable.itsJoin;
+
+          table.leftOuter = leftOuter;
+
+          if (queryColumn->itsExpression)
+          {
+            // lonlat and latlon share the coordinate pair columns
+
+            bool coordinatePair = (queryColumn->itsExpression == coordinatePairExpression);
+
+            if (!(coordinatePair && coordinatePairSelected))
+              selectClause += (string(selectClause.empty() ? "" : ",") +
+                               queryColumn->itsExpression(queryColumn->itsTableColumnName,
+                                                          queryColumn->itsName));
+
+            coordinatePairSelected = (coordinatePairSelected || coordinatePair);
+          }
+          else if (queryColumn->itsCoordinateExpression)
+          {
+            // Select NULL for distance and bearing columns; they will be set after the query by
+            // searching from station data
+            //
+            selectClause += (string(selectClause.empty() ? "" : ",") + nullExpression(queryColumn));
+          }
+          else
+          {
+            string tableColumn = (queryTable.itsAlias + "." + queryColumn->itsTableColumnName);
+
+            selectClause += (string(selectClause.empty() ? "" : ",") +
+                             ((queryColumn->itsType == ColumnType::DateTime)
+                                  ? timeColumnExpression(tableColumn)
+                                  : tableColumn));
+
+            if ((queryColumn->itsType == ColumnType::DateTime) ||
+                (queryColumn->itsName != queryColumn->itsTableColumnName))
+              selectClause += (string(" AS ") + queryColumn->itsName);
+          }
+
+          if ((queryTable.itsName != stationTableName) && (queryTable.itsName != firTableName))
+          {
+            if (queryTable.itsName == messageTableName)
+            {
+              distinct = false;
+
+              if (distinctMessages && (queryColumn->itsName == messageQueryColumn))
+                // Clear flag forcing automatic 'message' column selection
+                //
+                distinctMessages = false;
+              else
+                checkDuplicateMessages = true;
+            }
+
+            messageColumnSelected = true;
+          }
+
+          table.itsSelectedColumns.push_back(*queryColumn);
+          table.itsSelectedColumns.back().itsNumber = columnNumber;
+
+          break;
+        }
+
+        if (duplicate)
+          // Automatically selected column is selected by the caller too
+          break;
+      }
+
+      columnNumber++;
+    }
+
+    if (distinctMessages && checkDuplicateMessages)
+    {
+      // 'message' column was not selected by the caller; select it to skip duplicates
+      //
+      auto& table = tableMap[messageTableName];
+      const auto* queryColumn = getQueryColumn(
+          messageQueryColumns, table.itsSelectedColumns, messageQueryColumn, duplicate);
+
+      if (!queryColumn)
+        throw Fmi::Exception(
+            BCP, "buildMessageQuerySelectClause(): internal: Unable to get message column");
+
+      Column column(*queryColumn);
+      column.itsSelection = ColumnSelection::Automatic;
+      table.itsSelectedColumns.push_back(column);
+
+      selectClause += (string(",") + messageTableAlias + "." + queryColumn->itsTableColumnName +
+                       " AS " + queryColumn->itsName);
+    }
+
+    // SELECT [DISTINCT] ...
+    //
+    // Note: "for SELECT DISTINCT, ORDER BY expressions must appear in select list"; ensure
+    // avidb_stations is joined and icao is selected for non route query, or select 'position'
+    // column for route query
+
+    selectClause = (distinct ? "SELECT DISTINCT " : "SELECT ") + selectClause;
+
+    if ((!routeQuery) && distinct && (!icaoSelected))
+    {
+      auto& table = tableMap[stationTableName];
+
+      if (table.itsAlias.empty())
+        table.itsAlias = stationTableAlias;
+
+      if (table.itsJoin.empty())
+        table.itsJoin = stationTableJoin;
+
+      selectClause += (string(",") + stationTableAlias + "." + stationIcaoTableColumn);
+    }
+    else if (routeQuery && distinct && (!stationIdList.empty()))
+      selectClause +=
+          (string(",") + requestStationsTableAlias + "." + requestStationsPositionColumn);
+
+    // Ensure 'avidb_message_types' table is joined into the query if restricting query with given
+    // message types
+
+    if (messageColumnSelected && (!messageTypeList.empty()))
+    {
+      auto& table = tableMap[messageTypeTableName];
+
+      if (table.itsAlias.empty())
+        table.itsAlias = messageTypeTableAlias;
+
+      if (table.itsJoin.empty())
+        table.itsJoin = messageTypeTableJoin;
+
+      table.leftOuter = false;
+    }
+
+    return tableMap;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if the message group already has given message; if not,
+ *        the message is stored
+ *
+ * The rows are ordered by message group, so the stored messages are
+ * cleared when the group changes. Messages are compared by hash and, if
+ * the hashes are equal and the other message's text is available, by text.
+ * The texts refer to the result being loaded and are not copied
+ */
+// ----------------------------------------------------------------------
+
+bool EngineImpl::MessageRowFilter::isDuplicate(StationIdType theStationId,
+                                               int theTypeId,
+                                               std::int64_t theMessageTime,
+                                               const char* theMessage,
+                                               std::size_t theSize)
+{
+  setGroup(theStationId, theTypeId, theMessageTime);
+
+  auto hash = messageHash(theMessage, theSize);
+
+  for (auto const& message : itsMessages)
+  {
+    if (message.itsHash != hash)
+      continue;
+
+    // Messages of a previous batch or page are known by hash only
+
+    if ((!message.itsText) ||
+        ((message.itsSize == theSize) && (memcmp(message.itsText, theMessage, theSize) == 0)))
+      return true;
+  }
+
+  itsMessages.push_back(Message{hash, theMessage, theSize});
+
+  return false;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Set current message group; if the group changes, the stored
+ *        messages are cleared
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::MessageRowFilter::setGroup(StationIdType theStationId,
+                                            int theTypeId,
+                                            std::int64_t theMessageTime)
+{
+  if ((theStationId == itsStationId) && (theTypeId == itsTypeId) &&
+      (theMessageTime == itsMessageTime))
+    return;
+
+  itsStationId = theStationId;
+  itsTypeId = theTypeId;
+  itsMessageTime = theMessageTime;
+  itsMessages.clear();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Release message texts referring to a loaded result; the messages
+ *        are then known by hash only
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::MessageRowFilter::releaseTexts()
+{
+  for (auto& message : itsMessages)
+    message.itsText = nullptr;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load query result into given data object
+ */
+// ----------------------------------------------------------------------
+
+template <typename T>
+void EngineImpl::loadQueryResult(const pqxx::result& result,
+                                 bool debug,
+                                 T& queryData,
+                                 bool distinctRows,
+                                 int maxRows,
+                                 MessageRowFilter* rowFilter) const
+{
+  try
+  {
+    if (debug)
+      cerr << "Rows: " << result.size() << '\n';
+
+    if ((maxRows > 0) && ((int)result.size() > maxRows))
+      throw Fmi::Exception(
+          BCP,
+          string("Max number of rows exceeded (") + Fmi::to_string(maxRows) + "), limit the query");
+
+    loadResultRows(result, result.begin(), result.end(), queryData, distinctRows, rowFilter);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load result rows into given data object
+ *
+ * The rows are given as result iterators or as iterators to result row
+ * iterators (rows merged from multiple results having the same columns as
+ * the given result)
+ */
+// ----------------------------------------------------------------------
+
+template <typename T, typename RowIterator>
+void EngineImpl::loadResultRows(const pqxx::result& result,
+                                RowIterator firstRow,
+                                RowIterator lastRow,
+                                T& queryData,
+                                bool distinctRows,
+                                MessageRowFilter* rowFilter) const
+{
+  try
+  {
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::ResultDecoding);
+
+    if (firstRow == lastRow)
+      return;
+
+    bool checkDuplicateMessages =
+        (distinctRows && queryData.itsCheckDuplicateMessages &&
+         (find(queryData.itsColumns.begin(), queryData.itsColumns.end(), messageQueryColumn) !=
+          queryData.itsColumns.end()));
+    bool duplicate;
+
+    // Resolve result column numbers and decoders for the requested columns.
+    //
+    // For station data (stations and accepted messages) automatically selected station id is
+    // stored as a map key; it is not stored as a column if it was not requested.
+    //
+    // Also distance is selected automatically for stations to apply max # of nearest stations,
+    // and icao is automatically added to the column list to generate station table join to
+    // order the messages by icao code
+
+    auto columnNumbers = resultColumnNumbers(result);
+    ResultColumns resultColumns;
+
+    for (const Column& column : queryData.itsColumns)
+    {
+      if (column.itsSelection == ColumnSelection::Automatic)
+        // Column was not requested by the caller, skip it
+        //
+        continue;
+
+      resultColumns.push_back(resultColumn(columnNumbers, column));
+    }
+
+    // Only the 1'st copy of duplicate messages (for one of the routes) of each message group
+    // (station, message type and message time) is loaded; the messages are compared by hash.
+    // Hashes of the last group are passed from a page to the next one with the given row filter
+    // when querying messages by pages
+
+    int stationIdColumn = -1;
+    int typeIdColumn = -1;
+    int messageTimeColumn = -1;
+    int messageColumn = -1;
+    MessageRowFilter localRowFilter;
+    MessageRowFilter& messageRowFilter = (rowFilter ? *rowFilter : localRowFilter);
+
+    if (checkDuplicateMessages)
+    {
+      stationIdColumn = resultColumnNumber(columnNumbers, stationIdQueryColumn);
+      typeIdColumn = resultColumnNumber(columnNumbers, messageGroupTypeIdQueryColumn);
+      messageTimeColumn = resultColumnNumber(columnNumbers, messageGroupTimeQueryColumn);
+      messageColumn = resultColumnNumber(columnNumbers, messageQueryColumn);
+    }
+
+    for (auto it = firstRow; (it != lastRow); it++)
+    {
+      // Dereference the iterator to a row before indexing by column: libpqxx 8 no longer lets a
+      // result iterator be indexed as a row.
+      const pqxx::result::const_iterator& row = resultRowIterator(it);
+      const auto& dbRow = *row;
+
+      if (checkDuplicateMessages)
+      {
+        const auto& message = dbRow[messageColumn];
+
+        if (messageRowFilter.isDuplicate(dbRow[stationIdColumn].as<long>(),
+                                         dbRow[typeIdColumn].as<int>(),
+                                         dbRow[messageTimeColumn].as<std::int64_t>(),
+                                         message.c_str(),
+                                         message.size()))
+          continue;
+      }
+
+      // Passing the row as previous row too; duplicate messages are already skipped
+
+      QueryValues& queryValues = queryData.getValues(row, row, duplicate);
+
+      if (duplicate && distinctRows)
+        // Station was already selected
+        //
+        continue;
+
+      for (const auto& resultColumn : resultColumns)
+      {
+        auto& values = queryValues[resultColumn.itsColumn->itsName];
+
+        if (resultColumn.itsNumber < 0)
+          values.emplace_back(TimeSeries::None());
+        else
+          resultColumn.itsDecoder(dbRow, resultColumn, values);
+      }
+    }
+
+    // The result is released by the caller
+
+    messageRowFilter.releaseTexts();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load query result into given columnar data object
+ *
+ * Duplicate rows are skipped like when loading StationQueryData. If the
+ * rows of a station are not contiguous in the result, the rows are
+ * (stably) grouped by station in the order of appearance
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::loadQueryResult(const pqxx::result& result,
+                                 bool debug,
+                                 StationQueryTable& queryTable,
+                                 bool distinctRows,
+                                 int maxRows) const
+{
+  try
+  {
+    if (debug)
+      cerr << "Rows: " << result.size() << '\n';
+
+    if ((maxRows > 0) && ((int)result.size() > maxRows))
+      throw Fmi::Exception(
+          BCP,
+          string("Max number of rows exceeded (") + Fmi::to_string(maxRows) + "), limit the query");
+
+    MessageRowFilter rowFilter;
+
+    loadQueryRows(result, queryTable, distinctRows, rowFilter);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load query result rows into given columnar data object
+ *
+ * The messages loaded are passed from a batch to the next one with the
+ * row filter when streaming the results
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::loadQueryRows(const pqxx::result& result,
+                               StationQueryTable& queryTable,
+                               bool distinctRows,
+                               MessageRowFilter& rowFilter) const
+{
+  try
+  {
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::ResultDecoding);
+
+    queryTable.itsColumnValues.assign(queryTable.itsColumns.size(), ValueVector());
+    queryTable.itsStationRows.clear();
+    queryTable.itsRowCount = 0;
+
+    if (result.empty())
+      return;
+
+    auto columnNumbers = resultColumnNumbers(result);
+    int stationIdColumn = resultColumnNumber(columnNumbers, stationIdQueryColumn);
+
+    auto it = columnNumbers.find(messageQueryColumn);
+
+    int messageColumn = ((it != columnNumbers.end()) ? it->second : -1);
+    bool checkDuplicateMessages = (distinctRows && (messageColumn >= 0));
+    int typeIdColumn = -1;
+    int messageTimeColumn = -1;
+
+    if (checkDuplicateMessages)
+    {
+      typeIdColumn = resultColumnNumber(columnNumbers, messageGroupTypeIdQueryColumn);
+      messageTimeColumn = resultColumnNumber(columnNumbers, messageGroupTimeQueryColumn);
+    }
+
+    // Resolve result column numbers and decoders for the requested columns
+
+    ResultColumns resultColumns;
+    std::vector<ValueVector*> columnValues;
+    size_t columnIndex = 0;
+
+    for (const Column& column : queryTable.itsColumns)
+    {
+      auto& values = queryTable.itsColumnValues[columnIndex++];
+
+      if (column.itsSelection == ColumnSelection::Automatic)
+        continue;
+
+      resultColumns.push_back(resultColumn(columnNumbers, column));
+      columnValues.push_back(&values);
+      values.reserve(result.size());
+    }
+
+    // Station index (in itsStationRows) of each loaded row
+
+    auto& stationRows = queryTable.itsStationRows;
+    std::map<StationIdType, size_t> stationIndexes;
+    std::vector<size_t> rowStations;
+    bool grouped = true;
+
+    rowStations.reserve(result.size());
+
+    for (pqxx::result::const_iterator row = result.begin(); (row != result.end()); row++)
+    {
+      const auto& dbRow = *row;
+
+      StationIdType stationId = dbRow[stationIdColumn].as<long>();
+
+      if (checkDuplicateMessages)
+      {
+        // Skip duplicate messages of the message group but the 1'st, also over the batches
+
+        const auto& message = dbRow[messageColumn];
+
+        if (rowFilter.isDuplicate(stationId,
+                                  dbRow[typeIdColumn].as<int>(),
+                                  dbRow[messageTimeColumn].as<std::int64_t>(),
+                                  message.c_str(),
+                                  message.size()))
+          continue;
+      }
+
+      auto station = stationIndexes.insert(std::make_pair(stationId, stationRows.size()));
+      auto stationIndex = station.first->second;
+
+      if (station.second)
+        stationRows.push_back(StationQueryTable::StationRows{stationId, 0, 0});
+
+      if ((!rowStations.empty()) && (rowStations.back() != stationIndex) &&
+          (stationRows[stationIndex].itsRowCount > 0))
+        grouped = false;
+
+      stationRows[stationIndex].itsRowCount++;
+      rowStations.push_back(stationIndex);
+
+      for (size_t n = 0; (n < resultColumns.size()); n++)
+      {
+        const auto& column = resultColumns[n];
+        auto& values = *columnValues[n];
+
+        if (column.itsNumber < 0)
+          values.emplace_back(TimeSeries::None());
+        else
+          column.itsDecoder(dbRow, column, values);
+      }
+    }
+
+    // The result (batch) is released by the caller
+
+    rowFilter.releaseTexts();
+
+    // Set station row ranges and if needed, group the rows by station
+
+    size_t firstRow = 0;
+
+    for (auto& station : stationRows)
+    {
+      station.itsFirstRow = firstRow;
+      firstRow += station.itsRowCount;
+    }
+
+    queryTable.itsRowCount = rowStations.size();
+
+    if (grouped)
+      return;
+
+    std::vector<size_t> nextRows;
+    std::vector<size_t> rowPositions;
+
+    nextRows.reserve(stationRows.size());
+    rowPositions.reserve(rowStations.size());
+
+    for (const auto& station : stationRows)
+      nextRows.push_back(station.itsFirstRow);
+
+    for (auto stationIndex : rowStations)
+      rowPositions.push_back(nextRows[stationIndex]++);
+
+    for (auto values : columnValues)
+    {
+      ValueVector groupedValues(values->size());
+
+      for (size_t n = 0; (n < rowPositions.size()); n++)
+        groupedValues[rowPositions[n]] = std::move((*values)[n]);
+
+      values->swap(groupedValues);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute query and load the result into given data object
+ */
+// ----------------------------------------------------------------------
+
+template <typename T>
+void EngineImpl::executeQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                              const string& query,
+                              bool debug,
+                              T& queryData,
+                              bool distinctRows,
+                              int maxRows) const
+{
+  try
+  {
+    if (debug)
+      cerr << "Query: " << query << '\n';
+
+    auto result = connection.executeNonTransaction(query);
+
+    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute parametrized query and load query result into given data object
+ */
+// ----------------------------------------------------------------------
+
+template <typename T>
+void EngineImpl::executeParamQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                                   const string& query,
+                                   const string& queryArg,
+                                   bool debug,
+                                   T& queryData,
+                                   bool distinctRows,
+                                   int maxRows) const
+{
+  try
+  {
+    if (debug)
+      cerr << "Query: " << query << '\n';
+
+    auto result = connection.exec_params(query, queryArg);
+
+    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+template <typename T, typename T2>
+void EngineImpl::executeParamQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                                   const string& query,
+                                   const T2& queryArgs,
+                                   bool debug,
+                                   T& queryData,
+                                   bool distinctRows,
+                                   int maxRows) const
+{
+  try
+  {
+    if (debug)
+      cerr << "Query: " << query << '\n';
+
+    auto result = connection.exec_params_p(query, queryArgs);
+
+    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute normalized query with bound parameters and load query result
+ *        into given data object
+ */
+// ----------------------------------------------------------------------
+
+template <typename T>
+void EngineImpl::executePreparedQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                                      const string& query,
+                                      const QueryParameters& queryParameters,
+                                      bool debug,
+                                      T& queryData,
+                                      bool distinctRows,
+                                      int maxRows) const
+{
+  try
+  {
+    if (debug)
+    {
+      cerr << "Query: " << query << '\n';
+
+      size_t n = 1;
+
+      for (auto const& value : queryParameters.getValues())
+        cerr << "  $" << n++ << " = " << value << '\n';
+    }
+
+    auto result = executePrepared(connection, query, queryParameters);
+
+    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute normalized query with bound parameters
+ *
+ * The query is prepared once per pooled connection with a name numbered
+ * per connection and then executed with the parameters. If the number of
+ * statements prepared for the connection has reached the limit, the query
+ * is executed unprepared with the parameters.
+ */
+// ----------------------------------------------------------------------
+
+pqxx::result EngineImpl::executePrepared(const Fmi::Database::PostgreSQLConnection& connection,
+                                         const string& query,
+                                         const QueryParameters& queryParameters) const
+{
+  try
+  {
+    // Max number of prepared statements per connection
+
+    const size_t maxPreparedStatements = 500;
+
+    string statementName;
+    bool prepare = false;
+
+    {
+      std::lock_guard<std::mutex> lock(itsPreparedStatementMutex);
+
+      auto& statements = itsPreparedStatements[&connection];
+      auto it = statements.itsNames.find(query);
+
+      if (it != statements.itsNames.end())
+        statementName = it->second;
+      else
+      {
+        if (statements.itsNames.size() >= maxPreparedStatements)
+          return connection.exec_params_p(query, queryParameters.getValues());
+
+        statementName = "avi_" + Fmi::to_string(++statements.itsCounter);
+        prepare = true;
+      }
+    }
+
+    pqxx::params params;
+
+    for (auto const& value : queryParameters.getValues())
+      params.append(value);
+
+    if (!prepare)
+    {
+      try
+      {
+        return connection.exec_prepared(statementName, params);
+      }
+      catch (...)
+      {
+        // The statements are lost if the connection has been reopened; if the statement can be
+        // prepared, forget the connection's other statements and retry once. Otherwise the
+        // statement exists and the query itself failed
+
+        auto queryError = std::current_exception();
+
+        try
+        {
+          connection.prepare(statementName, query);
+        }
+        catch (...)
+        {
+          std::rethrow_exception(queryError);
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(itsPreparedStatementMutex);
+
+          auto& statements = itsPreparedStatements[&connection];
+          statements.itsNames.clear();
+          statements.itsNames[query] = statementName;
+        }
+
+        return connection.exec_prepared(statementName, params);
+      }
+    }
+
+    connection.prepare(statementName, query);
+
+    {
+      std::lock_guard<std::mutex> lock(itsPreparedStatementMutex);
+      itsPreparedStatements[&connection].itsNames[query] = statementName;
+    }
+
+    return connection.exec_prepared(statementName, params);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute query with a cursor and pass the result rows to given
+ *        callback in batches
+ *
+ * The cursor is declared in a transaction of its own; the number of rows
+ * is checked while fetching, the query is not limited with max rows.
+ * Since the rows are not counted beforehand, the batches fetched before
+ * max rows is exceeded have already been passed to the callback when the
+ * error is thrown.
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::executeCursorQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                                    const string& query,
+                                    const QueryParameters& queryParameters,
+                                    bool debug,
+                                    int maxRows,
+                                    const std::function<void(const pqxx::result&)>& loadBatch)
+{
+  try
+  {
+    // Number of rows fetched at a time
+
+    const size_t batchSize = 1000;
+
+    if (debug)
+    {
+      cerr << "Cursor query: " << query << '\n';
+
+      size_t n = 1;
+
+      for (auto const& value : queryParameters.getValues())
+        cerr << "  $" << n++ << " = " << value << '\n';
+    }
+
+    // The transaction is rolled back (and the cursor closed) when destroyed uncommitted
+
+    auto transaction = connection.transaction();
+
+    string declareCursor = "DECLARE avi_cursor NO SCROLL CURSOR FOR " + query;
+
+    if (queryParameters.empty())
+      transaction->execute(declareCursor);
+    else
+      transaction->exec_params_p(declareCursor, queryParameters.getValues());
+
+    string fetchQuery = "FETCH FORWARD " + Fmi::to_string(batchSize) + " FROM avi_cursor";
+    size_t rowCount = 0;
+
+    for (;;)
+    {
+      auto result = transaction->execute(fetchQuery);
+
+      rowCount += result.size();
+
+      if (debug)
+        cerr << "Fetched rows: " << result.size() << " (" << rowCount << ")\n";
+
+      if ((maxRows > 0) && (rowCount > (size_t)maxRows))
+        throw Fmi::Exception(BCP,
+                             string("Max number of rows exceeded (") + Fmi::to_string(maxRows) +
+                                 "), limit the query");
+
+      if (!result.empty())
+        loadBatch(result);
+
+      if (result.size() < batchSize)
+        break;
+    }
+
+    transaction->execute("CLOSE avi_cursor");
+    transaction->commit();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute normalized query with bound parameters and pass the
+ *        result rows to stream's callback in columnar batches
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::executePreparedQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                                      const string& query,
+                                      const QueryParameters& queryParameters,
+                                      bool debug,
+                                      MessageStream& queryStream,
+                                      bool distinctRows,
+                                      int maxRows) const
+{
+  try
+  {
+    MessageRowFilter rowFilter;
+
+    executeCursorQuery(connection,
+                       query,
+                       queryParameters,
+                       debug,
+                       maxRows,
+                       [&](const pqxx::result& result)
+                       {
+                         StationQueryTable batch;
+                         batch.itsColumns = queryStream.itsColumns;
+
+                         loadQueryRows(result, batch, distinctRows, rowFilter);
+
+                         if (batch.getRowCount() > 0)
+                           queryStream.itsCallback(batch);
+                       });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute query and pass the result rows to stream's callback in
+ *        batches
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::executeQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                              const string& query,
+                              bool debug,
+                              RejectedMessageStream& queryStream,
+                              bool distinctRows,
+                              int maxRows) const
+{
+  try
+  {
+    executeCursorQuery(connection,
+                       query,
+                       QueryParameters(),
+                       debug,
+                       maxRows,
+                       [&](const pqxx::result& result)
+                       {
+                         QueryData batch;
+                         batch.itsColumns = queryStream.itsColumns;
+
+                         loadQueryResult(result, debug, batch, distinctRows);
+
+                         queryStream.itsCallback(batch);
+                       });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given coordinates
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithCoordinates(const Fmi::Database::PostgreSQLConnection& connection,
+                                              const LocationOptions& locationOptions,
+                                              const StringList& messageTypes,
+                                              const string& selectClause,
+                                              bool debug,
+                                              StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Build select expressions for coordinate dependent derived columns
+
+    string derivedColumnSelectExpressions =
+        buildStationQueryCoordinateExpressions(stationQueryData.itsColumns);
+
+    // Build from and where clause
+
+    ostringstream fromWhereClause;
+
+    buildStationQueryFromWhereClause(locationOptions, messageTypes, fromWhereClause);
+
+    // Add 'SELECT FROM (...)' query level(s) to apply DISTINCT ON (station_id) and max # of nearest
+    // stations
+
+    ostringstream selectFromClause;
+
+    selectFromClause << "SELECT DISTINCT ON (" + string(stationIdQueryColumn) + ") * FROM (";
+    fromWhereClause << ") AS stations";
+
+    if (locationOptions.itsNumberOfNearestStations > 0)
+    {
+      selectFromClause << "SELECT *,RANK() OVER (PARTITION BY " << stationCoordinateColumn
+                       << " ORDER BY " << stationDistanceQueryColumn << ") AS rank FROM (";
+      fromWhereClause << ") AS stations WHERE rank <= " << fixed
+                      << locationOptions.itsNumberOfNearestStations;
+    }
+
+    // Execute query
+
+    const string query = selectFromClause.str() + selectClause + derivedColumnSelectExpressions +
+                         ",coordinates." + stationCoordinateColumn + " " + fromWhereClause.str();
+
+    executeQuery<StationQueryData>(connection, query, debug, stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given station id's
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithIds(const Fmi::Database::PostgreSQLConnection& connection,
+                                      const StationIdList& stationIdList,
+                                      const string& selectClause,
+                                      bool debug,
+                                      StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Build where clause and execute query
+
+    ostringstream whereClause;
+    QueryParameters queryParameters;
+
+    buildStationQueryWhereClause(stationIdList, queryParameters, whereClause);
+
+    executePreparedQuery<StationQueryData>(connection,
+                                           selectClause + " FROM avidb_stations " +
+                                               whereClause.str(),
+                                           queryParameters,
+                                           debug,
+                                           stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute station query with FIR id
+ *
+ * FIR id is set using FIR index by station coordinates. As with joining
+ * the stations to FIR areas, stations not within any FIR are skipped.
+ * Unlike the join, which returned a row for each FIR containing the
+ * station, a station within overlapping FIR areas is returned once with
+ * the smallest FIR id
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::executeFIRStationQuery(const Fmi::Database::PostgreSQLConnection& connection,
+                                        const string& query,
+                                        const QueryParameters& queryParameters,
+                                        bool debug,
+                                        StationQueryData& stationQueryData) const
+{
+  try
+  {
+    if (debug)
+    {
+      cerr << "Query: " << query << '\n';
+
+      size_t n = 1;
+
+      for (auto const& value : queryParameters.getValues())
+        cerr << "  $" << n++ << " = " << value << '\n';
+    }
+
+    auto result = executePrepared(connection, query, queryParameters);
+
+    if (result.empty())
+      return;
+
+    auto firAreaSnapshot = getFIRAreaSnapshot();
+    auto const& firIndex = firAreaSnapshot->itsIndex;
+    int stationIdColumn = result.column_number(stationIdQueryColumn);
+    int lonColumn = result.column_number(firLonQueryColumn);
+    int latColumn = result.column_number(firLatQueryColumn);
+
+    std::vector<pqxx::result::const_iterator> firRows;
+    std::vector<std::pair<StationIdType, int>> firIds;
+
+    for (auto row = result.begin(); (row != result.end()); row++)
+    {
+      const auto& dbRow = *row;
+
+      auto firId =
+          firIndex.getFIRId(dbRow[lonColumn].as<double>(), dbRow[latColumn].as<double>());
+
+      if (!firId)
+        continue;
+
+      firRows.push_back(row);
+      firIds.emplace_back(dbRow[stationIdColumn].as<StationIdType>(), *firId);
+    }
+
+    if (debug)
+      cerr << "Rows: " << firRows.size() << '\n';
+
+    loadResultRows(result, firRows.cbegin(), firRows.cend(), stationQueryData, true, nullptr);
+
+    for (auto const& firId : firIds)
+    {
+      for (auto& value : stationQueryData.itsValues[firId.first][firIdQueryColumn])
+        value = firId.second;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given icao codes
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithIcaos(const Fmi::Database::PostgreSQLConnection& connection,
+                                        const StringList& icaoList,
+                                        const string& selectClause,
+                                        bool firIdQuery,
+                                        bool debug,
+                                        StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Build where clause and execute query
+
+    ostringstream whereClause;
+    QueryParameters queryParameters;
+
+    string fromClause(string(" FROM avidb_stations ") + stationTableAlias);
+
+    buildStationQueryWhereClause(
+        "UPPER(icao_code)", icaoList, "", {}, queryParameters, whereClause);
+
+    if (firIdQuery)
+      executeFIRStationQuery(connection,
+                             selectClause + fromClause + " " + whereClause.str(),
+                             queryParameters,
+                             debug,
+                             stationQueryData);
+    else
+      executePreparedQuery<StationQueryData>(connection,
+                                             selectClause + fromClause + " " + whereClause.str(),
+                                             queryParameters,
+                                             debug,
+                                             stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given country codes
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithCountries(const Fmi::Database::PostgreSQLConnection& connection,
+                                            const StringList& countryList,
+                                            const StringList& excludeIcaoFilters,
+                                            const string& selectClause,
+                                            bool firIdQuery,
+                                            bool debug,
+                                            StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Build where clause and execute query
+
+    ostringstream whereClause;
+    QueryParameters queryParameters;
+
+    string fromClause(string(" FROM avidb_stations ") + stationTableAlias);
+
+    buildStationQueryWhereClause("UPPER(country_code)",
+                                 countryList,
+                                 "icao_code",
+                                 excludeIcaoFilters,
+                                 queryParameters,
+                                 whereClause);
+
+    if (firIdQuery)
+      executeFIRStationQuery(connection,
+                             selectClause + fromClause + " " + whereClause.str(),
+                             queryParameters,
+                             debug,
+                             stationQueryData);
+    else
+      executePreparedQuery<StationQueryData>(connection,
+                                             selectClause + fromClause + " " + whereClause.str(),
+                                             queryParameters,
+                                             debug,
+                                             stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given places (station names)
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithPlaces(const Fmi::Database::PostgreSQLConnection& connection,
+                                         const StringList& placeNameList,
+                                         const string& selectClause,
+                                         bool debug,
+                                         StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Build where clause and execute query
+
+    ostringstream whereClause;
+    QueryParameters queryParameters;
+
+    buildStationQueryWhereClause(
+        "UPPER(BTRIM(name))", placeNameList, "", {}, queryParameters, whereClause);
+
+    executePreparedQuery<StationQueryData>(connection,
+                                           selectClause + " FROM avidb_stations " +
+                                               whereClause.str(),
+                                           queryParameters,
+                                           debug,
+                                           stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given wkts
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithWKTs(const Fmi::Database::PostgreSQLConnection& connection,
+                                       const LocationOptions& locationOptions,
+                                       const StringList& messageTypes,
+                                       const string& selectClause,
+                                       bool debug,
+                                       StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Route query stations for station scoped message types are selected from station catalog,
+    // if the catalog is available, and are cached. Stations are cached for the route rounded to
+    // the cache precision, and are selected for the rounded route.
+    //
+    // FIR scoped stations depend on the FIR areas too, so they are queried from the database
+    // and not cached
+
+    std::shared_ptr<const StationCatalog> stationCatalog;
+
+    if (locationOptions.itsWKTs.isRoute &&
+        (stationQueryScope(locationOptions, messageTypes, itsConfig->getMessageTypes()) ==
+         MessageScope::StationScope))
+      stationCatalog = getStationCatalog();
+
+    LonLatList route;
+
+    if (stationCatalog && parseRoute(locationOptions.itsWKTs.itsWKTs.front(), route))
+    {
+      string routeKey;
+
+      if (itsRouteCache)
+      {
+        route = itsRouteCache->quantize(route);
+        routeKey =
+            RouteCache::key(route, locationOptions.itsMaxDistance, MessageScope::StationScope);
+
+        auto stationIds = itsRouteCache->find(routeKey, stationCatalog->getVersion());
+
+        if (stationIds)
+        {
+          if (debug)
+            cerr << "Route stations found from route cache\n";
+
+          for (auto stationId : *stationIds)
+          {
+            auto const* station = stationCatalog->getStation(stationId);
+
+            if (station)
+              loadStationCatalogResult(*station, nullptr, stationQueryData);
+          }
+
+          return;
+        }
+      }
+
+      if (debug)
+        cerr << "Querying route stations from station catalog version "
+             << stationCatalog->getVersion() << '\n';
+
+      auto stations = stationCatalog->getStationsWithRoute(route, locationOptions.itsMaxDistance);
+
+      loadStationCatalogResult(stations, stationQueryData);
+
+      if (itsRouteCache)
+      {
+        StationIdList stationIds;
+
+        for (auto const* station : stations)
+          stationIds.push_back(station->itsId);
+
+        itsRouteCache->insert(routeKey, stationCatalog->getVersion(), std::move(stationIds));
+      }
+
+      return;
+    }
+
+    // Build from and where (and order by for route query) clauses and execute query
+
+    ostringstream fromWhereOrderByClause;
+
+    buildStationQueryFromWhereOrderByClause(connection,
+                                            locationOptions,
+                                            messageTypes,
+                                            itsConfig->getMessageTypes(),
+                                            fromWhereOrderByClause);
+
+    // Note: no stations (fromWhereOrderByClause is empty) to restrict messages for route query
+    // for global scoped message types (message time and type restriction is generated later)
+
+    if (!fromWhereOrderByClause.str().empty())
+      executeQuery<StationQueryData>(
+          connection, selectClause + fromWhereOrderByClause.str(), debug, stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations with given bboxes
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::queryStationsWithBBoxes(const Fmi::Database::PostgreSQLConnection& connection,
+                                         const LocationOptions& locationOptions,
+                                         const string& selectClause,
+                                         bool debug,
+                                         StationQueryData& stationQueryData) const
+{
+  try
+  {
+    // Build where clause and execute query
+
+    ostringstream whereClause;
+
+    buildStationQueryWhereClause(
+        locationOptions.itsBBoxes, locationOptions.itsMaxDistance, whereClause);
+
+    executeQuery<StationQueryData>(connection,
+                                   selectClause + " FROM avidb_stations " + whereClause.str(),
+                                   debug,
+                                   stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check time parameter values are valid
+ */
+// ----------------------------------------------------------------------
+
+namespace
+{
+
+Fmi::DateTime parseTime(const string& timeName, const string& timeStr)
+{
+  try
+  {
+    // Expecting "timestamptz '<datetime>'"
+
+    const char* timestamptz = "timestamptz";
+    const char* TIMESTAMPTZ = "TIMESTAMPTZ";
+    const char* c = timeStr.c_str();
+
+    while (*c == ' ')
+    {
+      c++;
+    }
+
+    while (*c && *timestamptz && ((*c == *timestamptz) || (*c == *TIMESTAMPTZ)))
+    {
+      c++;
+      timestamptz++;
+      TIMESTAMPTZ++;
+    }
+
+    if ((!(*timestamptz)) && (*c == ' '))
+    {
+      do
+      {
+        c++;
+      } while (*c == ' ');
+
+      const char* c2 = nullptr;
+      if (*c == '\'')
+        c2 = strchr(c + 1, '\'');
+
+      if ((c2 != nullptr) && (c2 > (c + 1)))
+      {
+        const auto* c3 = c2;
+
+        do
+        {
+          c3++;
+        } while (*c3 == ' ');
+
+        if (!(*c3))
+        {
+          string ts;
+
+          c++;
+          ts.assign(c, c2 - c);
+
+          return Fmi::TimeParser::parse(ts);
+        }
+      }
+    }
+
+    throw Fmi::Exception(
+        BCP, timeName + " \"" + timeStr + "\" is not valid, timestamptz '<datetime>' expected");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace
+
+void EngineImpl::validateTimes(const QueryOptions& queryOptions)
+{
+  try
+  {
+    // Time range or observation time is required, having "timestamptz '<datetime>'" value(s)
+
+    auto const& timeOptions = queryOptions.itsTimeOptions;
+
+    if (timeOptions.itsStartTime.empty() != timeOptions.itsEndTime.empty())
+      throw Fmi::Exception(BCP, "'starttime' and 'endtime' options must be given simultaneously");
+
+    if (!timeOptions.itsStartTime.empty())
+    {
+      if (!timeOptions.itsObservationTime.empty())
+        throw Fmi::Exception(
+            BCP,
+            "Can't specify both time range ('starttime' and 'endtime') and observation time "
+            "('time')");
+
+      auto st = parseTime("starttime", timeOptions.itsStartTime);
+      auto et = parseTime("endtime", timeOptions.itsEndTime);
+
+      if (st > et)
+        throw Fmi::Exception(BCP, "'starttime' must be earlier than 'endtime'");
+    }
+    else if (!timeOptions.itsObservationTime.empty())
+    {
+      auto s = Fmi::ascii_tolower_copy(boost::algorithm::trim_copy(timeOptions.itsObservationTime));
+
+      if (s != "current_timestamp")
+        parseTime("time", timeOptions.itsObservationTime);
+    }
+    else
+      throw Fmi::Exception(BCP, "Query starttime and endtime or observation time must be given");
+
+    if (queryOptions.itsTimeOptions.itsMessageTimeChecks)
+      queryOptions.itsTimeOptions.itsMessageCreatedTime.clear();
+    else
+      queryOptions.itsTimeOptions.itsMessageCreatedTime = "current_timestamp";
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check requested parameters are known
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateParameters(const StringList& paramList,
+                                    Validity validity,
+                                    bool& messageColumnSelected)
+{
+  try
+  {
+    // All parameters must be known but don't have to be selectable (validity controls whether
+    // selecting stations and/or accepted messages or rejected messages). At least one parameter
+    // must be selectable. Duplicates are not allowed.
+    //
+    // 'messageColumnSelected' is set on return if any selectable message column is requested
+    // (the information is used when querying stations)
+
+    if (paramList.empty())
+      throw Fmi::Exception(BCP, "The 'param'option is missing or empty!");
+
+    Columns columns;
+    bool paramKnown = false;
+    bool duplicate = false;
+
+    for (auto const& param : paramList)
+    {
+      QueryTable* queryTables = messageQueryTables;
+      paramKnown = false;
+
+      for (QueryTable* qt = queryTables;;)
+      {
+        const QueryTable& queryTable = *qt;
+
+        if (queryTable.itsName.empty())
+        {
+          if (queryTables == messageQueryTables)
+          {
+            qt = queryTables = rejectedMessageQueryTables;
+            continue;
+          }
+          if (queryTables == rejectedMessageQueryTables)
+          {
+            qt = queryTables = firQueryTables;
+            continue;
+          }
+
+          break;
+        }
+
+        const auto* queryColumn = getQueryColumn(queryTable.itsColumns, columns, param, duplicate);
+
+        if (queryColumn)
+        {
+          columns.emplace_back(*queryColumn);
+          paramKnown = true;
+
+          break;
+        }
+        if (duplicate)
+          throw Fmi::Exception(BCP, "Duplicate 'param' name '" + param + "'");
+
+        qt++;
+      }
+
+      if (!paramKnown)
+        throw Fmi::Exception(BCP, "Unknown 'param' name '" + param + "'");
+    }
+
+    string selectClause;
+    bool distinct = false;
+
+    if ((validity == Validity::Accepted) || (validity == Validity::AcceptedMessages))
+    {
+      // Must have at least 1 station or accepted message column for 'Accepted' and at least 1
+      // message column for 'AcceptedMessages'
+      //
+      buildMessageQuerySelectClause(messageQueryTables,
+                                    StationIdList(),
+                                    StringList(),
+                                    paramList,
+                                    false,
+                                    selectClause,
+                                    messageColumnSelected,
+                                    distinct);
+
+      if ((validity == Validity::AcceptedMessages) && (!messageColumnSelected))
+        selectClause.clear();
+    }
+    else
+    {
+      // Must have at least 1 rejected message column
+      //
+      buildMessageQuerySelectClause(rejectedMessageQueryTables,
+                                    StationIdList(),
+                                    StringList(),
+                                    paramList,
+                                    false,
+                                    selectClause,
+                                    messageColumnSelected,
+                                    distinct);
+    }
+
+    if (selectClause.empty())
+      throw Fmi::Exception(BCP, "No applicable 'param' names given");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given station id's exist
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateStationIds(const Fmi::Database::PostgreSQLConnection& connection,
+                                    const StationIdList& stationIdList,
+                                    bool debug) const
+{
+  try
+  {
+    if (stationIdList.empty())
+      return;
+
+    auto stationCatalog = getStationCatalog();
+
+    if (stationCatalog)
+      return validateStationIds(*stationCatalog, stationIdList);
+
+    ostringstream selectFromWhereClause;
+
+    selectFromWhereClause << "SELECT request_stations.station_id FROM (VALUES ";
+
+    for (size_t n = 1; (n <= stationIdList.size()); n++)
+      selectFromWhereClause << ((n == 1) ? "($" : ",($") << n << ((n == 1) ? "::integer)" : ")");
+
+    selectFromWhereClause << ") AS request_stations (station_id) LEFT JOIN avidb_stations ON "
+                             "request_stations.station_id = avidb_stations.station_id "
+                          << "WHERE avidb_stations.station_id IS NULL LIMIT 1";
+
+    QueryData queryData;
+
+    queryData.itsColumns.emplace_back(ColumnType::Integer, "station_id");
+
+    executeParamQuery<QueryData, StationIdList>(
+        connection, selectFromWhereClause.str(), stationIdList, debug, queryData);
+
+    if (!queryData.itsValues.empty())
+    {
+      const auto* id = std::get_if<int>(&queryData.itsValues["station_id"].front());
+      const int stationId = id ? *id : -1;
+      throw Fmi::Exception(BCP, "Unknown station id " + Fmi::to_string(stationId));
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given icao codes exist
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateIcaos(const Fmi::Database::PostgreSQLConnection& connection,
+                               const StringList& icaoList,
+                               bool debug) const
+{
+  try
+  {
+    if (icaoList.empty())
+      return;
+
+    auto stationCatalog = getStationCatalog();
+
+    if (stationCatalog)
+      return validateIcaos(*stationCatalog, icaoList);
+
+    ostringstream selectFromWhereClause;
+
+    selectFromWhereClause << "SELECT request_icaos.icao_code FROM (VALUES ";
+
+    for (size_t n = 1; (n <= icaoList.size()); n++)
+      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n;
+
+    selectFromWhereClause << ")) AS request_icaos (icao_code) LEFT JOIN avidb_stations ON "
+                             "UPPER(request_icaos.icao_code) = UPPER(avidb_stations.icao_code) "
+                          << "WHERE avidb_stations.icao_code IS NULL LIMIT 1";
+
+    QueryData queryData;
+
+    queryData.itsColumns.emplace_back(ColumnType::String, "icao_code");
+
+    executeParamQuery<QueryData, StringList>(
+        connection, selectFromWhereClause.str(), icaoList, debug, queryData);
+
+    if (!queryData.itsValues.empty())
+    {
+      const auto* ptr = std::get_if<std::string>(&(queryData.itsValues["icao_code"].front()));
+      string icaoCode = ptr ? *ptr : "?";
+      throw Fmi::Exception(BCP, "Unknown icao code " + icaoCode).disableLogging();
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given icao filters
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateIcaoFilters(const LocationOptions& locationOptions)
+{
+  try
+  {
+    auto const& includeIcaoFilters = locationOptions.itsIncludeIcaoFilters;
+    auto const& excludeIcaoFilters = locationOptions.itsExcludeIcaoFilters;
+
+    if (includeIcaoFilters.empty() && excludeIcaoFilters.empty())
+      return;
+
+    if (locationOptions.itsCountries.empty() && locationOptions.itsWKTs.itsWKTs.empty())
+    {
+      // edr sets filters for queries which do not use them; ignore them instead of error
+      //
+      return;
+
+      /*
+      throw Fmi::Exception(
+          BCP, "Icao code filters are applicable with country code and polygon queries only"
+                          ).disableLogging();
+      */
+    }
+
+    for (auto const& filter : includeIcaoFilters)
+      if (filter.empty() || (filter.size() > 4) || strpbrk(filter.c_str(), "%_"))
+        throw Fmi::Exception(BCP, "1-4 letter icao code filter expected, no wildcards: " + filter)
+            .disableLogging();
+
+    for (auto const& filter : excludeIcaoFilters)
+      if (filter.empty() || (filter.size() > 4) || strpbrk(filter.c_str(), "%_"))
+        throw Fmi::Exception(BCP, "1-4 letter icao code filter expected, no wildcards: " + filter)
+            .disableLogging();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given places (station names) exist
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validatePlaces(const Fmi::Database::PostgreSQLConnection& connection,
+                                StringList& placeNameList,
+                                bool debug) const
+{
+  try
+  {
+    if (placeNameList.empty())
+      return;
+
+    // Station catalog compares names in ascii upper case; let database handle others
+
+    auto stationCatalog = getStationCatalog();
+
+    if (stationCatalog && isAscii(placeNameList))
+      return validatePlaces(*stationCatalog, placeNameList);
+
+    ostringstream selectFromWhereClause;
+
+    /* Since non-existing station names has been allowed, just strip them off
+     * instead of throwing an error
+
+    selectFromWhereClause << "SELECT request_stations.name FROM (VALUES ";
+
+    for (size_t n = 1; (n <= placeNameList.size()); n++)
+      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n;
+
+    selectFromWhereClause
+        << ")) AS request_stations (name) LEFT JOIN avidb_stations ON "
+           "UPPER(request_stations.name) = UPPER(BTRIM(avidb_stations.name)) "
+        << "WHERE avidb_stations.name IS NULL LIMIT 1";
+
+    QueryData queryData;
+
+    queryData.itsColumns.push_back(Column(String, "name"));
+
+    executeParamQuery<QueryData, StringList>(
+        connection, selectFromWhereClause.str(), placeNameList, debug, queryData);
+
+    if (!queryData.itsValues.empty())
+    {
+      string stationName(boost::get<std::string>(&(queryData.itsValues["name"].front()))
+                           ? *(boost::get<std::string>(&(queryData.itsValues["name"].front())))
+                           : "?");
+      throw Fmi::Exception(BCP, "Unknown station name " + stationName).disableLogging();
+    }
+    */
+
+    StringList places(placeNameList);
+    placeNameList.clear();
+
+    for (auto const& place : places)
+    {
+      QueryData queryData;
+
+      queryData.itsColumns.emplace_back(ColumnType::String, "name");
+
+      selectFromWhereClause << "SELECT request_stations.name FROM (VALUES ($1)) "
+                            << "AS request_stations (name) LEFT JOIN avidb_stations ON "
+                               "UPPER(request_stations.name) = UPPER(BTRIM(avidb_stations.name)) "
+                            << "WHERE avidb_stations.name IS NULL";
+
+      executeParamQuery<QueryData>(
+          connection, selectFromWhereClause.str(), place, debug, queryData);
+
+      if (queryData.itsValues.empty())
+        placeNameList.push_back(place);
+
+      selectFromWhereClause.str("");
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given country codes exist
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateCountries(const Fmi::Database::PostgreSQLConnection& connection,
+                                   const StringList& countryList,
+                                   bool debug) const
+{
+  try
+  {
+    if (countryList.empty())
+      return;
+
+    auto stationCatalog = getStationCatalog();
+
+    if (stationCatalog)
+      return validateCountries(*stationCatalog, countryList);
+
+    ostringstream selectFromWhereClause;
+
+    selectFromWhereClause << "WITH request_countries AS (SELECT country_code FROM (VALUES ";
+
+    for (size_t n = 1; (n <= countryList.size()); n++)
+      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n;
+
+    selectFromWhereClause
+        << ")) AS request_countries (country_code)) SELECT country_code FROM request_countries "
+        << "WHERE NOT EXISTS (SELECT station_id FROM avidb_stations WHERE "
+           "request_countries.country_code = UPPER(avidb_stations.country_code)) LIMIT 1";
+
+    QueryData queryData;
+
+    queryData.itsColumns.emplace_back(ColumnType::String, "country_code");
+
+    executeParamQuery<QueryData, StringList>(
+        connection, selectFromWhereClause.str(), countryList, debug, queryData);
+
+    if (!queryData.itsValues.empty())
+    {
+      const auto* ptr = std::get_if<std::string>(&(queryData.itsValues["country_code"].front()));
+      string countryCode = ptr ? *ptr : "?";
+      throw Fmi::Exception(BCP, "Unknown country code " + countryCode);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given station id's exist in station catalog
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateStationIds(const StationCatalog& stationCatalog,
+                                    const StationIdList& stationIdList)
+{
+  try
+  {
+    for (auto stationId : stationIdList)
+      if (!stationCatalog.getStation(stationId))
+        throw Fmi::Exception(BCP, "Unknown station id " + Fmi::to_string(stationId));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given icao codes exist in station catalog
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateIcaos(const StationCatalog& stationCatalog, const StringList& icaoList)
+{
+  try
+  {
+    for (auto const& icao : icaoList)
+      if (!stationCatalog.hasIcao(icao))
+        throw Fmi::Exception(BCP, "Unknown icao code " + icao).disableLogging();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Strip off places (station names) not existing in station catalog
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validatePlaces(const StationCatalog& stationCatalog, StringList& placeNameList)
+{
+  try
+  {
+    placeNameList.remove_if([&stationCatalog](const string& place)
+                            { return !stationCatalog.hasPlace(place); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given country codes exist in station catalog
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateCountries(const StationCatalog& stationCatalog,
+                                   const StringList& countryList)
+{
+  try
+  {
+    for (auto const& country : countryList)
+      if (!stationCatalog.hasCountry(country))
+        throw Fmi::Exception(BCP, "Unknown country code " + country);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given wkt's are valid and of supported type.
+ *        Convert POINTs to latlons to support 'max # of nearest station' search.
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateWKTs(const Fmi::Database::PostgreSQLConnection& connection,
+                              LocationOptions& locationOptions,
+                              bool debug) const
+{
+  try
+  {
+    if (locationOptions.itsWKTs.itsWKTs.empty())
+      return;
+
+    // If a single LINESTRING (route) is given, the stations (and their messages) will be ordered by
+    // route segment index and station's distance to the start of the segment. Otherwise icao code
+    // order is used
+
+    size_t wktCnt = locationOptions.itsWKTs.itsWKTs.size();
+
+    bool checkIfRoute =
+        (locationOptions.itsLonLats.empty() && locationOptions.itsStationIds.empty() &&
+         locationOptions.itsIcaos.empty() && locationOptions.itsCountries.empty() &&
+         locationOptions.itsPlaces.empty() && locationOptions.itsBBoxes.empty() && (wktCnt == 1));
+
+    // A plain LINESTRING is valid if it has at least 2 distinct points; no need to ask database
+
+    LonLatList route;
+
+    if (checkIfRoute && parseRoute(locationOptions.itsWKTs.itsWKTs.front(), route) &&
+        (std::find_if(route.begin(),
+                      route.end(),
+                      [&route](const LonLat& lonlat)
+                      {
+                        return ((lonlat.itsLon != route.front().itsLon) ||
+                                (lonlat.itsLat != route.front().itsLat));
+                      }) != route.end()))
+    {
+      locationOptions.itsWKTs.isRoute = true;
+      return;
+    }
+
+    // Get type, validity and index (position in itsWKTs collection), and latitude and longitude of
+    // POINT definitions for the wkt's.
+    // To ease the handling of result rows sort invalid wkts and POINTs to come first.
+
+    ostringstream selectFromWhereClause;
+
+    selectFromWhereClause << "SELECT wkt,geomtype,isvalid,index,"
+                          << "CASE geomtype WHEN 'ST_Point' THEN ST_Y(geom) ELSE 0 END AS lat,"
+                             "CASE geomtype WHEN 'ST_Point' THEN ST_X(geom) ELSE 0 END AS lon "
+                          << "FROM (SELECT wkt,ST_GeomFromText(wkt,4326) AS geom,"
+                             "ST_GeometryType(ST_GeomFromText(wkt,4326)) AS geomtype,"
+                          << "CASE WHEN NOT ST_IsValid(ST_GeomFromText(wkt,4326)) OR "
+                          << "ST_GeometryType(ST_GeomFromText(wkt,4326)) NOT IN "
+                             "('ST_Point','ST_Polygon','ST_LineString') "
+                          << "THEN 0 ELSE 1 END AS isvalid,index FROM (VALUES ";
+
+    for (size_t n = 1; (n <= wktCnt); n++)
+      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n << "," << n - 1;
+
+    selectFromWhereClause
+        << ")) AS request_wkts (wkt,index)) AS wkts ORDER BY isvalid,CASE geomtype "
+           "WHEN 'ST_Point' THEN 0 ELSE 1 END,index";
+
+    QueryData queryData;
+
+    queryData.itsColumns.emplace_back(ColumnType::String, "wkt");
+    queryData.itsColumns.emplace_back(ColumnType::String, "geomtype");
+    queryData.itsColumns.emplace_back(ColumnType::Integer, "isvalid");
+    queryData.itsColumns.emplace_back(ColumnType::Integer, "index");
+    queryData.itsColumns.emplace_back(ColumnType::Double, "lat");
+    queryData.itsColumns.emplace_back(ColumnType::Double, "lon");
+
+    executeParamQuery<QueryData, StringList>(
+        connection, selectFromWhereClause.str(), locationOptions.itsWKTs.itsWKTs, debug, queryData);
+
+    if (queryData.itsValues["wkt"].size() != wktCnt)
+      throw Fmi::Exception(
+          BCP, "validateWKTs: internal: wkt check query did not return as many rows as expected");
+
+    bool isValid = value_or<int>(queryData.itsValues["isvalid"].front(), 0);
+
+    if (!isValid)
+    {
+      auto wkt = value_or<std::string>(queryData.itsValues["wkt"].front(), "?");
+
+      const auto geomType = value_or<std::string>(queryData.itsValues["geomtype"].front(), "?");
+
+      if ((geomType == "ST_Point") || (geomType == "ST_Polygon") || (geomType == "ST_LineString"))
+        throw Fmi::Exception(BCP, "Invalid wkt " + wkt);
+
+      throw Fmi::Exception(
+          BCP, "Unsupported wkt " + wkt + "; use POINT(s), POLYGON(s) or LINESTRING(s)");
+    }
+
+    // Convert POINTs to latlons to support 'max # of nearest station' search
+
+    auto itwkt = locationOptions.itsWKTs.itsWKTs.begin();
+    string geomType;
+
+    for (int wktIndex = 0, dataIndex = 0; (wktCnt > 0); wktCnt--, wktIndex++, dataIndex++)
+    {
+      geomType = value_or<std::string>(queryData.itsValues["geomtype"][dataIndex], "?");
+
+      if (geomType != "ST_Point")
+        break;
+
+      int index = value_or<int>(queryData.itsValues["index"][dataIndex], -1);
+
+      if (index >= 0)
+      {
+        for (; ((wktIndex < index) && (itwkt != locationOptions.itsWKTs.itsWKTs.end())); wktIndex++)
+          itwkt++;
+      }
+
+      if ((index < 0) || (itwkt == locationOptions.itsWKTs.itsWKTs.end()))
+        throw Fmi::Exception(BCP, "validateWKTs: internal: wkt index is invalid");
+
+      auto lat = value_or<double>(queryData.itsValues["lat"][dataIndex], 0);
+      auto lon = value_or<double>(queryData.itsValues["lon"][dataIndex], 0);
+
+      locationOptions.itsLonLats.emplace_back(lon, lat);
+
+      itwkt = locationOptions.itsWKTs.itsWKTs.erase(itwkt);
+    }
+
+    // Set 'route' flag if the one and only wkt is a LINESTRING
+
+    locationOptions.itsWKTs.isRoute = (checkIfRoute && (geomType == "ST_LineString"));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations
+ */
+// ----------------------------------------------------------------------
+//
+// private
+//
+StationQueryData EngineImpl::queryStations(const Fmi::Database::PostgreSQLConnection& connection,
+                                           QueryOptions& queryOptions,
+                                           bool validateQuery) const
+{
+  try
+  {
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::StationQuery);
+
+    // Query stations from station catalog if available and applicable to the location options
+
+    if (stationCatalogCovers(queryOptions))
+    {
+      auto stationCatalog = getStationCatalog();
+
+      if (stationCatalog)
+        return queryStations(*stationCatalog, queryOptions, validateQuery);
+    }
+
+    // Validate requested times, parameters, station id's, icao codes, country codes and wkts
+
+    auto const& paramList = queryOptions.itsParameters;
+    auto& locationOptions = queryOptions.itsLocationOptions;
+
+    if (validateQuery)
+    {
+      QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+
+      validateParameters(paramList, Validity::Accepted, queryOptions.itsMessageColumnSelected);
+
+      if (!locationOptions.itsStationIds.empty())
+        validateStationIds(connection, locationOptions.itsStationIds, queryOptions.itsDebug);
+
+      if (!locationOptions.itsIcaos.empty())
+        validateIcaos(connection, locationOptions.itsIcaos, queryOptions.itsDebug);
+
+      if ((!locationOptions.itsIncludeIcaoFilters.empty()) ||
+          (!locationOptions.itsExcludeIcaoFilters.empty()))
+        validateIcaoFilters(locationOptions);
+
+      if (!locationOptions.itsPlaces.empty())
+        validatePlaces(connection, locationOptions.itsPlaces, queryOptions.itsDebug);
+
+      if (!locationOptions.itsCountries.empty())
+        validateCountries(connection, locationOptions.itsCountries, queryOptions.itsDebug);
+
+      if ((!locationOptions.itsWKTs.itsWKTs.empty()) && (!locationOptions.itsWKTs.isRoute))
+        validateWKTs(connection, locationOptions, queryOptions.itsDebug);
+    }
+
+    // If any message column is requested, select only stationid and additionally distance/bearing
+    // if requested (all other requested station columns except distance/bearing are selected by
+    // message query) and queryOptions.messageColumnSelected is set instructing the caller to call
+    // queryMessages() with the returned station id's
+    //
+    // Build select column expressions
+    //
+    // distance is automatically selected if querying with coordinates and max # of nearest stations
+
+    StationQueryData stationQueryData;
+    bool selectStationListOnly = queryOptions.itsMessageColumnSelected;
+    bool autoSelectDistance =
+        ((!locationOptions.itsLonLats.empty()) && (locationOptions.itsNumberOfNearestStations > 0));
+    bool firIdQuery;
+    string selectClause;
+
+    stationQueryData.itsColumns = buildStationQuerySelectClause(
+        paramList, selectStationListOnly, autoSelectDistance, selectClause, firIdQuery);
+
+    // Query separately with each type of location options, adding the unique results to 'queryData'
+    //
+    // Note: Query with coordinates must be executed first to get distance and bearing values
+
+    if (!locationOptions.itsLonLats.empty())
+      queryStationsWithCoordinates(connection,
+                                   locationOptions,
+                                   queryOptions.itsMessageTypes,
+                                   selectClause,
+                                   queryOptions.itsDebug,
+                                   stationQueryData);
+
+    if (!locationOptions.itsStationIds.empty())
+      queryStationsWithIds(connection,
+                           locationOptions.itsStationIds,
+                           selectClause,
+                           queryOptions.itsDebug,
+                           stationQueryData);
+
+    if (!locationOptions.itsIcaos.empty())
+      queryStationsWithIcaos(connection,
+                             locationOptions.itsIcaos,
+                             selectClause,
+                             firIdQuery,
+                             queryOptions.itsDebug,
+                             stationQueryData);
+
+    if (!locationOptions.itsCountries.empty())
+      queryStationsWithCountries(connection,
+                                 locationOptions.itsCountries,
+                                 locationOptions.itsExcludeIcaoFilters,
+                                 selectClause,
+                                 firIdQuery,
+                                 queryOptions.itsDebug,
+                                 stationQueryData);
+
+    if (!locationOptions.itsPlaces.empty())
+      queryStationsWithPlaces(connection,
+                              locationOptions.itsPlaces,
+                              selectClause,
+                              queryOptions.itsDebug,
+                              stationQueryData);
+
+    if (!locationOptions.itsWKTs.itsWKTs.empty())
+      queryStationsWithWKTs(connection,
+                            locationOptions,
+                            queryOptions.itsMessageTypes,
+                            selectClause,
+                            queryOptions.itsDebug,
+                            stationQueryData);
+
+    if (!locationOptions.itsBBoxes.empty())
+      queryStationsWithBBoxes(
+          connection, locationOptions, selectClause, queryOptions.itsDebug, stationQueryData);
+
+    if (!queryOptions.itsMessageColumnSelected)
+    {
+      // There are no message related columns.
+      //
+      // Sort the columns and erase automatically selected columns (distance) if such exist
+      //
+      if (autoSelectDistance)
+      {
+        sortColumnList(stationQueryData.itsColumns);
+
+        for (auto it = stationQueryData.itsColumns.begin();
+             (it != stationQueryData.itsColumns.end());)
+        {
+          if (it->itsSelection == ColumnSelection::Automatic)
+            it = stationQueryData.itsColumns.erase(it);
+          else
+            it++;
+        }
+      }
+    }
+
+    return stationQueryData;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations from station catalog
+ */
+// ----------------------------------------------------------------------
+//
+// private
+//
+StationQueryData EngineImpl::queryStations(const StationCatalog& stationCatalog,
+                                           QueryOptions& queryOptions,
+                                           bool validateQuery) const
+{
+  try
+  {
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::StationQuery);
+
+    // Validate requested parameters, station id's, icao codes and country codes
+
+    auto const& paramList = queryOptions.itsParameters;
+    auto& locationOptions = queryOptions.itsLocationOptions;
+
+    if (validateQuery)
+    {
+      QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+
+      validateParameters(paramList, Validity::Accepted, queryOptions.itsMessageColumnSelected);
+
+      validateStationIds(stationCatalog, locationOptions.itsStationIds);
+      validateIcaos(stationCatalog, locationOptions.itsIcaos);
+
+      if ((!locationOptions.itsIncludeIcaoFilters.empty()) ||
+          (!locationOptions.itsExcludeIcaoFilters.empty()))
+        validateIcaoFilters(locationOptions);
+
+      validatePlaces(stationCatalog, locationOptions.itsPlaces);
+      validateCountries(stationCatalog, locationOptions.itsCountries);
+    }
+
+    // Select columns as with database query (select clause is not used)
+
+    StationQueryData stationQueryData;
+    bool selectStationListOnly = queryOptions.itsMessageColumnSelected;
+    bool autoSelectDistance =
+        ((!locationOptions.itsLonLats.empty()) && (locationOptions.itsNumberOfNearestStations > 0));
+    bool firIdQuery;
+    string selectClause;
+
+    stationQueryData.itsColumns = buildStationQuerySelectClause(
+        paramList, selectStationListOnly, autoSelectDistance, selectClause, firIdQuery);
+
+    if (queryOptions.itsDebug)
+      cerr << "Querying stations from station catalog version " << stationCatalog.getVersion()
+           << '\n';
+
+    // Add the unique results from each type of location options to 'stationQueryData'
+    //
+    // Note: Stations with coordinates must be loaded first to get distance and bearing values
+
+    if (!locationOptions.itsLonLats.empty())
+    {
+      // Stations having icao code starting with 'IL' are ignored when querying for given max #
+      // of nearest stations if message types were given but AWSMETAR was not included (see
+      // buildStationQueryFromWhereClause())
+
+      auto const& messageTypes = queryOptions.itsMessageTypes;
+      bool excludeILStations =
+          ((locationOptions.itsNumberOfNearestStations > 0) && (!messageTypes.empty()) &&
+           (find(messageTypes.begin(), messageTypes.end(), "AWSMETAR") == messageTypes.end()));
+
+      loadStationCatalogResult(
+          stationCatalog.getStationsWithCoordinates(locationOptions.itsLonLats,
+                                                    locationOptions.itsMaxDistance,
+                                                    locationOptions.itsNumberOfNearestStations,
+                                                    excludeILStations),
+          stationQueryData);
+    }
+
+    if (!locationOptions.itsStationIds.empty())
+      loadStationCatalogResult(stationCatalog.getStations(locationOptions.itsStationIds),
+                               stationQueryData);
+
+    if (!locationOptions.itsIcaos.empty())
+      loadStationCatalogResult(stationCatalog.getStationsWithIcaos(locationOptions.itsIcaos),
+                               stationQueryData);
+
+    if (!locationOptions.itsCountries.empty())
+      loadStationCatalogResult(
+          stationCatalog.getStationsWithCountries(locationOptions.itsCountries,
+                                                  locationOptions.itsExcludeIcaoFilters),
+          stationQueryData);
+
+    if (!locationOptions.itsPlaces.empty())
+      loadStationCatalogResult(stationCatalog.getStationsWithPlaces(locationOptions.itsPlaces),
+                               stationQueryData);
+
+    if (!locationOptions.itsBBoxes.empty())
+      loadStationCatalogResult(stationCatalog.getStationsWithBBoxes(locationOptions.itsBBoxes,
+                                                                    locationOptions.itsMaxDistance),
+                               stationQueryData);
+
+    if ((!queryOptions.itsMessageColumnSelected) && autoSelectDistance)
+    {
+      // Sort the columns and erase automatically selected distance column as with database query
+
+      sortColumnList(stationQueryData.itsColumns);
+
+      for (auto it = stationQueryData.itsColumns.begin();
+           (it != stationQueryData.itsColumns.end());)
+      {
+        if (it->itsSelection == ColumnSelection::Automatic)
+          it = stationQueryData.itsColumns.erase(it);
+        else
+          it++;
+      }
+    }
+
+    return stationQueryData;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    if (queryTables->itsName == messageTableName)
+//
+// public api stub
+//
+StationQueryData EngineImpl::queryStations(QueryOptions& queryOptions) const
+{
+  try
+  {
+    QueryMetrics::Call call(itsQueryMetrics, "queryStations");
+
+    queryOptions.itsLocationOptions.itsWKTs.isRoute = false;
+
+    // No database connection is needed if the stations can be queried from station catalog
+
+    if (stationCatalogCovers(queryOptions))
     {
-      // Because queries like "param=name,messagetype,route" - selecting columns from
-      // avidb_stations, avidb_message_types and avidb_message_routes, but none from
-      // avidb_messages - are allowed, the select for accepted messages is distinct unless at
-      // least one avidb_messages column other than station id is selected
+      auto stationCatalog = getStationCatalog();
+
+      if (stationCatalog)
+        return queryStations(*stationCatalog, queryOptions, true);
+    }
+
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
+
+    return queryStations(connection, queryOptions, true);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check given message types are known
+ */
+// ----------------------------------------------------------------------
+
+void EngineImpl::validateMessageTypes(const Fmi::Database::PostgreSQLConnection& /*connection*/,
+                                      const StringList& messageTypeList,
+                                      bool /*debug*/) const
+{
+  try
+  {
+    if (messageTypeList.empty())
+      return;
+
+    // Checking against configuration (not the database)
+
+    auto const& messageTypeRules = itsConfig->getMessageTypeRules();
+
+    for (auto const& msgType : messageTypeList)
+      if (!messageTypeRules.getMessageType(msgType))
+        throw Fmi::Exception(BCP, "Unknown message type " + msgType);
+
+    /*
+    ostringstream selectFromWhereClause;
+
+    size_t n = 0;
+
+    for (auto const & messageType : messageTypeList) {
+            selectFromWhereClause << ((n == 0) ? "SELECT request_message_types.type FROM (VALUES
+    (quote_literal('" : "')),(quote_literal('") << Fmi::ascii_toupper_copy(messageType);
+            n++;
+    }
+
+    selectFromWhereClause << "'))) AS request_message_types (type) LEFT JOIN avidb_message_types ON
+    BTRIM(request_message_types.type,'''') = UPPER(avidb_message_types.type) "
+                                              << "WHERE avidb_message_types.type IS NULL LIMIT 1";
+
+    QueryData queryData;
+
+    queryData.itsColumns.push_back(Column(String,"type"));
+
+    executeQuery<QueryData>(connection,selectFromWhereClause.str(),debug,queryData);
+
+    if (!queryData.itsValues.empty()) {
+            string msgType(boost::get<std::string>(&(queryData.itsValues["type"].front())) ?
+    *(boost::get<std::string>(&(queryData.itsValues["type"].front()))) : "?");
+            throw Fmi::Exception(BCP,"Unknown message type " + msgType);
+    }
+    */
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get pointer to internal column definition for given
+ *        datetime column in avidb_messages table
+ */
+// ----------------------------------------------------------------------
+
+const Column* EngineImpl::getMessageTableTimeColumn(const string& timeColumn)
+{
+  try
+  {
+    Columns columns;
+    bool duplicate = false;
+
+    const auto* queryColumn = getQueryColumn(messageQueryColumns, columns, timeColumn, duplicate);
+
+    if ((!queryColumn) || (queryColumn->itsType != ColumnType::DateTime))
+      throw Fmi::Exception(
+          BCP, string("Column '") + timeColumn + "' is not a datetime column in message table");
+
+    return queryColumn;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query accepted messages
+ */
+// ----------------------------------------------------------------------
+//
+// private
+//
+template <typename T>
+void EngineImpl::queryMessages(const Fmi::Database::PostgreSQLConnection& connection,
+                               const StationIdList& stationIdList,
+                               const QueryOptions& requestQueryOptions,
+                               bool validateQuery,
+                               T& stationQueryData,
+                               MessagePageToken* pageToken) const
+{
+  try
+  {
+    if (pageToken && (pageToken->itsPageSize == 0))
+      throw Fmi::Exception(BCP, "Page size must be given to query messages by pages");
+
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::MessageQuery);
+
+    // Check # of stations and validate requested parameters and message types
+
+    int maxStations = (requestQueryOptions.itsMaxMessageStations >= 0
+                           ? requestQueryOptions.itsMaxMessageStations
+                           : itsConfig->getMaxMessageStations());
+
+    if ((maxStations > 0) && ((int)stationIdList.size() > maxStations))
+      throw Fmi::Exception(BCP,
+                           string("Max number of stations exceeded (") +
+                               Fmi::to_string(maxStations) + "/" +
+                               Fmi::to_string(stationIdList.size()) + "), limit the query");
+
+    bool messageColumnSelected = requestQueryOptions.itsMessageColumnSelected;
+    const Column* timeRangeColumn = nullptr;
+
+    if (validateQuery)
+    {
+      QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+
+      validateTimes(requestQueryOptions);
+
+      validateParameters(
+          requestQueryOptions.itsParameters, Validity::AcceptedMessages, messageColumnSelected);
+
+      if (!requestQueryOptions.itsMessageTypes.empty())
+        validateMessageTypes(
+            connection, requestQueryOptions.itsMessageTypes, requestQueryOptions.itsDebug);
+    }
+
+    // Times and station id's are passed as query parameters; the query text (template)
+    // then depends only on the query structure and is prepared once per connection
+
+    QueryOptions queryOptions(requestQueryOptions);
+    QueryParameters queryParameters;
+
+    auto& timeOptions = queryOptions.itsTimeOptions;
+    auto timeRangeParameterIndex = queryParameters.size();
+    timeOptions.itsStartTime = queryParameters.addTime(timeOptions.itsStartTime);
+    timeOptions.itsEndTime = queryParameters.addTime(timeOptions.itsEndTime);
+    bool timeRangeParameters = (queryParameters.size() == (timeRangeParameterIndex + 2));
+    timeOptions.itsObservationTime = queryParameters.addTime(timeOptions.itsObservationTime);
+    timeOptions.itsMessageCreatedTime = queryParameters.addTime(timeOptions.itsMessageCreatedTime);
+
+    // If querying messages created within time range, get the column to be used for time
+    // restriction (message_time by default, not settable currently)
+
+    if (queryOptions.itsTimeOptions.itsObservationTime.empty() &&
+        (!queryOptions.itsTimeOptions.itsQueryValidRangeMessages))
+      timeRangeColumn =
+          getMessageTableTimeColumn(queryOptions.itsTimeOptions.getMessageTableTimeRangeColumn());
+
+    // Build select column expressions
+
+    bool routeQuery = queryOptions.itsLocationOptions.itsWKTs.isRoute;
+    bool distinct = queryOptions.itsDistinctMessages;
+    string selectClause;
+
+    TableMap tableMap = buildMessageQuerySelectClause(messageQueryTables,
+                                                      stationIdList,
+                                                      queryOptions.itsMessageTypes,
+                                                      queryOptions.itsParameters,
+                                                      routeQuery,
+                                                      selectClause,
+                                                      messageColumnSelected,
+                                                      distinct);
+
+    // Duplicate messages are skipped by message group (station, message type and message time)
+
+    if (queryOptions.itsDistinctMessages && (!distinct))
+      selectClause += messageGroupKeySelectExpressions();
+
+    // Build column list and sort the columns to the requested order
+
+    stationQueryData.itsColumns.clear();
+
+    for (auto const& table : tableMap)
+    {
+      for (auto const& column : table.second.itsSelectedColumns)
+        stationQueryData.itsColumns.push_back(column);
+    }
+
+    sortColumnList(stationQueryData.itsColumns);
+
+    string withClause;
+
+    if ((!stationIdList.empty()) && queryOptions.itsLocationOptions.itsWKTs.isRoute)
+    {
+      // Build 'request_stations' table ('WITH table AS ...') for input station id's',
+      // containing 'position' column for sorting the stations to route order
       //
-      // No LEFT OUTER joins when querying accepted messages
+      withClause = buildRequestStationsWithClause(queryParameters.add(stationIdList),
+                                                  queryOptions.itsLocationOptions.itsWKTs.isRoute);
+
+      // Add 'request_stations' into tablemap for joining into main query
+
+      auto& table = tableMap[requestStationsTable.itsName];
+      table.itsAlias = requestStationsTable.itsAlias;
+      table.itsJoin = requestStationsTable.itsJoin;
+    }
+
+    // If querying valid messages (in contrast to querying messages created within the given time
+    // range) the query is generated based on 'record_set' CTE using message_time restriction and
+    // thus enabling use of an index. Otherwise an indexed time column
+    // (queryOptions.itsTimeOptions.itsTimeRangeColumn) is expected to be used for 'created within'
+    // query; the query is generated directly against avidb_messages table
+
+    bool filterMETARs = queryOptions.itsFilterMETARs && itsConfig->getFilterFIMETARxxx();
+    bool excludeSPECIs = queryOptions.itsExcludeSPECIs;
+
+    if (!queryOptions.itsTimeOptions.itsObservationTime.empty() ||
+        queryOptions.itsTimeOptions.itsQueryValidRangeMessages)
+    {
+      // Build WITH clause for 'record_set' table containg all valid messages for given time
+      // instant/range.
       //
-      distinct = true;
-      leftOuter = false;
+      // Note: By passing false instead of queryOptions.itsLocationOptions.itsWKTs.isRoute
+      // record_set.station_id is limited by IN (StationIdList) instead by subquery from
+      // request_stations table which makes the query slower (request_stations CTE is generated
+      // only for route query)
+
+      // Latest messages for current time are selected from the latest message cache when
+      // possible; database's current time (read when catching up the cache) is then used as the
+      // observation time for 'record_set'
+
+      string observationTime = queryOptions.itsTimeOptions.itsObservationTime;
+      std::vector<long> latestMessageIds;
+      bool latestMessagesCached = false;
+
+      if (itsLatestMessageCache &&
+          LatestMessageCache::covers(stationIdList, requestQueryOptions, *itsConfig))
+      {
+        Fmi::DateTime currentTime;
+        int timeZoneOffset = 0;
+
+        if (itsLatestMessageCache->catchUp(connection, currentTime, timeZoneOffset))
+        {
+          latestMessageIds = itsLatestMessageCache->getLatestMessageIds(
+              stationIdList, requestQueryOptions, currentTime, timeZoneOffset);
+          observationTime =
+              queryParameters.add(Fmi::to_iso_extended_string(currentTime) + "Z", "timestamptz");
+          latestMessagesCached = true;
+        }
+      }
+
+      // The following pages of a paged query read only the remaining stations' messages
+
+      string recordSetWithClause;
+      const StationIdList recordSetStationIds =
+          (pageToken ? getMessagePageStationIds(stationIdList, queryOptions, *pageToken)
+                     : StationIdList());
+      const StationIdList& recordSetStationIdList =
+          (pageToken ? recordSetStationIds : stationIdList);
+
+      if (queryOptions.itsTimeOptions.itsObservationTime.empty())
+        recordSetWithClause =
+            buildRecordSetWithClause(!queryOptions.itsLocationOptions.itsBBoxes.empty(),
+                                     false /*queryOptions.itsLocationOptions.itsWKTs.isRoute*/,
+                                     recordSetStationIdList,
+                                     queryParameters,
+                                     queryOptions.itsMessageFormat,
+                                     queryOptions.itsMessageTypes,
+                                     itsConfig->getMessageTypeRules(),
+                                     itsConfig->getRecordSetStartTimeOffsetHours(),
+                                     itsConfig->getRecordSetEndTimeOffsetHours(),
+                                     queryOptions.itsTimeOptions.itsStartTime,
+                                     queryOptions.itsTimeOptions.itsEndTime);
+      else
+        recordSetWithClause =
+            buildRecordSetWithClause(!queryOptions.itsLocationOptions.itsBBoxes.empty(),
+                                     false /*queryOptions.itsLocationOptions.itsWKTs.isRoute*/,
+                                     recordSetStationIdList,
+                                     queryParameters,
+                                     queryOptions.itsMessageFormat,
+                                     queryOptions.itsMessageTypes,
+                                     itsConfig->getMessageTypeRules(),
+                                     itsConfig->getRecordSetStartTimeOffsetHours(),
+                                     itsConfig->getRecordSetEndTimeOffsetHours(),
+                                     observationTime);
 
-      for (QueryTable* qt = queryTables;; qt++)
-      {
-        const QueryTable& queryTable = *qt;
+      withClause += ((withClause.empty() ? "WITH " : ",") + recordSetWithClause);
 
-        if (queryTable.itsName.empty())
-          break;
+      // Build WITH clause for 'message_validity' table containing configured message type specific
+      // validity length for message types having MessageValidTimeRange[Latest] or
+      // MessageTimeRange[Latest] restriction
 
-        if (queryTable.itsName == messageTableName)
+      string messageValidityWithClause = buildMessageTypeValidityWithClause(
+          queryOptions.itsMessageTypes, itsConfig->getMessageTypeRules());
+
+      if (!messageValidityWithClause.empty())
+      {
+        withClause += ("," + messageValidityWithClause);
+
+        if (queryOptions.itsTimeOptions.itsObservationTime.empty())
         {
-          auto& table = tableMap[messageTableName];
-          table.itsAlias = queryTable.itsAlias;
-          table.itsJoin = queryTable.itsJoin;
+          // If needed, add 'message_validity' into tablemap for joining into main query
+          // ('latest_messages' and 'messagetimerangelatest_messages' queries join
+          // to it by itself when needed).
+          //
+          list<TimeRangeType> timeRangeTypes;
+          timeRangeTypes.push_back(TimeRangeType::ValidTimeRange);
+          timeRangeTypes.push_back(TimeRangeType::ValidTimeRangeLatest);
+          timeRangeTypes.push_back(TimeRangeType::CreationValidTimeRange);
+          timeRangeTypes.push_back(TimeRangeType::CreationValidTimeRangeLatest);
+          timeRangeTypes.push_back(TimeRangeType::MessageValidTimeRange);
+          timeRangeTypes.push_back(TimeRangeType::MessageValidTimeRangeLatest);
+          timeRangeTypes.push_back(TimeRangeType::MessageTimeRange);
 
-          const auto* queryColumn = getQueryColumn(
-              queryTable.itsColumns, table.itsSelectedColumns, stationIdQueryColumn, duplicate);
+          string noMessageValidityTypesIn = buildMessageTypeInClause(
+              queryOptions.itsMessageTypes, itsConfig->getMessageTypeRules(), timeRangeTypes);
 
-          if (!queryColumn)
-            throw Fmi::Exception(
-                BCP, "buildMessageQuerySelectClause(): internal: Unable to get station id column");
+          if (!noMessageValidityTypesIn.empty())
+          {
+            //
+            // Because 'message_validity' contains data only for message types queried with
+            // MessageValidTimeRange[Latest] or MessageTimeRange[Latest] time restriction,
+            // it needs to be outer joined with avidb_message_types in the main query for querying
+            // message types with other time restriction types
+            //
+            auto& table = tableMap[messageValidityTable.itsName];
+            table.itsAlias = messageValidityTable.itsAlias;
+            table.itsJoin = messageValidityTable.itsJoin;
 
-          Column column(*queryColumn);
-          column.itsSelection = ColumnSelection::Automatic;
-          table.itsSelectedColumns.push_back(column);
+            timeRangeTypes.pop_back();  // Erase MessageTimeRange, MessageValidTimeRangeLatest and
+                                        // MessageValidTimeRange
+            timeRangeTypes.pop_back();  //
+            timeRangeTypes.pop_back();  //
 
-          selectClause = queryTable.itsAlias + "." + queryColumn->itsTableColumnName + " AS " +
-                         queryColumn->itsName;
+            noMessageValidityTypesIn = buildMessageTypeInClause(
+                queryOptions.itsMessageTypes, itsConfig->getMessageTypeRules(), timeRangeTypes);
+
+            table.leftOuter = (!noMessageValidityTypesIn.empty());
+          }
+          else
+          {
+            // Only MessageTimeRangeLatest types queried, no need to add 'message_validity' into the
+            // tablemap
+          }
         }
-        else if ((!routeQuery) && (queryTable.itsName == stationTableName))
-        {
-          auto& table = tableMap[stationTableName];
-          table.itsAlias = queryTable.itsAlias;
-          table.itsJoin = queryTable.itsJoin;
+      }
 
-          const auto* queryColumn = getQueryColumn(
-              queryTable.itsColumns, table.itsSelectedColumns, stationIcaoQueryColumn, duplicate);
+      // If querying with observation time, build WITH clause for 'latest_messages' table containing
+      // message id's for the latest messages.
+      //
+      // Otherwise if querying valid MessageTimeRangeLatest messages, build WITH clause for
+      // 'messagetimerangelatest_messages' table containing message id's for the
+      // latest messages having message_time earlier than range start time in addition to all
+      // messages having starttime <= message_time < endtime
 
-          if (!queryColumn)
-            throw Fmi::Exception(
-                BCP,
-                "buildMessageQuerySelectClause(): internal: Unable to get station icao column");
+      if (!queryOptions.itsTimeOptions.itsObservationTime.empty())
+      {
+        // Build WITH clause for 'latest_messages' table
+        //
+        if (latestMessagesCached)
+          withClause += ("," + buildLatestMessagesWithClause(latestMessageIds, queryParameters));
+        else
+          withClause += ("," + buildLatestMessagesWithClause(
+                                       queryOptions.itsMessageTypes,
+                                       itsConfig->getMessageTypeRules(),
+                                       queryOptions.itsTimeOptions.itsObservationTime,
+                                       queryOptions.itsTimeOptions.itsMessageCreatedTime,
+                                       queryOptions.itsTimeOptions.itsUseCurrentTime,
+                                       filterMETARs,
+                                       excludeSPECIs,
+                                       queryOptions.itsDistinctMessages,
+                                       itsConfig->getFilterFIMETARxxxExcludeIcaos()));
 
-          Column column(*queryColumn);
-          column.itsSelection = ColumnSelection::Automatic;
-          table.itsSelectedColumns.push_back(column);
+        // Add 'latest_messages' into tablemap
+        //
+        // Note: 'latest_messages' is used thru subquery because of poor performance if joined.
 
-          // NOTE: Generate select expression if icao is requested by the caller too. When looping
-          // the parameters below, column's select expression is NOT generated if the column already
-          // exists in column list; it's type just gets changed to AutomaticRequested
+        auto& table = tableMap[latestMessagesTable.itsName];
+        table.itsJoin = latestMessagesTable.itsJoin;
+        table.subQuery = true;
+      }
+      else
+        withClause +=
+            buildMessageTimeRangeMessagesWithClause(queryOptions.itsMessageTypes,
+                                                    itsConfig->getMessageTypeRules(),
+                                                    queryOptions.itsTimeOptions.itsStartTime,
+                                                    queryOptions.itsTimeOptions.itsEndTime,
+                                                    filterMETARs,
+                                                    excludeSPECIs,
+                                                    itsConfig->getFilterFIMETARxxxExcludeIcaos());
 
-          if (find(paramList.begin(), paramList.end(), stationIcaoQueryColumn) != paramList.end())
+      withClause += " ";
+
+      // Replace avidb_messages with record_set in the tablemap; record_set contains all (columns
+      // of) needed avidb_messages rows, and is used instead
+
+      auto it = tableMap.find(messageTableName);
+
+      if (it == tableMap.end())
+        throw Fmi::Exception(BCP, "queryMessages: internal: Unable to get avidb_messages table");
+
+      auto recordSetTable = it->second;
+      tableMap.erase(it);
+
+      tableMap[recordSetTableName] = recordSetTable;
+    }
+    else
+    {
+      if (queryOptions.itsLocationOptions.itsWKTs.isRoute)
+      {
+        withClause += " ";
+
+        if (filterMETARs || excludeSPECIs)
+        {
+          // Ensure station table is joined into main query for METAR filtering or exclusion of
+          // SPECIs (for nonroute query it's joined anyways for ordering the rows by icao code)
+          //
+          string messageTypeIn = buildMessageTypeInClause(
+              queryOptions.itsMessageTypes,
+              itsConfig->getMessageTypeRules(),
+              list<TimeRangeType>());
+
+          if ((filterMETARs && (messageTypeIn.find("'METAR") != string::npos)) ||
+              (excludeSPECIs && (messageTypeIn.find("'SPECI'") != string::npos)))
           {
-            selectClause += (string(selectClause.empty() ? "" : ",") + queryTable.itsAlias + "." +
-                             queryColumn->itsTableColumnName + " AS " + queryColumn->itsName);
-            icaoSelected = true;
+            auto& table = tableMap[stationTableName];
+
+            if (table.itsAlias.empty())
+              table.itsAlias = stationTableAlias;
+
+            if (table.itsJoin.empty())
+              table.itsJoin = stationTableJoin;
           }
         }
       }
+
+      // Filter by message format
+
+      auto& table = tableMap[messageFormatTableName];
+      table.itsAlias = messageFormatTableAlias;
+      table.itsJoin = queryOptions.itsMessageFormat == "TAC" ? messageFormatTableJoinTAC
+                                                             : messageFormatTableJoinIWXXM;
     }
 
-    for (auto const& param : paramList)
+    // For time range query ensure tablemap contains message_types table for joining into main
+    // query; needed for message type or type specific time range restriction
+
+    if (queryOptions.itsTimeOptions.itsObservationTime.empty())
     {
-      for (QueryTable* qt = queryTables;; qt++)
+      auto& table = tableMap[messageTypeTableName];
+
+      if (table.itsAlias.empty())
+        table.itsAlias = messageTypeTableAlias;
+
+      if (table.itsJoin.empty())
+        table.itsJoin = messageTypeTableJoin;
+    }
+
+    // Max row count for the query; if exceeded, an error is thrown; if <= 0, unlimited.
+    //
+    // The query is limited to max row count + 1 rows unless the result is streamed; streamed
+    // rows are counted while fetched
+
+    int maxMessageRows = (queryOptions.itsMaxMessageRows >= 0 ? queryOptions.itsMaxMessageRows
+                                                              : itsConfig->getMaxMessageRows());
+    bool streamed = std::is_same<T, MessageStream>::value;
+
+    if constexpr (std::is_same<T, StationQueryData>::value)
+    {
+      if (pageToken)
       {
-        const QueryTable& queryTable = *qt;
+        // Pages are continued by message id which is not selected by distinct query
+
+        if (distinct)
+          throw Fmi::Exception(BCP, "Message columns must be selected to query messages by pages");
+
+        queryMessagePage(connection,
+                         stationIdList,
+                         queryOptions,
+                         tableMap,
+                         withClause,
+                         selectClause,
+                         queryParameters,
+                         timeRangeColumn,
+                         *pageToken,
+                         stationQueryData);
+        return;
+      }
 
-        if (queryTable.itsName.empty())
-          break;
+      // Long valid messages time range query is split into time chunks queried concurrently
 
-        auto& table = tableMap[queryTable.itsName];
-        const auto* queryColumn = getQueryColumn(
-            queryTable.itsColumns, table.itsSelectedColumns, param, duplicate, columnNumber);
+      if (timeRangeParameters && (!distinct))
+      {
+        auto timeChunks = getMessageQueryTimeChunks(requestQueryOptions);
 
-        if (queryColumn)
+        if (timeChunks.size() > 1)
         {
-          if (table.itsAlias.empty())
-            table.itsAlias = queryTable.itsAlias;
-
-          if (table.itsJoin.empty())
-            table.itsJoin = queryTable.itsJoin;
+          queryMessageTimeChunks(connection,
+                                 stationIdList,
+                                 queryOptions,
+                                 tableMap,
+                                 withClause,
+                                 selectClause,
+                                 queryParameters,
+                                 timeRangeColumn,
+                                 timeRangeParameterIndex,
+                                 timeChunks,
+                                 maxMessageRows,
+                                 stationQueryData);
+          return;
+        }
+      }
+    }
 
-          table.leftOuter = leftOuter;
+    // Build from, where and order by clause (by avidb_stations.icao_code or by route segment index
+    // and station's distance to the start of the segment) and execute query
 
-          if (queryColumn->itsExpression)
-          {
-            selectClause +=
-                (string(selectClause.empty() ? "" : ",") +
-                 queryColumn->itsExpression(queryColumn->itsTableColumnName, queryColumn->itsName));
-          }
-          else if (queryColumn->itsCoordinateExpression)
-          {
-            // Select NULL for distance and bearing columns; they will be set after the query by
-            // searching from station data
-            //
-            selectClause += (string(selectClause.empty() ? "" : ",") + nullExpression(queryColumn));
-          }
-          else
-          {
-            selectClause += (string(selectClause.empty() ? "" : ",") + queryTable.itsAlias + "." +
-                             queryColumn->itsTableColumnName);
+    ostringstream fromWhereOrderByClause;
 
-            if (queryColumn->itsType == ColumnType::DateTime)
-              selectClause += string(" AT TIME ZONE 'UTC'");
+    buildMessageQueryFromWhereOrderByClause(streamed ? 0 : maxMessageRows,
+                                            stationIdList,
+                                            queryParameters,
+                                            queryOptions,
+                                            tableMap,
+                                            *itsConfig,
+                                            timeRangeColumn,
+                                            distinct,
+                                            "",
+                                            fromWhereOrderByClause);
 
-            if ((queryColumn->itsType == ColumnType::DateTime) ||
-                (queryColumn->itsName != queryColumn->itsTableColumnName))
-              selectClause += (string(" AS ") + queryColumn->itsName);
-          }
+    executePreparedQuery(connection,
+                         withClause + selectClause + fromWhereOrderByClause.str(),
+                         queryParameters,
+                         queryOptions.itsDebug,
+                         stationQueryData,
+                         queryOptions.itsDistinctMessages,
+                         maxMessageRows);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-          if ((queryTable.itsName != stationTableName) && (queryTable.itsName != firTableName))
-          {
-            if (queryTable.itsName == messageTableName)
-            {
-              distinct = false;
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query a page of accepted messages
+ *
+ * The messages are ordered by (station order column,station_id,
+ * [type_id,message_time,]message_id) like when querying all messages; the
+ * page starts after the key of the last message of the previous page stored
+ * in the token. The record_set of the following pages is limited to the
+ * stations not yet completed (see getMessagePageStationIds()). Since a
+ * message group's messages are contiguous, duplicate messages of the last
+ * group of the previous page are skipped using the message hashes stored in
+ * the token. The token is updated for the next page
+ */
+// ----------------------------------------------------------------------
 
-              if (distinctMessages && (queryColumn->itsName == messageQueryColumn))
-                // Clear flag forcing automatic 'message' column selection
-                //
-                distinctMessages = false;
-              else
-                checkDuplicateMessages = true;
-            }
+void EngineImpl::queryMessagePage(const Fmi::Database::PostgreSQLConnection& connection,
+                                  const StationIdList& stationIdList,
+                                  const QueryOptions& queryOptions,
+                                  const TableMap& tableMap,
+                                  const string& withClause,
+                                  const string& selectClause,
+                                  QueryParameters& queryParameters,
+                                  const Column* timeRangeColumn,
+                                  MessagePageToken& pageToken,
+                                  StationQueryData& queryData) const
+{
+  try
+  {
+    // Select the key columns for the next page token and add the key restriction; the key
+    // values are passed as query parameters
 
-            messageColumnSelected = true;
-          }
+    const string stationKeyColumn = messageQueryStationOrderColumn(stationIdList, queryOptions);
+    const string stationIdColumn = string(messageTableAlias) + "." + messageStationIdTableColumn;
+    const string messageIdColumn = string(messageTableAlias) + "." + messageIdTableColumn;
+    bool routeQuery = queryOptions.itsLocationOptions.itsWKTs.isRoute;
 
-          table.itsSelectedColumns.push_back(*queryColumn);
-          table.itsSelectedColumns.back().itsNumber = columnNumber;
+    string pageSelectClause =
+        selectClause + messageOrderKeySelectExpressions(stationIdList, queryOptions);
 
-          break;
-        }
+    string pageKeyCondition;
+    MessageRowFilter rowFilter;
 
-        if (duplicate)
-          // Automatically selected column is selected by the caller too
-          break;
-      }
+    if (pageToken.itsMessageId != 0)
+    {
+      // Message type and time are part of the key when querying distinct messages (see
+      // buildMessageQueryFromWhereOrderByClause())
 
-      columnNumber++;
-    }
+      string groupColumns;
+      string groupValues;
 
-    if (distinctMessages && checkDuplicateMessages)
-    {
-      // 'message' column was not selected by the caller; select it to skip duplicates
-      //
-      auto& table = tableMap[messageTableName];
-      const auto* queryColumn = getQueryColumn(
-          messageQueryColumns, table.itsSelectedColumns, messageQueryColumn, duplicate);
+      if (queryOptions.itsDistinctMessages)
+      {
+        groupColumns = string(",") + messageTableAlias + ".type_id," + messageTableAlias +
+                       ".message_time";
+        groupValues = "," + queryParameters.add(Fmi::to_string(pageToken.itsTypeId), "integer") +
+                      ",timestamptz 'epoch' + " +
+                      queryParameters.add(Fmi::to_string(pageToken.itsMessageTime), "bigint") +
+                      " * interval '1 microsecond'";
 
-      if (!queryColumn)
-        throw Fmi::Exception(
-            BCP, "buildMessageQuerySelectClause(): internal: Unable to get message column");
+        rowFilter.setGroup(pageToken.itsStationId, pageToken.itsTypeId, pageToken.itsMessageTime);
 
-      Column column(*queryColumn);
-      column.itsSelection = ColumnSelection::Automatic;
-      table.itsSelectedColumns.push_back(column);
+        for (auto hash : pageToken.itsMessageHashes)
+          rowFilter.itsMessages.push_back(MessageRowFilter::Message{hash, nullptr, 0});
+      }
 
-      selectClause += (string(",") + messageTableAlias + "." + queryColumn->itsTableColumnName +
-                       " AS " + queryColumn->itsName);
+      pageKeyCondition =
+          "(" + stationKeyColumn + "," + stationIdColumn + groupColumns + "," + messageIdColumn +
+          ") > (" + queryParameters.add(pageToken.itsStationKey, routeQuery ? "bigint" : "text") +
+          "," + queryParameters.add(Fmi::to_string(pageToken.itsStationId), "integer") +
+          groupValues + "," +
+          queryParameters.add(Fmi::to_string(pageToken.itsMessageId), "bigint") + ")";
     }
 
-    // SELECT [DISTINCT] ...
-    //
-    // Note: "for SELECT DISTINCT, ORDER BY expressions must appear in select list"; ensure
-    // avidb_stations is joined and icao is selected for non route query, or select 'position'
-    // column for route query
+    // The page is limited to page size rows; if less rows are returned, it is the last page
 
-    selectClause = (distinct ? "SELECT DISTINCT " : "SELECT ") + selectClause;
+    ostringstream fromWhereOrderByClause;
 
-    if ((!routeQuery) && distinct && (!icaoSelected))
-    {
-      auto& table = tableMap[stationTableName];
+    buildMessageQueryFromWhereOrderByClause(0,
+                                            stationIdList,
+                                            queryParameters,
+                                            queryOptions,
+                                            tableMap,
+                                            *itsConfig,
+                                            timeRangeColumn,
+                                            false,
+                                            pageKeyCondition,
+                                            fromWhereOrderByClause);
 
-      if (table.itsAlias.empty())
-        table.itsAlias = stationTableAlias;
+    fromWhereOrderByClause << " LIMIT " << pageToken.itsPageSize;
 
-      if (table.itsJoin.empty())
-        table.itsJoin = stationTableJoin;
+    const string query = withClause + pageSelectClause + fromWhereOrderByClause.str();
 
-      selectClause += (string(",") + stationTableAlias + "." + stationIcaoTableColumn);
+    if (queryOptions.itsDebug)
+    {
+      cerr << "Query: " << query << '\n';
+
+      size_t n = 1;
+
+      for (auto const& value : queryParameters.getValues())
+        cerr << "  $" << n++ << " = " << value << '\n';
     }
-    else if (routeQuery && distinct && (!stationIdList.empty()))
-      selectClause +=
-          (string(",") + requestStationsTableAlias + "." + requestStationsPositionColumn);
 
-    // Ensure 'avidb_message_types' table is joined into the query if restricting query with given
-    // message types
+    auto result = executePrepared(connection, query, queryParameters);
 
-    if (messageColumnSelected && (!messageTypeList.empty()))
-    {
-      auto& table = tableMap[messageTypeTableName];
+    loadQueryResult(
+        result, queryOptions.itsDebug, queryData, queryOptions.itsDistinctMessages, 0, &rowFilter);
 
-      if (table.itsAlias.empty())
-        table.itsAlias = messageTypeTableAlias;
+    size_t rows = result.size();
+    pageToken.itsLastPage = (rows < pageToken.itsPageSize);
 
-      if (table.itsJoin.empty())
-        table.itsJoin = messageTypeTableJoin;
+    if (rows > 0)
+    {
+      const auto& lastRow = result[rows - 1];
 
-      table.leftOuter = false;
-    }
+      pageToken.itsStationKey =
+          lastRow[result.column_number(messageOrderKeyQueryColumn)].as<string>();
+      pageToken.itsStationId =
+          lastRow[result.column_number(stationIdQueryColumn)].as<StationIdType>();
+      pageToken.itsMessageId =
+          lastRow[result.column_number(messageOrderIdQueryColumn)].as<std::int64_t>();
+      pageToken.itsMessageHashes.clear();
 
-    return tableMap;
+      if (queryOptions.itsDistinctMessages)
+      {
+        pageToken.itsTypeId =
+            lastRow[result.column_number(messageGroupTypeIdQueryColumn)].as<int>();
+        pageToken.itsMessageTime =
+            lastRow[result.column_number(messageGroupTimeQueryColumn)].as<std::int64_t>();
+
+        // The filter has the last row's group unless duplicate messages are not checked
+
+        if ((rowFilter.itsStationId == pageToken.itsStationId) &&
+            (rowFilter.itsTypeId == pageToken.itsTypeId) &&
+            (rowFilter.itsMessageTime == pageToken.itsMessageTime))
+          for (auto const& message : rowFilter.itsMessages)
+            pageToken.itsMessageHashes.push_back(message.itsHash);
+      }
+    }
   }
   catch (...)
   {
@@ -3035,162 +6895,58 @@ TableMap EngineImpl::buildMessageQuerySelectClause(QueryTable* queryTables,
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Load query result into given data object
+ * \brief Get the stations not yet completed by the previous pages
+ *
+ * Stations ordered before the last station of the previous page have no
+ * more messages to return; they are left out of the page's record_set so
+ * that each page reads only the remaining stations' messages for the time
+ * range. Route stations are given in route order; icao codes of the stations
+ * are taken from the station catalog. If the order of the stations is not
+ * known, all stations are returned
  */
 // ----------------------------------------------------------------------
 
-template <typename T>
-void EngineImpl::loadQueryResult(
-    const pqxx::result& result, bool debug, T& queryData, bool distinctRows, int maxRows) const
+StationIdList EngineImpl::getMessagePageStationIds(const StationIdList& stationIdList,
+                                                   const QueryOptions& queryOptions,
+                                                   const MessagePageToken& pageToken) const
 {
   try
   {
-    if (debug)
-      cerr << "Rows: " << result.size() << '\n';
-
-    if ((maxRows > 0) && ((int)result.size() > maxRows))
-      throw Fmi::Exception(
-          BCP,
-          string("Max number of rows exceeded (") + Fmi::to_string(maxRows) + "), limit the query");
+    if ((pageToken.itsMessageId == 0) || stationIdList.empty())
+      return stationIdList;
 
-    bool checkDuplicateMessages =
-        (distinctRows &&
-         (find(queryData.itsColumns.begin(), queryData.itsColumns.end(), messageQueryColumn) !=
-          queryData.itsColumns.end()));
-    bool duplicate;
+    StationIdList stationIds;
 
-    for (pqxx::result::const_iterator row = result.begin(), prevRow = result.begin();
-         (row != result.end());
-         row++)
+    if (queryOptions.itsLocationOptions.itsWKTs.isRoute)
     {
-      QueryValues& queryValues =
-          queryData.getValues(row, checkDuplicateMessages ? prevRow : row, duplicate);
-
-      if (duplicate && distinctRows)
-        // Station or message was already selected
-        //
-        continue;
-
-      prevRow = row;
+      // Position of the last station on the route
 
-      // Dereference the iterator to a row before indexing by column: libpqxx 8 no longer lets a
-      // result iterator be indexed as a row.
-      const auto& dbRow = *row;
-
-      for (const Column& column : queryData.itsColumns)
-      {
-        // For station data (stations and accepted messages) automatically selected station id is
-        // stored as a map key; it is not stored as a column if it was not requested.
-        //
-        // Also distance is selected automatically for stations to apply max # of nearest stations,
-        // and icao is automatically added to the column list to generate station table join to
-        // order the messages by icao code
-        //
-        if (column.itsSelection == ColumnSelection::Automatic)
-          // Column was not requested by the caller, skip it
-          //
-          continue;
-
-        if (column.itsType == ColumnType::Integer)
-        {
-          // Currently can't handle NULLs properly, but by setting kFloatMissing for NULL,
-          // TableFeeder (used by avi plugin) produces 'missing' (by default, 'nan') column value.
-          //
-          // Solution is poor, numeric column value 32700 cannot be returned by avi plugin
-          // (in practice through, only stationid or messageid could have value 32700).
-          //
-          TimeSeries::Value return_value = TimeSeries::None();
-          if (!dbRow[column.itsName].is_null())
-            return_value = dbRow[column.itsName].as<int>();
-
-          queryValues[column.itsName].push_back(return_value);
-        }
-        else if (column.itsType == ColumnType::Double)
-        {
-          // Note: try/catch; With station query distance and bearing are available only when
-          // querying stations with coordinates; for other station queries distance and bearing
-          // are not selected at all
-          //
-          TimeSeries::Value return_value = TimeSeries::None();
-          try
-          {
-            if (!dbRow[column.itsName].is_null())
-              return_value = dbRow[column.itsName].as<double>();
-          }
-          catch (...)
-          {
-            return_value = TimeSeries::None();
-          }
-
-          queryValues[column.itsName].push_back(return_value);
-        }
-        else if (column.itsType == ColumnType::String)
-        {
-          bool isNull;
+      auto position = Fmi::stol(pageToken.itsStationKey);
+      long n = 0;
 
-          try
-          {
-            isNull = dbRow[column.itsName].is_null();
-          }
-          catch (...)
-          {
-            isNull = true;
-          }
+      for (auto stationId : stationIdList)
+        if (n++ >= position)
+          stationIds.push_back(stationId);
 
-          if (isNull)
-            queryValues[column.itsName].emplace_back(TimeSeries::None());
-          else
-            queryValues[column.itsName].emplace_back(
-                boost::algorithm::trim_copy(dbRow[column.itsName].as<string>()));
-        }
-        else if ((column.itsType == ColumnType::TS_LonLat) ||
-                 (column.itsType == ColumnType::TS_LatLon))
-        {
-          // 'latlon' and 'lonlat' are selected as comma separated strings. Return them as
-          // TimeSeries::LonLat for formatted output with TableFeeder
-          //
-          TimeSeries::LonLat lonlat(0, 0);
-          string llStr(boost::algorithm::trim_copy(dbRow[column.itsName].as<string>()));
-          vector<string> flds;
-          boost::algorithm::split(flds, llStr, boost::is_any_of(","));
-          bool lonlatValid = false;
+      return stationIds;
+    }
 
-          if (flds.size() == 2)
-          {
-            string& lon = ((column.itsName == stationLonLatQueryColumn) ? flds[0] : flds[1]);
-            string& lat = ((column.itsName == stationLonLatQueryColumn) ? flds[1] : flds[0]);
+    auto stationCatalog = getStationCatalog();
 
-            boost::algorithm::trim(lon);
-            boost::algorithm::trim(lat);
+    if (!stationCatalog)
+      return stationIdList;
 
-            try
-            {
-              lonlat.lon = Fmi::stod(lon);
-              lonlat.lat = Fmi::stod(lat);
-              lonlatValid = true;
-            }
-            catch (...)
-            {
-            }
-          }
+    auto lastKey = std::make_pair(pageToken.itsStationKey, pageToken.itsStationId);
 
-          if (!lonlatValid)
-            throw Fmi::Exception(
-                BCP, string("Query returned invalid ") + column.itsName + " value '" + llStr + "'");
+    for (auto stationId : stationIdList)
+    {
+      auto station = stationCatalog->getStation(stationId);
 
-          queryValues[column.itsName].emplace_back(lonlat);
-        }
-        else
-        {
-          Fmi::LocalDateTime utcTime(
-              dbRow[column.itsName].is_null()
-                  ? Fmi::DateTime()
-                  : Fmi::DateTime::from_string(dbRow[column.itsName].as<string>()),
-              tzUTC);
-          queryValues[column.itsName].emplace_back(utcTime);
-        }
-      }
+      if ((!station) || (std::make_pair(station->itsIcao, stationId) >= lastKey))
+        stationIds.push_back(stationId);
     }
+
+    return stationIds;
   }
   catch (...)
   {
@@ -3200,26 +6956,63 @@ void EngineImpl::loadQueryResult(
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Execute query and load the result into given data object
+ * \brief Get time chunks for querying valid messages for long time range
+ *
+ * The range is split at multiples of configured chunk length (from epoch).
+ * Returns no chunks if the query is not split
  */
 // ----------------------------------------------------------------------
 
-template <typename T>
-void EngineImpl::executeQuery(const Fmi::Database::PostgreSQLConnection& connection,
-                              const string& query,
-                              bool debug,
-                              T& queryData,
-                              bool distinctRows,
-                              int maxRows) const
+EngineImpl::TimeChunks EngineImpl::getMessageQueryTimeChunks(const QueryOptions& queryOptions) const
 {
   try
   {
-    if (debug)
-      cerr << "Query: " << query << '\n';
+    TimeChunks timeChunks;
 
-    auto result = connection.executeNonTransaction(query);
+    auto chunkHours = itsConfig->getHistoryChunkHours();
+    auto const& timeOptions = queryOptions.itsTimeOptions;
 
-    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
+    if ((chunkHours == 0) || timeOptions.itsStartTime.empty() ||
+        (!timeOptions.itsObservationTime.empty()) || (!timeOptions.itsQueryValidRangeMessages))
+      return timeChunks;
+
+    // Message types having 'latest' time range restriction are queried for the latest message(s)
+    // within the whole range; the query can't be split
+
+    list<TimeRangeType> latestTimeRangeTypes{TimeRangeType::ValidTimeRangeLatest,
+                                             TimeRangeType::MessageValidTimeRangeLatest,
+                                             TimeRangeType::MessageTimeRangeLatest,
+                                             TimeRangeType::CreationValidTimeRangeLatest};
+
+    if (!buildMessageTypeInClause(
+             queryOptions.itsMessageTypes, itsConfig->getMessageTypeRules(), latestTimeRangeTypes)
+             .empty())
+      return timeChunks;
+
+    auto startTime = parseTime("starttime", timeOptions.itsStartTime);
+    auto endTime = parseTime("endtime", timeOptions.itsEndTime);
+    auto chunkLength = Fmi::Hours(chunkHours);
+
+    if ((endTime - startTime) <= chunkLength)
+      return timeChunks;
+
+    // The first chunk ends at the first chunk boundary after the start time
+
+    static const Fmi::DateTime epoch(Fmi::Date(1970, 1, 1));
+
+    long hours = (startTime - epoch).hours();
+    auto chunkEndTime = epoch + Fmi::Hours(((hours / chunkHours) + 1) * chunkHours);
+
+    while (startTime < endTime)
+    {
+      auto chunkStartTime = startTime;
+      startTime = std::min(chunkEndTime, endTime);
+
+      timeChunks.emplace_back(chunkStartTime, startTime);
+      chunkEndTime = chunkEndTime + chunkLength;
+    }
+
+    return timeChunks;
   }
   catch (...)
   {
@@ -3229,51 +7022,249 @@ void EngineImpl::executeQuery(const Fmi::Database::PostgreSQLConnection& connect
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Execute parametrized query and load query result into given data object
+ * \brief Query valid messages for time range in time chunks
+ *
+ * The chunks are queried concurrently with the same query (template) by
+ * changing the time range parameter values, using the given connection and
+ * additional pooled connections. Each chunk query's record_set covers its
+ * own time offset window; messages valid within multiple chunks are
+ * returned by each of them, and are merged as one. The rows are merged
+ * to the order of unsplit query
  */
 // ----------------------------------------------------------------------
 
-template <typename T>
-void EngineImpl::executeParamQuery(const Fmi::Database::PostgreSQLConnection& connection,
-                                   const string& query,
-                                   const string& queryArg,
-                                   bool debug,
-                                   T& queryData,
-                                   bool distinctRows,
-                                   int maxRows) const
+void EngineImpl::queryMessageTimeChunks(const Fmi::Database::PostgreSQLConnection& connection,
+                                        const StationIdList& stationIdList,
+                                        const QueryOptions& queryOptions,
+                                        const TableMap& tableMap,
+                                        const string& withClause,
+                                        const string& selectClause,
+                                        QueryParameters& queryParameters,
+                                        const Column* timeRangeColumn,
+                                        std::size_t timeRangeParameterIndex,
+                                        const TimeChunks& timeChunks,
+                                        int maxMessageRows,
+                                        StationQueryData& queryData) const
 {
   try
   {
-    if (debug)
+    // Select the order key columns for merging the chunks
+
+    ostringstream fromWhereOrderByClause;
+
+    buildMessageQueryFromWhereOrderByClause(maxMessageRows,
+                                            stationIdList,
+                                            queryParameters,
+                                            queryOptions,
+                                            tableMap,
+                                            *itsConfig,
+                                            timeRangeColumn,
+                                            false,
+                                            "",
+                                            fromWhereOrderByClause);
+
+    const string query = withClause + selectClause +
+                         messageOrderKeySelectExpressions(stationIdList, queryOptions) +
+                         fromWhereOrderByClause.str();
+
+    if (queryOptions.itsDebug)
+    {
       cerr << "Query: " << query << '\n';
 
-    auto result = connection.exec_params(query, queryArg);
+      size_t n = 1;
+
+      for (auto const& value : queryParameters.getValues())
+        cerr << "  $" << n++ << " = " << value << '\n';
+
+      cerr << "Time chunks: " << timeChunks.size() << '\n';
+    }
+
+    // Chunks are taken in order by the querying threads; if a query fails, the remaining
+    // chunks are skipped
+
+    std::vector<pqxx::result> chunkResults(timeChunks.size());
+    std::atomic<std::size_t> nextChunk(0);
+
+    auto queryChunks = [this, &query, &queryParameters, timeRangeParameterIndex, &timeChunks,
+                        maxMessageRows, &chunkResults, &nextChunk](
+                           const Fmi::Database::PostgreSQLConnection& chunkConnection)
+    {
+      try
+      {
+        for (auto chunk = nextChunk++; (chunk < timeChunks.size()); chunk = nextChunk++)
+        {
+          QueryParameters chunkParameters(queryParameters);
+
+          chunkParameters.set(timeRangeParameterIndex,
+                              Fmi::to_iso_extended_string(timeChunks[chunk].first) + "Z");
+          chunkParameters.set(timeRangeParameterIndex + 1,
+                              Fmi::to_iso_extended_string(timeChunks[chunk].second) + "Z");
+
+          chunkResults[chunk] = executePrepared(chunkConnection, query, chunkParameters);
+
+          if ((maxMessageRows > 0) && ((int)chunkResults[chunk].size() > maxMessageRows))
+            throw Fmi::Exception(BCP,
+                                 string("Max number of rows exceeded (") +
+                                     Fmi::to_string(maxMessageRows) + "), limit the query");
+        }
+      }
+      catch (...)
+      {
+        nextChunk = timeChunks.size();
+        throw;
+      }
+    };
+
+    // Number of concurrent queries is limited by configured max number of chunk connections,
+    // and to half of the connection pool size. Additional connections are taken only if they are
+    // free right now; waiting for a connection while holding one could deadlock concurrent
+    // queries. The caller's connection queries the chunks not taken by the others
+
+    auto* call = QueryMetrics::currentCall();
+    auto* callTimer = QueryMetrics::currentTimer();
+    auto maxThreads = std::min(itsConfig->getHistoryChunkConnections(),
+                               std::max(1U, itsConfig->getMaxConnections() / 2));
+    auto threads = std::min<std::size_t>(timeChunks.size(), maxThreads);
+    list<std::future<void>> chunkQueries;
+
+    for (std::size_t n = 1; (n < threads); n++)
+    {
+      std::shared_ptr<PooledConnection> chunkConnectionPtr = tryGetConnection();
+
+      if (!chunkConnectionPtr)
+        break;
+
+      chunkQueries.push_back(std::async(std::launch::async,
+                                        [call, callTimer, chunkConnectionPtr, &queryChunks]()
+                                        {
+                                          QueryMetrics::CallScope callScope(call, callTimer);
+
+                                          queryChunks(*chunkConnectionPtr->get());
+                                        }));
+    }
+
+    // Wait for all chunks to complete; the first error is thrown
+
+    std::exception_ptr chunkError;
+
+    try
+    {
+      queryChunks(connection);
+    }
+    catch (...)
+    {
+      chunkError = std::current_exception();
+    }
+
+    for (auto& chunkQuery : chunkQueries)
+    {
+      try
+      {
+        chunkQuery.get();
+      }
+      catch (...)
+      {
+        if (!chunkError)
+          chunkError = std::current_exception();
+      }
+    }
+
+    if (chunkError)
+      std::rethrow_exception(chunkError);
+
+    // Merge the rows to the order of the unsplit query (by icao code or route position, station
+    // id, [message type and message time,] message id), skipping the copies of the messages
+    // returned by multiple chunks
+
+    struct ChunkRow
+    {
+      long long itsPosition;
+      string itsIcao;
+      StationIdType itsStationId;
+      int itsTypeId;
+      std::int64_t itsMessageTime;
+      std::int64_t itsMessageId;
+      pqxx::result::const_iterator itsRow;
+    };
+
+    bool routeQuery = queryOptions.itsLocationOptions.itsWKTs.isRoute;
+    bool groupMessages = queryOptions.itsDistinctMessages;
+    const pqxx::result* columnResult = nullptr;
+    std::vector<ChunkRow> chunkRows;
+
+    for (auto const& result : chunkResults)
+    {
+      if (result.empty())
+        continue;
+
+      int keyColumn = result.column_number(messageOrderKeyQueryColumn);
+      int stationIdColumn = result.column_number(stationIdQueryColumn);
+      int typeIdColumn = (groupMessages ? result.column_number(messageGroupTypeIdQueryColumn) : -1);
+      int messageTimeColumn =
+          (groupMessages ? result.column_number(messageGroupTimeQueryColumn) : -1);
+      int messageIdColumn = result.column_number(messageOrderIdQueryColumn);
+
+      for (auto row = result.begin(); (row != result.end()); row++)
+      {
+        const auto& dbRow = *row;
+
+        chunkRows.push_back(
+            ChunkRow{routeQuery ? dbRow[keyColumn].as<long long>() : 0,
+                     routeQuery ? "" : dbRow[keyColumn].as<string>(),
+                     dbRow[stationIdColumn].as<StationIdType>(),
+                     groupMessages ? dbRow[typeIdColumn].as<int>() : 0,
+                     groupMessages ? dbRow[messageTimeColumn].as<std::int64_t>() : 0,
+                     dbRow[messageIdColumn].as<std::int64_t>(),
+                     row});
+      }
+
+      columnResult = &result;
+    }
+
+    auto rowKey = [](const ChunkRow& row)
+    {
+      return std::tie(row.itsPosition,
+                      row.itsIcao,
+                      row.itsStationId,
+                      row.itsTypeId,
+                      row.itsMessageTime,
+                      row.itsMessageId);
+    };
 
-    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
+    std::sort(chunkRows.begin(),
+              chunkRows.end(),
+              [&rowKey](const ChunkRow& row1, const ChunkRow& row2)
+              { return (rowKey(row1) < rowKey(row2)); });
 
-template <typename T, typename T2>
-void EngineImpl::executeParamQuery(const Fmi::Database::PostgreSQLConnection& connection,
-                                   const string& query,
-                                   const T2& queryArgs,
-                                   bool debug,
-                                   T& queryData,
-                                   bool distinctRows,
-                                   int maxRows) const
-{
-  try
-  {
-    if (debug)
-      cerr << "Query: " << query << '\n';
+    chunkRows.erase(std::unique(chunkRows.begin(),
+                                chunkRows.end(),
+                                [&rowKey](const ChunkRow& row1, const ChunkRow& row2)
+                                { return (rowKey(row1) == rowKey(row2)); }),
+                    chunkRows.end());
 
-    auto result = connection.exec_params_p(query, queryArgs);
+    if (queryOptions.itsDebug)
+      cerr << "Rows: " << chunkRows.size() << '\n';
 
-    loadQueryResult(result, debug, queryData, distinctRows, maxRows);
+    if ((maxMessageRows > 0) && ((int)chunkRows.size() > maxMessageRows))
+      throw Fmi::Exception(BCP,
+                           string("Max number of rows exceeded (") +
+                               Fmi::to_string(maxMessageRows) + "), limit the query");
+
+    if (!columnResult)
+      return;
+
+    std::vector<pqxx::result::const_iterator> resultRows;
+    resultRows.reserve(chunkRows.size());
+
+    for (auto const& chunkRow : chunkRows)
+      resultRows.push_back(chunkRow.itsRow);
+
+    loadResultRows(*columnResult,
+                   resultRows.cbegin(),
+                   resultRows.cend(),
+                   queryData,
+                   queryOptions.itsDistinctMessages,
+                   nullptr);
   }
   catch (...)
   {
@@ -3283,83 +7274,119 @@ void EngineImpl::executeParamQuery(const Fmi::Database::PostgreSQLConnection& co
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations with given coordinates
+ * \brief Get cached query result, wait for identical in-flight query or
+ *        execute the query
+ *
+ * If modifiedOptions is given, the query options as modified by the query
+ * are shared/cached with the result and returned to the caller
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::queryStationsWithCoordinates(const Fmi::Database::PostgreSQLConnection& connection,
-                                              const LocationOptions& locationOptions,
-                                              const StringList& messageTypes,
-                                              const string& selectClause,
-                                              bool debug,
-                                              StationQueryData& stationQueryData) const
+template <typename Query>
+StationQueryData EngineImpl::queryCachedResult(const char* method,
+                                               const StationIdList* stationIdList,
+                                               const QueryOptions& queryOptions,
+                                               QueryOptions* modifiedOptions,
+                                               Query query) const
 {
   try
   {
-    // Build select expressions for coordinate dependent derived columns
+    bool coalesceQueries = itsConfig->getCoalesceQueries();
 
-    string derivedColumnSelectExpressions =
-        buildStationQueryCoordinateExpressions(stationQueryData.itsColumns);
+    if (((!itsQueryResultCache) && (!coalesceQueries)) || queryOptions.itsDebug)
+      return query();
 
-    // Build from and where clause
+    // The key is built after validating the times, since the validation sets the message
+    // creation time the query (and whether it depends on current time) depends on
 
-    ostringstream fromWhereClause;
+    {
+      QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+      validateTimes(queryOptions);
+    }
 
-    buildStationQueryFromWhereClause(locationOptions, messageTypes, fromWhereClause);
+    // Identical concurrent queries are coalesced; the key is built from the query options
+    // the generated sql and its bound parameters depend on. Time bucket is used only if caching
 
-    // Add 'SELECT FROM (...)' query level(s) to apply DISTINCT ON (station_id) and max # of nearest
-    // stations
+    auto currentTime = std::chrono::duration_cast<std::chrono::seconds>(
+                           std::chrono::system_clock::now().time_since_epoch())
+                           .count();
+    auto timeBucket = itsConfig->getResultCacheTimeBucket();
 
-    ostringstream selectFromClause;
+    auto key = QueryResultCache::key(
+        method, stationIdList, queryOptions, itsQueryResultCache ? (currentTime / timeBucket) : 0);
 
-    selectFromClause << "SELECT DISTINCT ON (" + string(stationIdQueryColumn) + ") * FROM (";
-    fromWhereClause << ") AS stations";
+    QueryResultCache::ResultPtr result;
 
-    if (locationOptions.itsNumberOfNearestStations > 0)
+    if (itsQueryResultCache)
     {
-      selectFromClause << "SELECT *,RANK() OVER (PARTITION BY " << stationCoordinateColumn
-                       << " ORDER BY " << stationDistanceQueryColumn << ") AS rank FROM (";
-      fromWhereClause << ") AS stations WHERE rank <= " << fixed
-                      << locationOptions.itsNumberOfNearestStations;
+      result = itsQueryResultCache->find(key);
+
+      if (result)
+      {
+        if (modifiedOptions)
+          *modifiedOptions = result->itsQueryOptions;
+
+        return result->itsData;
+      }
     }
 
-    // Execute query
+    // Expiration time is set before the query; the result can't be newer than the query
 
-    const string query = selectFromClause.str() + selectClause + derivedColumnSelectExpressions +
-                         ",coordinates." + stationCoordinateColumn + " " + fromWhereClause.str();
+    std::uint64_t generation = 0;
+    StringList messageTypes(queryOptions.itsMessageTypes);
+    auto expirationTime = QueryResultCache::Clock::now();
 
-    executeQuery<StationQueryData>(connection, query, debug, stationQueryData);
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
+    if (itsQueryResultCache)
+    {
+      generation = itsQueryResultCache->getGeneration();
+      auto timeToLive = resultCacheTimeToLive(messageTypes);
 
-// ----------------------------------------------------------------------
-/*!
- * \brief Query stations with given station id's
- */
-// ----------------------------------------------------------------------
+      if (QueryResultCache::isCurrentTimeQuery(queryOptions))
+        timeToLive = std::min<long>(timeToLive, timeBucket - (currentTime % timeBucket));
 
-void EngineImpl::queryStationsWithIds(const Fmi::Database::PostgreSQLConnection& connection,
-                                      const StationIdList& stationIdList,
-                                      const string& selectClause,
-                                      bool debug,
-                                      StationQueryData& stationQueryData) const
-{
-  try
-  {
-    // Build where clause and execute query
+      expirationTime += std::chrono::seconds(timeToLive);
+    }
 
-    ostringstream whereClause;
+    // The result executed by this caller is kept modifiable; if it is neither cached nor shared
+    // with coalesced callers, the data is moved out instead of copying it
 
-    buildStationQueryWhereClause(stationIdList, whereClause);
+    std::shared_ptr<QueryResultCache::Result> executedResult;
 
-    executeQuery<StationQueryData>(connection,
-                                   selectClause + " FROM avidb_stations " + whereClause.str(),
-                                   debug,
-                                   stationQueryData);
+    auto executeQuery = [&query, &queryOptions, modifiedOptions, &executedResult]()
+    {
+      executedResult = std::make_shared<QueryResultCache::Result>();
+      executedResult->itsData = query();
+      executedResult->itsQueryOptions = (modifiedOptions ? *modifiedOptions : queryOptions);
+
+      return QueryResultCache::ResultPtr(executedResult);
+    };
+
+    bool executed = true;
+    bool shared = false;
+
+    if (coalesceQueries)
+      result = itsInFlightQueries.execute(key, executeQuery, executed, shared);
+    else
+      result = executeQuery();
+
+    if (!executed)
+    {
+      if (modifiedOptions)
+        *modifiedOptions = result->itsQueryOptions;
+
+      return result->itsData;
+    }
+
+    if (itsQueryResultCache &&
+        itsQueryResultCache->insert(key, messageTypes, expirationTime, result, generation))
+      shared = true;
+
+    if (shared)
+      return result->itsData;
+
+    result.reset();
+
+    return std::move(executedResult->itsData);
   }
   catch (...)
   {
@@ -3369,35 +7396,53 @@ void EngineImpl::queryStationsWithIds(const Fmi::Database::PostgreSQLConnection&
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations with given icao codes
+ * \brief Get time to live (seconds) for cached result of given message
+ *        types
+ *
+ * The smallest 'validityhours' of the message types is used; if any of the
+ * types (or all types) is queried without validity hours, configured ttl
+ * is used as the upper limit
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::queryStationsWithIcaos(const Fmi::Database::PostgreSQLConnection& connection,
-                                        const StringList& icaoList,
-                                        const string& selectClause,
-                                        bool firIdQuery,
-                                        bool debug,
-                                        StationQueryData& stationQueryData) const
+long EngineImpl::resultCacheTimeToLive(const StringList& messageTypes) const
 {
   try
   {
-    // Build where clause and execute query
+    long defaultTimeToLive = itsConfig->getResultCacheTTL();
+    long timeToLive = 0;
+    bool useDefault = messageTypes.empty();
 
-    ostringstream whereClause;
+    for (auto const& messageType : messageTypes)
+    {
+      auto type = Fmi::ascii_toupper_copy(messageType);
+      bool hasValidityHours = false;
 
-    string fromClause(string(" FROM avidb_stations ") + stationTableAlias);
+      for (auto const& configType : itsConfig->getMessageTypes())
+      {
+        auto const& names = configType.getMessageTypes();
 
-    buildStationQueryWhereClause(connection, "UPPER(icao_code)", icaoList, "", {}, whereClause);
+        if ((!configType.hasValidityHours()) ||
+            (find(names.begin(), names.end(), type) == names.end()))
+          continue;
 
-    if (firIdQuery)
-    {
-      fromClause += (string(",") + firTableName + " AS " + firTableAlias);
-      whereClause << " AND " << firTableJoin;
+        long validitySeconds = configType.getValidityHours() * 3600L;
+
+        if ((timeToLive == 0) || (validitySeconds < timeToLive))
+          timeToLive = validitySeconds;
+
+        hasValidityHours = true;
+        break;
+      }
+
+      if (!hasValidityHours)
+        useDefault = true;
     }
 
-    executeQuery<StationQueryData>(
-        connection, selectClause + fromClause + " " + whereClause.str(), debug, stationQueryData);
+    if (timeToLive == 0)
+      return defaultTimeToLive;
+
+    return (useDefault ? std::min(timeToLive, defaultTimeToLive) : timeToLive);
   }
   catch (...)
   {
@@ -3405,43 +7450,32 @@ void EngineImpl::queryStationsWithIcaos(const Fmi::Database::PostgreSQLConnectio
   }
 }
 
-// ----------------------------------------------------------------------
-/*!
- * \brief Query stations with given country codes
- */
-// ----------------------------------------------------------------------
-
-void EngineImpl::queryStationsWithCountries(const Fmi::Database::PostgreSQLConnection& connection,
-                                            const StringList& countryList,
-                                            const StringList& excludeIcaoFilters,
-                                            const string& selectClause,
-                                            bool firIdQuery,
-                                            bool debug,
-                                            StationQueryData& stationQueryData) const
+//
+// public api stub
+//
+StationQueryData EngineImpl::queryMessages(const StationIdList& stationIdList,
+                                           const QueryOptions& queryOptions) const
 {
   try
   {
-    // Build where clause and execute query
-
-    ostringstream whereClause;
+    QueryMetrics::Call call(itsQueryMetrics, "queryMessages", queryOptions.itsMessageTypes);
 
-    string fromClause(string(" FROM avidb_stations ") + stationTableAlias);
+    return queryCachedResult("queryMessages",
+                             &stationIdList,
+                             queryOptions,
+                             nullptr,
+                             [this, &stationIdList, &queryOptions]()
+                             {
+                               auto connectionPtr = getConnection();
+                               auto& connection = *connectionPtr.get();
 
-    buildStationQueryWhereClause(connection,
-                                 "UPPER(country_code)",
-                                 countryList,
-                                 "icao_code",
-                                 excludeIcaoFilters,
-                                 whereClause);
+                               StationQueryData stationQueryData;
 
-    if (firIdQuery)
-    {
-      fromClause += (string(",") + firTableName + " AS " + firTableAlias);
-      whereClause << " AND " << firTableJoin;
-    }
+                               queryMessages(
+                                   connection, stationIdList, queryOptions, true, stationQueryData);
 
-    executeQuery<StationQueryData>(
-        connection, selectClause + fromClause + " " + whereClause.str(), debug, stationQueryData);
+                               return stationQueryData;
+                             });
   }
   catch (...)
   {
@@ -3451,29 +7485,26 @@ void EngineImpl::queryStationsWithCountries(const Fmi::Database::PostgreSQLConne
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations with given places (station names)
+ * \brief Query a page of accepted messages
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::queryStationsWithPlaces(const Fmi::Database::PostgreSQLConnection& connection,
-                                         const StringList& placeNameList,
-                                         const string& selectClause,
-                                         bool debug,
-                                         StationQueryData& stationQueryData) const
+StationQueryData EngineImpl::queryMessages(const StationIdList& stationIdList,
+                                           const QueryOptions& queryOptions,
+                                           MessagePageToken& pageToken) const
 {
   try
   {
-    // Build where clause and execute query
+    QueryMetrics::Call call(itsQueryMetrics, "queryMessagePage", queryOptions.itsMessageTypes);
 
-    ostringstream whereClause;
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-    buildStationQueryWhereClause(
-        connection, "UPPER(BTRIM(name))", placeNameList, "", {}, whereClause);
+    StationQueryData stationQueryData;
 
-    executeQuery<StationQueryData>(connection,
-                                   selectClause + " FROM avidb_stations " + whereClause.str(),
-                                   debug,
-                                   stationQueryData);
+    queryMessages(connection, stationIdList, queryOptions, true, stationQueryData, &pageToken);
+
+    return stationQueryData;
   }
   catch (...)
   {
@@ -3483,35 +7514,25 @@ void EngineImpl::queryStationsWithPlaces(const Fmi::Database::PostgreSQLConnecti
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations with given wkts
+ * \brief Query accepted messages into columnar data object
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::queryStationsWithWKTs(const Fmi::Database::PostgreSQLConnection& connection,
-                                       const LocationOptions& locationOptions,
-                                       const StringList& messageTypes,
-                                       const string& selectClause,
-                                       bool debug,
-                                       StationQueryData& stationQueryData) const
+StationQueryTable EngineImpl::queryMessageTable(const StationIdList& stationIdList,
+                                                const QueryOptions& queryOptions) const
 {
   try
   {
-    // Build from and where (and order by for route query) clauses and execute query
+    QueryMetrics::Call call(itsQueryMetrics, "queryMessageTable", queryOptions.itsMessageTypes);
 
-    ostringstream fromWhereOrderByClause;
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-    buildStationQueryFromWhereOrderByClause(connection,
-                                            locationOptions,
-                                            messageTypes,
-                                            itsConfig->getMessageTypes(),
-                                            fromWhereOrderByClause);
+    StationQueryTable stationQueryTable;
 
-    // Note: no stations (fromWhereOrderByClause is empty) to restrict messages for route query
-    // for global scoped message types (message time and type restriction is generated later)
+    queryMessages(connection, stationIdList, queryOptions, true, stationQueryTable);
 
-    if (!fromWhereOrderByClause.str().empty())
-      executeQuery<StationQueryData>(
-          connection, selectClause + fromWhereOrderByClause.str(), debug, stationQueryData);
+    return stationQueryTable;
   }
   catch (...)
   {
@@ -3521,29 +7542,25 @@ void EngineImpl::queryStationsWithWKTs(const Fmi::Database::PostgreSQLConnection
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations with given bboxes
+ * \brief Query accepted messages and pass them to given callback in
+ *        columnar batches
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::queryStationsWithBBoxes(const Fmi::Database::PostgreSQLConnection& connection,
-                                         const LocationOptions& locationOptions,
-                                         const string& selectClause,
-                                         bool debug,
-                                         StationQueryData& stationQueryData) const
+void EngineImpl::streamMessages(const StationIdList& stationIdList,
+                                const QueryOptions& queryOptions,
+                                const MessageBatchCallback& callback) const
 {
   try
   {
-    // Build where clause and execute query
+    QueryMetrics::Call call(itsQueryMetrics, "streamMessages", queryOptions.itsMessageTypes);
 
-    ostringstream whereClause;
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-    buildStationQueryWhereClause(
-        locationOptions.itsBBoxes, locationOptions.itsMaxDistance, whereClause);
+    MessageStream messageStream{Columns(), callback};
 
-    executeQuery<StationQueryData>(connection,
-                                   selectClause + " FROM avidb_stations " + whereClause.str(),
-                                   debug,
-                                   stationQueryData);
+    queryMessages(connection, stationIdList, queryOptions, true, messageStream);
   }
   catch (...)
   {
@@ -3553,69 +7570,80 @@ void EngineImpl::queryStationsWithBBoxes(const Fmi::Database::PostgreSQLConnecti
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Check time parameter values are valid
+ * \brief Join station data to another by station id
  */
 // ----------------------------------------------------------------------
 
-namespace
-{
-
-Fmi::DateTime parseTime(const string& timeName, const string& timeStr)
+StationQueryData& EngineImpl::joinStationAndMessageData(const StationQueryData& stationData,
+                                                        StationQueryData& messageData) const
 {
   try
   {
-    // Expecting "timestamptz '<datetime>'"
-
-    const char* timestamptz = "timestamptz";
-    const char* TIMESTAMPTZ = "TIMESTAMPTZ";
-    const char* c = timeStr.c_str();
-
-    while (*c == ' ')
-    {
-      c++;
-    }
+    QueryMetrics::Call call(itsQueryMetrics, "joinStationAndMessageData");
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::Join);
 
-    while (*c && *timestamptz && ((*c == *timestamptz) || (*c == *TIMESTAMPTZ)))
-    {
-      c++;
-      timestamptz++;
-      TIMESTAMPTZ++;
-    }
+    // If distance or bearing is available, copy the values from station data to message data
 
-    if ((!(*timestamptz)) && (*c == ' '))
-    {
-      do
-      {
-        c++;
-      } while (*c == ' ');
+    bool hasDistance = ((find(stationData.itsColumns.begin(),
+                              stationData.itsColumns.end(),
+                              stationDistanceQueryColumn) != stationData.itsColumns.end()) &&
+                        (find(messageData.itsColumns.begin(),
+                              messageData.itsColumns.end(),
+                              stationDistanceQueryColumn) != messageData.itsColumns.end()));
+    bool hasBearing = ((find(stationData.itsColumns.begin(),
+                             stationData.itsColumns.end(),
+                             stationBearingQueryColumn) != stationData.itsColumns.end()) &&
+                       (find(messageData.itsColumns.begin(),
+                             messageData.itsColumns.end(),
+                             stationBearingQueryColumn) != messageData.itsColumns.end()));
 
-      const char* c2 = nullptr;
-      if (*c == '\'')
-        c2 = strchr(c + 1, '\'');
+    if (hasDistance || hasBearing)
+    {
+      for (auto const& station : stationData.itsValues)
+        // Ignore stations having no messages.
+        //
+        // Note: The input data's have station id as a map key. If the 'station' data contains
+        // distance and/or bearing, copy the values to 'message' data
+        //
+        if (messageData.itsValues.find(station.first) != messageData.itsValues.end())
+        {
+          if (hasDistance)
+          {
+            // Copy nonnull distance value to all message rows for the station
+            //
+            auto const& distanceValue =
+                station.second.find(stationDistanceQueryColumn)->second.front();
 
-      if ((c2 != nullptr) && (c2 > (c + 1)))
-      {
-        const auto* c3 = c2;
+            const double* distancePtr = std::get_if<double>(&distanceValue);
+            if (distancePtr)
+            {
+              auto stationDistance = *distancePtr;
 
-        do
-        {
-          c3++;
-        } while (*c3 == ' ');
+              for (auto& distance :
+                   messageData.itsValues[station.first][stationDistanceQueryColumn])
+                distance = stationDistance;
+            }
+          }
 
-        if (!(*c3))
-        {
-          string ts;
+          if (hasBearing)
+          {
+            // Copy bearing value to all message rows for the station
+            //
+            auto const& bearingValue =
+                station.second.find(stationBearingQueryColumn)->second.front();
 
-          c++;
-          ts.assign(c, c2 - c);
+            if (const double* bearingPtr = std::get_if<double>(&bearingValue))
+            {
+              auto stationBearing = *bearingPtr;
 
-          return Fmi::TimeParser::parse(ts);
+              for (auto& bearing : messageData.itsValues[station.first][stationBearingQueryColumn])
+                bearing = stationBearing;
+            }
+          }
         }
-      }
     }
 
-    throw Fmi::Exception(
-        BCP, timeName + " \"" + timeStr + "\" is not valid, timestamptz '<datetime>' expected");
+    return messageData;
   }
   catch (...)
   {
@@ -3623,47 +7651,34 @@ Fmi::DateTime parseTime(const string& timeName, const string& timeStr)
   }
 }
 
-}  // namespace
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations and/or accepted messages.
+ *
+ *        This method serves for convenience, by executing station and message queries
+ *        and joining the data.
+ */
+// ----------------------------------------------------------------------
 
-void EngineImpl::validateTimes(const QueryOptions& queryOptions)
+StationQueryData EngineImpl::queryStationsAndMessages(QueryOptions& queryOptions) const
 {
   try
   {
-    // Time range or observation time is required, having "timestamptz '<datetime>'" value(s)
-
-    auto const& timeOptions = queryOptions.itsTimeOptions;
-
-    if (timeOptions.itsStartTime.empty() != timeOptions.itsEndTime.empty())
-      throw Fmi::Exception(BCP, "'starttime' and 'endtime' options must be given simultaneously");
-
-    if (!timeOptions.itsStartTime.empty())
-    {
-      if (!timeOptions.itsObservationTime.empty())
-        throw Fmi::Exception(
-            BCP,
-            "Can't specify both time range ('starttime' and 'endtime') and observation time "
-            "('time')");
-
-      auto st = parseTime("starttime", timeOptions.itsStartTime);
-      auto et = parseTime("endtime", timeOptions.itsEndTime);
-
-      if (st > et)
-        throw Fmi::Exception(BCP, "'starttime' must be earlier than 'endtime'");
-    }
-    else if (!timeOptions.itsObservationTime.empty())
-    {
-      auto s = Fmi::ascii_tolower_copy(boost::algorithm::trim_copy(timeOptions.itsObservationTime));
+    if (queryOptions.itsValidity == Validity::Rejected)
+      throw Fmi::Exception(
+          BCP,
+          "queryStationsAndMessages() can't be used to query rejected messages; use "
+          "queryRejectedMessages() instead");
 
-      if (s != "current_timestamp")
-        parseTime("time", timeOptions.itsObservationTime);
-    }
-    else
-      throw Fmi::Exception(BCP, "Query starttime and endtime or observation time must be given");
+    QueryMetrics::Call call(
+        itsQueryMetrics, "queryStationsAndMessages", queryOptions.itsMessageTypes);
 
-    if (queryOptions.itsTimeOptions.itsMessageTimeChecks)
-      queryOptions.itsTimeOptions.itsMessageCreatedTime.clear();
-    else
-      queryOptions.itsTimeOptions.itsMessageCreatedTime = "current_timestamp";
+    return queryCachedResult("queryStationsAndMessages",
+                             nullptr,
+                             queryOptions,
+                             &queryOptions,
+                             [this, &queryOptions]()
+                             { return queryDatabaseStationsAndMessages(queryOptions); });
   }
   catch (...)
   {
@@ -3673,202 +7688,244 @@ void EngineImpl::validateTimes(const QueryOptions& queryOptions)
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Check requested parameters are known
+ * \brief Query stations and/or accepted messages from database
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::validateParameters(const StringList& paramList,
-                                    Validity validity,
-                                    bool& messageColumnSelected)
+StationQueryData EngineImpl::queryDatabaseStationsAndMessages(QueryOptions& queryOptions) const
 {
   try
   {
-    // All parameters must be known but don't have to be selectable (validity controls whether
-    // selecting stations and/or accepted messages or rejected messages). At least one parameter
-    // must be selectable. Duplicates are not allowed.
-    //
-    // 'messageColumnSelected' is set on return if any selectable message column is requested
-    // (the information is used when querying stations)
-
-    if (paramList.empty())
-      throw Fmi::Exception(BCP, "The 'param'option is missing or empty!");
+    auto* call = QueryMetrics::currentCall();
+    auto* callTimer = QueryMetrics::currentTimer();
 
-    Columns columns;
-    bool paramKnown = false;
-    bool duplicate = false;
-
-    for (auto const& param : paramList)
     {
-      QueryTable* queryTables = messageQueryTables;
-      paramKnown = false;
+      QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+      validateTimes(queryOptions);
+    }
 
-      for (QueryTable* qt = queryTables;;)
-      {
-        const QueryTable& queryTable = *qt;
+    // Query station scoped, FIR scped and global scoped stations and messages.
+    //
+    // If route query (single linestring wkt) is requested, query each scope separately;
+    // otherwise fetch all messages (message types) with single query
 
-        if (queryTable.itsName.empty())
-        {
-          if (queryTables == messageQueryTables)
-          {
-            qt = queryTables = rejectedMessageQueryTables;
-            continue;
-          }
-          if (queryTables == rejectedMessageQueryTables)
-          {
-            qt = queryTables = firQueryTables;
-            continue;
-          }
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-          break;
-        }
+    StringList queryMessageTypes(queryOptions.itsMessageTypes.begin(),
+                                 queryOptions.itsMessageTypes.end());
 
-        const auto* queryColumn = getQueryColumn(queryTable.itsColumns, columns, param, duplicate);
+    struct ScopeData
+    {
+      MessageScope scope;
+      StationQueryData stationData;
+      StationQueryData messageData;
+      bool hasData = false;
+    };
 
-        if (queryColumn)
-        {
-          columns.emplace_back(*queryColumn);
-          paramKnown = true;
+    MessageScope stationOrAll = MessageScope::NoScope;
 
-          break;
-        }
-        if (duplicate)
-          throw Fmi::Exception(BCP, "Duplicate 'param' name '" + param + "'");
+    if (!queryOptions.itsLocationOptions.itsWKTs.itsWKTs.empty())
+    {
+      // Check for route query; whether to use scoped queries or single query for all message types
 
-        qt++;
+      {
+        QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+        validateWKTs(connection, queryOptions.itsLocationOptions, queryOptions.itsDebug);
       }
 
-      if (!paramKnown)
-        throw Fmi::Exception(BCP, "Unknown 'param' name '" + param + "'");
+      if (queryOptions.itsLocationOptions.itsWKTs.isRoute)
+        stationOrAll = MessageScope::StationScope;
     }
 
-    string selectClause;
-    bool distinct = false;
+    // Validate all requested message types (without taking scope into account)
 
-    if ((validity == Validity::Accepted) || (validity == Validity::AcceptedMessages))
     {
-      // Must have at least 1 station or accepted message column for 'Accepted' and at least 1
-      // message column for 'AcceptedMessages'
-      //
-      buildMessageQuerySelectClause(messageQueryTables,
-                                    StationIdList(),
-                                    StringList(),
-                                    paramList,
-                                    false,
-                                    selectClause,
-                                    messageColumnSelected,
-                                    distinct);
-
-      if ((validity == Validity::AcceptedMessages) && (!messageColumnSelected))
-        selectClause.clear();
+      QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
+      validateMessageTypes(connection, queryMessageTypes, queryOptions.itsDebug);
     }
-    else
+
+    list<ScopeData> scopeDatas;
+    scopeDatas.push_back(ScopeData{stationOrAll});
+
+    if (stationOrAll != MessageScope::NoScope)
     {
-      // Must have at least 1 rejected message column
-      //
-      buildMessageQuerySelectClause(rejectedMessageQueryTables,
-                                    StationIdList(),
-                                    StringList(),
-                                    paramList,
-                                    false,
-                                    selectClause,
-                                    messageColumnSelected,
-                                    distinct);
+      scopeDatas.push_back(ScopeData{MessageScope::FIRScope});
+      scopeDatas.push_back(ScopeData{MessageScope::GlobalScope});
     }
 
-    if (selectClause.empty())
-      throw Fmi::Exception(BCP, "No applicable 'param' names given");
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
+    if ((scopeDatas.size() > 1) && itsConfig->getParallelScopeQueries())
+    {
+      // Query the scopes concurrently using separate copies of query options; since the query
+      // options are validated by each scope, the options of the first queried scope are
+      // returned to the caller
 
-// ----------------------------------------------------------------------
-/*!
- * \brief Check given station id's exist
- */
-// ----------------------------------------------------------------------
+      list<QueryOptions> scopeOptions;
+      list<std::future<void>> scopeQueries;
+      QueryOptions* validatedOptions = nullptr;
 
-void EngineImpl::validateStationIds(const Fmi::Database::PostgreSQLConnection& connection,
-                                    const StationIdList& stationIdList,
-                                    bool debug) const
-{
-  try
-  {
-    if (stationIdList.empty())
-      return;
+      for (auto& scope : scopeDatas)
+      {
+        scopeMessageTypes(queryMessageTypes,
+                          itsConfig->getMessageTypes(),
+                          scope.scope,
+                          queryOptions.itsMessageTypes);
 
-    ostringstream selectFromWhereClause;
+        if (queryOptions.itsMessageTypes.empty())
+          continue;
 
-    selectFromWhereClause << "SELECT request_stations.station_id FROM (VALUES ";
+        scopeOptions.push_back(queryOptions);
+        auto& options = scopeOptions.back();
 
-    for (size_t n = 1; (n <= stationIdList.size()); n++)
-      selectFromWhereClause << ((n == 1) ? "($" : ",($") << n << ((n == 1) ? "::integer)" : ")");
+        if (!validatedOptions)
+        {
+          validatedOptions = &options;
+
+          scopeQueries.push_back(std::async(std::launch::deferred,
+                                            [this, &connection, &scope, &options]()
+                                            {
+                                              scope.hasData = queryScopeStationsAndMessages(
+                                                  connection,
+                                                  scope.scope,
+                                                  options,
+                                                  true,
+                                                  scope.stationData,
+                                                  scope.messageData);
+                                            }));
+        }
+        else
+        {
+          // The scope is queried concurrently only if a connection is free right now; waiting
+          // for a connection while holding one could deadlock concurrent queries. Otherwise the
+          // scope is queried with the held connection after the first scope
 
-    selectFromWhereClause << ") AS request_stations (station_id) LEFT JOIN avidb_stations ON "
-                             "request_stations.station_id = avidb_stations.station_id "
-                          << "WHERE avidb_stations.station_id IS NULL LIMIT 1";
+          std::shared_ptr<PooledConnection> scopeConnectionPtr = tryGetConnection();
 
-    QueryData queryData;
+          if (scopeConnectionPtr)
+            scopeQueries.push_back(std::async(
+                std::launch::async,
+                [this, call, callTimer, scopeConnectionPtr, &scope, &options]()
+                {
+                  QueryMetrics::CallScope callScope(call, callTimer);
+
+                  scope.hasData = queryScopeStationsAndMessages(*scopeConnectionPtr->get(),
+                                                                scope.scope,
+                                                                options,
+                                                                true,
+                                                                scope.stationData,
+                                                                scope.messageData);
+                }));
+          else
+            scopeQueries.push_back(std::async(std::launch::deferred,
+                                              [this, &connection, &scope, &options]()
+                                              {
+                                                scope.hasData = queryScopeStationsAndMessages(
+                                                    connection,
+                                                    scope.scope,
+                                                    options,
+                                                    true,
+                                                    scope.stationData,
+                                                    scope.messageData);
+                                              }));
+        }
+      }
 
-    queryData.itsColumns.emplace_back(ColumnType::Integer, "station_id");
+      // Wait for all scopes to complete; the first error (in scope order) is thrown
+
+      std::exception_ptr scopeError;
+
+      for (auto& scopeQuery : scopeQueries)
+      {
+        try
+        {
+          scopeQuery.get();
+        }
+        catch (...)
+        {
+          if (!scopeError)
+            scopeError = std::current_exception();
+        }
+      }
 
-    executeParamQuery<QueryData, StationIdList>(
-        connection, selectFromWhereClause.str(), stationIdList, debug, queryData);
+      if (scopeError)
+        std::rethrow_exception(scopeError);
 
-    if (!queryData.itsValues.empty())
-    {
-      const auto* id = std::get_if<int>(&queryData.itsValues["station_id"].front());
-      const int stationId = id ? *id : -1;
-      throw Fmi::Exception(BCP, "Unknown station id " + Fmi::to_string(stationId));
+      if (validatedOptions)
+      {
+        StringList messageTypes(std::move(queryOptions.itsMessageTypes));
+        queryOptions = *validatedOptions;
+        queryOptions.itsMessageTypes = std::move(messageTypes);
+      }
     }
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-// ----------------------------------------------------------------------
-/*!
- * \brief Check given icao codes exist
- */
-// ----------------------------------------------------------------------
+    else
+    {
+      bool validateQuery = true;
 
-void EngineImpl::validateIcaos(const Fmi::Database::PostgreSQLConnection& connection,
-                               const StringList& icaoList,
-                               bool debug) const
-{
-  try
-  {
-    if (icaoList.empty())
-      return;
+      for (auto& scope : scopeDatas)
+      {
+        scopeMessageTypes(queryMessageTypes,
+                          itsConfig->getMessageTypes(),
+                          scope.scope,
+                          queryOptions.itsMessageTypes);
 
-    ostringstream selectFromWhereClause;
+        if (!queryOptions.itsMessageTypes.empty())
+        {
+          scope.hasData = queryScopeStationsAndMessages(connection,
+                                                        scope.scope,
+                                                        queryOptions,
+                                                        validateQuery,
+                                                        scope.stationData,
+                                                        scope.messageData);
+          validateQuery = false;
+        }
+      }
+    }
 
-    selectFromWhereClause << "SELECT request_icaos.icao_code FROM (VALUES ";
+    // Collect/combine data in scope order
 
-    for (size_t n = 1; (n <= icaoList.size()); n++)
-      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n;
+    StationQueryData* data = nullptr;
 
-    selectFromWhereClause << ")) AS request_icaos (icao_code) LEFT JOIN avidb_stations ON "
-                             "UPPER(request_icaos.icao_code) = UPPER(avidb_stations.icao_code) "
-                          << "WHERE avidb_stations.icao_code IS NULL LIMIT 1";
+    for (auto& scope : scopeDatas)
+    {
+      if (!scope.hasData)
+        continue;
 
-    QueryData queryData;
+      if (queryOptions.itsMessageColumnSelected)
+      {
+        if (!data)
+          data = &scope.messageData;
+        else
+          for (auto& station : scope.messageData.itsValues)
+          {
+            auto its = data->itsValues.insert(make_pair(station.first, QueryValues()));
 
-    queryData.itsColumns.emplace_back(ColumnType::String, "icao_code");
+            if (its.second)
+            {
+              data->itsStationIds.push_back(station.first);
+              its.first->second = std::move(station.second);
+              continue;
+            }
 
-    executeParamQuery<QueryData, StringList>(
-        connection, selectFromWhereClause.str(), icaoList, debug, queryData);
+            for (auto& column : station.second)
+            {
+              auto& values = its.first->second[column.first];
+              values.insert(values.end(),
+                            std::make_move_iterator(column.second.begin()),
+                            std::make_move_iterator(column.second.end()));
+            }
+          }
+      }
+      else
+      {
+        if (data)
+          data->itsValues.insert(scope.stationData.itsValues.begin(),
+                                 scope.stationData.itsValues.end());
 
-    if (!queryData.itsValues.empty())
-    {
-      const auto* ptr = std::get_if<std::string>(&(queryData.itsValues["icao_code"].front()));
-      string icaoCode = ptr ? *ptr : "?";
-      throw Fmi::Exception(BCP, "Unknown icao code " + icaoCode).disableLogging();
+        data = &scope.stationData;
+      }
     }
+
+    return std::move(data ? *data : scopeDatas.front().stationData);
   }
   catch (...)
   {
@@ -3878,42 +7935,40 @@ void EngineImpl::validateIcaos(const Fmi::Database::PostgreSQLConnection& connec
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Check given icao filters
+ * \brief Query stations and messages for a scope (station, FIR or global scope, or all
+ *        messages with single query); returns true if the scope has data to be combined
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::validateIcaoFilters(const LocationOptions& locationOptions)
+bool EngineImpl::queryScopeStationsAndMessages(
+    const Fmi::Database::PostgreSQLConnection& connection,
+    MessageScope scope,
+    QueryOptions& queryOptions,
+    bool validateQuery,
+    StationQueryData& stationData,
+    StationQueryData& messageData) const
 {
   try
   {
-    auto const& includeIcaoFilters = locationOptions.itsIncludeIcaoFilters;
-    auto const& excludeIcaoFilters = locationOptions.itsExcludeIcaoFilters;
+    // Query stations
 
-    if (includeIcaoFilters.empty() && excludeIcaoFilters.empty())
-      return;
+    stationData = queryStations(connection, queryOptions, validateQuery);
 
-    if (locationOptions.itsCountries.empty() && locationOptions.itsWKTs.itsWKTs.empty())
+    if ((scope != MessageScope::GlobalScope) && stationData.itsStationIds.empty())
+      return false;
+
+    // Query messages if any message column were requested
+
+    if (queryOptions.itsMessageColumnSelected)
     {
-      // edr sets filters for queries which do not use them; ignore them instead of error
+      // Query messages and join station and message data to get distance and bearing values
+      // for message data rows
       //
-      return;
-
-      /*
-      throw Fmi::Exception(
-          BCP, "Icao code filters are applicable with country code and polygon queries only"
-                          ).disableLogging();
-      */
+      queryMessages(connection, stationData.itsStationIds, queryOptions, false, messageData);
+      joinStationAndMessageData(stationData, messageData);
     }
 
-    for (auto const& filter : includeIcaoFilters)
-      if (filter.empty() || (filter.size() > 4) || strpbrk(filter.c_str(), "%_"))
-        throw Fmi::Exception(BCP, "1-4 letter icao code filter expected, no wildcards: " + filter)
-            .disableLogging();
-
-    for (auto const& filter : excludeIcaoFilters)
-      if (filter.empty() || (filter.size() > 4) || strpbrk(filter.c_str(), "%_"))
-        throw Fmi::Exception(BCP, "1-4 letter icao code filter expected, no wildcards: " + filter)
-            .disableLogging();
+    return true;
   }
   catch (...)
   {
@@ -3923,72 +7978,34 @@ void EngineImpl::validateIcaoFilters(const LocationOptions& locationOptions)
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Check given places (station names) exist
+ * \brief Copy given stations' data from combined message data in the
+ *        combined data's station order
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::validatePlaces(const Fmi::Database::PostgreSQLConnection& connection,
-                                StringList& placeNameList,
-                                bool debug) const
+namespace
+{
+
+StationQueryData stationSubset(const StationQueryData& messageData,
+                               const StationIdList& stationIdList)
 {
   try
   {
-    if (placeNameList.empty())
-      return;
-
-    ostringstream selectFromWhereClause;
-
-    /* Since non-existing station names has been allowed, just strip them off
-     * instead of throwing an error
-
-    selectFromWhereClause << "SELECT request_stations.name FROM (VALUES ";
-
-    for (size_t n = 1; (n <= placeNameList.size()); n++)
-      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n;
-
-    selectFromWhereClause
-        << ")) AS request_stations (name) LEFT JOIN avidb_stations ON "
-           "UPPER(request_stations.name) = UPPER(BTRIM(avidb_stations.name)) "
-        << "WHERE avidb_stations.name IS NULL LIMIT 1";
-
-    QueryData queryData;
-
-    queryData.itsColumns.push_back(Column(String, "name"));
-
-    executeParamQuery<QueryData, StringList>(
-        connection, selectFromWhereClause.str(), placeNameList, debug, queryData);
-
-    if (!queryData.itsValues.empty())
-    {
-      string stationName(boost::get<std::string>(&(queryData.itsValues["name"].front()))
-                           ? *(boost::get<std::string>(&(queryData.itsValues["name"].front())))
-                           : "?");
-      throw Fmi::Exception(BCP, "Unknown station name " + stationName).disableLogging();
-    }
-    */
+    std::set<StationIdType> stationIds(stationIdList.begin(), stationIdList.end());
+    StationQueryData stationQueryData(messageData.itsCheckDuplicateMessages);
 
-    StringList places(placeNameList);
-    placeNameList.clear();
+    stationQueryData.itsColumns = messageData.itsColumns;
 
-    for (auto const& place : places)
+    for (auto stationId : messageData.itsStationIds)
     {
-      QueryData queryData;
-
-      queryData.itsColumns.emplace_back(ColumnType::String, "name");
-
-      selectFromWhereClause << "SELECT request_stations.name FROM (VALUES ($1)) "
-                            << "AS request_stations (name) LEFT JOIN avidb_stations ON "
-                               "UPPER(request_stations.name) = UPPER(BTRIM(avidb_stations.name)) "
-                            << "WHERE avidb_stations.name IS NULL";
-
-      executeParamQuery<QueryData>(
-          connection, selectFromWhereClause.str(), place, debug, queryData);
-
-      if (queryData.itsValues.empty())
-        placeNameList.push_back(place);
+      if (stationIds.find(stationId) == stationIds.end())
+        continue;
 
-      selectFromWhereClause.str("");
+      stationQueryData.itsStationIds.push_back(stationId);
+      stationQueryData.itsValues[stationId] = messageData.itsValues.at(stationId);
     }
+
+    return stationQueryData;
   }
   catch (...)
   {
@@ -3996,46 +8013,61 @@ void EngineImpl::validatePlaces(const Fmi::Database::PostgreSQLConnection& conne
   }
 }
 
+// Columns selected to build station catalog
+
+const char* stationInfoSelectClause =
+    "SELECT station_id,icao_code,name,elevation,"
+    "valid_from AT TIME ZONE 'UTC' AS valid_from,valid_to AT TIME ZONE 'UTC' AS valid_to,"
+    "modified_last AT TIME ZONE 'UTC' AS modified_last,country_code,"
+    "ST_X(geom) AS longitude,ST_Y(geom) AS latitude";
+
 // ----------------------------------------------------------------------
 /*!
- * \brief Check given country codes exist
+ * \brief Load station catalog stations from query result; FIR id's are
+ *        set if FIR index is given
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::validateCountries(const Fmi::Database::PostgreSQLConnection& connection,
-                                   const StringList& countryList,
-                                   bool debug) const
+StationInfos loadStationInfos(const pqxx::result& result, const FIRIndex* firIndex)
 {
   try
   {
-    if (countryList.empty())
-      return;
-
-    ostringstream selectFromWhereClause;
+    auto timeValue = [](const pqxx::field& field)
+    {
+      return (field.is_null() ? Fmi::DateTime() : Fmi::DateTime::from_string(field.as<string>()));
+    };
+    auto stringValue = [](const pqxx::field& field)
+    { return (field.is_null() ? string() : boost::algorithm::trim_copy(field.as<string>())); };
 
-    selectFromWhereClause << "WITH request_countries AS (SELECT country_code FROM (VALUES ";
+    StationInfos stations;
+    stations.reserve(result.size());
 
-    for (size_t n = 1; (n <= countryList.size()); n++)
-      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n;
+    for (pqxx::result::const_iterator row = result.begin(); (row != result.end()); row++)
+    {
+      const auto& dbRow = *row;
+      StationInfo station;
 
-    selectFromWhereClause
-        << ")) AS request_countries (country_code)) SELECT country_code FROM request_countries "
-        << "WHERE NOT EXISTS (SELECT station_id FROM avidb_stations WHERE "
-           "request_countries.country_code = UPPER(avidb_stations.country_code)) LIMIT 1";
+      station.itsId = dbRow["station_id"].as<long>();
+      station.itsIcao = stringValue(dbRow["icao_code"]);
+      station.itsName = stringValue(dbRow["name"]);
 
-    QueryData queryData;
+      if (!dbRow["elevation"].is_null())
+        station.itsElevation = dbRow["elevation"].as<int>();
 
-    queryData.itsColumns.emplace_back(ColumnType::String, "country_code");
+      station.itsValidFrom = timeValue(dbRow["valid_from"]);
+      station.itsValidTo = timeValue(dbRow["valid_to"]);
+      station.itsModified = timeValue(dbRow["modified_last"]);
+      station.itsCountryCode = stringValue(dbRow["country_code"]);
+      station.itsLongitude = dbRow["longitude"].as<double>();
+      station.itsLatitude = dbRow["latitude"].as<double>();
 
-    executeParamQuery<QueryData, StringList>(
-        connection, selectFromWhereClause.str(), countryList, debug, queryData);
+      if (firIndex)
+        station.itsFIRId = firIndex->getFIRId(station.itsLongitude, station.itsLatitude);
 
-    if (!queryData.itsValues.empty())
-    {
-      const auto* ptr = std::get_if<std::string>(&(queryData.itsValues["country_code"].front()));
-      string countryCode = ptr ? *ptr : "?";
-      throw Fmi::Exception(BCP, "Unknown country code " + countryCode);
+      stations.push_back(std::move(station));
     }
+
+    return stations;
   }
   catch (...)
   {
@@ -4045,119 +8077,102 @@ void EngineImpl::validateCountries(const Fmi::Database::PostgreSQLConnection& co
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Check given wkt's are valid and of supported type.
- *        Convert POINTs to latlons to support 'max # of nearest station' search.
+ * \brief Check if stations are queried only with station id's, icao codes
+ *        and/or country codes
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::validateWKTs(const Fmi::Database::PostgreSQLConnection& connection,
-                              LocationOptions& locationOptions,
-                              bool debug) const
+bool stationLookupOnly(const LocationOptions& locationOptions)
 {
-  try
-  {
-    if (locationOptions.itsWKTs.itsWKTs.empty())
-      return;
-
-    // Get type, validity and index (position in itsWKTs collection), and latitude and longitude of
-    // POINT definitions for the wkt's.
-    // To ease the handling of result rows sort invalid wkts and POINTs to come first.
-
-    ostringstream selectFromWhereClause;
-
-    selectFromWhereClause << "SELECT wkt,geomtype,isvalid,index,"
-                          << "CASE geomtype WHEN 'ST_Point' THEN ST_Y(geom) ELSE 0 END AS lat,"
-                             "CASE geomtype WHEN 'ST_Point' THEN ST_X(geom) ELSE 0 END AS lon "
-                          << "FROM (SELECT wkt,ST_GeomFromText(wkt,4326) AS geom,"
-                             "ST_GeometryType(ST_GeomFromText(wkt,4326)) AS geomtype,"
-                          << "CASE WHEN NOT ST_IsValid(ST_GeomFromText(wkt,4326)) OR "
-                          << "ST_GeometryType(ST_GeomFromText(wkt,4326)) NOT IN "
-                             "('ST_Point','ST_Polygon','ST_LineString') "
-                          << "THEN 0 ELSE 1 END AS isvalid,index FROM (VALUES ";
-
-    size_t wktCnt = locationOptions.itsWKTs.itsWKTs.size();
-
-    for (size_t n = 1; (n <= wktCnt); n++)
-      selectFromWhereClause << ((n == 1) ? "($" : "),($") << n << "," << n - 1;
-
-    selectFromWhereClause
-        << ")) AS request_wkts (wkt,index)) AS wkts ORDER BY isvalid,CASE geomtype "
-           "WHEN 'ST_Point' THEN 0 ELSE 1 END,index";
-
-    // If a single LINESTRING (route) is given, the stations (and their messages) will be ordered by
-    // route segment index and station's distance to the start of the segment. Otherwise icao code
-    // order is used
-
-    bool checkIfRoute =
-        (locationOptions.itsLonLats.empty() && locationOptions.itsStationIds.empty() &&
-         locationOptions.itsIcaos.empty() && locationOptions.itsCountries.empty() &&
-         locationOptions.itsPlaces.empty() && locationOptions.itsBBoxes.empty() && (wktCnt == 1));
-
-    QueryData queryData;
-
-    queryData.itsColumns.emplace_back(ColumnType::String, "wkt");
-    queryData.itsColumns.emplace_back(ColumnType::String, "geomtype");
-    queryData.itsColumns.emplace_back(ColumnType::Integer, "isvalid");
-    queryData.itsColumns.emplace_back(ColumnType::Integer, "index");
-    queryData.itsColumns.emplace_back(ColumnType::Double, "lat");
-    queryData.itsColumns.emplace_back(ColumnType::Double, "lon");
+  return (locationOptions.itsLonLats.empty() && locationOptions.itsPlaces.empty() &&
+          locationOptions.itsWKTs.itsWKTs.empty() && locationOptions.itsBBoxes.empty() &&
+          ((!locationOptions.itsStationIds.empty()) || (!locationOptions.itsIcaos.empty()) ||
+           (!locationOptions.itsCountries.empty())));
+}
 
-    executeParamQuery<QueryData, StringList>(
-        connection, selectFromWhereClause.str(), locationOptions.itsWKTs.itsWKTs, debug, queryData);
+std::size_t rowCount(const StationQueryData& stationQueryData)
+{
+  std::size_t rows = 0;
 
-    if (queryData.itsValues["wkt"].size() != wktCnt)
-      throw Fmi::Exception(
-          BCP, "validateWKTs: internal: wkt check query did not return as many rows as expected");
+  for (auto const& station : stationQueryData.itsValues)
+    if (!station.second.empty())
+      rows += station.second.begin()->second.size();
 
-    bool isValid = value_or<int>(queryData.itsValues["isvalid"].front(), 0);
+  return rows;
+}
 
-    if (!isValid)
-    {
-      auto wkt = value_or<std::string>(queryData.itsValues["wkt"].front(), "?");
+}  // namespace
 
-      const auto geomType = value_or<std::string>(queryData.itsValues["geomtype"].front(), "?");
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query the stations of batch requests looked up by station id's,
+ *        icao codes or country codes with single query
+ *
+ *        Used when station catalog is not available. Returns a catalog of
+ *        the union of the stations to query and validate each request's
+ *        stations from, or nullptr if there are no such requests. Icao
+ *        filters are applied per request when querying the catalog
+ */
+// ----------------------------------------------------------------------
 
-      if ((geomType == "ST_Point") || (geomType == "ST_Polygon") || (geomType == "ST_LineString"))
-        throw Fmi::Exception(BCP, "Invalid wkt " + wkt);
+std::shared_ptr<const StationCatalog> EngineImpl::queryBatchStationCatalog(
+    const Fmi::Database::PostgreSQLConnection& connection,
+    const std::vector<QueryOptions>& queryOptionsList) const
+{
+  try
+  {
+    std::set<StationIdType> stationIdSet;
+    std::set<string> icaoSet;
+    std::set<string> countrySet;
+    bool firIdQuery = false;
 
-      throw Fmi::Exception(
-          BCP, "Unsupported wkt " + wkt + "; use POINT(s), POLYGON(s) or LINESTRING(s)");
-    }
+    for (auto const& queryOptions : queryOptionsList)
+    {
+      auto const& locationOptions = queryOptions.itsLocationOptions;
 
-    // Convert POINTs to latlons to support 'max # of nearest station' search
+      if (queryOptions.itsDebug || (!stationLookupOnly(locationOptions)))
+        continue;
 
-    auto itwkt = locationOptions.itsWKTs.itsWKTs.begin();
-    string geomType;
+      stationIdSet.insert(locationOptions.itsStationIds.begin(),
+                          locationOptions.itsStationIds.end());
+      icaoSet.insert(locationOptions.itsIcaos.begin(), locationOptions.itsIcaos.end());
+      countrySet.insert(locationOptions.itsCountries.begin(), locationOptions.itsCountries.end());
 
-    for (int wktIndex = 0, dataIndex = 0; (wktCnt > 0); wktCnt--, wktIndex++, dataIndex++)
-    {
-      geomType = value_or<std::string>(queryData.itsValues["geomtype"][dataIndex], "?");
+      // FIR id can be selected only if no message column is selected
 
-      if (geomType != "ST_Point")
-        break;
+      if (!queryOptions.itsMessageColumnSelected)
+        firIdQuery = true;
+    }
 
-      int index = value_or<int>(queryData.itsValues["index"][dataIndex], -1);
+    if (stationIdSet.empty() && icaoSet.empty() && countrySet.empty())
+      return nullptr;
 
-      if (index >= 0)
-      {
-        for (; ((wktIndex < index) && (itwkt != locationOptions.itsWKTs.itsWKTs.end())); wktIndex++)
-          itwkt++;
-      }
+    // Stations within any of the requests' station id's, icao codes or country codes
 
-      if ((index < 0) || (itwkt == locationOptions.itsWKTs.itsWKTs.end()))
-        throw Fmi::Exception(BCP, "validateWKTs: internal: wkt index is invalid");
+    StationIdList stationIdList(stationIdSet.begin(), stationIdSet.end());
+    StringList icaoList(icaoSet.begin(), icaoSet.end());
+    StringList countryList(countrySet.begin(), countrySet.end());
+    ostringstream whereClause;
+    QueryParameters queryParameters;
 
-      auto lat = value_or<double>(queryData.itsValues["lat"][dataIndex], 0);
-      auto lon = value_or<double>(queryData.itsValues["lon"][dataIndex], 0);
+    buildStationQueryWhereClause(stationIdList, queryParameters, whereClause);
+    buildStationQueryWhereClause(
+        "UPPER(icao_code)", icaoList, "", {}, queryParameters, whereClause);
+    buildStationQueryWhereClause(
+        "UPPER(country_code)", countryList, "", {}, queryParameters, whereClause);
 
-      locationOptions.itsLonLats.emplace_back(lon, lat);
+    auto result = executePrepared(connection,
+                                  string(stationInfoSelectClause) + " FROM avidb_stations " +
+                                      whereClause.str(),
+                                  queryParameters);
 
-      itwkt = locationOptions.itsWKTs.itsWKTs.erase(itwkt);
-    }
+    std::shared_ptr<const FIRAreaSnapshot> firAreaSnapshot;
 
-    // Set 'route' flag if the one and only wkt is a LINESTRING
+    if (firIdQuery)
+      firAreaSnapshot = getFIRAreaSnapshot();
 
-    locationOptions.itsWKTs.isRoute = (checkIfRoute && (geomType == "ST_LineString"));
+    return std::make_shared<StationCatalog>(
+        loadStationInfos(result, firAreaSnapshot ? &firAreaSnapshot->itsIndex : nullptr), 0);
   }
   catch (...)
   {
@@ -4167,163 +8182,175 @@ void EngineImpl::validateWKTs(const Fmi::Database::PostgreSQLConnection& connect
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations
+ * \brief Query stations and/or accepted messages for multiple requests.
+ *
+ *        All requests are validated and their stations queried before
+ *        querying any messages. Nonroute requests (without bboxes) having
+ *        identical message query options are grouped and their messages
+ *        are fetched with single query for the union of the stations;
+ *        the rows are then split back per request. Other requests are
+ *        executed with queryStationsAndMessages()
  */
 // ----------------------------------------------------------------------
-//
-// private
-//
-StationQueryData EngineImpl::queryStations(const Fmi::Database::PostgreSQLConnection& connection,
-                                           QueryOptions& queryOptions,
-                                           bool validateQuery) const
+
+std::vector<StationQueryData> EngineImpl::queryBatch(
+    std::vector<QueryOptions>& queryOptionsList) const
 {
   try
   {
-    // Validate requested times, parameters, station id's, icao codes, country codes and wkts
+    QueryMetrics::Call call(itsQueryMetrics, "queryBatch");
 
-    auto const& paramList = queryOptions.itsParameters;
-    auto& locationOptions = queryOptions.itsLocationOptions;
+    for (auto const& queryOptions : queryOptionsList)
+      if (queryOptions.itsValidity == Validity::Rejected)
+        throw Fmi::Exception(
+            BCP,
+            "queryBatch() can't be used to query rejected messages; use "
+            "queryRejectedMessages() instead");
 
-    if (validateQuery)
-    {
-      validateParameters(paramList, Validity::Accepted, queryOptions.itsMessageColumnSelected);
+    std::vector<StationQueryData> results(queryOptionsList.size());
 
-      if (!locationOptions.itsStationIds.empty())
-        validateStationIds(connection, locationOptions.itsStationIds, queryOptions.itsDebug);
+    if (queryOptionsList.empty())
+      return results;
 
-      if (!locationOptions.itsIcaos.empty())
-        validateIcaos(connection, locationOptions.itsIcaos, queryOptions.itsDebug);
+    // Validate the requests and query the stations of the combinable requests. Requests
+    // with combinable message queries are grouped by message query options (the query options
+    // excluding location options and limits, which are checked per request)
+    //
+    // If station catalog is not available, the stations of the requests using only station id's,
+    // icao codes and/or country codes are queried with single query
 
-      if ((!locationOptions.itsIncludeIcaoFilters.empty()) ||
-          (!locationOptions.itsExcludeIcaoFilters.empty()))
-        validateIcaoFilters(locationOptions);
+    std::vector<bool> combined(queryOptionsList.size(), false);
+    std::map<std::string, std::vector<std::size_t>> groups;
 
-      if (!locationOptions.itsPlaces.empty())
-        validatePlaces(connection, locationOptions.itsPlaces, queryOptions.itsDebug);
+    {
+      auto connectionPtr = getConnection();
+      auto& connection = *connectionPtr.get();
 
-      if (!locationOptions.itsCountries.empty())
-        validateCountries(connection, locationOptions.itsCountries, queryOptions.itsDebug);
+      auto batchStationCatalog =
+          (getStationCatalog() ? nullptr : queryBatchStationCatalog(connection, queryOptionsList));
 
-      if ((!locationOptions.itsWKTs.itsWKTs.empty()) && (!locationOptions.itsWKTs.isRoute))
-        validateWKTs(connection, locationOptions, queryOptions.itsDebug);
-    }
+      for (std::size_t index = 0; index < queryOptionsList.size(); index++)
+      {
+        auto& queryOptions = queryOptionsList[index];
 
-    // If any message column is requested, select only stationid and additionally distance/bearing
-    // if requested (all other requested station columns except distance/bearing are selected by
-    // message query) and queryOptions.messageColumnSelected is set instructing the caller to call
-    // queryMessages() with the returned station id's
-    //
-    // Build select column expressions
-    //
-    // distance is automatically selected if querying with coordinates and max # of nearest stations
+        {
+          QueryMetrics::StageTimer timer(QueryMetrics::Stage::Validation);
 
-    StationQueryData stationQueryData;
-    bool selectStationListOnly = queryOptions.itsMessageColumnSelected;
-    bool autoSelectDistance =
-        ((!locationOptions.itsLonLats.empty()) && (locationOptions.itsNumberOfNearestStations > 0));
-    bool firIdQuery;
-    string selectClause;
+          validateTimes(queryOptions);
 
-    stationQueryData.itsColumns = buildStationQuerySelectClause(
-        paramList, selectStationListOnly, autoSelectDistance, selectClause, firIdQuery);
+          if (!queryOptions.itsLocationOptions.itsWKTs.itsWKTs.empty())
+            validateWKTs(connection, queryOptions.itsLocationOptions, queryOptions.itsDebug);
 
-    // Query separately with each type of location options, adding the unique results to 'queryData'
-    //
-    // Note: Query with coordinates must be executed first to get distance and bearing values
+          validateMessageTypes(connection, queryOptions.itsMessageTypes, queryOptions.itsDebug);
+        }
 
-    if (!locationOptions.itsLonLats.empty())
-      queryStationsWithCoordinates(connection,
-                                   locationOptions,
-                                   queryOptions.itsMessageTypes,
-                                   selectClause,
-                                   queryOptions.itsDebug,
-                                   stationQueryData);
+        if (queryOptions.itsLocationOptions.itsWKTs.isRoute ||
+            (!queryOptions.itsLocationOptions.itsBBoxes.empty()) || queryOptions.itsDebug)
+          continue;
 
-    if (!locationOptions.itsStationIds.empty())
-      queryStationsWithIds(connection,
-                           locationOptions.itsStationIds,
-                           selectClause,
-                           queryOptions.itsDebug,
-                           stationQueryData);
+        if (batchStationCatalog && stationLookupOnly(queryOptions.itsLocationOptions))
+          results[index] = queryStations(*batchStationCatalog, queryOptions, true);
+        else
+          results[index] = queryStations(connection, queryOptions, true);
 
-    if (!locationOptions.itsIcaos.empty())
-      queryStationsWithIcaos(connection,
-                             locationOptions.itsIcaos,
-                             selectClause,
-                             firIdQuery,
-                             queryOptions.itsDebug,
-                             stationQueryData);
+        combined[index] = true;
 
-    if (!locationOptions.itsCountries.empty())
-      queryStationsWithCountries(connection,
-                                 locationOptions.itsCountries,
-                                 locationOptions.itsExcludeIcaoFilters,
-                                 selectClause,
-                                 firIdQuery,
-                                 queryOptions.itsDebug,
-                                 stationQueryData);
+        if ((!queryOptions.itsMessageColumnSelected) || results[index].itsStationIds.empty())
+          continue;
 
-    if (!locationOptions.itsPlaces.empty())
-      queryStationsWithPlaces(connection,
-                              locationOptions.itsPlaces,
-                              selectClause,
-                              queryOptions.itsDebug,
-                              stationQueryData);
+        int maxStations = (queryOptions.itsMaxMessageStations >= 0
+                               ? queryOptions.itsMaxMessageStations
+                               : itsConfig->getMaxMessageStations());
+        auto stationCount = results[index].itsStationIds.size();
 
-    if (!locationOptions.itsWKTs.itsWKTs.empty())
-      queryStationsWithWKTs(connection,
-                            locationOptions,
-                            queryOptions.itsMessageTypes,
-                            selectClause,
-                            queryOptions.itsDebug,
-                            stationQueryData);
+        if ((maxStations > 0) && ((int)stationCount > maxStations))
+          throw Fmi::Exception(BCP,
+                               string("Max number of stations exceeded (") +
+                                   Fmi::to_string(maxStations) + "/" +
+                                   Fmi::to_string(stationCount) + "), limit the query");
 
-    if (!locationOptions.itsBBoxes.empty())
-      queryStationsWithBBoxes(
-          connection, locationOptions, selectClause, queryOptions.itsDebug, stationQueryData);
+        QueryOptions groupOptions(queryOptions);
+        groupOptions.itsLocationOptions = LocationOptions();
+        groupOptions.itsMaxMessageStations = 0;
+        groupOptions.itsMaxMessageRows = 0;
 
-    if (!queryOptions.itsMessageColumnSelected)
-    {
-      // There are no message related columns.
-      //
-      // Sort the columns and erase automatically selected columns (distance) if such exist
-      //
-      if (autoSelectDistance)
+        groups[QueryResultCache::key("queryBatch", nullptr, groupOptions, 0)].push_back(index);
+      }
+
+      // Query the messages of each group with a single query
+
+      for (auto const& group : groups)
       {
-        sortColumnList(stationQueryData.itsColumns);
+        auto const& indexes = group.second;
 
-        for (auto it = stationQueryData.itsColumns.begin();
-             (it != stationQueryData.itsColumns.end());)
+        std::set<StationIdType> stationIdSet;
+        StationIdList stationIdList;
+        int maxMessageRows = 0;
+        bool unlimitedRows = false;
+
+        for (auto index : indexes)
         {
-          if (it->itsSelection == ColumnSelection::Automatic)
-            it = stationQueryData.itsColumns.erase(it);
+          for (auto stationId : results[index].itsStationIds)
+            if (stationIdSet.insert(stationId).second)
+              stationIdList.push_back(stationId);
+
+          auto const& queryOptions = queryOptionsList[index];
+          int maxRows = (queryOptions.itsMaxMessageRows >= 0 ? queryOptions.itsMaxMessageRows
+                                                             : itsConfig->getMaxMessageRows());
+
+          if (maxRows <= 0)
+            unlimitedRows = true;
           else
-            it++;
+            maxMessageRows += maxRows;
+        }
+
+        if (indexes.size() == 1)
+        {
+          auto index = indexes.front();
+          StationQueryData messageData;
+
+          queryMessages(connection, stationIdList, queryOptionsList[index], false, messageData);
+          results[index] = std::move(joinStationAndMessageData(results[index], messageData));
+
+          continue;
+        }
+
+        // The combined query is limited by the sum of the requests' row limits; the limit of
+        // each request is checked after splitting the rows
+
+        QueryOptions groupOptions(queryOptionsList[indexes.front()]);
+        groupOptions.itsMaxMessageStations = 0;
+        groupOptions.itsMaxMessageRows = (unlimitedRows ? 0 : maxMessageRows);
+
+        StationQueryData groupData;
+
+        queryMessages(connection, stationIdList, groupOptions, false, groupData);
+
+        for (auto index : indexes)
+        {
+          auto messageData = stationSubset(groupData, results[index].itsStationIds);
+
+          auto const& queryOptions = queryOptionsList[index];
+          int maxRows = (queryOptions.itsMaxMessageRows >= 0 ? queryOptions.itsMaxMessageRows
+                                                             : itsConfig->getMaxMessageRows());
+
+          if ((maxRows > 0) && (rowCount(messageData) > static_cast<std::size_t>(maxRows)))
+            throw Fmi::Exception(BCP,
+                                 string("Max number of rows exceeded (") + Fmi::to_string(maxRows) +
+                                     "), limit the query");
+
+          results[index] = std::move(joinStationAndMessageData(results[index], messageData));
         }
       }
     }
 
-    return stationQueryData;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
-
-//
-// public api stub
-//
-StationQueryData EngineImpl::queryStations(QueryOptions& queryOptions) const
-{
-  try
-  {
-    auto connectionPtr = itsConnectionPool->get();
-    auto& connection = *connectionPtr.get();
+    // Execute the other requests separately; they are not combined
 
-    queryOptions.itsLocationOptions.itsWKTs.isRoute = false;
+    for (std::size_t index = 0; index < queryOptionsList.size(); index++)
+      if (!combined[index])
+        results[index] = queryStationsAndMessages(queryOptionsList[index]);
 
-    return queryStations(connection, queryOptions, true);
+    return results;
   }
   catch (...)
   {
@@ -4333,55 +8360,100 @@ StationQueryData EngineImpl::queryStations(QueryOptions& queryOptions) const
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Check given message types are known
+ * \brief Query rejected messages into given data object
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::validateMessageTypes(const Fmi::Database::PostgreSQLConnection& /*connection*/,
-                                      const StringList& messageTypeList,
-                                      bool /*debug*/) const
+template <typename T>
+void EngineImpl::queryRejectedMessages(const QueryOptions& queryOptions,
+                                       T& queryData,
+                                       RejectedMessagePageToken* pageToken) const
 {
   try
   {
-    if (messageTypeList.empty())
-      return;
+    // Validate time options, parameters and message types
 
-    // Checking against configuration (not the database)
+    if (!queryOptions.itsTimeOptions.itsObservationTime.empty())
+      throw Fmi::Exception(BCP, "Time range must be used to query rejected messages");
 
-    auto it_begin = itsConfig->getMessageTypes().begin();
-    auto it_end = itsConfig->getMessageTypes().end();
+    if (pageToken && (pageToken->itsPageSize == 0))
+      throw Fmi::Exception(BCP, "Page size must be given to query rejected messages by pages");
 
-    for (auto const& msgType : messageTypeList)
-      if (find(it_begin, it_end, msgType) == it_end)
-        throw Fmi::Exception(BCP, "Unknown message type " + msgType);
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-    /*
-    ostringstream selectFromWhereClause;
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::MessageQuery);
 
-    size_t n = 0;
+    bool messageColumnSelected;
 
-    for (auto const & messageType : messageTypeList) {
-            selectFromWhereClause << ((n == 0) ? "SELECT request_message_types.type FROM (VALUES
-    (quote_literal('" : "')),(quote_literal('") << Fmi::ascii_toupper_copy(messageType);
-            n++;
+    {
+      QueryMetrics::StageTimer validationTimer(QueryMetrics::Stage::Validation);
+
+      validateTimes(queryOptions);
+      validateParameters(queryOptions.itsParameters, Validity::Rejected, messageColumnSelected);
+
+      if (!queryOptions.itsMessageTypes.empty())
+        validateMessageTypes(connection, queryOptions.itsMessageTypes, queryOptions.itsDebug);
     }
 
-    selectFromWhereClause << "'))) AS request_message_types (type) LEFT JOIN avidb_message_types ON
-    BTRIM(request_message_types.type,'''') = UPPER(avidb_message_types.type) "
-                                              << "WHERE avidb_message_types.type IS NULL LIMIT 1";
+    // Build select column expressions
+
+    string selectClause;
+    bool distinct = false;
+
+    TableMap tableMap = buildMessageQuerySelectClause(rejectedMessageQueryTables,
+                                                      StationIdList(),
+                                                      queryOptions.itsMessageTypes,
+                                                      queryOptions.itsParameters,
+                                                      false,
+                                                      selectClause,
+                                                      messageColumnSelected,
+                                                      distinct);
+
+    // Build column list and sort the columns to the requested order
+
+    queryData.itsColumns.clear();
+
+    for (auto const& table : tableMap)
+    {
+      for (auto const& column : table.second.itsSelectedColumns)
+        queryData.itsColumns.push_back(column);
+    }
+
+    sortColumnList(queryData.itsColumns);
+
+    // Max row count for the query; if exceeded, an error is thrown; if <= 0, unlimited.
+    //
+    // The query is limited to max row count + 1 rows unless the result is streamed; streamed
+    // rows are counted while fetched
+
+    int maxMessageRows = (queryOptions.itsMaxMessageRows >= 0 ? queryOptions.itsMaxMessageRows
+                                                              : itsConfig->getMaxMessageRows());
+    bool streamed = std::is_same<T, RejectedMessageStream>::value;
 
-    QueryData queryData;
+    if constexpr (std::is_same<T, QueryData>::value)
+    {
+      if (pageToken)
+      {
+        queryRejectedMessagePage(
+            connection, queryOptions, tableMap, selectClause, *pageToken, queryData);
+        return;
+      }
+    }
 
-    queryData.itsColumns.push_back(Column(String,"type"));
+    // Build from, where and order by clause (by rejected_messages.icao_code) and execute query
 
-    executeQuery<QueryData>(connection,selectFromWhereClause.str(),debug,queryData);
+    ostringstream fromWhereOrderByClause;
 
-    if (!queryData.itsValues.empty()) {
-            string msgType(boost::get<std::string>(&(queryData.itsValues["type"].front())) ?
-    *(boost::get<std::string>(&(queryData.itsValues["type"].front()))) : "?");
-            throw Fmi::Exception(BCP,"Unknown message type " + msgType);
-    }
-    */
+    buildRejectedMessageQueryFromWhereOrderByClause(
+        streamed ? 0 : maxMessageRows, queryOptions, tableMap, false, "", fromWhereOrderByClause);
+
+    executeQuery(connection,
+                 selectClause + fromWhereOrderByClause.str(),
+                 queryOptions.itsDebug,
+                 queryData,
+                 false,
+                 maxMessageRows);
   }
   catch (...)
   {
@@ -4391,383 +8463,442 @@ void EngineImpl::validateMessageTypes(const Fmi::Database::PostgreSQLConnection&
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Get pointer to internal column definition for given
- *        datetime column in avidb_messages table
+ * \brief Query a page of rejected messages
+ *
+ * The messages are ordered by key (icao_code,created,message); the page
+ * starts after the key of the last message of the previous page stored in
+ * the token. Messages having icao code are queried first and the ones
+ * without it (ordered last) then; the key restriction is a row comparison
+ * of plain columns for each, so that the page is read by a range scan of
+ * btree index
+ *
+ *   avidb_rejected_messages (icao_code,created)
+ *
+ * (messages having equal icao code and creation time are then sorted by
+ * message). Page size + 1 rows are fetched to check if there are more
+ * messages. The token is updated for the next page
  */
 // ----------------------------------------------------------------------
 
-const Column* EngineImpl::getMessageTableTimeColumn(const string& timeColumn)
+void EngineImpl::queryRejectedMessagePage(const Fmi::Database::PostgreSQLConnection& connection,
+                                          const QueryOptions& queryOptions,
+                                          const TableMap& tableMap,
+                                          const string& selectClause,
+                                          RejectedMessagePageToken& pageToken,
+                                          QueryData& queryData) const
 {
   try
   {
-    Columns columns;
-    bool duplicate = false;
+    // Select the key columns for the next page token and add the key restriction; the key
+    // values are passed as query parameters
 
-    const auto* queryColumn = getQueryColumn(messageQueryColumns, columns, timeColumn, duplicate);
+    const string icaoColumn =
+        string(rejectedMessageTableAlias) + "." + rejectedMessageIcaoTableColumn;
+    const string createdColumn = string(rejectedMessageTableAlias) + ".created";
+    const string messageColumn = string(rejectedMessageTableAlias) + ".message";
+    const char* pageIcaoColumn = "pageicao";
+    const char* pageCreatedColumn = "pagecreated";
+    const char* pageMessageColumn = "pagemessage";
 
-    if ((!queryColumn) || (queryColumn->itsType != ColumnType::DateTime))
-      throw Fmi::Exception(
-          BCP, string("Column '") + timeColumn + "' is not a datetime column in message table");
+    const string pageSelectClause = selectClause + "," + icaoColumn + " AS " + pageIcaoColumn +
+                                    "," + timeColumnExpression(createdColumn) + " AS " +
+                                    pageCreatedColumn + "," + messageColumn + " AS " +
+                                    pageMessageColumn;
 
-    return queryColumn;
-  }
-  catch (...)
-  {
-    throw Fmi::Exception::Trace(BCP, "Operation failed!");
-  }
-}
+    bool firstPage = pageToken.itsFirstPage;
+    size_t rows = 0;
 
-// ----------------------------------------------------------------------
-/*!
- * \brief Query accepted messages
- */
-// ----------------------------------------------------------------------
-//
-// private
-//
-StationQueryData EngineImpl::queryMessages(const Fmi::Database::PostgreSQLConnection& connection,
-                                           const StationIdList& stationIdList,
-                                           const QueryOptions& queryOptions,
-                                           bool validateQuery) const
-{
-  try
-  {
-    // Check # of stations and validate requested parameters and message types
+    pageToken.itsFirstPage = false;
 
-    int maxStations =
-        (queryOptions.itsMaxMessageStations >= 0 ? queryOptions.itsMaxMessageStations
-                                                 : itsConfig->getMaxMessageStations());
+    for (bool nullIcao : {false, true})
+    {
+      // Messages without icao code are ordered last
 
-    if ((maxStations > 0) && ((int)stationIdList.size() > maxStations))
-      throw Fmi::Exception(BCP,
-                           string("Max number of stations exceeded (") +
-                               Fmi::to_string(maxStations) + "/" +
-                               Fmi::to_string(stationIdList.size()) + "), limit the query");
+      if ((!nullIcao) && (!firstPage) && pageToken.itsNullIcao)
+        continue;
 
-    bool messageColumnSelected = queryOptions.itsMessageColumnSelected;
-    const Column* timeRangeColumn = nullptr;
+      QueryParameters queryParameters;
+      string pageKeyCondition = icaoColumn + (nullIcao ? " IS NULL" : " IS NOT NULL");
 
-    if (validateQuery)
-    {
-      validateTimes(queryOptions);
+      if ((!firstPage) && (nullIcao == pageToken.itsNullIcao))
+      {
+        string created = "timestamptz 'epoch' + " +
+                         queryParameters.add(Fmi::to_string(pageToken.itsCreated), "bigint") +
+                         " * interval '1 microsecond'";
+        string message = queryParameters.add(pageToken.itsMessage, "text");
+
+        if (nullIcao)
+          pageKeyCondition += " AND (" + createdColumn + "," + messageColumn + ") > (" + created +
+                              "," + message + ")";
+        else
+          pageKeyCondition += " AND (" + icaoColumn + "," + createdColumn + "," + messageColumn +
+                              ") > (" + queryParameters.add(pageToken.itsIcao, "text") + "," +
+                              created + "," + message + ")";
+      }
 
-      validateParameters(
-          queryOptions.itsParameters, Validity::AcceptedMessages, messageColumnSelected);
+      // The rows remaining to fill the page and an extra row are fetched
 
-      if (!queryOptions.itsMessageTypes.empty())
-        validateMessageTypes(connection, queryOptions.itsMessageTypes, queryOptions.itsDebug);
-    }
+      ostringstream fromWhereOrderByClause;
 
-    // If querying messages created within time range, get the column to be used for time
-    // restriction (message_time by default, not settable currently)
+      buildRejectedMessageQueryFromWhereOrderByClause(
+          0, queryOptions, tableMap, true, pageKeyCondition, fromWhereOrderByClause);
 
-    if (queryOptions.itsTimeOptions.itsObservationTime.empty() &&
-        (!queryOptions.itsTimeOptions.itsQueryValidRangeMessages))
-      timeRangeColumn =
-          getMessageTableTimeColumn(queryOptions.itsTimeOptions.getMessageTableTimeRangeColumn());
+      fromWhereOrderByClause << " LIMIT " << (pageToken.itsPageSize - rows + 1);
 
-    // Build select column expressions
+      const string query = pageSelectClause + fromWhereOrderByClause.str();
 
-    bool routeQuery = queryOptions.itsLocationOptions.itsWKTs.isRoute;
-    bool distinct = queryOptions.itsDistinctMessages;
-    string selectClause;
+      if (queryOptions.itsDebug)
+      {
+        cerr << "Query: " << query << '\n';
 
-    TableMap tableMap = buildMessageQuerySelectClause(messageQueryTables,
-                                                      stationIdList,
-                                                      queryOptions.itsMessageTypes,
-                                                      queryOptions.itsParameters,
-                                                      routeQuery,
-                                                      selectClause,
-                                                      messageColumnSelected,
-                                                      distinct);
+        size_t n = 1;
 
-    // Build column list and sort the columns to the requested order
+        for (auto const& value : queryParameters.getValues())
+          cerr << "  $" << n++ << " = " << value << '\n';
+      }
 
-    StationQueryData stationQueryData;
+      auto result = (queryParameters.empty()
+                         ? connection.executeNonTransaction(query)
+                         : connection.exec_params_p(query, queryParameters.getValues()));
 
-    for (auto const& table : tableMap)
-    {
-      for (auto const& column : table.second.itsSelectedColumns)
-        stationQueryData.itsColumns.push_back(column);
-    }
+      loadQueryResult(result, queryOptions.itsDebug, queryData, false);
 
-    sortColumnList(stationQueryData.itsColumns);
+      // Store the key of the last message returned from the result
 
-    string withClause;
+      size_t resultRows = std::min<size_t>(result.size(), pageToken.itsPageSize - rows);
 
-    if ((!stationIdList.empty()) && queryOptions.itsLocationOptions.itsWKTs.isRoute)
-    {
-      // Build 'request_stations' table ('WITH table AS ...') for input station id's',
-      // containing 'position' column for sorting the stations to route order
-      //
-      withClause = buildRequestStationsWithClause(stationIdList,
-                                                  queryOptions.itsLocationOptions.itsWKTs.isRoute);
+      if (resultRows > 0)
+      {
+        auto const& lastRow = result[resultRows - 1];
 
-      // Add 'request_stations' into tablemap for joining into main query
+        pageToken.itsNullIcao = nullIcao;
+        pageToken.itsIcao = (nullIcao ? "" : lastRow[pageIcaoColumn].as<string>());
+        pageToken.itsCreated = lastRow[pageCreatedColumn].as<std::int64_t>();
+        pageToken.itsMessage = lastRow[pageMessageColumn].as<string>();
+      }
 
-      auto& table = tableMap[requestStationsTable.itsName];
-      table.itsAlias = requestStationsTable.itsAlias;
-      table.itsJoin = requestStationsTable.itsJoin;
+      rows += result.size();
+
+      if (rows > pageToken.itsPageSize)
+        break;
     }
 
-    // If querying valid messages (in contrast to querying messages created within the given time
-    // range) the query is generated based on 'record_set' CTE using message_time restriction and
-    // thus enabling use of an index. Otherwise an indexed time column
-    // (queryOptions.itsTimeOptions.itsTimeRangeColumn) is expected to be used for 'created within'
-    // query; the query is generated directly against avidb_messages table
+    // The extra row fetched to check for more messages is not returned
 
-    bool filterMETARs = queryOptions.itsFilterMETARs && itsConfig->getFilterFIMETARxxx();
-    bool excludeSPECIs = queryOptions.itsExcludeSPECIs;
+    pageToken.itsLastPage = (rows <= pageToken.itsPageSize);
 
-    if (!queryOptions.itsTimeOptions.itsObservationTime.empty() ||
-        queryOptions.itsTimeOptions.itsQueryValidRangeMessages)
+    if (!pageToken.itsLastPage)
     {
-      // Build WITH clause for 'record_set' table containg all valid messages for given time
-      // instant/range.
-      //
-      // Note: By passing false instead of queryOptions.itsLocationOptions.itsWKTs.isRoute
-      // record_set.station_id is limited by IN (StationIdList) instead by subquery from
-      // request_stations table which makes the query slower (request_stations CTE is generated
-      // only for route query)
-
-      string recordSetWithClause;
-
-      if (queryOptions.itsTimeOptions.itsObservationTime.empty())
-        recordSetWithClause =
-            buildRecordSetWithClause(!queryOptions.itsLocationOptions.itsBBoxes.empty(),
-                                     false /*queryOptions.itsLocationOptions.itsWKTs.isRoute*/,
-                                     stationIdList,
-                                     queryOptions.itsMessageFormat,
-                                     queryOptions.itsMessageTypes,
-                                     itsConfig->getMessageTypes(),
-                                     itsConfig->getRecordSetStartTimeOffsetHours(),
-                                     itsConfig->getRecordSetEndTimeOffsetHours(),
-                                     queryOptions.itsTimeOptions.itsStartTime,
-                                     queryOptions.itsTimeOptions.itsEndTime);
-      else
-        recordSetWithClause =
-            buildRecordSetWithClause(!queryOptions.itsLocationOptions.itsBBoxes.empty(),
-                                     false /*queryOptions.itsLocationOptions.itsWKTs.isRoute*/,
-                                     stationIdList,
-                                     queryOptions.itsMessageFormat,
-                                     queryOptions.itsMessageTypes,
-                                     itsConfig->getMessageTypes(),
-                                     itsConfig->getRecordSetStartTimeOffsetHours(),
-                                     itsConfig->getRecordSetEndTimeOffsetHours(),
-                                     queryOptions.itsTimeOptions.itsObservationTime);
+      for (auto& values : queryData.itsValues)
+        values.second.resize(pageToken.itsPageSize);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      withClause += ((withClause.empty() ? "WITH " : ",") + recordSetWithClause);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query rejected messages
+ */
+// ----------------------------------------------------------------------
 
-      // Build WITH clause for 'message_validity' table containing configured message type specific
-      // validity length for message types having MessageValidTimeRange[Latest] or
-      // MessageTimeRange[Latest] restriction
+QueryData EngineImpl::queryRejectedMessages(const QueryOptions& queryOptions) const
+{
+  try
+  {
+    QueryMetrics::Call call(itsQueryMetrics, "queryRejectedMessages", queryOptions.itsMessageTypes);
 
-      string messageValidityWithClause = buildMessageTypeValidityWithClause(
-          queryOptions.itsMessageTypes, itsConfig->getMessageTypes());
+    QueryData queryData;
 
-      if (!messageValidityWithClause.empty())
-      {
-        withClause += ("," + messageValidityWithClause);
+    queryRejectedMessages(queryOptions, queryData);
 
-        if (queryOptions.itsTimeOptions.itsObservationTime.empty())
-        {
-          // If needed, add 'message_validity' into tablemap for joining into main query
-          // ('latest_messages' and 'messagetimerangelatest_messages' queries join
-          // to it by itself when needed).
-          //
-          list<TimeRangeType> timeRangeTypes;
-          timeRangeTypes.push_back(TimeRangeType::ValidTimeRange);
-          timeRangeTypes.push_back(TimeRangeType::ValidTimeRangeLatest);
-          timeRangeTypes.push_back(TimeRangeType::CreationValidTimeRange);
-          timeRangeTypes.push_back(TimeRangeType::CreationValidTimeRangeLatest);
-          timeRangeTypes.push_back(TimeRangeType::MessageValidTimeRange);
-          timeRangeTypes.push_back(TimeRangeType::MessageValidTimeRangeLatest);
-          timeRangeTypes.push_back(TimeRangeType::MessageTimeRange);
+    return queryData;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-          string noMessageValidityTypesIn = buildMessageTypeInClause(
-              queryOptions.itsMessageTypes, itsConfig->getMessageTypes(), timeRangeTypes);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query a page of rejected messages
+ */
+// ----------------------------------------------------------------------
 
-          if (!noMessageValidityTypesIn.empty())
-          {
-            //
-            // Because 'message_validity' contains data only for message types queried with
-            // MessageValidTimeRange[Latest] or MessageTimeRange[Latest] time restriction,
-            // it needs to be outer joined with avidb_message_types in the main query for querying
-            // message types with other time restriction types
-            //
-            auto& table = tableMap[messageValidityTable.itsName];
-            table.itsAlias = messageValidityTable.itsAlias;
-            table.itsJoin = messageValidityTable.itsJoin;
+QueryData EngineImpl::queryRejectedMessages(const QueryOptions& queryOptions,
+                                            RejectedMessagePageToken& pageToken) const
+{
+  try
+  {
+    QueryMetrics::Call call(
+        itsQueryMetrics, "queryRejectedMessagePage", queryOptions.itsMessageTypes);
 
-            timeRangeTypes.pop_back();  // Erase MessageTimeRange, MessageValidTimeRangeLatest and
-                                        // MessageValidTimeRange
-            timeRangeTypes.pop_back();  //
-            timeRangeTypes.pop_back();  //
+    QueryData queryData;
 
-            noMessageValidityTypesIn = buildMessageTypeInClause(
-                queryOptions.itsMessageTypes, itsConfig->getMessageTypes(), timeRangeTypes);
+    queryRejectedMessages(queryOptions, queryData, &pageToken);
 
-            table.leftOuter = (!noMessageValidityTypesIn.empty());
-          }
-          else
-          {
-            // Only MessageTimeRangeLatest types queried, no need to add 'message_validity' into the
-            // tablemap
-          }
-        }
-      }
+    return queryData;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      // If querying with observation time, build WITH clause for 'latest_messages' table containing
-      // message id's for the latest messages.
-      //
-      // Otherwise if querying valid MessageTimeRangeLatest messages, build WITH clause for
-      // 'messagetimerangelatest_messages' table containing message id's for the
-      // latest messages having message_time earlier than range start time in addition to all
-      // messages having starttime <= message_time < endtime
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query rejected messages and pass them to given callback in batches
+ */
+// ----------------------------------------------------------------------
 
-      if (!queryOptions.itsTimeOptions.itsObservationTime.empty())
-      {
-        // Build WITH clause for 'latest_messages' table
-        //
-        withClause +=
-            ("," + buildLatestMessagesWithClause(queryOptions.itsMessageTypes,
-                                                 itsConfig->getMessageTypes(),
-                                                 queryOptions.itsTimeOptions.itsObservationTime,
-                                                 queryOptions.itsTimeOptions.itsMessageCreatedTime,
-                                                 queryOptions.itsTimeOptions.itsUseCurrentTime,
-                                                 filterMETARs,
-                                                 excludeSPECIs,
-                                                 queryOptions.itsDistinctMessages,
-                                                 itsConfig->getFilterFIMETARxxxExcludeIcaos()));
+void EngineImpl::streamRejectedMessages(const QueryOptions& queryOptions,
+                                        const RejectedMessageBatchCallback& callback) const
+{
+  try
+  {
+    QueryMetrics::Call call(
+        itsQueryMetrics, "streamRejectedMessages", queryOptions.itsMessageTypes);
 
-        // Add 'latest_messages' into tablemap
-        //
-        // Note: 'latest_messages' is used thru subquery because of poor performance if joined.
+    RejectedMessageStream messageStream{Columns(), callback};
 
-        auto& table = tableMap[latestMessagesTable.itsName];
-        table.itsJoin = latestMessagesTable.itsJoin;
-        table.subQuery = true;
-      }
-      else
-        withClause +=
-            buildMessageTimeRangeMessagesWithClause(queryOptions.itsMessageTypes,
-                                                    itsConfig->getMessageTypes(),
-                                                    queryOptions.itsTimeOptions.itsStartTime,
-                                                    queryOptions.itsTimeOptions.itsEndTime,
-                                                    filterMETARs,
-                                                    excludeSPECIs,
-                                                    itsConfig->getFilterFIMETARxxxExcludeIcaos());
+    queryRejectedMessages(queryOptions, messageStream);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      withClause += " ";
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations asynchronously; the query options modified by the
+ *        query are returned with the data
+ */
+// ----------------------------------------------------------------------
 
-      // Replace avidb_messages with record_set in the tablemap; record_set contains all (columns
-      // of) needed avidb_messages rows, and is used instead
+std::future<StationQueryResult> EngineImpl::queryStationsAsync(
+    const QueryOptions& queryOptions) const
+{
+  try
+  {
+    return itsWorkerPool->submit<StationQueryResult>(
+        [this, queryOptions]()
+        {
+          StationQueryResult result{queryOptions, StationQueryData()};
+          result.itsQueryData = queryStations(result.itsQueryOptions);
 
-      auto it = tableMap.find(messageTableName);
+          return result;
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      if (it == tableMap.end())
-        throw Fmi::Exception(BCP, "queryMessages: internal: Unable to get avidb_messages table");
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query accepted messages asynchronously
+ */
+// ----------------------------------------------------------------------
 
-      auto recordSetTable = it->second;
-      tableMap.erase(it);
+std::future<StationQueryData> EngineImpl::queryMessagesAsync(const StationIdList& stationIdList,
+                                                             const QueryOptions& queryOptions) const
+{
+  try
+  {
+    return itsWorkerPool->submit<StationQueryData>(
+        [this, stationIdList, queryOptions]()
+        { return queryMessages(stationIdList, queryOptions); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      tableMap[recordSetTableName] = recordSetTable;
-    }
-    else
-    {
-      if (queryOptions.itsLocationOptions.itsWKTs.isRoute)
-      {
-        withClause += " ";
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query stations and/or accepted messages asynchronously; the query
+ *        options modified by the query are returned with the data
+ */
+// ----------------------------------------------------------------------
 
-        if (filterMETARs || excludeSPECIs)
+std::future<StationQueryResult> EngineImpl::queryStationsAndMessagesAsync(
+    const QueryOptions& queryOptions) const
+{
+  try
+  {
+    return itsWorkerPool->submit<StationQueryResult>(
+        [this, queryOptions]()
         {
-          // Ensure station table is joined into main query for METAR filtering or exclusion of
-          // SPECIs (for nonroute query it's joined anyways for ordering the rows by icao code)
-          //
-          string messageTypeIn = buildMessageTypeInClause(
-              queryOptions.itsMessageTypes, itsConfig->getMessageTypes(), list<TimeRangeType>());
+          StationQueryResult result{queryOptions, StationQueryData()};
+          result.itsQueryData = queryStationsAndMessages(result.itsQueryOptions);
 
-          if ((filterMETARs && (messageTypeIn.find("'METAR") != string::npos)) ||
-              (excludeSPECIs && (messageTypeIn.find("'SPECI'") != string::npos)))
-          {
-            auto& table = tableMap[stationTableName];
+          return result;
+        });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-            if (table.itsAlias.empty())
-              table.itsAlias = stationTableAlias;
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query rejected messages asynchronously
+ */
+// ----------------------------------------------------------------------
 
-            if (table.itsJoin.empty())
-              table.itsJoin = stationTableJoin;
-          }
-        }
-      }
+std::future<QueryData> EngineImpl::queryRejectedMessagesAsync(
+    const QueryOptions& queryOptions) const
+{
+  try
+  {
+    return itsWorkerPool->submit<QueryData>(
+        [this, queryOptions]() { return queryRejectedMessages(queryOptions); });
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-      // Filter by message format
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get per stage latency histograms of the api calls
+ */
+// ----------------------------------------------------------------------
 
-      auto& table = tableMap[messageFormatTableName];
-      table.itsAlias = messageFormatTableAlias;
-      table.itsJoin = queryOptions.itsMessageFormat == "TAC" ? messageFormatTableJoinTAC
-                                                             : messageFormatTableJoinIWXXM;
-    }
+QueryMetricsData EngineImpl::getQueryMetrics() const
+{
+  try
+  {
+    return itsQueryMetrics.getMetrics();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    // For time range query ensure tablemap contains message_types table for joining into main
-    // query; needed for message type or type specific time range restriction
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get FIR area geometry from GeoJSON
+ */
+// ----------------------------------------------------------------------
 
-    if (queryOptions.itsTimeOptions.itsObservationTime.empty())
+FIRAreaGeometry firAreaGeometry(std::shared_ptr<const std::string> geoJSON)
+{
+  try
+  {
+    FIRAreaGeometry geometry;
+
+    for (auto const& ring : FIRIndex::parseRings(*geoJSON))
     {
-      auto& table = tableMap[messageTypeTableName];
+      std::vector<double> coordinates;
+      coordinates.reserve(2 * ring.size());
 
-      if (table.itsAlias.empty())
-        table.itsAlias = messageTypeTableAlias;
+      for (auto const& point : ring)
+      {
+        coordinates.push_back(point.itsLon);
+        coordinates.push_back(point.itsLat);
+      }
 
-      if (table.itsJoin.empty())
-        table.itsJoin = messageTypeTableJoin;
+      geometry.itsRings.push_back(std::move(coordinates));
+      geometry.itsVertexCount += ring.size();
     }
 
-    // Max row count for the query; if exceeded, an error is thrown; if <= 0, unlimited
+    geometry.itsGeoJSON = std::move(geoJSON);
 
-    int maxMessageRows = (queryOptions.itsMaxMessageRows >= 0 ? queryOptions.itsMaxMessageRows
-                                                              : itsConfig->getMaxMessageRows());
+    return geometry;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    // Build from, where and order by clause (by avidb_stations.icao_code or by route segment index
-    // and station's distance to the start of the segment) and execute query
+}  // namespace
 
-    ostringstream fromWhereOrderByClause;
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query FIR areas
+ *
+ * The areas are returned from the current snapshot. Published snapshots
+ * are retained, the returned reference stays valid when the areas are
+ * reloaded
+ */
+// ----------------------------------------------------------------------
 
-    buildMessageQueryFromWhereOrderByClause(maxMessageRows,
-                                            stationIdList,
-                                            queryOptions,
-                                            tableMap,
-                                            *itsConfig,
-                                            timeRangeColumn,
-                                            distinct,
-                                            fromWhereOrderByClause);
+const FIRQueryData& EngineImpl::queryFIRAreas() const
+{
+  try
+  {
+    return *(getFIRAreaSnapshot()->itsAreas);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    executeQuery<StationQueryData>(connection,
-                                   withClause + selectClause + fromWhereOrderByClause.str(),
-                                   queryOptions.itsDebug,
-                                   stationQueryData,
-                                   queryOptions.itsDistinctMessages,
-                                   maxMessageRows);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query FIR areas of the current snapshot as shared pointer
+ */
+// ----------------------------------------------------------------------
 
-    return stationQueryData;
+std::shared_ptr<const FIRQueryData> EngineImpl::queryFIRAreasShared() const
+{
+  try
+  {
+    return getFIRAreaSnapshot()->itsAreas;
   }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
-//
-// public api stub
-//
-StationQueryData EngineImpl::queryMessages(const StationIdList& stationIdList,
-                                           const QueryOptions& queryOptions) const
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query FIR areas at full resolution and simplified with the
+ *        configured tolerances
+ */
+// ----------------------------------------------------------------------
+
+const FIRAreaResolutions& EngineImpl::queryFIRAreaResolutions() const
 {
   try
   {
-    auto connectionPtr = itsConnectionPool->get();
-    auto& connection = *connectionPtr.get();
+    return getFIRAreaSnapshot()->itsResolutions;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query FIR areas at all resolutions sharing the current snapshot
+ */
+// ----------------------------------------------------------------------
+
+std::shared_ptr<const FIRAreaResolutions> EngineImpl::queryFIRAreaResolutionsShared() const
+{
+  try
+  {
+    auto snapshot = getFIRAreaSnapshot();
 
-    return queryMessages(connection, stationIdList, queryOptions, true);
+    return std::shared_ptr<const FIRAreaResolutions>(snapshot, &snapshot->itsResolutions);
   }
   catch (...)
   {
@@ -4777,77 +8908,62 @@ StationQueryData EngineImpl::queryMessages(const StationIdList& stationIdList,
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Join station data to another by station id
+ * \brief Query FIR areas simplified with the largest configured tolerance
+ *        not exceeding given tolerance
  */
 // ----------------------------------------------------------------------
 
-StationQueryData& EngineImpl::joinStationAndMessageData(const StationQueryData& stationData,
-                                                        StationQueryData& messageData) const
+const FIRAreaResolution& EngineImpl::queryFIRAreas(double tolerance) const
 {
   try
   {
-    // If distance or bearing is available, copy the values from station data to message data
+    if (tolerance < 0)
+      throw Fmi::Exception(BCP, "Simplify tolerance must be >= 0");
 
-    bool hasDistance = ((find(stationData.itsColumns.begin(),
-                              stationData.itsColumns.end(),
-                              stationDistanceQueryColumn) != stationData.itsColumns.end()) &&
-                        (find(messageData.itsColumns.begin(),
-                              messageData.itsColumns.end(),
-                              stationDistanceQueryColumn) != messageData.itsColumns.end()));
-    bool hasBearing = ((find(stationData.itsColumns.begin(),
-                             stationData.itsColumns.end(),
-                             stationBearingQueryColumn) != stationData.itsColumns.end()) &&
-                       (find(messageData.itsColumns.begin(),
-                             messageData.itsColumns.end(),
-                             stationBearingQueryColumn) != messageData.itsColumns.end()));
+    auto const& resolutions = getFIRAreaSnapshot()->itsResolutions;
 
-    if (hasDistance || hasBearing)
-    {
-      for (auto const& station : stationData.itsValues)
-        // Ignore stations having no messages.
-        //
-        // Note: The input data's have station id as a map key. If the 'station' data contains
-        // distance and/or bearing, copy the values to 'message' data
-        //
-        if (messageData.itsValues.find(station.first) != messageData.itsValues.end())
-        {
-          if (hasDistance)
-          {
-            // Copy nonnull distance value to all message rows for the station
-            //
-            auto const& distanceValue =
-                station.second.find(stationDistanceQueryColumn)->second.front();
+    // Full resolution areas are stored first
+
+    auto resolution = std::upper_bound(resolutions.begin(),
+                                       resolutions.end(),
+                                       tolerance,
+                                       [](double value, const FIRAreaResolution& resolution)
+                                       { return value < resolution.itsTolerance; });
+
+    return *(--resolution);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get FIR area snapshot
+ *
+ * The snapshot is loaded and refreshed by a background task; if it is
+ * not loaded yet, it is loaded now
+ */
+// ----------------------------------------------------------------------
 
-            const double* distancePtr = std::get_if<double>(&distanceValue);
-            if (distancePtr)
-            {
-              auto stationDistance = *distancePtr;
+std::shared_ptr<const EngineImpl::FIRAreaSnapshot> EngineImpl::getFIRAreaSnapshot() const
+{
+  try
+  {
+    auto snapshot = std::atomic_load(&itsFIRAreaSnapshot);
 
-              for (auto& distance :
-                   messageData.itsValues[station.first][stationDistanceQueryColumn])
-                distance = stationDistance;
-            }
-          }
+    if (snapshot)
+      return snapshot;
 
-          if (hasBearing)
-          {
-            // Copy bearing value to all message rows for the station
-            //
-            auto const& bearingValue =
-                station.second.find(stationBearingQueryColumn)->second.front();
+    loadFIRAreas();
 
-            if (const double* bearingPtr = std::get_if<double>(&bearingValue))
-            {
-              auto stationBearing = *bearingPtr;
+    snapshot = std::atomic_load(&itsFIRAreaSnapshot);
 
-              for (auto& bearing : messageData.itsValues[station.first][stationBearingQueryColumn])
-                bearing = stationBearing;
-            }
-          }
-        }
-    }
+    if (!snapshot)
+      throw Fmi::Exception(BCP, "FIR areas are not available");
 
-    return messageData;
+    return snapshot;
   }
   catch (...)
   {
@@ -4857,138 +8973,118 @@ StationQueryData& EngineImpl::joinStationAndMessageData(const StationQueryData&
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query stations and/or accepted messages.
+ * \brief Load/refresh FIR areas
  *
- *        This method serves for convenience, by executing station and message queries
- *        and joining the data.
+ * The areas are reloaded and a new snapshot is published only if the
+ * checksum of the FIR table (area id's and geometries) has changed
  */
 // ----------------------------------------------------------------------
 
-StationQueryData EngineImpl::queryStationsAndMessages(QueryOptions& queryOptions) const
+void EngineImpl::loadFIRAreas() const
 {
   try
   {
-    if (queryOptions.itsValidity == Validity::Rejected)
-      throw Fmi::Exception(
-          BCP,
-          "queryStationsAndMessages() can't be used to query rejected messages; use "
-          "queryRejectedMessages() instead");
+    std::lock_guard<std::mutex> lock(itsFIRMutex);
 
-    validateTimes(queryOptions);
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-    // Query station scoped, FIR scped and global scoped stations and messages.
-    //
-    // If route query (single linestring wkt) is requested, query each scope separately;
-    // otherwise fetch all messages (message types) with single query
+    const string checksumQuery(
+        "SELECT md5(COALESCE(string_agg(gid::text || ':' || md5(ST_AsBinary(areageom)),',' "
+        "ORDER BY gid),'')) FROM icao_fir_yhdiste");
 
-    auto connectionPtr = itsConnectionPool->get();
-    auto& connection = *connectionPtr.get();
+    auto snapshot = std::atomic_load(&itsFIRAreaSnapshot);
+    auto result = connection.executeNonTransaction(checksumQuery);
 
-    StringList queryMessageTypes(queryOptions.itsMessageTypes.begin(),
-                                 queryOptions.itsMessageTypes.end());
+    if (result.empty())
+      return;
 
-    StationQueryData stationScopeStations;
-    StationQueryData firScopeStations;
-    StationQueryData globalScopeStations;
-    StationQueryData stationScopeMessages;
-    StationQueryData firScopeMessages;
-    StationQueryData globalScopeMessages;
-    StationQueryData* data = nullptr;
+    auto checksum = result[0][0].as<string>();
 
-    struct ScopeData
-    {
-      MessageScope scope;
-      StationQueryData& stationData;
-      StationQueryData& messageData;
-    };
+    if (snapshot && (checksum == snapshot->itsChecksum))
+      return;
 
-    MessageScope stationOrAll = MessageScope::NoScope;
+    // The simplified geometries are selected as geom1, geom2, ... in increasing tolerance order
 
-    if (!queryOptions.itsLocationOptions.itsWKTs.itsWKTs.empty())
-    {
-      // Check for route query; whether to use scoped queries or single query for all message types
+    auto const& tolerances = itsConfig->getFIRAreaSimplifyTolerances();
+    ostringstream simplifiedGeoms;
 
-      validateWKTs(connection, queryOptions.itsLocationOptions, queryOptions.itsDebug);
+    simplifiedGeoms << setprecision(numeric_limits<double>::max_digits10);
 
-      if (queryOptions.itsLocationOptions.itsWKTs.isRoute)
-        stationOrAll = MessageScope::StationScope;
-    }
+    for (std::size_t n = 0; (n < tolerances.size()); n++)
+      simplifiedGeoms << ",ST_AsGeoJSON(ST_ForcePolygonCCW(ST_SimplifyPreserveTopology(areageom,"
+                      << tolerances[n] << "))) AS geom" << (n + 1);
 
-    // Validate all requested message types (without taking scope into account)
+    // The checksum is selected by the same statement to match the loaded areas even if the
+    // table is modified in between
 
-    validateMessageTypes(connection, queryMessageTypes, queryOptions.itsDebug);
+    string query(
+        "SELECT gid, ST_AsGeoJSON(ST_ForcePolygonCCW(areageom)) AS geom,"
+        "ST_XMin(areageom) AS xmin,ST_YMin(areageom) AS ymin,"
+        "ST_XMax(areageom) AS xmax,ST_YMax(areageom) AS ymax" +
+        simplifiedGeoms.str() + ",(" + checksumQuery +
+        ") AS checksum FROM icao_fir_yhdiste ORDER BY 1");
 
-    list<ScopeData> scopeDatas = {
-        {stationOrAll, stationScopeStations, stationScopeMessages},
-        {MessageScope::FIRScope, firScopeStations, firScopeMessages},
-        {MessageScope::GlobalScope, globalScopeStations, globalScopeMessages}};
+    result = connection.executeNonTransaction(query);
 
-    bool validateQuery = true;
+    auto newSnapshot = std::make_shared<FIRAreaSnapshot>();
+    newSnapshot->itsChecksum = checksum;
+    auto& resolutions = newSnapshot->itsResolutions;
 
-    for (auto& scope : scopeDatas)
-    {
-      scopeMessageTypes(queryMessageTypes,
-                        itsConfig->getMessageTypes(),
-                        scope.scope,
-                        queryOptions.itsMessageTypes);
+    resolutions.resize(tolerances.size() + 1);
 
-      if (!queryOptions.itsMessageTypes.empty())
-      {
-        // Query stations
+    for (std::size_t n = 0; (n < tolerances.size()); n++)
+      resolutions[n + 1].itsTolerance = tolerances[n];
 
-        scope.stationData = queryStations(connection, queryOptions, validateQuery);
-        validateQuery = false;
+    auto areas = std::make_shared<FIRQueryData>();
 
-        if ((scope.scope == MessageScope::GlobalScope) || !scope.stationData.itsStationIds.empty())
-        {
-          // Query messages if any message column were requested
+    for (pqxx::result::const_iterator row = result.begin(); (row != result.end()); row++)
+    {
+      // Dereference the iterator to a row before indexing by column: libpqxx 8 no longer lets a
+      // result iterator be indexed as a row.
+      const auto& dbRow = *row;
+      auto gid = dbRow["gid"].as<int>();
+      auto geom = dbRow["geom"].as<string>();
+      auto xmin = dbRow["xmin"].as<double>();
+      auto ymin = dbRow["ymin"].as<double>();
+      auto xmax = dbRow["xmax"].as<double>();
+      auto ymax = dbRow["ymax"].as<double>();
 
-          if (queryOptions.itsMessageColumnSelected)
-          {
-            // Query messages and join station and message data to get distance and bearing values
-            // for message data rows
-            //
-            scope.messageData = queryMessages(
-                connection, scope.stationData.itsStationIds, queryOptions, validateQuery);
-            joinStationAndMessageData(scope.stationData, scope.messageData);
+      BBox bbox(xmin, xmax, ymin, ymax);
 
-            // Collect/combine data
+      areas->insert(std::make_pair(gid, std::make_pair(std::move(geom), bbox)));
+      newSnapshot->itsChecksum = dbRow["checksum"].as<string>();
+    }
 
-            if (!data)
-              data = &scope.messageData;
+    newSnapshot->itsAreas = areas;
 
-            if (data != &scope.messageData)
-              for (const auto& station : scope.messageData.itsValues)
-              {
-                auto its = data->itsValues.insert(make_pair(station.first, QueryValues()));
+    for (pqxx::result::const_iterator row = result.begin(); (row != result.end()); row++)
+    {
+      const auto& dbRow = *row;
+      auto gid = dbRow["gid"].as<int>();
 
-                if (its.second)
-                  data->itsStationIds.push_back(station.first);
+      for (std::size_t n = 0; (n < resolutions.size()); n++)
+      {
+        // Full resolution geometry shares the area's GeoJSON, keeping the areas alive
 
-                for (auto column : station.second)
-                {
-                  auto itc = its.first->second.insert(make_pair(column.first, ValueVector()));
-                  itc.first->second.insert(
-                      itc.first->second.end(), column.second.begin(), column.second.end());
-                }
-              }
-          }
-          else
-          {
-            if (data)
-              data->itsValues.insert(scope.stationData.itsValues.begin(),
-                                     scope.stationData.itsValues.end());
+        auto geoJSON =
+            ((n == 0) ? std::shared_ptr<const string>(newSnapshot->itsAreas,
+                                                      &newSnapshot->itsAreas->at(gid).first)
+                      : std::make_shared<const string>(
+                            dbRow[string("geom") + Fmi::to_string(n)].as<string>()));
+        auto geometry = firAreaGeometry(std::move(geoJSON));
 
-            data = &scope.stationData;
-          }
-        }
+        resolutions[n].itsVertexCount += geometry.itsVertexCount;
+        resolutions[n].itsAreas.insert(std::make_pair(gid, std::move(geometry)));
       }
-
-      if (scope.scope == MessageScope::NoScope)
-        break;
     }
 
-    return data ? *data : stationScopeStations;
+    newSnapshot->itsIndex = FIRIndex(*newSnapshot->itsAreas);
+
+    std::shared_ptr<const FIRAreaSnapshot> publishedSnapshot(std::move(newSnapshot));
+
+    itsPublishedFIRAreaSnapshots.push_back(publishedSnapshot);
+    std::atomic_store(&itsFIRAreaSnapshot, publishedSnapshot);
   }
   catch (...)
   {
@@ -4998,77 +9094,181 @@ StationQueryData EngineImpl::queryStationsAndMessages(QueryOptions& queryOptions
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query rejected messages
+ * \brief Check if stations can be queried from station catalog.
+ *
+ * Wkt queries need spatial functions, they are executed by database.
+ * Station names are compared in ascii upper case by the catalog.
  */
 // ----------------------------------------------------------------------
 
-QueryData EngineImpl::queryRejectedMessages(const QueryOptions& queryOptions) const
+bool EngineImpl::stationCatalogCovers(const QueryOptions& queryOptions)
 {
   try
   {
-    // Validate time options, parameters and message types
+    auto const& locationOptions = queryOptions.itsLocationOptions;
 
-    if (!queryOptions.itsTimeOptions.itsObservationTime.empty())
-      throw Fmi::Exception(BCP, "Time range must be used to query rejected messages");
+    return (locationOptions.itsWKTs.itsWKTs.empty() && isAscii(locationOptions.itsPlaces));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    validateTimes(queryOptions);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load stations from station catalog into given data object
+ */
+// ----------------------------------------------------------------------
 
-    auto connectionPtr = itsConnectionPool->get();
-    auto& connection = *connectionPtr.get();
+void EngineImpl::loadStationCatalogResult(const StationInfoList& stations,
+                                          StationQueryData& stationQueryData)
+{
+  try
+  {
+    for (const auto* station : stations)
+      loadStationCatalogResult(*station, nullptr, stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    bool messageColumnSelected;
+void EngineImpl::loadStationCatalogResult(const StationDistanceList& stations,
+                                          StationQueryData& stationQueryData)
+{
+  try
+  {
+    for (const auto& station : stations)
+      loadStationCatalogResult(*station.itsStation, &station, stationQueryData);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    validateParameters(queryOptions.itsParameters, Validity::Rejected, messageColumnSelected);
+void EngineImpl::loadStationCatalogResult(const StationInfo& station,
+                                          const StationDistance* stationDistance,
+                                          StationQueryData& stationQueryData)
+{
+  try
+  {
+    // As with database query, stations not within any FIR are skipped when querying FIR id
 
-    if (!queryOptions.itsMessageTypes.empty())
-      validateMessageTypes(connection, queryOptions.itsMessageTypes, queryOptions.itsDebug);
+    if ((!station.itsFIRId) &&
+        (find(stationQueryData.itsColumns.begin(),
+              stationQueryData.itsColumns.end(),
+              firIdQueryColumn) != stationQueryData.itsColumns.end()))
+      return;
 
-    // Build select column expressions
+    // Maintain list of station id's in the order of appearance; skip already loaded stations
 
-    string selectClause;
-    bool distinct = false;
+    auto stationQueryValues =
+        stationQueryData.itsValues.insert(std::make_pair(station.itsId, QueryValues()));
 
-    TableMap tableMap = buildMessageQuerySelectClause(rejectedMessageQueryTables,
-                                                      StationIdList(),
-                                                      queryOptions.itsMessageTypes,
-                                                      queryOptions.itsParameters,
-                                                      false,
-                                                      selectClause,
-                                                      messageColumnSelected,
-                                                      distinct);
+    if (!stationQueryValues.second)
+      return;
 
-    // Build column list and sort the columns to the requested order
+    stationQueryData.itsStationIds.push_back(station.itsId);
 
-    QueryData queryData;
+    QueryValues& queryValues = stationQueryValues.first->second;
 
-    for (auto const& table : tableMap)
+    for (const Column& column : stationQueryData.itsColumns)
     {
-      for (auto const& column : table.second.itsSelectedColumns)
-        queryData.itsColumns.push_back(column);
+      // Automatically selected station id and distance are not stored as columns
+
+      if (column.itsSelection == ColumnSelection::Automatic)
+        continue;
+
+      queryValues[column.itsName].push_back(stationColumnValue(station, stationDistance, column));
     }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
 
-    sortColumnList(queryData.itsColumns);
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get current station catalog snapshot; nullptr if not (yet) loaded
+ */
+// ----------------------------------------------------------------------
 
-    // Max row count for the query; if exceeded, an error is thrown; if <= 0, unlimited
+std::shared_ptr<const StationCatalog> EngineImpl::getStationCatalog() const
+{
+  return std::atomic_load(&itsStationCatalog);
+}
 
-    int maxMessageRows = (queryOptions.itsMaxMessageRows >= 0 ? queryOptions.itsMaxMessageRows
-                                                              : itsConfig->getMaxMessageRows());
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load/refresh station catalog.
+ *
+ * The catalog is reloaded if avidb_stations row count or max modified_last
+ * differs from current snapshot's.
+ */
+// ----------------------------------------------------------------------
 
-    // Build from, where and order by clause (by rejected_messages.icao_code) and execute query
+void EngineImpl::loadStationCatalog()
+{
+  try
+  {
+    auto stationCatalog = getStationCatalog();
 
-    ostringstream fromWhereOrderByClause;
+    // Station FIR id's are set using the current FIR areas; the catalog is rebuilt if the areas
+    // have changed. If the areas can't be loaded, the catalog is built without FIR id's and
+    // rebuilt when the areas have been loaded
 
-    buildRejectedMessageQueryFromWhereOrderByClause(
-        maxMessageRows, queryOptions, tableMap, fromWhereOrderByClause);
+    std::shared_ptr<const FIRAreaSnapshot> firAreaSnapshot;
 
-    executeQuery<QueryData>(connection,
-                            selectClause + fromWhereOrderByClause.str(),
-                            queryOptions.itsDebug,
-                            queryData,
-                            false,
-                            maxMessageRows);
+    try
+    {
+      firAreaSnapshot = getFIRAreaSnapshot();
+    }
+    catch (...)
+    {
+      Fmi::Exception::Trace(BCP, "FIR areas not available, station FIR id's are not set")
+          .printError();
+    }
 
-    return queryData;
+    // The connection is taken after loading the FIR areas (which takes a connection of its own)
+
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
+
+    if (stationCatalog && (firAreaSnapshot == itsStationCatalogFIRAreaSnapshot))
+    {
+      auto result = connection.executeNonTransaction(
+          "SELECT COUNT(*) AS count,MAX(modified_last) AT TIME ZONE 'UTC' AS modified_last "
+          "FROM avidb_stations");
+
+      if (result.empty())
+        return;
+
+      const auto& dbRow = result[0];
+      auto count = dbRow["count"].as<long>();
+      auto modifiedLast = (dbRow["modified_last"].is_null()
+                               ? Fmi::DateTime()
+                               : Fmi::DateTime::from_string(dbRow["modified_last"].as<string>()));
+
+      if ((count == static_cast<long>(stationCatalog->size())) &&
+          (modifiedLast == stationCatalog->getModifiedLast()))
+        return;
+    }
+
+    auto result = connection.executeNonTransaction(string(stationInfoSelectClause) +
+                                                   " FROM avidb_stations");
+
+    auto stations =
+        loadStationInfos(result, firAreaSnapshot ? &firAreaSnapshot->itsIndex : nullptr);
+
+    std::shared_ptr<const StationCatalog> newStationCatalog = std::make_shared<StationCatalog>(
+        std::move(stations), stationCatalog ? (stationCatalog->getVersion() + 1) : 1);
+
+    std::atomic_store(&itsStationCatalog, newStationCatalog);
+    itsStationCatalogFIRAreaSnapshot = firAreaSnapshot;
   }
   catch (...)
   {
@@ -5078,27 +9278,18 @@ QueryData EngineImpl::queryRejectedMessages(const QueryOptions& queryOptions) co
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Query FIR areas
+ * \brief Load/update latest message cache.
  */
 // ----------------------------------------------------------------------
 
-const FIRQueryData& EngineImpl::queryFIRAreas() const
+void EngineImpl::updateLatestMessageCache()
 {
   try
   {
-    auto* ptr = itsFIRAreasPtr.load(std::memory_order_relaxed);
-
-    if (ptr)
-      return *ptr;
-
-    std::unique_lock<std::mutex> lock(itsFIRMutex);
-
-    loadFIRAreas();
-
-    if (!itsFIRAreas.empty())
-      itsFIRAreasPtr.store(&itsFIRAreas, std::memory_order_relaxed);
+    auto connectionPtr = getConnection();
+    auto& connection = *connectionPtr.get();
 
-    return itsFIRAreas;
+    itsLatestMessageCache->update(connection);
   }
   catch (...)
   {
@@ -5108,47 +9299,93 @@ const FIRQueryData& EngineImpl::queryFIRAreas() const
 
 // ----------------------------------------------------------------------
 /*!
- * \brief Load/store FIR areas
+ * \brief Invalidate cached results of the message types having new
+ *        messages
+ *
+ * Messages are polled by creation time instead of by message id, since
+ * message ids are not committed in increasing order. A message is
+ * committed after its creation time, so the poll starts configured commit
+ * lag before the previous poll; messages already seen by the previous polls
+ * are skipped. The first poll only fetches the database time; all results
+ * are invalidated since messages may have been stored before the poll
  */
 // ----------------------------------------------------------------------
 
-void EngineImpl::loadFIRAreas() const
+void EngineImpl::updateQueryResultCache()
 {
   try
   {
-    auto connectionPtr = itsConnectionPool->get();
+    auto connectionPtr = getConnection();
     auto& connection = *connectionPtr.get();
 
-    string query(
-        "SELECT gid, ST_AsGeoJSON(ST_ForcePolygonCCW(areageom)) AS geom,"
-        "ST_XMin(areageom) AS xmin,ST_YMin(areageom) AS ymin,"
-        "ST_XMax(areageom) AS xmax,ST_YMax(areageom) AS ymax"
-        " FROM icao_fir_yhdiste ORDER BY 1");
+    auto pollState = itsQueryResultCache->getPollState();
+    const string pollTimeExpression = timeColumnExpression("statement_timestamp()");
 
-    auto result = connection.executeNonTransaction(query);
+    if (pollState.itsPollTime < 0)
+    {
+      auto result = connection.executeNonTransaction("SELECT " + pollTimeExpression);
 
-    for (pqxx::result::const_iterator row = result.begin(); (row != result.end()); row++)
+      itsQueryResultCache->clear();
+
+      pollState.itsPollTime = result[0][0].as<std::int64_t>();
+      itsQueryResultCache->setPollState(std::move(pollState));
+
+      return;
+    }
+
+    std::int64_t since =
+        pollState.itsPollTime - (std::int64_t(itsConfig->getResultCacheCommitLag()) * 1000000);
+
+    auto result = connection.executeNonTransaction(
+        "SELECT " + pollTimeExpression +
+        " AS polltime,m.type,m.message_id,m.created FROM (SELECT 1) AS p LEFT JOIN "
+        "(SELECT UPPER(mt.type) AS type,me.message_id," +
+        timeColumnExpression("me.created") +
+        " AS created FROM avidb_messages me,avidb_message_types mt "
+        "WHERE me.created >= timestamptz 'epoch' + " + Fmi::to_string(since) +
+        " * interval '1 microsecond' AND me.type_id = mt.type_id) AS m ON true");
+
+    std::set<std::string> messageTypes;
+    std::map<long, std::int64_t> messages;
+
+    for (auto row : result)
     {
-      // Dereference the iterator to a row before indexing by column: libpqxx 8 no longer lets a
-      // result iterator be indexed as a row.
-      const auto& dbRow = *row;
-      auto gid = dbRow["gid"].as<int>();
-      auto geom = dbRow["geom"].as<string>();
-      auto xmin = dbRow["xmin"].as<double>();
-      auto ymin = dbRow["ymin"].as<double>();
-      auto xmax = dbRow["xmax"].as<double>();
-      auto ymax = dbRow["ymax"].as<double>();
+      pollState.itsPollTime = row[0].as<std::int64_t>();
 
-      BBox bbox(xmin, xmax, ymin, ymax);
+      if (row[2].is_null())
+        continue;
+
+      auto messageId = row[2].as<long>();
+
+      if (pollState.itsMessages.find(messageId) == pollState.itsMessages.end())
+        messageTypes.insert(row[1].as<string>());
 
-      itsFIRAreas.insert(std::make_pair(gid, std::make_pair(geom, bbox)));
+      messages[messageId] = row[3].as<std::int64_t>();
     }
+
+    // Messages created before the next poll's start time are not polled again
+
+    since = pollState.itsPollTime - (std::int64_t(itsConfig->getResultCacheCommitLag()) * 1000000);
+
+    for (auto it = messages.begin(); (it != messages.end());)
+      if (it->second < since)
+        it = messages.erase(it);
+      else
+        it++;
+
+    pollState.itsMessages = std::move(messages);
+
+    if (!messageTypes.empty())
+      itsQueryResultCache->invalidate(messageTypes);
+
+    itsQueryResultCache->setPollState(std::move(pollState));
   }
   catch (...)
   {
     throw Fmi::Exception::Trace(BCP, "Operation failed!");
   }
 }
+
 }  // namespace Avi
 }  // namespace Engine
 }  // namespace SmartMet
@@ -2,7 +2,24 @@
 
 #include "Config.h"
 #include "Engine.h"
+#include "FIRIndex.h"
+#include "InFlightQueries.h"
+#include "LatestMessageCache.h"
+#include "QueryMetrics.h"
+#include "QueryParameters.h"
+#include "QueryResultCache.h"
+#include "RouteCache.h"
+#include "StationCatalog.h"
+#include "WorkerPool.h"
 #include <macgyver/PostgreSQLConnection.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
 
 namespace SmartMet
 {
@@ -16,24 +33,132 @@ class EngineImpl : public Engine
  public:
   EngineImpl(std::string theConfigFileName);
   EngineImpl() = delete;
+  ~EngineImpl() override;
 
   StationQueryData queryStations(QueryOptions &queryOptions) const override;
   StationQueryData queryMessages(const StationIdList &stationIdList,
                                  const QueryOptions &queryOptions) const override;
+  StationQueryData queryMessages(const StationIdList &stationIdList,
+                                 const QueryOptions &queryOptions,
+                                 MessagePageToken &pageToken) const override;
+  StationQueryTable queryMessageTable(const StationIdList &stationIdList,
+                                      const QueryOptions &queryOptions) const override;
   StationQueryData &joinStationAndMessageData(const StationQueryData &stationData,
                                               StationQueryData &messageData) const override;
 
   StationQueryData queryStationsAndMessages(QueryOptions &queryOptions) const override;
+  std::vector<StationQueryData> queryBatch(
+      std::vector<QueryOptions> &queryOptionsList) const override;
+
+  void streamMessages(const StationIdList &stationIdList,
+                      const QueryOptions &queryOptions,
+                      const MessageBatchCallback &callback) const override;
 
   QueryData queryRejectedMessages(const QueryOptions &queryOptions) const override;
+  QueryData queryRejectedMessages(const QueryOptions &queryOptions,
+                                  RejectedMessagePageToken &pageToken) const override;
+  void streamRejectedMessages(const QueryOptions &queryOptions,
+                              const RejectedMessageBatchCallback &callback) const override;
 
   const FIRQueryData &queryFIRAreas() const override;
+  std::shared_ptr<const FIRQueryData> queryFIRAreasShared() const override;
+  const FIRAreaResolutions &queryFIRAreaResolutions() const override;
+  std::shared_ptr<const FIRAreaResolutions> queryFIRAreaResolutionsShared() const override;
+  const FIRAreaResolution &queryFIRAreas(double tolerance) const override;
+
+  std::future<StationQueryResult> queryStationsAsync(
+      const QueryOptions &queryOptions) const override;
+  std::future<StationQueryData> queryMessagesAsync(
+      const StationIdList &stationIdList, const QueryOptions &queryOptions) const override;
+  std::future<StationQueryResult> queryStationsAndMessagesAsync(
+      const QueryOptions &queryOptions) const override;
+  std::future<QueryData> queryRejectedMessagesAsync(
+      const QueryOptions &queryOptions) const override;
+
+  QueryMetricsData getQueryMetrics() const override;
 
  protected:
   void init() override;
   void shutdown() override;
 
  private:
+  // Streamed query result sinks; columns are set by the query
+
+  struct MessageStream
+  {
+    Columns itsColumns;
+    const MessageBatchCallback &itsCallback;
+  };
+
+  struct RejectedMessageStream
+  {
+    Columns itsColumns;
+    const RejectedMessageBatchCallback &itsCallback;
+  };
+
+  // Duplicate message filtering state; passed from a streamed batch to the next. The rows are
+  // ordered by message group (station, message type and message time), so only the current
+  // group's messages are kept. Message texts refer to the result being loaded; when the load
+  // ends, only the hashes are kept
+
+  struct MessageRowFilter
+  {
+    struct Message
+    {
+      std::uint64_t itsHash;
+      const char *itsText;  // Text in the result being loaded, or nullptr
+      std::size_t itsSize;
+    };
+
+    bool isDuplicate(StationIdType theStationId,
+                     int theTypeId,
+                     std::int64_t theMessageTime,
+                     const char *theMessage,
+                     std::size_t theSize);
+    void setGroup(StationIdType theStationId, int theTypeId, std::int64_t theMessageTime);
+    void releaseTexts();
+
+    StationIdType itsStationId = 0;
+    int itsTypeId = 0;
+    std::int64_t itsMessageTime = 0;
+    std::vector<Message> itsMessages;
+  };
+
+  // Pooled connection; the number of connections taken from the pool is counted, so that a
+  // query already holding a connection can take additional ones only if they are free and
+  // never blocks waiting for them (concurrent queries could otherwise deadlock each other)
+
+  class PooledConnection
+  {
+   public:
+    using Handle = decltype(std::declval<Fmi::Database::PostgreSQLConnectionPool &>().get());
+
+    PooledConnection(Handle theHandle, std::atomic<unsigned int> &theConnectionsInUse)
+        : itsHandle(std::move(theHandle)), itsConnectionsInUse(theConnectionsInUse)
+    {
+    }
+
+    ~PooledConnection()
+    {
+      itsHandle.reset();
+      itsConnectionsInUse--;
+    }
+
+    PooledConnection() = delete;
+    PooledConnection(const PooledConnection &) = delete;
+    PooledConnection &operator=(const PooledConnection &) = delete;
+
+    auto *get() const { return itsHandle->get(); }
+
+   private:
+    std::optional<Handle> itsHandle;
+    std::atomic<unsigned int> &itsConnectionsInUse;
+  };
+
+  // Time chunks (start and end time) of a time range query split into parts
+
+  using TimeChunks = std::vector<std::pair<Fmi::DateTime, Fmi::DateTime>>;
+
   static void validateTimes(const QueryOptions &queryOptions);
   static void validateParameters(const StringList &paramList,
                                  Validity validity,
@@ -58,6 +183,13 @@ class EngineImpl : public Engine
                             const StringList &messageTypeList,
                             bool debug) const;
 
+  static void validateStationIds(const StationCatalog &stationCatalog,
+                                 const StationIdList &stationIdList);
+  static void validateIcaos(const StationCatalog &stationCatalog, const StringList &icaoList);
+  static void validatePlaces(const StationCatalog &stationCatalog, StringList &placeNameList);
+  static void validateCountries(const StationCatalog &stationCatalog,
+                                const StringList &countryList);
+
   static const Column *getMessageTableTimeColumn(const std::string &timeColumn);
 
   static const Column *getQueryColumn(const ColumnTable &tableColumns,
@@ -86,7 +218,24 @@ class EngineImpl : public Engine
                        bool debug,
                        T &queryData,
                        bool distinctRows = true,
+                       int maxRows = 0,
+                       MessageRowFilter *rowFilter = nullptr) const;
+  template <typename T, typename RowIterator>
+  void loadResultRows(const pqxx::result &result,
+                      RowIterator firstRow,
+                      RowIterator lastRow,
+                      T &queryData,
+                      bool distinctRows,
+                      MessageRowFilter *rowFilter) const;
+  void loadQueryResult(const pqxx::result &result,
+                       bool debug,
+                       StationQueryTable &queryTable,
+                       bool distinctRows = true,
                        int maxRows = 0) const;
+  void loadQueryRows(const pqxx::result &result,
+                     StationQueryTable &queryTable,
+                     bool distinctRows,
+                     MessageRowFilter &rowFilter) const;
   template <typename T>
   void executeQuery(const Fmi::Database::PostgreSQLConnection &connection,
                     const std::string &query,
@@ -94,6 +243,12 @@ class EngineImpl : public Engine
                     T &queryData,
                     bool distinctRows = true,
                     int maxRows = 0) const;
+  void executeQuery(const Fmi::Database::PostgreSQLConnection &connection,
+                    const std::string &query,
+                    bool debug,
+                    RejectedMessageStream &queryStream,
+                    bool distinctRows,
+                    int maxRows) const;
   template <typename T>
   void executeParamQuery(const Fmi::Database::PostgreSQLConnection &connection,
                          const std::string &query,
@@ -110,6 +265,35 @@ class EngineImpl : public Engine
                          T &queryData,
                          bool distinctRows = true,
                          int maxRows = 0) const;
+  template <typename T>
+  void executePreparedQuery(const Fmi::Database::PostgreSQLConnection &connection,
+                            const std::string &query,
+                            const QueryParameters &queryParameters,
+                            bool debug,
+                            T &queryData,
+                            bool distinctRows = true,
+                            int maxRows = 0) const;
+  void executePreparedQuery(const Fmi::Database::PostgreSQLConnection &connection,
+                            const std::string &query,
+                            const QueryParameters &queryParameters,
+                            bool debug,
+                            MessageStream &queryStream,
+                            bool distinctRows,
+                            int maxRows) const;
+  static void executeCursorQuery(const Fmi::Database::PostgreSQLConnection &connection,
+                                 const std::string &query,
+                                 const QueryParameters &queryParameters,
+                                 bool debug,
+                                 int maxRows,
+                                 const std::function<void(const pqxx::result &)> &loadBatch);
+  pqxx::result executePrepared(const Fmi::Database::PostgreSQLConnection &connection,
+                               const std::string &query,
+                               const QueryParameters &queryParameters) const;
+  void executeFIRStationQuery(const Fmi::Database::PostgreSQLConnection &connection,
+                              const std::string &query,
+                              const QueryParameters &queryParameters,
+                              bool debug,
+                              StationQueryData &stationQueryData) const;
 
   void queryStationsWithIds(const Fmi::Database::PostgreSQLConnection &connection,
                             const StationIdList &stationIdList,
@@ -155,20 +339,183 @@ class EngineImpl : public Engine
   StationQueryData queryStations(const Fmi::Database::PostgreSQLConnection &connection,
                                  QueryOptions &queryOptions,
                                  bool validateQuery) const;
-  StationQueryData queryMessages(const Fmi::Database::PostgreSQLConnection &connection,
-                                 const StationIdList &stationIdList,
-                                 const QueryOptions &queryOptions,
+  StationQueryData queryStations(const StationCatalog &stationCatalog,
+                                 QueryOptions &queryOptions,
                                  bool validateQuery) const;
 
+  // Catalog of the stations looked up by station id's, icao codes or country codes in batch
+  // requests, queried with single query if station catalog is not available; nullptr if none
+
+  std::shared_ptr<const StationCatalog> queryBatchStationCatalog(
+      const Fmi::Database::PostgreSQLConnection &connection,
+      const std::vector<QueryOptions> &queryOptionsList) const;
+  template <typename T>
+  void queryMessages(const Fmi::Database::PostgreSQLConnection &connection,
+                     const StationIdList &stationIdList,
+                     const QueryOptions &queryOptions,
+                     bool validateQuery,
+                     T &queryData,
+                     MessagePageToken *pageToken = nullptr) const;
+  void queryMessagePage(const Fmi::Database::PostgreSQLConnection &connection,
+                        const StationIdList &stationIdList,
+                        const QueryOptions &queryOptions,
+                        const TableMap &tableMap,
+                        const std::string &withClause,
+                        const std::string &selectClause,
+                        QueryParameters &queryParameters,
+                        const Column *timeRangeColumn,
+                        MessagePageToken &pageToken,
+                        StationQueryData &queryData) const;
+  StationIdList getMessagePageStationIds(const StationIdList &stationIdList,
+                                         const QueryOptions &queryOptions,
+                                         const MessagePageToken &pageToken) const;
+  TimeChunks getMessageQueryTimeChunks(const QueryOptions &queryOptions) const;
+  void queryMessageTimeChunks(const Fmi::Database::PostgreSQLConnection &connection,
+                              const StationIdList &stationIdList,
+                              const QueryOptions &queryOptions,
+                              const TableMap &tableMap,
+                              const std::string &withClause,
+                              const std::string &selectClause,
+                              QueryParameters &queryParameters,
+                              const Column *timeRangeColumn,
+                              std::size_t timeRangeParameterIndex,
+                              const TimeChunks &timeChunks,
+                              int maxMessageRows,
+                              StationQueryData &queryData) const;
+  template <typename T>
+  void queryRejectedMessages(const QueryOptions &queryOptions,
+                             T &queryData,
+                             RejectedMessagePageToken *pageToken = nullptr) const;
+  void queryRejectedMessagePage(const Fmi::Database::PostgreSQLConnection &connection,
+                                const QueryOptions &queryOptions,
+                                const TableMap &tableMap,
+                                const std::string &selectClause,
+                                RejectedMessagePageToken &pageToken,
+                                QueryData &queryData) const;
+
+  StationQueryData queryDatabaseStationsAndMessages(QueryOptions &queryOptions) const;
+  template <typename Query>
+  StationQueryData queryCachedResult(const char *method,
+                                     const StationIdList *stationIdList,
+                                     const QueryOptions &queryOptions,
+                                     QueryOptions *modifiedOptions,
+                                     Query query) const;
+  long resultCacheTimeToLive(const StringList &messageTypes) const;
+
+  bool queryScopeStationsAndMessages(const Fmi::Database::PostgreSQLConnection &connection,
+                                     MessageScope scope,
+                                     QueryOptions &queryOptions,
+                                     bool validateQuery,
+                                     StationQueryData &stationData,
+                                     StationQueryData &messageData) const;
+
+  // FIR areas with their point-in-polygon index and simplified geometries. The snapshot is
+  // immutable; a new snapshot is published when the FIR table has changed
+
+  struct FIRAreaSnapshot
+  {
+    std::shared_ptr<const FIRQueryData> itsAreas;  // Shared with full resolution geometries
+    FIRIndex itsIndex;
+    FIRAreaResolutions itsResolutions;
+    std::string itsChecksum;
+  };
+
+  std::shared_ptr<const FIRAreaSnapshot> getFIRAreaSnapshot() const;
   void loadFIRAreas() const;
 
+  static bool stationCatalogCovers(const QueryOptions &queryOptions);
+  static void loadStationCatalogResult(const StationInfoList &stations,
+                                       StationQueryData &stationQueryData);
+  static void loadStationCatalogResult(const StationDistanceList &stations,
+                                       StationQueryData &stationQueryData);
+  static void loadStationCatalogResult(const StationInfo &station,
+                                       const StationDistance *stationDistance,
+                                       StationQueryData &stationQueryData);
+  std::shared_ptr<const StationCatalog> getStationCatalog() const;
+  void loadStationCatalog();
+  void updateLatestMessageCache();
+  void updateQueryResultCache();
+
+  void startBackgroundTask(const std::string &taskName,
+                           unsigned int intervalSeconds,
+                           const std::function<void()> &task);
+  void stopBackgroundTasks();
+
+  // Get pooled connection; the wait time is recorded to the current call's metrics
+
+  PooledConnection getConnection() const;
+
+  // Get pooled connection if one is free right now, otherwise nullptr
+
+  std::unique_ptr<PooledConnection> tryGetConnection() const;
+
   std::string itsConfigFileName;
   std::shared_ptr<Config> itsConfig;
   std::unique_ptr<Fmi::Database::PostgreSQLConnectionPool> itsConnectionPool;
+  mutable std::atomic<unsigned int> itsConnectionsInUse{0};
+
+  // Station catalog snapshot; accessed with std::atomic_load/std::atomic_store
+
+  std::shared_ptr<const StationCatalog> itsStationCatalog;
+
+  // Cache of recent messages for latest message queries; updated by a background task
+
+  std::unique_ptr<LatestMessageCache> itsLatestMessageCache;
 
+  // Cache of message query results; invalidated by a background task polling for new messages
+
+  std::unique_ptr<QueryResultCache> itsQueryResultCache;
+
+  // Cache of route query stations; cleared when station catalog is reloaded
+
+  std::unique_ptr<RouteCache> itsRouteCache;
+
+  // Identical message queries in flight; concurrent callers share the result
+
+  mutable InFlightQueries itsInFlightQueries;
+
+  // Worker threads for asynchronous queries; sized to the connection pool
+
+  std::unique_ptr<WorkerPool> itsWorkerPool;
+
+  // Per stage latency metrics of the api calls
+
+  mutable QueryMetrics itsQueryMetrics;
+
+  // Statements prepared for each pooled connection; statement names by query text. The names
+  // are numbered per connection and the entries are cleared when the statements are found to
+  // have been lost by reopening the connection
+
+  struct PreparedStatements
+  {
+    std::map<std::string, std::string> itsNames;
+    std::size_t itsCounter = 0;
+  };
+
+  mutable std::mutex itsPreparedStatementMutex;
+  mutable std::map<const Fmi::Database::PostgreSQLConnection *, PreparedStatements>
+      itsPreparedStatements;
+
+  // Background tasks (e.g. station catalog refresh) run until shutdown
+
+  std::list<std::thread> itsBackgroundTasks;
+  std::mutex itsShutdownMutex;
+  std::condition_variable itsShutdownCondition;
+  bool itsShutdownRequested = false;
+
+  // FIR area snapshot; accessed with std::atomic_load/std::atomic_store. Loads are serialized
+  // by itsFIRMutex. All published snapshots are retained to keep the references returned by
+  // queryFIRAreas() and queryFIRAreaResolutions() valid for the lifetime of the engine; a new
+  // snapshot is published only when the FIR table content has changed
+
+  mutable std::shared_ptr<const FIRAreaSnapshot> itsFIRAreaSnapshot;
   mutable std::mutex itsFIRMutex;
-  mutable FIRQueryData itsFIRAreas;
-  mutable std::atomic<FIRQueryData *> itsFIRAreasPtr = nullptr;
+  mutable std::vector<std::shared_ptr<const FIRAreaSnapshot>> itsPublishedFIRAreaSnapshots;
+
+  // FIR area snapshot used for the station FIR id's of the current station catalog; accessed
+  // only by the station catalog refresh
+
+  std::shared_ptr<const FIRAreaSnapshot> itsStationCatalogFIRAreaSnapshot;
 };  // class EngineImpl
 
 }  // namespace Avi
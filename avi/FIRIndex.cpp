@@ -0,0 +1,197 @@
+// ======================================================================
+
+#include "FIRIndex.h"
+#include <macgyver/Exception.h>
+#include <cctype>
+#include <cstdlib>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the index
+ */
+// ----------------------------------------------------------------------
+
+FIRIndex::FIRIndex(const FIRQueryData &theFIRAreas)
+{
+  try
+  {
+    itsAreas.reserve(theFIRAreas.size());
+
+    for (auto const &firArea : theFIRAreas)
+    {
+      auto const &bbox = firArea.second.second;
+
+      itsAreas.push_back(Area{firArea.first,
+                              bbox.itsWest,
+                              bbox.itsSouth,
+                              bbox.itsEast,
+                              bbox.itsNorth,
+                              parseRings(firArea.second.first)});
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get id of the FIR containing given lon/lat
+ */
+// ----------------------------------------------------------------------
+
+std::optional<int> FIRIndex::getFIRId(double theLon, double theLat) const
+{
+  for (auto const &area : itsAreas)
+  {
+    if ((theLon < area.itsMinLon) || (theLon > area.itsMaxLon) || (theLat < area.itsMinLat) ||
+        (theLat > area.itsMaxLat))
+      continue;
+
+    if (contains(area.itsRings, theLon, theLat))
+      return area.itsId;
+  }
+
+  return std::nullopt;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the rings of GeoJSON Polygon or MultiPolygon
+ *
+ * The innermost arrays of "coordinates" are points; each array of points
+ * is a ring. Polygon and MultiPolygon differ only by nesting depth
+ */
+// ----------------------------------------------------------------------
+
+FIRIndex::Rings FIRIndex::parseRings(const std::string &theGeoJSON)
+{
+  try
+  {
+    auto pos = theGeoJSON.find("\"coordinates\"");
+
+    if (pos != std::string::npos)
+      pos = theGeoJSON.find('[', pos);
+
+    if (pos == std::string::npos)
+      throw Fmi::Exception(BCP, "GeoJSON coordinates not found");
+
+    Rings rings;
+    Ring ring;
+    int depth = 0;
+    int ringDepth = -1;
+    const char *c = theGeoJSON.c_str() + pos;
+
+    do
+    {
+      if (*c == '[')
+      {
+        // Point if the array starts with a number, otherwise nested array
+
+        const char *value = c + 1;
+
+        while (isspace(*value))
+          value++;
+
+        if ((*value != '-') && (*value != '.') && (!isdigit(*value)))
+        {
+          depth++;
+          c++;
+          continue;
+        }
+
+        char *end = nullptr;
+        double lon = strtod(value, &end);
+
+        while ((end != value) && isspace(*end))
+          end++;
+
+        if ((end == value) || (*end != ','))
+          throw Fmi::Exception(BCP, "Invalid GeoJSON coordinates");
+
+        value = end + 1;
+        double lat = strtod(value, &end);
+
+        if (end == value)
+          throw Fmi::Exception(BCP, "Invalid GeoJSON coordinates");
+
+        // Skip any additional ordinates
+
+        while (*end && (*end != ']'))
+          end++;
+
+        if (!(*end))
+          throw Fmi::Exception(BCP, "Invalid GeoJSON coordinates");
+
+        if (ringDepth < 0)
+          ringDepth = depth;
+        else if (ringDepth != depth)
+          throw Fmi::Exception(BCP, "Invalid GeoJSON coordinates");
+
+        ring.push_back(Point{lon, lat});
+        c = end + 1;
+      }
+      else if (*c == ']')
+      {
+        if (depth == ringDepth)
+        {
+          rings.push_back(std::move(ring));
+          ring = Ring();
+        }
+
+        depth--;
+        c++;
+      }
+      else if (*c)
+        c++;
+      else
+        throw Fmi::Exception(BCP, "Invalid GeoJSON coordinates");
+    } while (depth > 0);
+
+    return rings;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Test if lon/lat is within rings
+ */
+// ----------------------------------------------------------------------
+
+bool FIRIndex::contains(const Rings &theRings, double theLon, double theLat)
+{
+  bool inside = false;
+
+  for (auto const &ring : theRings)
+  {
+    for (std::size_t i = 0, j = ring.size() - 1; (i < ring.size()); j = i++)
+    {
+      auto const &p1 = ring[i];
+      auto const &p2 = ring[j];
+
+      if (((p1.itsLat > theLat) != (p2.itsLat > theLat)) &&
+          (theLon < (p2.itsLon - p1.itsLon) * (theLat - p1.itsLat) / (p2.itsLat - p1.itsLat) +
+                        p1.itsLon))
+        inside = !inside;
+    }
+  }
+
+  return inside;
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,76 @@
+// ======================================================================
+/*!
+ * \brief Point-in-polygon index over FIR areas
+ *
+ * The index is built once from the FIR areas (GeoJSON polygons and their
+ * bounding boxes) and answers which FIR contains given lon/lat without
+ * querying the database. Candidate areas are selected by bounding box
+ * and the point is tested against the rings of the area polygon(s).
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Engine.h"
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class FIRIndex
+{
+ public:
+  struct Point
+  {
+    double itsLon;
+    double itsLat;
+  };
+
+  using Ring = std::vector<Point>;
+  using Rings = std::vector<Ring>;
+
+  FIRIndex() = default;
+  FIRIndex(const FIRQueryData &theFIRAreas);
+
+  // Get id of the FIR containing given lon/lat; if the point is within multiple (overlapping)
+  // areas, only the smallest id is returned. Stations are thus assigned to a single FIR, whereas
+  // joining them to the FIR table with ST_Contains returned a row for each containing area
+
+  std::optional<int> getFIRId(double theLon, double theLat) const;
+
+  std::size_t size() const { return itsAreas.size(); }
+
+  // Get the rings of GeoJSON Polygon or MultiPolygon
+
+  static Rings parseRings(const std::string &theGeoJSON);
+
+  // Test if lon/lat is within rings (even-odd rule; holes and multiple polygons are handled
+  // as long as the polygons do not overlap)
+
+  static bool contains(const Rings &theRings, double theLon, double theLat);
+
+ private:
+  struct Area
+  {
+    int itsId;
+    double itsMinLon;
+    double itsMinLat;
+    double itsMaxLon;
+    double itsMaxLat;
+    Rings itsRings;
+  };
+
+  std::vector<Area> itsAreas;  // Sorted by id
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
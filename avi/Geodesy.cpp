@@ -0,0 +1,166 @@
+// ======================================================================
+
+#include "Geodesy.h"
+#include <macgyver/Exception.h>
+#include <cmath>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+// WGS84 spheroid
+
+const double wgs84A = 6378137.0;
+const double wgs84F = 1 / 298.257223563;
+const double wgs84B = wgs84A * (1 - wgs84F);
+
+// Mean earth radius used if Vincenty's iteration does not converge (nearly antipodal points)
+
+const double meanRadius = 6371008.8;
+
+const double degToRad = M_PI / 180;
+const double radToDeg = 180 / M_PI;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Great circle distance in meters
+ */
+// ----------------------------------------------------------------------
+
+double haversineDistance(double lon1, double lat1, double lon2, double lat2)
+{
+  double sinDLat = sin((lat2 - lat1) * degToRad / 2);
+  double sinDLon = sin((lon2 - lon1) * degToRad / 2);
+  double h = sinDLat * sinDLat + cos(lat1 * degToRad) * cos(lat2 * degToRad) * sinDLon * sinDLon;
+
+  return 2 * meanRadius * asin(std::min(1.0, sqrt(h)));
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Geodesic distance in meters on WGS84 spheroid (Vincenty's inverse formula)
+ */
+// ----------------------------------------------------------------------
+
+double geodesicDistance(double theLon1, double theLat1, double theLon2, double theLat2)
+{
+  const double L = (theLon2 - theLon1) * degToRad;
+  const double U1 = atan((1 - wgs84F) * tan(theLat1 * degToRad));
+  const double U2 = atan((1 - wgs84F) * tan(theLat2 * degToRad));
+  const double sinU1 = sin(U1);
+  const double cosU1 = cos(U1);
+  const double sinU2 = sin(U2);
+  const double cosU2 = cos(U2);
+
+  double lambda = L;
+  double sinSigma = 0;
+  double cosSigma = 0;
+  double sigma = 0;
+  double cosSqAlpha = 0;
+  double cos2SigmaM = 0;
+
+  for (int iteration = 0; (iteration < 200); iteration++)
+  {
+    const double sinLambda = sin(lambda);
+    const double cosLambda = cos(lambda);
+    const double t1 = cosU2 * sinLambda;
+    const double t2 = cosU1 * sinU2 - sinU1 * cosU2 * cosLambda;
+
+    sinSigma = sqrt(t1 * t1 + t2 * t2);
+
+    if (sinSigma == 0)
+      // Coincident points
+      return 0;
+
+    cosSigma = sinU1 * sinU2 + cosU1 * cosU2 * cosLambda;
+    sigma = atan2(sinSigma, cosSigma);
+
+    const double sinAlpha = cosU1 * cosU2 * sinLambda / sinSigma;
+
+    cosSqAlpha = 1 - sinAlpha * sinAlpha;
+    cos2SigmaM = ((cosSqAlpha != 0) ? (cosSigma - 2 * sinU1 * sinU2 / cosSqAlpha) : 0);
+
+    const double C = wgs84F / 16 * cosSqAlpha * (4 + wgs84F * (4 - 3 * cosSqAlpha));
+    const double prevLambda = lambda;
+
+    lambda = L + (1 - C) * wgs84F * sinAlpha *
+                     (sigma + C * sinSigma *
+                                  (cos2SigmaM + C * cosSigma * (-1 + 2 * cos2SigmaM * cos2SigmaM)));
+
+    if (fabs(lambda - prevLambda) < 1e-12)
+    {
+      const double uSq = cosSqAlpha * (wgs84A * wgs84A - wgs84B * wgs84B) / (wgs84B * wgs84B);
+      const double A = 1 + uSq / 16384 * (4096 + uSq * (-768 + uSq * (320 - 175 * uSq)));
+      const double B = uSq / 1024 * (256 + uSq * (-128 + uSq * (74 - 47 * uSq)));
+      const double deltaSigma =
+          B * sinSigma *
+          (cos2SigmaM +
+           B / 4 *
+               (cosSigma * (-1 + 2 * cos2SigmaM * cos2SigmaM) -
+                B / 6 * cos2SigmaM * (-3 + 4 * sinSigma * sinSigma) *
+                    (-3 + 4 * cos2SigmaM * cos2SigmaM)));
+
+      return wgs84B * A * (sigma - deltaSigma);
+    }
+  }
+
+  return haversineDistance(theLon1, theLat1, theLon2, theLat2);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Planar azimuth in degrees (clockwise from north) from point 1 to point 2
+ */
+// ----------------------------------------------------------------------
+
+std::optional<double> planarAzimuth(double theLon1, double theLat1, double theLon2, double theLat2)
+{
+  const double dx = theLon2 - theLon1;
+  const double dy = theLat2 - theLat1;
+
+  if ((dx == 0) && (dy == 0))
+    return std::nullopt;
+
+  double azimuth = atan2(dx, dy);
+
+  if (azimuth < 0)
+    azimuth += 2 * M_PI;
+
+  return azimuth * radToDeg;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Latitude and longitude deltas bounding all points within given distance
+ *
+ * The bounds are calculated on a sphere having WGS84 polar radius (decreased by 1%)
+ * to keep them conservative for spheroid distances
+ */
+// ----------------------------------------------------------------------
+
+void distanceBounds(double theLat, double theDistance, double &theLatDelta, double &theLonDelta)
+{
+  const double angularDistance = theDistance / (wgs84B * 0.99);
+
+  theLatDelta = angularDistance * radToDeg;
+
+  if ((angularDistance >= M_PI / 2) || ((fabs(theLat) + theLatDelta) >= 90))
+  {
+    theLonDelta = 180;
+    return;
+  }
+
+  theLonDelta = asin(std::min(1.0, sin(angularDistance) / cos(theLat * degToRad))) * radToDeg;
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,43 @@
+// ======================================================================
+/*!
+ * \brief Geodesic utilities for in-engine spatial queries
+ *
+ * The functions mimic the PostGIS functions used by the engine's
+ * station queries: geography distances are calculated on WGS84
+ * spheroid and geometry functions operate on planar lon/lat.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <optional>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+// Geodesic distance in meters on WGS84 spheroid (ST_Distance(geography,geography))
+
+double geodesicDistance(double theLon1, double theLat1, double theLon2, double theLat2);
+
+// Planar azimuth in degrees from point 1 to point 2 (DEGREES(ST_Azimuth(geometry,geometry)));
+// no value for identical points
+
+std::optional<double> planarAzimuth(double theLon1,
+                                    double theLat1,
+                                    double theLon2,
+                                    double theLat2);
+
+// Latitude and longitude deltas (degrees) bounding all points within given
+// geodesic distance (meters) of a point at given latitude. Longitude delta
+// is 180 if the area reaches a pole
+
+void distanceBounds(double theLat, double theDistance, double &theLatDelta, double &theLonDelta);
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,97 @@
+// ======================================================================
+
+#include "InFlightQueries.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Execute the query or wait for in-flight query with the same key
+ */
+// ----------------------------------------------------------------------
+
+InFlightQueries::ResultPtr InFlightQueries::execute(const std::string &theKey,
+                                                    const std::function<ResultPtr()> &theQuery,
+                                                    bool &theExecuted,
+                                                    bool &theShared)
+{
+  try
+  {
+    std::promise<ResultPtr> promise;
+    auto query = promise.get_future().share();
+    std::shared_future<ResultPtr> inFlightQuery;
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      auto it = itsQueries.find(theKey);
+
+      if (it != itsQueries.end())
+      {
+        inFlightQuery = it->second.itsResult;
+        it->second.itsWaiters++;
+      }
+      else
+      {
+        Query inFlight;
+        inFlight.itsResult = query;
+        itsQueries.insert(std::make_pair(theKey, inFlight));
+      }
+    }
+
+    if (inFlightQuery.valid())
+    {
+      theExecuted = false;
+      theShared = true;
+      return inFlightQuery.get();
+    }
+
+    theExecuted = true;
+
+    try
+    {
+      promise.set_value(theQuery());
+    }
+    catch (...)
+    {
+      promise.set_exception(std::current_exception());
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      auto it = itsQueries.find(theKey);
+      theShared = (it->second.itsWaiters > 0);
+      itsQueries.erase(it);
+    }
+
+    return query.get();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get number of queries in flight
+ */
+// ----------------------------------------------------------------------
+
+std::size_t InFlightQueries::size() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsQueries.size();
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
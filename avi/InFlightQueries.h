@@ -0,0 +1,62 @@
+// ======================================================================
+/*!
+ * \brief Coalescing of identical concurrent queries
+ *
+ * The first caller with a given query key executes the query; callers
+ * with the same key arriving while the query is in flight wait for it
+ * and share its (read-only) result or error.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "QueryResultCache.h"
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class InFlightQueries
+{
+ public:
+  using ResultPtr = QueryResultCache::ResultPtr;
+
+  InFlightQueries() = default;
+  InFlightQueries(const InFlightQueries &) = delete;
+  InFlightQueries &operator=(const InFlightQueries &) = delete;
+
+  // Execute the query or wait for in-flight query with the same key; theExecuted is set if the
+  // query was executed by the caller and theShared if the result is shared with other callers
+  // (always set for waiting callers). If the executing caller's result is not shared, nobody
+  // else can reference it
+
+  ResultPtr execute(const std::string &theKey,
+                    const std::function<ResultPtr()> &theQuery,
+                    bool &theExecuted,
+                    bool &theShared);
+
+  std::size_t size() const;
+
+ private:
+  struct Query
+  {
+    std::shared_future<ResultPtr> itsResult;
+    std::size_t itsWaiters = 0;
+  };
+
+  mutable std::mutex itsMutex;
+  std::map<std::string, Query> itsQueries;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,1029 @@
+// ======================================================================
+
+#include "LatestMessageCache.h"
+#include <boost/algorithm/string/trim.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+const TimeRangeType latestTimeRangeTypes[] = {TimeRangeType::ValidTimeRangeLatest,
+                                              TimeRangeType::MessageValidTimeRangeLatest,
+                                              TimeRangeType::MessageTimeRangeLatest,
+                                              TimeRangeType::CreationValidTimeRangeLatest};
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get given (or all) message types having given time range type
+ *        (mimics buildMessageTypeInClause())
+ */
+// ----------------------------------------------------------------------
+
+StringList messageTypesIn(const StringList &messageTypeList,
+                          const MessageTypes &knownMessageTypes,
+                          TimeRangeType timeRangeType)
+{
+  StringList messageTypes;
+
+  if (messageTypeList.empty())
+  {
+    for (auto const &knownType : knownMessageTypes)
+      if (knownType.getTimeRangeType() == timeRangeType)
+      {
+        auto const &knownTypes = knownType.getMessageTypes();
+        messageTypes.insert(messageTypes.end(), knownTypes.begin(), knownTypes.end());
+      }
+
+    return messageTypes;
+  }
+
+  for (auto const &messageType : messageTypeList)
+    for (auto const &knownType : knownMessageTypes)
+      if ((knownType == messageType) && (knownType.getTimeRangeType() == timeRangeType))
+      {
+        messageTypes.push_back(messageType);
+        break;
+      }
+
+  return messageTypes;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get message type group name for message types returned as a group
+ *        (mimics buildMessageTypeGroupByExpr())
+ */
+// ----------------------------------------------------------------------
+
+std::map<std::string, std::string> messageTypeGroups(const StringList &messageTypeList,
+                                                     const MessageTypes &knownMessageTypes,
+                                                     TimeRangeType timeRangeType)
+{
+  std::map<std::string, std::string> typeGroups;
+
+  if (messageTypeList.empty())
+  {
+    for (auto const &knownType : knownMessageTypes)
+      if ((knownType.getTimeRangeType() == timeRangeType) &&
+          (knownType.getMessageTypes().size() > 1))
+        for (auto const &type : knownType.getMessageTypes())
+          typeGroups.insert(std::make_pair(type, knownType.getMessageTypes().front()));
+
+    return typeGroups;
+  }
+
+  StringList handledMessageTypes;
+
+  for (auto const &messageType : messageTypeList)
+    if (find(handledMessageTypes.begin(), handledMessageTypes.end(), messageType) ==
+        handledMessageTypes.end())
+      for (auto const &knownType : knownMessageTypes)
+      {
+        auto const &knownTypes = knownType.getMessageTypes();
+
+        if ((knownType.getTimeRangeType() != timeRangeType) || (knownTypes.size() <= 1) ||
+            (!(knownType == messageType)))
+          continue;
+
+        // The latest message is returned for the group if all group's types are given
+
+        auto it = knownTypes.begin();
+
+        for (; (it != knownTypes.end()); it++)
+          if (find(messageTypeList.begin(), messageTypeList.end(), *it) == messageTypeList.end())
+            break;
+
+        if (it == knownTypes.end())
+        {
+          for (auto const &type : knownTypes)
+            typeGroups.insert(std::make_pair(type, knownTypes.front()));
+
+          handledMessageTypes.insert(
+              handledMessageTypes.end(), knownTypes.begin(), knownTypes.end());
+
+          break;
+        }
+      }
+
+  return typeGroups;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get messir_heading patterns used for grouping the messages
+ *        (mimics buildMessirHeadingGroupByExpr())
+ */
+// ----------------------------------------------------------------------
+
+std::map<std::string, const std::list<std::string> *> messirPatterns(
+    const StringList &messageTypeList,
+    const MessageTypes &knownMessageTypes,
+    TimeRangeType timeRangeType)
+{
+  std::map<std::string, const std::list<std::string> *> patterns;
+
+  if (messageTypeList.empty())
+  {
+    for (auto const &knownType : knownMessageTypes)
+      if ((knownType.getTimeRangeType() == timeRangeType) &&
+          (!knownType.getMessirPatterns().empty()))
+        patterns.insert(
+            std::make_pair(knownType.getMessageTypes().front(), &knownType.getMessirPatterns()));
+
+    return patterns;
+  }
+
+  for (auto const &messageType : messageTypeList)
+    for (auto const &knownType : knownMessageTypes)
+      if ((knownType.getTimeRangeType() == timeRangeType) &&
+          (knownType.getMessageTypes().front() == messageType) &&
+          (!knownType.getMessirPatterns().empty()))
+        patterns.insert(std::make_pair(messageType, &knownType.getMessirPatterns()));
+
+  return patterns;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get message types and their validity hours (mimics
+ *        buildMessageTypeValidityWithClause())
+ */
+// ----------------------------------------------------------------------
+
+std::map<std::string, unsigned int> messageValidityHours(const StringList &messageTypeList,
+                                                         const MessageTypes &knownMessageTypes)
+{
+  std::map<std::string, unsigned int> validityHours;
+
+  if (messageTypeList.empty())
+  {
+    for (auto const &knownType : knownMessageTypes)
+      if (knownType.hasValidityHours())
+        for (auto const &type : knownType.getMessageTypes())
+          validityHours.insert(std::make_pair(type, knownType.getValidityHours()));
+
+    return validityHours;
+  }
+
+  for (auto const &messageType : messageTypeList)
+    for (auto const &knownType : knownMessageTypes)
+      if (knownType.hasValidityHours() && (knownType == messageType))
+      {
+        validityHours.insert(std::make_pair(messageType, knownType.getValidityHours()));
+        break;
+      }
+
+  return validityHours;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the message types whose condition is used for querying messages
+ *        having MessageValidTimeRangeLatest time restriction (mimics
+ *        buildMessageValidTimeRangeLatestTimeCondition())
+ */
+// ----------------------------------------------------------------------
+
+std::list<const MessageType *> messageValidTimeRangeLatestTypes(
+    const StringList &messageTypeList, const MessageTypes &knownMessageTypes)
+{
+  std::list<const MessageType *> types;
+
+  if (messageTypeList.empty())
+  {
+    for (auto const &knownType : knownMessageTypes)
+      if (knownType.getTimeRangeType() == TimeRangeType::MessageValidTimeRangeLatest)
+        types.push_back(&knownType);
+
+    return types;
+  }
+
+  for (auto const &messageType : messageTypeList)
+    for (auto const &knownType : knownMessageTypes)
+      if ((knownType.getTimeRangeType() == TimeRangeType::MessageValidTimeRangeLatest) &&
+          (knownType.getMessageTypes().front() == messageType))
+      {
+        types.push_back(&knownType);
+        break;
+      }
+
+  return types;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if station is not subject to query time restriction
+ */
+// ----------------------------------------------------------------------
+
+bool queryRestrictionNotApplied(const MessageType &messageType, const LatestMessage &message)
+{
+  auto icao = Fmi::ascii_toupper_copy(message.itsIcao);
+  auto countryCode = Fmi::ascii_toupper_copy(message.itsCountryCode);
+
+  for (auto const &pattern : messageType.getQueryRestrictionIcaoPatterns())
+    if (LatestMessageCache::likeMatches(icao, pattern))
+      return false;
+
+  for (auto const &code : messageType.getQueryRestrictionCountryCodes())
+    if (countryCode == code)
+      return false;
+
+  return true;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if string list contains the value
+ */
+// ----------------------------------------------------------------------
+
+bool contains(const StringList &stringList, const std::string &value)
+{
+  return (std::find(stringList.begin(), stringList.end(), value) != stringList.end());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get from and where clause for querying cached message types'
+ *        messages matching given condition
+ */
+// ----------------------------------------------------------------------
+
+std::string messageFromWhereClause(const std::string &messageTypeIn, const std::string &condition)
+{
+  return " FROM avidb_messages me,avidb_message_types mt,avidb_message_format mf,"
+         "avidb_stations st WHERE me.type_id = mt.type_id AND me.format_id = mf.format_id AND "
+         "me.station_id = st.station_id AND " +
+         messageTypeIn + " AND " + condition;
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+LatestMessageCache::LatestMessageCache(const Config &theConfig) : itsConfig(theConfig)
+{
+  try
+  {
+    // Only the types queried with 'latestmessage = true' are cached
+
+    std::ostringstream messageTypeIn;
+    size_t n = 0;
+
+    for (auto const &knownType : itsConfig.getMessageTypes())
+      if (knownType.getLatestMessageOnly())
+        for (auto const &type : knownType.getMessageTypes())
+          messageTypeIn << ((n++ == 0) ? "UPPER(mt.type) IN ('" : "','") << type;
+
+    itsMessageTypeIn = ((n > 0) ? (messageTypeIn.str() + "')") : "false");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Query messages matching given condition, and current time and time
+ *        zone offset
+ */
+// ----------------------------------------------------------------------
+
+LatestMessages LatestMessageCache::queryMessages(
+    const Fmi::Database::PostgreSQLConnection &theConnection,
+    const std::string &theCondition,
+    Fmi::DateTime &theCurrentTime,
+    int &theTimeZoneOffset) const
+{
+  try
+  {
+    // Current time is selected even if there are no messages
+
+    std::string query =
+        "SELECT n.now,n.tzoffset,m.* FROM (SELECT current_timestamp AT TIME ZONE 'UTC' AS now,"
+        "EXTRACT(TIMEZONE FROM current_timestamp)::integer AS tzoffset) AS n LEFT JOIN ("
+        "SELECT me.message_id,me.station_id,me.type_id,mt.type,me.route_id,mf.name AS format,"
+        "UPPER(me.messir_heading) AS messir_heading,"
+        "me.message_time AT TIME ZONE 'UTC' AS message_time,"
+        "me.valid_from AT TIME ZONE 'UTC' AS valid_from,"
+        "me.valid_to AT TIME ZONE 'UTC' AS valid_to,"
+        "me.created AT TIME ZONE 'UTC' AS created,"
+        "(me.message LIKE 'METAR%') AS metar_prefix,st.icao_code,st.country_code" +
+        messageFromWhereClause(itsMessageTypeIn, theCondition) + ") AS m ON true";
+
+    auto result = theConnection.executeNonTransaction(query);
+
+    auto timeValue = [](const pqxx::field &field)
+    {
+      return (field.is_null() ? Fmi::DateTime()
+                              : Fmi::DateTime::from_string(field.as<std::string>()));
+    };
+    auto stringValue = [](const pqxx::field &field)
+    { return (field.is_null() ? std::string() : field.as<std::string>()); };
+
+    LatestMessages messages;
+    messages.reserve(result.size());
+
+    for (pqxx::result::const_iterator row = result.begin(); (row != result.end()); row++)
+    {
+      const auto &dbRow = *row;
+
+      if (row == result.begin())
+      {
+        theCurrentTime = timeValue(dbRow["now"]);
+        theTimeZoneOffset = dbRow["tzoffset"].as<int>();
+      }
+
+      if (dbRow["message_id"].is_null())
+        continue;
+
+      LatestMessage message;
+
+      message.itsMessageId = dbRow["message_id"].as<long>();
+      message.itsStationId = dbRow["station_id"].as<long>();
+      message.itsTypeId = dbRow["type_id"].as<int>();
+      message.itsType = stringValue(dbRow["type"]);
+      message.itsTypeUpper = Fmi::ascii_toupper_copy(message.itsType);
+
+      if (!dbRow["route_id"].is_null())
+        message.itsRouteId = dbRow["route_id"].as<int>();
+
+      message.itsFormat = stringValue(dbRow["format"]);
+
+      if (!dbRow["messir_heading"].is_null())
+        message.itsMessirHeading = dbRow["messir_heading"].as<std::string>();
+
+      message.itsMessageTime = timeValue(dbRow["message_time"]);
+      message.itsValidFrom = timeValue(dbRow["valid_from"]);
+      message.itsValidTo = timeValue(dbRow["valid_to"]);
+      message.itsCreated = timeValue(dbRow["created"]);
+      message.itsMETARPrefix =
+          ((!dbRow["metar_prefix"].is_null()) && dbRow["metar_prefix"].as<bool>());
+      message.itsIcao = stringValue(dbRow["icao_code"]);
+      message.itsCountryCode = stringValue(dbRow["country_code"]);
+
+      messages.push_back(std::move(message));
+    }
+
+    return messages;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Load the messages within record set time window or poll for new messages
+ */
+// ----------------------------------------------------------------------
+
+void LatestMessageCache::update(const Fmi::Database::PostgreSQLConnection &theConnection)
+{
+  try
+  {
+    std::lock_guard<std::mutex> updateLock(itsUpdateMutex);
+
+    bool loaded;
+    long pollMessageId;
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      loaded = itsLoaded;
+      pollMessageId = itsMaxMessageId;
+    }
+
+    std::string condition;
+
+    if (!loaded)
+      condition = ("me.message_time >= current_timestamp - INTERVAL '" +
+                   Fmi::to_string(itsConfig.getRecordSetStartTimeOffsetHours()) + " hours'");
+    else
+      condition = ("me.message_id > " + Fmi::to_string(itsPollMessageId));
+
+    Fmi::DateTime currentTime;
+    int timeZoneOffset = 0;
+
+    auto messages = queryMessages(theConnection, condition, currentTime, timeZoneOffset);
+
+    addMessages(std::move(messages));
+    expireMessages(currentTime);
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    itsPollMessageId = (loaded ? pollMessageId : itsMaxMessageId);
+    itsLoaded = true;
+
+    itsRecentMessageIds.erase(itsRecentMessageIds.begin(),
+                              itsRecentMessageIds.upper_bound(itsPollMessageId));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if the cache has all messages inserted since the previous
+ *        poll
+ *
+ * The number and max id of the messages above the poll watermark are
+ * compared to the cached ones; messages committed out of message_id order
+ * change the number. Returns database's current time and session time zone
+ * offset
+ */
+// ----------------------------------------------------------------------
+
+bool LatestMessageCache::isCurrent(const Fmi::Database::PostgreSQLConnection &theConnection,
+                                   Fmi::DateTime &theCurrentTime,
+                                   int &theTimeZoneOffset) const
+{
+  try
+  {
+    long pollMessageId;
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      pollMessageId = itsPollMessageId;
+    }
+
+    std::string query =
+        "SELECT current_timestamp AT TIME ZONE 'UTC' AS now,"
+        "EXTRACT(TIMEZONE FROM current_timestamp)::integer AS tzoffset,"
+        "COUNT(me.message_id) AS messages,MAX(me.message_id) AS max_message_id" +
+        messageFromWhereClause(itsMessageTypeIn,
+                               "me.message_id > " + Fmi::to_string(pollMessageId));
+
+    auto result = theConnection.executeNonTransaction(query);
+
+    if (result.empty())
+      return false;
+
+    const auto &dbRow = *(result.begin());
+
+    theCurrentTime = Fmi::DateTime::from_string(dbRow["now"].as<std::string>());
+    theTimeZoneOffset = dbRow["tzoffset"].as<int>();
+
+    auto messages = dbRow["messages"].as<std::size_t>();
+    long maxMessageId =
+        (dbRow["max_message_id"].is_null() ? 0 : dbRow["max_message_id"].as<long>());
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    return ((pollMessageId == itsPollMessageId) && (messages == itsRecentMessageIds.size()) &&
+            ((messages == 0) || (maxMessageId == *(itsRecentMessageIds.rbegin()))));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Bring the cache up to date for a query
+ *
+ * A cheap watermark probe is made for each query; the messages inserted
+ * since the previous poll are read only if the cache is not up to date,
+ * so the cache answers like querying the database
+ */
+// ----------------------------------------------------------------------
+
+bool LatestMessageCache::catchUp(const Fmi::Database::PostgreSQLConnection &theConnection,
+                                 Fmi::DateTime &theCurrentTime,
+                                 int &theTimeZoneOffset)
+{
+  try
+  {
+    if (!isLoaded())
+      return false;
+
+    if (isCurrent(theConnection, theCurrentTime, theTimeZoneOffset))
+      return true;
+
+    long pollMessageId;
+
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      pollMessageId = itsPollMessageId;
+    }
+
+    auto messages = queryMessages(theConnection,
+                                  "me.message_id > " + Fmi::to_string(pollMessageId),
+                                  theCurrentTime,
+                                  theTimeZoneOffset);
+
+    addMessages(std::move(messages));
+
+    return (!theCurrentTime.is_not_a_date_time());
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add messages not already cached
+ */
+// ----------------------------------------------------------------------
+
+void LatestMessageCache::addMessages(LatestMessages theMessages)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    for (auto &message : theMessages)
+    {
+      auto &stationMessages = itsMessages[message.itsStationId];
+      auto messageId = message.itsMessageId;
+
+      if (messageId > itsPollMessageId)
+        itsRecentMessageIds.insert(messageId);
+
+      if (std::find_if(stationMessages.begin(),
+                       stationMessages.end(),
+                       [messageId](const LatestMessage &stationMessage)
+                       { return (stationMessage.itsMessageId == messageId); }) !=
+          stationMessages.end())
+        continue;
+
+      itsMaxMessageId = std::max(itsMaxMessageId, messageId);
+      stationMessages.push_back(std::move(message));
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Erase messages older than record set start time
+ */
+// ----------------------------------------------------------------------
+
+void LatestMessageCache::expireMessages(const Fmi::DateTime &theCurrentTime)
+{
+  try
+  {
+    if (theCurrentTime.is_not_a_date_time())
+      return;
+
+    auto startTime =
+        theCurrentTime - Fmi::Hours(itsConfig.getRecordSetStartTimeOffsetHours());
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    for (auto it = itsMessages.begin(); (it != itsMessages.end());)
+    {
+      auto &stationMessages = it->second;
+
+      stationMessages.erase(std::remove_if(stationMessages.begin(),
+                                           stationMessages.end(),
+                                           [&startTime](const LatestMessage &message)
+                                           { return (message.itsMessageTime < startTime); }),
+                            stationMessages.end());
+
+      if (stationMessages.empty())
+        it = itsMessages.erase(it);
+      else
+        it++;
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if the cache has been loaded
+ */
+// ----------------------------------------------------------------------
+
+bool LatestMessageCache::isLoaded() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+
+  return itsLoaded;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if the query can be answered from the cache
+ *
+ * Only queries for current time (non edr queries, i.e. with message
+ * creation time checks) for message types having 'latestmessage = true'
+ * are answered from the cache
+ */
+// ----------------------------------------------------------------------
+
+bool LatestMessageCache::covers(const StationIdList &theStationIdList,
+                                const QueryOptions &theQueryOptions,
+                                const Config &theConfig)
+{
+  try
+  {
+    auto const &timeOptions = theQueryOptions.itsTimeOptions;
+
+    if (theStationIdList.empty() || (!timeOptions.itsMessageCreatedTime.empty()) ||
+        (Fmi::ascii_tolower_copy(boost::algorithm::trim_copy(timeOptions.itsObservationTime)) !=
+         "current_timestamp"))
+      return false;
+
+    auto const &knownMessageTypes = theConfig.getMessageTypes();
+    auto const &messageTypes = theQueryOptions.itsMessageTypes;
+
+    if (messageTypes.empty())
+    {
+      for (auto const &knownType : knownMessageTypes)
+        if (!knownType.getLatestMessageOnly())
+          return false;
+    }
+    else
+      for (auto const &messageType : messageTypes)
+      {
+        auto knownType = theConfig.getMessageTypeRules().getMessageType(messageType);
+
+        if ((!knownType) || (!knownType->getLatestMessageOnly()))
+          return false;
+      }
+
+    // Query time restriction is not supported for multiple MessageValidTimeRangeLatest types
+    // (the database query fails)
+
+    if (!messageTypesIn(
+             messageTypes, knownMessageTypes, TimeRangeType::MessageValidTimeRangeLatest)
+             .empty())
+    {
+      auto types = messageValidTimeRangeLatestTypes(messageTypes, knownMessageTypes);
+
+      if (types.empty())
+        return false;
+
+      if (types.size() > 1)
+        for (const auto *type : types)
+          if (!type->getQueryRestrictionHours().empty())
+            return false;
+    }
+
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get the id's of the latest messages for given observation time
+ *
+ * Mimics the 'latest_messages' query (buildLatestMessagesWithClause()):
+ * the latest message (by message_time and created) is selected for each
+ * station, message type (group) and messir_heading pattern among the
+ * messages valid at the observation time
+ */
+// ----------------------------------------------------------------------
+
+std::vector<long> LatestMessageCache::getLatestMessageIds(const StationIdList &theStationIdList,
+                                                          const QueryOptions &theQueryOptions,
+                                                          const Fmi::DateTime &theObservationTime,
+                                                          int theTimeZoneOffset) const
+{
+  try
+  {
+    auto const &knownMessageTypes = itsConfig.getMessageTypes();
+    auto const &messageTypes = theQueryOptions.itsMessageTypes;
+    const auto &obsTime = theObservationTime;
+
+    // Time range type, type groups and messir_heading patterns for each queried type
+
+    std::map<std::string, TimeRangeType> timeRangeTypes;
+    std::map<TimeRangeType, std::map<std::string, std::string>> typeGroups;
+    std::map<TimeRangeType, std::map<std::string, const std::list<std::string> *>> patterns;
+
+    for (auto timeRangeType : latestTimeRangeTypes)
+    {
+      for (auto const &type : messageTypesIn(messageTypes, knownMessageTypes, timeRangeType))
+        timeRangeTypes.insert(std::make_pair(type, timeRangeType));
+
+      typeGroups[timeRangeType] = messageTypeGroups(messageTypes, knownMessageTypes, timeRangeType);
+      patterns[timeRangeType] = messirPatterns(messageTypes, knownMessageTypes, timeRangeType);
+    }
+
+    // Validity hours; MessageValidTimeRangeLatest time condition is (cross) joined with all
+    // validity rows, MessageTimeRangeLatest is joined by type
+
+    auto validityHours = messageValidityHours(messageTypes, knownMessageTypes);
+    unsigned int maxValidityHours = 0;
+
+    for (auto const &validity : validityHours)
+      maxValidityHours = std::max(maxValidityHours, validity.second);
+
+    // Query time restriction (i.e. TAF) settings
+
+    auto mvTypes = messageValidTimeRangeLatestTypes(messageTypes, knownMessageTypes);
+    const MessageType *restrictedType =
+        ((mvTypes.size() == 1) && (!mvTypes.front()->getQueryRestrictionHours().empty())
+             ? mvTypes.front()
+             : nullptr);
+    std::set<long> restrictionHours;
+
+    if (restrictedType)
+    {
+      std::istringstream hours(restrictedType->getQueryRestrictionHours());
+      std::string hour;
+
+      while (std::getline(hours, hour, ','))
+        restrictionHours.insert(Fmi::stol(hour));
+    }
+
+    // Finnish METAR filtering and SPECI exclusion for MessageTimeRangeLatest types
+
+    auto mtTypes =
+        messageTypesIn(messageTypes, knownMessageTypes, TimeRangeType::MessageTimeRangeLatest);
+    bool filterMETARs = false;
+    bool excludeSPECIs =
+        (theQueryOptions.itsExcludeSPECIs && contains(mtTypes, "SPECI"));
+
+    if (theQueryOptions.itsFilterMETARs && itsConfig.getFilterFIMETARxxx())
+      for (auto const &type : mtTypes)
+        if (type.substr(0, 5) == "METAR")
+          filterMETARs = true;
+
+    auto const &filterFIMETARxxxExcludeIcaos = itsConfig.getFilterFIMETARxxxExcludeIcaos();
+
+    // Observation time and message_time in session time zone for the query time restriction
+
+    auto localTime = [theTimeZoneOffset](const Fmi::DateTime &time)
+    { return (time + Fmi::Seconds(theTimeZoneOffset)); };
+    auto localObsTime = localTime(obsTime);
+    auto obsDate = localObsTime.date();
+    auto obsTimeOfDay = localObsTime.time_of_day();
+
+    // Record set time window and message format
+
+    auto startTime = obsTime - Fmi::Hours(itsConfig.getRecordSetStartTimeOffsetHours());
+    auto endTime = obsTime + Fmi::Hours(itsConfig.getRecordSetEndTimeOffsetHours());
+    std::string messageFormat = ((theQueryOptions.itsMessageFormat == "TAC") ? "TAC" : "IWXXM");
+    bool distinct = theQueryOptions.itsDistinctMessages;
+
+    // Check if message is valid at observation time
+
+    auto isValid = [&](const LatestMessage &message, TimeRangeType timeRangeType)
+    {
+      auto const &validFrom = message.itsValidFrom;
+      auto const &validTo = message.itsValidTo;
+      auto const &messageTime = message.itsMessageTime;
+
+      if (obsTime < message.itsCreated)
+        return false;
+
+      switch (timeRangeType)
+      {
+        case TimeRangeType::ValidTimeRangeLatest:
+          return ((!validFrom.is_not_a_date_time()) && (!validTo.is_not_a_date_time()) &&
+                  (obsTime >= validFrom) && (obsTime < validTo));
+
+        case TimeRangeType::MessageValidTimeRangeLatest:
+        {
+          if (validFrom.is_not_a_date_time() && validTo.is_not_a_date_time())
+            return ((!validityHours.empty()) && (obsTime >= messageTime) &&
+                    (obsTime < (messageTime + Fmi::Hours(maxValidityHours))));
+
+          if (validTo.is_not_a_date_time() || (obsTime < messageTime))
+            return false;
+
+          if (!restrictedType)
+            return (obsTime <= validTo);
+
+          if (obsTime >= validTo)
+            return false;
+
+          // Messages (i.e. TAFs) are stored e.g. every n'th (3rd) hour between xx:20 and xx:40
+          // and then published; during publication hour delay latest message until xx:40
+
+          auto localMessageTime = localTime(messageTime);
+          auto messageTimeOfDay = localMessageTime.time_of_day();
+
+          return (queryRestrictionNotApplied(*restrictedType, message) ||
+                  (localMessageTime.date() != obsDate) ||
+                  (messageTimeOfDay.hours() != obsTimeOfDay.hours()) ||
+                  (restrictionHours.find(obsTimeOfDay.hours()) == restrictionHours.end()) ||
+                  (messageTimeOfDay.minutes() <
+                   restrictedType->getQueryRestrictionStartMinute()) ||
+                  (obsTimeOfDay.minutes() >= restrictedType->getQueryRestrictionEndMinute()));
+        }
+
+        case TimeRangeType::MessageTimeRangeLatest:
+        {
+          auto validity = validityHours.find(message.itsType);
+
+          if ((validity == validityHours.end()) || (obsTime < messageTime) ||
+              (obsTime >= (messageTime + Fmi::Hours(validity->second))))
+            return false;
+
+          if ((!(filterMETARs || excludeSPECIs)) || (message.itsCountryCode != "FI"))
+            return true;
+
+          if (filterMETARs && (message.itsType == "METAR") && (!message.itsMETARPrefix) &&
+              (!contains(filterFIMETARxxxExcludeIcaos, message.itsIcao)))
+            return false;
+
+          return ((!excludeSPECIs) || (message.itsType != "SPECI"));
+        }
+
+        case TimeRangeType::CreationValidTimeRangeLatest:
+          return ((!validTo.is_not_a_date_time()) && (obsTime < validTo));
+
+        default:
+          return false;
+      }
+    };
+
+    // Select the latest message for each group
+
+    using GroupKey = std::tuple<TimeRangeType, std::string, int>;
+
+    std::vector<long> messageIds;
+    std::set<StationIdType> stationIds(theStationIdList.begin(), theStationIdList.end());
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    for (auto stationId : stationIds)
+    {
+      auto stationMessages = itsMessages.find(stationId);
+
+      if (stationMessages == itsMessages.end())
+        continue;
+
+      std::map<GroupKey, const LatestMessage *> latestMessages;
+
+      for (auto const &message : stationMessages->second)
+      {
+        if ((message.itsFormat != messageFormat) || (message.itsMessageTime < startTime) ||
+            (message.itsMessageTime > endTime))
+          continue;
+
+        auto typeTimeRange = timeRangeTypes.find(message.itsTypeUpper);
+
+        if (typeTimeRange == timeRangeTypes.end())
+          continue;
+
+        auto timeRangeType = typeTimeRange->second;
+
+        if (!isValid(message, timeRangeType))
+          continue;
+
+        // Message type (group) or type id (and route id)
+
+        std::string group;
+
+        if ((timeRangeType == TimeRangeType::ValidTimeRangeLatest) ||
+            (timeRangeType == TimeRangeType::MessageTimeRangeLatest))
+        {
+          auto const &groups = typeGroups[timeRangeType];
+          auto it = groups.find(message.itsTypeUpper);
+
+          group = ((it != groups.end()) ? it->second : message.itsType);
+        }
+        else
+        {
+          group = Fmi::to_string(message.itsTypeId);
+
+          if ((timeRangeType == TimeRangeType::MessageValidTimeRangeLatest) && (!distinct))
+            group += ("," + (message.itsRouteId ? Fmi::to_string(*message.itsRouteId) : "-"));
+        }
+
+        // messir_heading pattern number
+
+        int messirPattern = 0;
+        auto const &typePatterns = patterns[timeRangeType];
+        auto it = typePatterns.find(message.itsTypeUpper);
+
+        if ((it != typePatterns.end()) && message.itsMessirHeading)
+        {
+          int n = 1;
+
+          for (auto const &pattern : *(it->second))
+          {
+            if (likeMatches(*message.itsMessirHeading, pattern))
+            {
+              messirPattern = n;
+              break;
+            }
+
+            n++;
+          }
+        }
+
+        // ORDER BY message_time DESC,created DESC
+
+        auto &latestMessage = latestMessages[GroupKey(timeRangeType, group, messirPattern)];
+
+        if ((!latestMessage) || (message.itsMessageTime > latestMessage->itsMessageTime) ||
+            ((message.itsMessageTime == latestMessage->itsMessageTime) &&
+             ((message.itsCreated > latestMessage->itsCreated) ||
+              ((message.itsCreated == latestMessage->itsCreated) &&
+               (message.itsMessageId > latestMessage->itsMessageId)))))
+          latestMessage = &message;
+      }
+
+      for (auto const &latestMessage : latestMessages)
+        messageIds.push_back(latestMessage.second->itsMessageId);
+    }
+
+    std::sort(messageIds.begin(), messageIds.end());
+
+    return messageIds;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if value matches sql LIKE pattern ('%' and '_' wildcards,
+ *        '\' escape)
+ */
+// ----------------------------------------------------------------------
+
+bool LatestMessageCache::likeMatches(const std::string &theValue, const std::string &thePattern)
+{
+  std::size_t v = 0;
+  std::size_t p = 0;
+  std::size_t starP = std::string::npos;
+  std::size_t starV = 0;
+
+  while (v < theValue.size())
+  {
+    if ((p < thePattern.size()) && (thePattern[p] == '%'))
+    {
+      starP = ++p;
+      starV = v;
+      continue;
+    }
+
+    if (p < thePattern.size())
+    {
+      std::size_t pp = p;
+      bool escaped = ((thePattern[pp] == '\\') && ((pp + 1) < thePattern.size()));
+
+      if (escaped)
+        pp++;
+
+      if ((thePattern[pp] == theValue[v]) || ((!escaped) && (thePattern[pp] == '_')))
+      {
+        p = pp + 1;
+        v++;
+        continue;
+      }
+    }
+
+    if (starP == std::string::npos)
+      return false;
+
+    p = starP;
+    v = ++starV;
+  }
+
+  while ((p < thePattern.size()) && (thePattern[p] == '%'))
+    p++;
+
+  return (p == thePattern.size());
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
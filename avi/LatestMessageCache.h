@@ -0,0 +1,132 @@
+// ======================================================================
+/*!
+ * \brief In-memory cache of recent accepted messages for latest message
+ *        queries
+ *
+ * The cache holds the metadata (no message content) of accepted messages
+ * of the message types configured with 'latestmessage = true' and
+ * message_time within the record set time window. The cache is kept
+ * current by polling avidb_messages for message_id's above a watermark.
+ * Each query first checks the cache is up to date with a probe of the
+ * watermark; if not, the new messages are read before answering.
+ *
+ * Queries for current time are answered by selecting the latest message
+ * for each station, message type (group) and messir_heading pattern from
+ * the cached messages like the 'latest_messages' query does; the message
+ * data is then fetched from database with the resulting message id's.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Config.h"
+#include "Engine.h"
+#include <macgyver/DateTime.h>
+#include <macgyver/PostgreSQLConnection.h>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+struct LatestMessage
+{
+  long itsMessageId = 0;
+  StationIdType itsStationId = 0;
+  int itsTypeId = 0;
+  std::string itsType;       // mt.type
+  std::string itsTypeUpper;  // UPPER(mt.type)
+  std::optional<int> itsRouteId;
+  std::string itsFormat;                        // mf.name (TAC, IWXXM)
+  std::optional<std::string> itsMessirHeading;  // UPPER(messir_heading)
+  Fmi::DateTime itsMessageTime;
+  Fmi::DateTime itsValidFrom;  // not_a_date_time if NULL
+  Fmi::DateTime itsValidTo;    // not_a_date_time if NULL
+  Fmi::DateTime itsCreated;
+  bool itsMETARPrefix = false;  // message LIKE 'METAR%'
+  std::string itsIcao;          // st.icao_code
+  std::string itsCountryCode;   // st.country_code
+};
+
+using LatestMessages = std::vector<LatestMessage>;
+
+class LatestMessageCache
+{
+ public:
+  LatestMessageCache(const Config &theConfig);
+  LatestMessageCache() = delete;
+  LatestMessageCache(const LatestMessageCache &) = delete;
+  LatestMessageCache &operator=(const LatestMessageCache &) = delete;
+
+  // Initial load / periodic poll; rereads the messages inserted since the previous poll to
+  // catch messages committed out of message_id order
+
+  void update(const Fmi::Database::PostgreSQLConnection &theConnection);
+
+  // Probe the number and max id of the messages inserted since the previous poll; if they
+  // differ from the cached ones, read the messages. Returns database's current time and
+  // session time zone offset (seconds) to be used as the observation time
+
+  bool catchUp(const Fmi::Database::PostgreSQLConnection &theConnection,
+               Fmi::DateTime &theCurrentTime,
+               int &theTimeZoneOffset);
+
+  // Add messages not already cached
+
+  void addMessages(LatestMessages theMessages);
+
+  bool isLoaded() const;
+
+  // Check if the query can be answered from the cache
+
+  static bool covers(const StationIdList &theStationIdList,
+                     const QueryOptions &theQueryOptions,
+                     const Config &theConfig);
+
+  // Get the id's of the latest messages for given observation time
+
+  std::vector<long> getLatestMessageIds(const StationIdList &theStationIdList,
+                                        const QueryOptions &theQueryOptions,
+                                        const Fmi::DateTime &theObservationTime,
+                                        int theTimeZoneOffset) const;
+
+  static bool likeMatches(const std::string &theValue, const std::string &thePattern);
+
+ private:
+  LatestMessages queryMessages(const Fmi::Database::PostgreSQLConnection &theConnection,
+                               const std::string &theCondition,
+                               Fmi::DateTime &theCurrentTime,
+                               int &theTimeZoneOffset) const;
+  bool isCurrent(const Fmi::Database::PostgreSQLConnection &theConnection,
+                 Fmi::DateTime &theCurrentTime,
+                 int &theTimeZoneOffset) const;
+  void expireMessages(const Fmi::DateTime &theCurrentTime);
+
+  const Config &itsConfig;
+  std::string itsMessageTypeIn;  // UPPER(mt.type) IN (latest message types)
+
+  mutable std::mutex itsMutex;
+  std::map<StationIdType, LatestMessages> itsMessages;
+  long itsMaxMessageId = 0;
+  long itsPollMessageId = 0;  // Max message id at the start of previous poll
+  bool itsLoaded = false;
+
+  // Id's of the messages above itsPollMessageId; compared to the watermark probe
+
+  std::set<long> itsRecentMessageIds;
+
+  std::mutex itsUpdateMutex;  // Serializes initial load and polls
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,382 @@
+// ======================================================================
+
+#include "QueryMetrics.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <set>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+// Upper limits (milliseconds) of the histogram buckets; the last bucket is unbounded
+
+const std::array<double, 13> bucketLimits{
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000};
+
+// Max number of method and message type set combinations; further message type sets are
+// recorded as "*"
+
+const std::size_t maxKeys = 500;
+
+thread_local QueryMetrics::Call *threadCall = nullptr;
+thread_local QueryMetrics::StageTimer *threadTimer = nullptr;
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get sorted comma separated list of unique upper case message types
+ */
+// ----------------------------------------------------------------------
+
+std::string messageTypeKey(const StringList &theMessageTypes)
+{
+  std::set<std::string> messageTypes;
+
+  for (const auto &messageType : theMessageTypes)
+    messageTypes.insert(Fmi::ascii_toupper_copy(messageType));
+
+  std::string key;
+
+  for (const auto &messageType : messageTypes)
+    key.append(key.empty() ? "" : ",").append(messageType);
+
+  return key;
+}
+
+std::int64_t slotPeriod(QueryMetrics::Clock::time_point theTime)
+{
+  return std::chrono::duration_cast<std::chrono::minutes>(theTime.time_since_epoch()).count() /
+         QueryMetrics::SlotMinutes;
+}
+
+double milliseconds(QueryMetrics::Clock::duration theDuration)
+{
+  return std::chrono::duration<double, std::milli>(theDuration).count();
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start a call
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::Call::Call(QueryMetrics &theMetrics,
+                         const char *theMethod,
+                         const StringList &theMessageTypes)
+    : Call(theMetrics, theMethod)
+{
+  try
+  {
+    if (itsActive)
+      itsMessageTypes = messageTypeKey(theMessageTypes);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+QueryMetrics::Call::Call(QueryMetrics &theMetrics, const char *theMethod)
+    : itsMetrics(theMetrics),
+      itsMethod(theMethod),
+      itsStartTime(Clock::now()),
+      itsActive(threadCall == nullptr)
+{
+  for (auto &duration : itsDurations)
+    duration = 0;
+
+  if (itsActive)
+    threadCall = this;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief End the call and record the durations
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::Call::~Call()
+{
+  if (!itsActive)
+    return;
+
+  threadCall = nullptr;
+
+  try
+  {
+    itsMetrics.record(*this, Clock::now());
+  }
+  catch (...)
+  {
+    // Metrics are not worth failing (or terminating) the call for
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add stage duration
+ */
+// ----------------------------------------------------------------------
+
+void QueryMetrics::Call::add(Stage theStage, Clock::duration theDuration)
+{
+  itsDurations[static_cast<std::size_t>(theStage)] +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(theDuration).count();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Attach current thread to given call
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::CallScope::CallScope(Call *theCall, StageTimer *theParentTimer)
+    : itsPreviousCall(threadCall), itsPreviousTimer(threadTimer)
+{
+  threadCall = theCall;
+  threadTimer = theParentTimer;
+}
+
+QueryMetrics::CallScope::~CallScope()
+{
+  threadCall = itsPreviousCall;
+  threadTimer = itsPreviousTimer;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Start timing a stage
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::StageTimer::StageTimer(Stage theStage)
+    : itsStage(theStage), itsStartTime(Clock::now()), itsParent(threadTimer)
+{
+  threadTimer = this;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add the stage's exclusive time to current call
+ *
+ * Nested timers of concurrent worker threads may together exceed the
+ * stage's elapsed time; the exclusive time is then zero
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::StageTimer::~StageTimer()
+{
+  auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - itsStartTime);
+
+  threadTimer = itsParent;
+
+  if (itsParent)
+    itsParent->itsNestedTime += elapsed.count();
+
+  if (threadCall)
+    threadCall->add(itsStage,
+                    std::max(elapsed - std::chrono::nanoseconds(itsNestedTime.load()),
+                             std::chrono::nanoseconds(0)));
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get current thread's call
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::Call *QueryMetrics::currentCall()
+{
+  return threadCall;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get current thread's innermost stage timer
+ */
+// ----------------------------------------------------------------------
+
+QueryMetrics::StageTimer *QueryMetrics::currentTimer()
+{
+  return threadTimer;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stage name
+ */
+// ----------------------------------------------------------------------
+
+const char *QueryMetrics::stageName(Stage theStage)
+{
+  switch (theStage)
+  {
+    case Stage::Validation:
+      return "validation";
+    case Stage::StationQuery:
+      return "stationquery";
+    case Stage::MessageQuery:
+      return "messagequery";
+    case Stage::ResultDecoding:
+      return "resultdecoding";
+    case Stage::Join:
+      return "join";
+    case Stage::ConnectionWait:
+      return "connectionwait";
+  }
+
+  throw Fmi::Exception(BCP, "Unknown query stage");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add value to histogram
+ */
+// ----------------------------------------------------------------------
+
+void QueryMetrics::Histogram::add(double theMilliseconds)
+{
+  auto bucket = std::lower_bound(bucketLimits.begin(), bucketLimits.end(), theMilliseconds);
+
+  itsCounts[bucket - bucketLimits.begin()]++;
+  itsCount++;
+  itsTotal += theMilliseconds;
+  itsMax = std::max(itsMax, theMilliseconds);
+}
+
+void QueryMetrics::Histogram::add(const Histogram &theHistogram)
+{
+  for (std::size_t n = 0; (n < NumberOfBuckets); n++)
+    itsCounts[n] += theHistogram.itsCounts[n];
+
+  itsCount += theHistogram.itsCount;
+  itsTotal += theHistogram.itsTotal;
+  itsMax = std::max(itsMax, theHistogram.itsMax);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Record call's stage durations and total time
+ */
+// ----------------------------------------------------------------------
+
+void QueryMetrics::record(const Call &theCall, Clock::time_point theEndTime)
+{
+  try
+  {
+    auto period = slotPeriod(theEndTime);
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    auto key = std::make_pair(std::string(theCall.itsMethod), theCall.itsMessageTypes);
+    auto it = itsSlots.find(key);
+
+    if (it == itsSlots.end())
+    {
+      if (itsSlots.size() >= maxKeys)
+        key.second = "*";
+
+      it = itsSlots.insert(std::make_pair(key, Slots())).first;
+    }
+
+    auto &slot = it->second[period % NumberOfSlots];
+
+    if (slot.itsPeriod != period)
+    {
+      slot = Slot();
+      slot.itsPeriod = period;
+    }
+
+    for (std::size_t n = 0; (n < NumberOfStages); n++)
+    {
+      std::int64_t duration = theCall.itsDurations[n];
+
+      if (duration > 0)
+        slot.itsHistograms[n].add(duration / 1000000.0);
+    }
+
+    slot.itsHistograms[NumberOfStages].add(milliseconds(theEndTime - theCall.itsStartTime));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get histograms over the time window
+ */
+// ----------------------------------------------------------------------
+
+QueryMetricsData QueryMetrics::getMetrics() const
+{
+  try
+  {
+    auto period = slotPeriod(Clock::now());
+
+    QueryMetricsData metricsData;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    for (const auto &slots : itsSlots)
+    {
+      std::array<Histogram, NumberOfStages + 1> histograms;
+
+      for (const auto &slot : slots.second)
+      {
+        if ((slot.itsPeriod < 0) || (slot.itsPeriod <= period - NumberOfSlots))
+          continue;
+
+        for (std::size_t n = 0; (n <= NumberOfStages); n++)
+          histograms[n].add(slot.itsHistograms[n]);
+      }
+
+      if (histograms[NumberOfStages].itsCount == 0)
+        continue;
+
+      QueryLatencies latencies;
+      latencies.itsMethod = slots.first.first;
+      latencies.itsMessageTypes = slots.first.second;
+
+      for (std::size_t n = 0; (n <= NumberOfStages); n++)
+      {
+        const auto &histogram = histograms[n];
+
+        if (histogram.itsCount == 0)
+          continue;
+
+        auto &stage = latencies.itsStages[(n < NumberOfStages)
+                                              ? stageName(static_cast<Stage>(n))
+                                              : "total"];
+
+        stage.itsBucketLimits.assign(bucketLimits.begin(), bucketLimits.end());
+        stage.itsCounts.assign(histogram.itsCounts.begin(), histogram.itsCounts.end());
+        stage.itsCount = histogram.itsCount;
+        stage.itsTotal = histogram.itsTotal;
+        stage.itsMax = histogram.itsMax;
+      }
+
+      metricsData.push_back(std::move(latencies));
+    }
+
+    return metricsData;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,171 @@
+// ======================================================================
+/*!
+ * \brief Per stage latency metrics of the public api calls
+ *
+ * A Call object is created at the start of a public api method; stage
+ * timers created during the call (in the same thread, or in a thread
+ * attached to the call with CallScope) add their exclusive time (time
+ * not spent in nested stage timers) to the call's stage durations.
+ * Stage timers of a worker thread are nested under the stage timer that
+ * was current when the worker's task was created, so the time spent
+ * waiting for the workers is not counted again in the calling thread's
+ * stage.
+ * When the call ends, the durations are recorded to the rolling
+ * histograms of the method and the queried message type set.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Engine.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class QueryMetrics
+{
+ public:
+  enum class Stage
+  {
+    Validation,
+    StationQuery,
+    MessageQuery,
+    ResultDecoding,
+    Join,
+    ConnectionWait
+  };
+
+  static constexpr std::size_t NumberOfStages = 6;
+
+  // Histograms are kept for NumberOfSlots periods of SlotMinutes minutes
+
+  static constexpr int SlotMinutes = 5;
+  static constexpr int NumberOfSlots = 12;
+
+  using Clock = std::chrono::steady_clock;
+
+  class Call
+  {
+   public:
+    Call(QueryMetrics &theMetrics, const char *theMethod, const StringList &theMessageTypes);
+    Call(QueryMetrics &theMetrics, const char *theMethod);
+    ~Call();
+
+    Call() = delete;
+    Call(const Call &) = delete;
+    Call &operator=(const Call &) = delete;
+
+    void add(Stage theStage, Clock::duration theDuration);
+
+   private:
+    friend class QueryMetrics;
+
+    QueryMetrics &itsMetrics;
+    const char *itsMethod;
+    std::string itsMessageTypes;
+    Clock::time_point itsStartTime;
+    std::array<std::atomic<std::int64_t>, NumberOfStages> itsDurations;  // Nanoseconds
+    bool itsActive;  // Nested api calls are recorded as part of the outermost call
+  };
+
+  class StageTimer;
+
+  // Attach current thread to given call (e.g. for a worker thread executing part of the call);
+  // the thread's stage timers are nested under given parent timer of the calling thread. The
+  // parent timer must outlive the scope
+
+  class CallScope
+  {
+   public:
+    CallScope(Call *theCall, StageTimer *theParentTimer);
+    ~CallScope();
+
+    CallScope(const CallScope &) = delete;
+    CallScope &operator=(const CallScope &) = delete;
+
+   private:
+    Call *itsPreviousCall;
+    StageTimer *itsPreviousTimer;
+  };
+
+  class StageTimer
+  {
+   public:
+    StageTimer(Stage theStage);
+    ~StageTimer();
+
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+   private:
+    Stage itsStage;
+    Clock::time_point itsStartTime;
+    std::atomic<std::int64_t> itsNestedTime{0};  // Nanoseconds; added by worker threads too
+    StageTimer *itsParent;
+  };
+
+  QueryMetrics() = default;
+  QueryMetrics(const QueryMetrics &) = delete;
+  QueryMetrics &operator=(const QueryMetrics &) = delete;
+
+  // Current thread's call or nullptr
+
+  static Call *currentCall();
+
+  // Current thread's innermost stage timer or nullptr
+
+  static StageTimer *currentTimer();
+
+  static const char *stageName(Stage theStage);
+
+  // Histograms over the time window
+
+  QueryMetricsData getMetrics() const;
+
+ private:
+  static constexpr std::size_t NumberOfBuckets = 14;
+
+  struct Histogram
+  {
+    std::array<std::size_t, NumberOfBuckets> itsCounts{};
+    std::size_t itsCount = 0;
+    double itsTotal = 0;
+    double itsMax = 0;
+
+    void add(double theMilliseconds);
+    void add(const Histogram &theHistogram);
+  };
+
+  // Histograms of a period; stage histograms followed by histogram of the call's total time
+
+  struct Slot
+  {
+    std::int64_t itsPeriod = -1;
+    std::array<Histogram, NumberOfStages + 1> itsHistograms;
+  };
+
+  using Slots = std::array<Slot, NumberOfSlots>;
+
+  void record(const Call &theCall, Clock::time_point theEndTime);
+
+  mutable std::mutex itsMutex;
+  std::map<std::pair<std::string, std::string>, Slots> itsSlots;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,148 @@
+// ======================================================================
+
+#include "QueryParameters.h"
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get array literal for integer values
+ */
+// ----------------------------------------------------------------------
+
+template <typename T>
+std::string arrayLiteral(const T &theValues)
+{
+  std::string literal("{");
+
+  for (auto value : theValues)
+    literal.append((literal.size() > 1) ? "," : "").append(Fmi::to_string(value));
+
+  return literal + "}";
+}
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add parameter value
+ */
+// ----------------------------------------------------------------------
+
+std::string QueryParameters::add(const std::string &theValue, const std::string &theType)
+{
+  try
+  {
+    itsValues.push_back(theValue);
+
+    return "$" + Fmi::to_string(itsValues.size()) + "::" + theType;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+std::string QueryParameters::add(const StationIdList &theValues)
+{
+  return add(arrayLiteral(theValues), "integer[]");
+}
+
+std::string QueryParameters::add(const std::vector<long> &theValues)
+{
+  return add(arrayLiteral(theValues), "bigint[]");
+}
+
+std::string QueryParameters::add(const StringList &theValues)
+{
+  try
+  {
+    // {"value1","value2",...} with '"' and '\' escaped
+
+    std::string literal("{");
+
+    for (auto const &value : theValues)
+    {
+      literal.append((literal.size() > 1) ? ",\"" : "\"");
+
+      for (auto c : value)
+      {
+        if ((c == '"') || (c == '\\'))
+          literal.push_back('\\');
+
+        literal.push_back(c);
+      }
+
+      literal.push_back('"');
+    }
+
+    return add(literal + "}", "text[]");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Replace parameter value
+ */
+// ----------------------------------------------------------------------
+
+void QueryParameters::set(std::size_t theIndex, const std::string &theValue)
+{
+  try
+  {
+    if (theIndex >= itsValues.size())
+      throw Fmi::Exception(BCP,
+                           "Query parameter index " + Fmi::to_string(theIndex) + " out of range");
+
+    itsValues[theIndex] = theValue;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Add time parameter
+ */
+// ----------------------------------------------------------------------
+
+std::string QueryParameters::addTime(const std::string &theTimeExpression)
+{
+  try
+  {
+    // Expecting "timestamptz '<datetime>'" (validated by the engine)
+
+    auto first = theTimeExpression.find('\'');
+    auto last = theTimeExpression.rfind('\'');
+
+    if ((first == std::string::npos) || (last <= first) ||
+        (Fmi::ascii_tolower_copy(theTimeExpression.substr(0, first)).find("timestamptz") ==
+         std::string::npos))
+      return theTimeExpression;
+
+    return add(theTimeExpression.substr(first + 1, last - first - 1), "timestamptz");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
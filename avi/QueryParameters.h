@@ -0,0 +1,57 @@
+// ======================================================================
+/*!
+ * \brief Bound parameters of a normalized (prepared) query
+ *
+ * Values are passed as text and cast to the parameter type in the query
+ * ($n::type), so that the query text (template) only depends on the
+ * query structure and can be prepared once per connection.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Engine.h"
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class QueryParameters
+{
+ public:
+  // Add a value; returns the placeholder expression ($n::type)
+
+  std::string add(const std::string &theValue, const std::string &theType);
+
+  // Add an array value; returns the placeholder expression ($n::type[])
+
+  std::string add(const StationIdList &theValues);
+  std::string add(const std::vector<long> &theValues);
+  std::string add(const StringList &theValues);
+
+  // Add time value "timestamptz '<time>'"; other expressions (i.e. current_timestamp) are
+  // returned as is
+
+  std::string addTime(const std::string &theTimeExpression);
+
+  // Replace the value of n'th (0-based) parameter; used to execute the query with other values
+
+  void set(std::size_t theIndex, const std::string &theValue);
+
+  const std::vector<std::string> &getValues() const { return itsValues; }
+  bool empty() const { return itsValues.empty(); }
+  std::size_t size() const { return itsValues.size(); }
+
+ private:
+  std::vector<std::string> itsValues;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,476 @@
+// ======================================================================
+
+#include "QueryResultCache.h"
+#include <boost/algorithm/string/predicate.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append length prefixed value to key
+ */
+// ----------------------------------------------------------------------
+
+void append(std::string &theKey, const std::string &theValue)
+{
+  theKey.append(Fmi::to_string(theValue.size())).append(":").append(theValue);
+}
+
+void append(std::string &theKey, double theValue)
+{
+  char buffer[32];
+
+  snprintf(buffer, sizeof(buffer), "%.17g", theValue);
+  append(theKey, std::string(buffer));
+}
+
+void append(std::string &theKey, long theValue)
+{
+  append(theKey, Fmi::to_string(theValue));
+}
+
+void append(std::string &theKey, bool theValue)
+{
+  theKey.append(theValue ? "1" : "0");
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Append list of values to key, optionally upper cased and sorted
+ *        (as unique values)
+ */
+// ----------------------------------------------------------------------
+
+void append(std::string &theKey, const StringList &theValues, bool toUpper, bool sorted)
+{
+  std::vector<std::string> values;
+
+  for (const auto &value : theValues)
+    values.push_back(toUpper ? Fmi::ascii_toupper_copy(value) : value);
+
+  if (sorted)
+  {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+  }
+
+  append(theKey, static_cast<long>(values.size()));
+
+  for (const auto &value : values)
+    append(theKey, value);
+}
+
+void append(std::string &theKey, const StationIdList &theValues, bool sorted)
+{
+  std::vector<StationIdType> values(theValues.begin(), theValues.end());
+
+  if (sorted)
+  {
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+  }
+
+  append(theKey, static_cast<long>(values.size()));
+
+  for (auto value : values)
+    append(theKey, value);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated memory size of a value vector
+ */
+// ----------------------------------------------------------------------
+
+std::size_t valuesSize(const ValueVector &theValues)
+{
+  std::size_t size = sizeof(ValueVector) + theValues.capacity() * sizeof(TimeSeries::Value);
+
+  for (const auto &value : theValues)
+  {
+    const auto *stringValue = std::get_if<std::string>(&value);
+
+    if (stringValue)
+      size += stringValue->capacity();
+  }
+
+  return size;
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+QueryResultCache::QueryResultCache(std::size_t theMaxSize) : itsMaxSize(theMaxSize) {}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build canonical key for the query
+ *
+ * Station id's, icao codes, places, countries, filters and message types
+ * are sorted since the result rows are ordered by icao code; for route
+ * queries (wkts given) station id's are kept in the given order.
+ * Coordinates, bboxes, wkts and parameters are kept in the given order.
+ */
+// ----------------------------------------------------------------------
+
+std::string QueryResultCache::key(const char *theMethod,
+                                  const StationIdList *theStationIdList,
+                                  const QueryOptions &theQueryOptions,
+                                  std::int64_t theTimeBucket)
+{
+  try
+  {
+    const auto &locationOptions = theQueryOptions.itsLocationOptions;
+    const auto &timeOptions = theQueryOptions.itsTimeOptions;
+    bool routeQuery = !locationOptions.itsWKTs.itsWKTs.empty();
+
+    std::string key;
+
+    append(key, std::string(theMethod));
+    append(key, (theStationIdList != nullptr));
+
+    if (theStationIdList)
+      append(key, *theStationIdList, !routeQuery);
+
+    append(key, theQueryOptions.itsMessageFormat);
+    append(key, theQueryOptions.itsMessageTypes, true, true);
+    append(key, theQueryOptions.itsParameters, false, false);
+    append(key, static_cast<long>(theQueryOptions.itsValidity));
+    append(key, theQueryOptions.itsMessageColumnSelected);
+    append(key, static_cast<long>(theQueryOptions.itsMaxMessageStations));
+    append(key, static_cast<long>(theQueryOptions.itsMaxMessageRows));
+    append(key, theQueryOptions.itsDistinctMessages);
+    append(key, theQueryOptions.itsFilterMETARs);
+    append(key, theQueryOptions.itsExcludeSPECIs);
+
+    append(key, locationOptions.itsStationIds, !routeQuery);
+    append(key, locationOptions.itsIcaos, true, true);
+    append(key, locationOptions.itsPlaces, true, true);
+    append(key, locationOptions.itsCountries, false, true);
+    append(key, locationOptions.itsIncludeCountryFilters, false, true);
+    append(key, locationOptions.itsIncludeIcaoFilters, true, true);
+    append(key, locationOptions.itsExcludeIcaoFilters, true, true);
+
+    append(key, static_cast<long>(locationOptions.itsBBoxes.size()));
+
+    for (const auto &bbox : locationOptions.itsBBoxes)
+    {
+      append(key, bbox.itsWest);
+      append(key, bbox.itsEast);
+      append(key, bbox.itsSouth);
+      append(key, bbox.itsNorth);
+    }
+
+    append(key, static_cast<long>(locationOptions.itsLonLats.size()));
+
+    for (const auto &lonlat : locationOptions.itsLonLats)
+    {
+      append(key, lonlat.itsLon);
+      append(key, lonlat.itsLat);
+    }
+
+    append(key, locationOptions.itsWKTs.itsWKTs, false, false);
+    append(key, locationOptions.itsWKTs.isRoute);
+    append(key, locationOptions.itsMaxDistance);
+    append(key, static_cast<long>(locationOptions.itsNumberOfNearestStations));
+
+    append(key, timeOptions.itsObservationTime);
+    append(key, timeOptions.itsMessageCreatedTime);
+    append(key, timeOptions.itsCurrentTime);
+    append(key, timeOptions.itsStartTime);
+    append(key, timeOptions.itsEndTime);
+    append(key, timeOptions.itsTimeFormat);
+    append(key, timeOptions.itsTimeZone);
+    append(key, timeOptions.getMessageTableTimeRangeColumn());
+    append(key, timeOptions.itsQueryValidRangeMessages);
+    append(key, timeOptions.itsMessageTimeChecks);
+    append(key, timeOptions.itsUseCurrentTime);
+    append(key, timeOptions.itsClosedTimeRange);
+
+    if (isCurrentTimeQuery(theQueryOptions))
+      append(key, static_cast<long>(theTimeBucket));
+
+    return key;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if the result depends on the current time
+ */
+// ----------------------------------------------------------------------
+
+bool QueryResultCache::isCurrentTimeQuery(const QueryOptions &theQueryOptions)
+{
+  try
+  {
+    const auto &timeOptions = theQueryOptions.itsTimeOptions;
+
+    if (!timeOptions.itsCurrentTime.empty())
+      return false;
+
+    if (timeOptions.itsUseCurrentTime ||
+        (timeOptions.itsObservationTime.empty() && timeOptions.itsStartTime.empty()))
+      return true;
+
+    for (const auto *time : {&timeOptions.itsObservationTime,
+                             &timeOptions.itsMessageCreatedTime,
+                             &timeOptions.itsStartTime,
+                             &timeOptions.itsEndTime})
+      if (boost::algorithm::icontains(*time, "current_") ||
+          boost::algorithm::icontains(*time, "now"))
+        return true;
+
+    return false;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Estimated memory size of the result
+ */
+// ----------------------------------------------------------------------
+
+std::size_t QueryResultCache::resultSize(const Result &theResult)
+{
+  try
+  {
+    const auto &data = theResult.itsData;
+    std::size_t size = sizeof(Result) + (data.itsColumns.size() * sizeof(Column)) +
+                       (data.itsStationIds.size() * sizeof(StationIdType));
+
+    for (const auto &station : data.itsValues)
+    {
+      for (const auto &values : station.second)
+        size += values.first.capacity() + valuesSize(values.second);
+    }
+
+    return size;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find unexpired result
+ */
+// ----------------------------------------------------------------------
+
+QueryResultCache::ResultPtr QueryResultCache::find(const std::string &theKey)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    auto it = itsIndex.find(theKey);
+
+    if (it == itsIndex.end())
+      return nullptr;
+
+    auto entry = it->second;
+
+    if (entry->itsExpirationTime <= Clock::now())
+    {
+      erase(entry);
+      return nullptr;
+    }
+
+    itsEntries.splice(itsEntries.begin(), itsEntries, entry);
+
+    return entry->itsResult;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get current generation
+ */
+// ----------------------------------------------------------------------
+
+std::uint64_t QueryResultCache::getGeneration() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsGeneration;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Store result; least recently used results are evicted to keep
+ *        the cache within memory budget
+ */
+// ----------------------------------------------------------------------
+
+bool QueryResultCache::insert(const std::string &theKey,
+                              const StringList &theMessageTypes,
+                              Clock::time_point theExpirationTime,
+                              ResultPtr theResult,
+                              std::uint64_t theGeneration)
+{
+  try
+  {
+    Entry entry;
+    entry.itsKey = theKey;
+    entry.itsExpirationTime = theExpirationTime;
+    entry.itsSize = resultSize(*theResult) + (2 * theKey.capacity());
+    entry.itsResult = std::move(theResult);
+
+    for (const auto &messageType : theMessageTypes)
+      entry.itsMessageTypes.insert(Fmi::ascii_toupper_copy(messageType));
+
+    if (entry.itsSize > itsMaxSize)
+      return false;
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    if (theGeneration != itsGeneration)
+      return false;
+
+    auto it = itsIndex.find(theKey);
+
+    if (it != itsIndex.end())
+      erase(it->second);
+
+    while ((!itsEntries.empty()) && ((itsSize + entry.itsSize) > itsMaxSize))
+      erase(std::prev(itsEntries.end()));
+
+    itsSize += entry.itsSize;
+    itsEntries.push_front(std::move(entry));
+    itsIndex[theKey] = itsEntries.begin();
+
+    return true;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Invalidate results having any of given message types or all
+ *        types
+ */
+// ----------------------------------------------------------------------
+
+void QueryResultCache::invalidate(const std::set<std::string> &theMessageTypes)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    itsGeneration++;
+
+    for (auto it = itsEntries.begin(); (it != itsEntries.end());)
+    {
+      auto entry = it++;
+      bool invalid = entry->itsMessageTypes.empty();
+
+      for (auto type = theMessageTypes.begin(); ((!invalid) && (type != theMessageTypes.end()));
+           type++)
+        invalid = (entry->itsMessageTypes.find(*type) != entry->itsMessageTypes.end());
+
+      if (invalid)
+        erase(entry);
+    }
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove all results
+ */
+// ----------------------------------------------------------------------
+
+void QueryResultCache::clear()
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+
+  itsGeneration++;
+  itsEntries.clear();
+  itsIndex.clear();
+  itsSize = 0;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get estimated memory size of the cached results
+ */
+// ----------------------------------------------------------------------
+
+std::size_t QueryResultCache::size() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsSize;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get/set state of the invalidation poll
+ */
+// ----------------------------------------------------------------------
+
+QueryResultCache::PollState QueryResultCache::getPollState() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsPollState;
+}
+
+void QueryResultCache::setPollState(PollState thePollState)
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  itsPollState = std::move(thePollState);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Remove entry; the mutex must be locked by the caller
+ */
+// ----------------------------------------------------------------------
+
+void QueryResultCache::erase(Entries::iterator theEntry)
+{
+  itsSize -= theEntry->itsSize;
+  itsIndex.erase(theEntry->itsKey);
+  itsEntries.erase(theEntry);
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,129 @@
+// ======================================================================
+/*!
+ * \brief Cache of message query results
+ *
+ * Results are cached with a canonical key built from the query options;
+ * location lists whose order does not affect the result are sorted and
+ * current time queries are keyed by a time bucket. The cache has a
+ * memory budget (least recently used results are evicted) and the
+ * results expire at given time or when invalidated because new
+ * messages of the result's message types have been stored.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Engine.h"
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class QueryResultCache
+{
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Cached result and the query options as modified by the query
+
+  struct Result
+  {
+    StationQueryData itsData;
+    QueryOptions itsQueryOptions;
+  };
+
+  using ResultPtr = std::shared_ptr<const Result>;
+
+  QueryResultCache(std::size_t theMaxSize);
+  QueryResultCache() = delete;
+  QueryResultCache(const QueryResultCache &) = delete;
+  QueryResultCache &operator=(const QueryResultCache &) = delete;
+
+  // Canonical key for the query; theTimeBucket is used for current time queries
+
+  static std::string key(const char *theMethod,
+                         const StationIdList *theStationIdList,
+                         const QueryOptions &theQueryOptions,
+                         std::int64_t theTimeBucket);
+
+  // Whether the result depends on the current time
+
+  static bool isCurrentTimeQuery(const QueryOptions &theQueryOptions);
+
+  // Estimated memory size of the result
+
+  static std::size_t resultSize(const Result &theResult);
+
+  ResultPtr find(const std::string &theKey);
+
+  // Results of queries started before the latest invalidation (theGeneration differs from
+  // current generation) are not stored. Returns true if the result was stored
+
+  std::uint64_t getGeneration() const;
+
+  bool insert(const std::string &theKey,
+              const StringList &theMessageTypes,
+              Clock::time_point theExpirationTime,
+              ResultPtr theResult,
+              std::uint64_t theGeneration);
+
+  // Invalidate results having any of given (upper case) message types or all types
+
+  void invalidate(const std::set<std::string> &theMessageTypes);
+  void clear();
+
+  std::size_t size() const;
+
+  // State of the invalidation poll: database time of the previous poll (microseconds since
+  // epoch; < 0 if not polled yet) and the messages (id and creation time) polled within the
+  // commit lag before it; they are not invalidated again when polled again
+
+  struct PollState
+  {
+    std::int64_t itsPollTime = -1;
+    std::map<long, std::int64_t> itsMessages;
+  };
+
+  PollState getPollState() const;
+  void setPollState(PollState thePollState);
+
+ private:
+  struct Entry
+  {
+    std::string itsKey;
+    std::set<std::string> itsMessageTypes;  // Upper case; empty if all types were queried
+    Clock::time_point itsExpirationTime;
+    ResultPtr itsResult;
+    std::size_t itsSize = 0;
+  };
+
+  using Entries = std::list<Entry>;
+
+  void erase(Entries::iterator theEntry);
+
+  const std::size_t itsMaxSize;
+
+  mutable std::mutex itsMutex;
+  Entries itsEntries;  // Most recently used first
+  std::unordered_map<std::string, Entries::iterator> itsIndex;
+  std::size_t itsSize = 0;
+  std::uint64_t itsGeneration = 0;
+  PollState itsPollState;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
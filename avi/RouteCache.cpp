@@ -0,0 +1,239 @@
+// ======================================================================
+
+#include "RouteCache.h"
+#include <macgyver/Exception.h>
+#include <cmath>
+#include <cstdio>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor
+ */
+// ----------------------------------------------------------------------
+
+RouteCache::RouteCache(std::size_t theMaxSize, unsigned int thePrecision)
+    : itsMaxSize(theMaxSize), itsPrecision(thePrecision)
+{
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Round route coordinates to the configured number of decimals
+ */
+// ----------------------------------------------------------------------
+
+LonLatList RouteCache::quantize(const LonLatList &theRoute) const
+{
+  try
+  {
+    const double scale = std::pow(10.0, itsPrecision);
+    LonLatList route;
+
+    // Adding zero turns negative zero to zero
+
+    for (const auto &lonlat : theRoute)
+      route.emplace_back((std::round(lonlat.itsLon * scale) / scale) + 0.0,
+                         (std::round(lonlat.itsLat * scale) / scale) + 0.0);
+
+    return route;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get LINESTRING wkt of the quantized route
+ */
+// ----------------------------------------------------------------------
+
+std::string RouteCache::wkt(const LonLatList &theQuantizedRoute) const
+{
+  try
+  {
+    std::string wkt("LINESTRING(");
+    char buffer[64];
+
+    for (const auto &lonlat : theQuantizedRoute)
+    {
+      snprintf(buffer,
+               sizeof(buffer),
+               "%s%.*f %.*f",
+               ((wkt.size() > 11) ? "," : ""),
+               static_cast<int>(itsPrecision),
+               lonlat.itsLon,
+               static_cast<int>(itsPrecision),
+               lonlat.itsLat);
+      wkt.append(buffer);
+    }
+
+    return wkt.append(")");
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get key for the quantized route
+ */
+// ----------------------------------------------------------------------
+
+std::string RouteCache::key(const LonLatList &theQuantizedRoute,
+                            double theMaxDistance,
+                            MessageScope theScope)
+{
+  try
+  {
+    // Max distance is rounded to meters as in the database query
+
+    char buffer[64];
+
+    snprintf(buffer,
+             sizeof(buffer),
+             "%d:%.0f",
+             static_cast<int>(theScope),
+             std::nearbyint(theMaxDistance));
+
+    std::string key(buffer);
+
+    for (const auto &lonlat : theQuantizedRoute)
+    {
+      snprintf(buffer, sizeof(buffer), ":%.17g,%.17g", lonlat.itsLon, lonlat.itsLat);
+      key.append(buffer);
+    }
+
+    return key;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Drop all routes if station catalog version has changed; the mutex
+ *        must be locked by the caller
+ */
+// ----------------------------------------------------------------------
+
+void RouteCache::setStationCatalogVersion(std::size_t theStationCatalogVersion)
+{
+  if (theStationCatalogVersion == itsStationCatalogVersion)
+    return;
+
+  itsEntries.clear();
+  itsIndex.clear();
+  itsStationCatalogVersion = theStationCatalogVersion;
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Find route stations
+ *
+ * Returns nullptr if the cached routes were selected with another station
+ * catalog version; the cache is cleared only when storing routes selected
+ * with a newer version, so a caller holding an older catalog snapshot does
+ * not drop the current routes
+ */
+// ----------------------------------------------------------------------
+
+RouteCache::StationIdsPtr RouteCache::find(const std::string &theKey,
+                                           std::size_t theStationCatalogVersion)
+{
+  try
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    if (theStationCatalogVersion != itsStationCatalogVersion)
+      return nullptr;
+
+    auto it = itsIndex.find(theKey);
+
+    if (it == itsIndex.end())
+      return nullptr;
+
+    itsEntries.splice(itsEntries.begin(), itsEntries, it->second);
+
+    return it->second->second;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Store route stations
+ *
+ * Stations selected with older station catalog version are not stored
+ */
+// ----------------------------------------------------------------------
+
+void RouteCache::insert(const std::string &theKey,
+                        std::size_t theStationCatalogVersion,
+                        StationIdList theStationIds)
+{
+  try
+  {
+    auto stationIds = std::make_shared<const StationIdList>(std::move(theStationIds));
+
+    std::lock_guard<std::mutex> lock(itsMutex);
+
+    if (theStationCatalogVersion < itsStationCatalogVersion)
+      return;
+
+    setStationCatalogVersion(theStationCatalogVersion);
+
+    auto it = itsIndex.find(theKey);
+
+    if (it != itsIndex.end())
+    {
+      itsEntries.erase(it->second);
+      itsIndex.erase(it);
+    }
+
+    while ((!itsEntries.empty()) && (itsEntries.size() >= itsMaxSize))
+    {
+      itsIndex.erase(itsEntries.back().first);
+      itsEntries.pop_back();
+    }
+
+    itsEntries.emplace_front(theKey, std::move(stationIds));
+    itsIndex[theKey] = itsEntries.begin();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Number of cached routes
+ */
+// ----------------------------------------------------------------------
+
+std::size_t RouteCache::size() const
+{
+  std::lock_guard<std::mutex> lock(itsMutex);
+  return itsEntries.size();
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
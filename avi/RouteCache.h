@@ -0,0 +1,85 @@
+// ======================================================================
+/*!
+ * \brief Cache of route query stations
+ *
+ * The stations selected for a route (a single linestring) are cached in
+ * route order with a key built from the route quantized to given number
+ * of decimals, the max distance and the message scope. The stations
+ * depend on the station catalog snapshot they were selected with; all
+ * entries are dropped when routes selected with a newer snapshot version
+ * are stored, and only routes of the requested version are returned. Least
+ * recently used routes are evicted when the max number of routes is reached.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Config.h"
+#include "Engine.h"
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class RouteCache
+{
+ public:
+  using StationIdsPtr = std::shared_ptr<const StationIdList>;
+
+  RouteCache(std::size_t theMaxSize, unsigned int thePrecision);
+  RouteCache() = delete;
+  RouteCache(const RouteCache &) = delete;
+  RouteCache &operator=(const RouteCache &) = delete;
+
+  // Route with coordinates rounded to the configured number of decimals
+
+  LonLatList quantize(const LonLatList &theRoute) const;
+
+  // LINESTRING wkt of the quantized route
+
+  std::string wkt(const LonLatList &theQuantizedRoute) const;
+
+  // Key for the quantized route
+
+  static std::string key(const LonLatList &theQuantizedRoute,
+                         double theMaxDistance,
+                         MessageScope theScope);
+
+  // Stations (in route order) of the route selected with given station catalog version
+
+  StationIdsPtr find(const std::string &theKey, std::size_t theStationCatalogVersion);
+
+  void insert(const std::string &theKey,
+              std::size_t theStationCatalogVersion,
+              StationIdList theStationIds);
+
+  std::size_t size() const;
+
+ private:
+  using Entries = std::list<std::pair<std::string, StationIdsPtr>>;
+
+  void setStationCatalogVersion(std::size_t theStationCatalogVersion);
+
+  const std::size_t itsMaxSize;
+  const unsigned int itsPrecision;
+
+  mutable std::mutex itsMutex;
+  Entries itsEntries;  // Most recently used first
+  std::unordered_map<std::string, Entries::iterator> itsIndex;
+  std::size_t itsStationCatalogVersion = 0;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
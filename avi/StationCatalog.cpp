@@ -0,0 +1,573 @@
+// ======================================================================
+
+#include "StationCatalog.h"
+#include "Geodesy.h"
+#include <boost/algorithm/string/trim.hpp>
+#include <macgyver/Exception.h>
+#include <macgyver/StringConversion.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Round the value as it is printed to the sql query
+ */
+// ----------------------------------------------------------------------
+
+double sqlValue(double value, const char *format)
+{
+  char buffer[64];
+
+  snprintf(buffer, sizeof(buffer), format, value);
+
+  return strtod(buffer, nullptr);
+}
+
+}  // namespace
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Construct the snapshot and the lookup indexes
+ */
+// ----------------------------------------------------------------------
+
+StationCatalog::StationCatalog(StationInfos theStations, std::size_t theVersion)
+    : itsStations(std::move(theStations)), itsVersion(theVersion)
+{
+  try
+  {
+    std::sort(itsStations.begin(),
+              itsStations.end(),
+              [](const StationInfo &first, const StationInfo &second)
+              { return first.itsId < second.itsId; });
+
+    std::vector<StationIndex::Point> points;
+    points.reserve(itsStations.size());
+
+    for (std::size_t n = 0; (n < itsStations.size()); n++)
+    {
+      const auto &station = itsStations[n];
+
+      points.push_back(StationIndex::Point{station.itsLongitude, station.itsLatitude, n});
+
+      if (itsModifiedLast.is_not_a_date_time() || (station.itsModified > itsModifiedLast))
+        itsModifiedLast = station.itsModified;
+
+      itsIcaoIndex[Fmi::ascii_toupper_copy(station.itsIcao)].push_back(n);
+      itsCountryIndex[Fmi::ascii_toupper_copy(station.itsCountryCode)].push_back(n);
+      itsPlaceIndex[Fmi::ascii_toupper_copy(boost::algorithm::trim_copy(station.itsName))]
+          .push_back(n);
+    }
+
+    itsSpatialIndex = StationIndex(std::move(points));
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get station with given station id
+ */
+// ----------------------------------------------------------------------
+
+const StationInfo *StationCatalog::getStation(StationIdType theStationId) const
+{
+  auto it = std::lower_bound(itsStations.begin(),
+                             itsStations.end(),
+                             theStationId,
+                             [](const StationInfo &station, StationIdType stationId)
+                             { return station.itsId < stationId; });
+
+  return (((it != itsStations.end()) && (it->itsId == theStationId)) ? &(*it) : nullptr);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if icao code exists (UPPER(icao) = UPPER(icao_code))
+ */
+// ----------------------------------------------------------------------
+
+bool StationCatalog::hasIcao(const std::string &theIcao) const
+{
+  return (itsIcaoIndex.find(Fmi::ascii_toupper_copy(theIcao)) != itsIcaoIndex.end());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if country code exists (country = UPPER(country_code))
+ *
+ * Note: the given code is not converted to upper case; the database
+ *       validation query does not do that either
+ */
+// ----------------------------------------------------------------------
+
+bool StationCatalog::hasCountry(const std::string &theCountryCode) const
+{
+  return (itsCountryIndex.find(theCountryCode) != itsCountryIndex.end());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if place exists (UPPER(place) = UPPER(BTRIM(name)))
+ */
+// ----------------------------------------------------------------------
+
+bool StationCatalog::hasPlace(const std::string &thePlace) const
+{
+  return (itsPlaceIndex.find(Fmi::ascii_toupper_copy(thePlace)) != itsPlaceIndex.end());
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations with given station id's
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStations(const StationIdList &theStationIds) const
+{
+  try
+  {
+    StationInfoList stations;
+
+    for (auto stationId : theStationIds)
+    {
+      const auto *station = getStation(stationId);
+
+      if (station)
+        stations.push_back(station);
+    }
+
+    std::sort(stations.begin(),
+              stations.end(),
+              [](const StationInfo *first, const StationInfo *second)
+              { return first->itsId < second->itsId; });
+    stations.erase(std::unique(stations.begin(), stations.end()), stations.end());
+
+    return stations;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations having any of the given (upper case) index keys
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStations(const KeyIndex &theIndex,
+                                            const StringList &theKeys) const
+{
+  try
+  {
+    std::vector<std::size_t> indexes;
+
+    for (const auto &key : theKeys)
+    {
+      auto it = theIndex.find(Fmi::ascii_toupper_copy(key));
+
+      if (it != theIndex.end())
+        indexes.insert(indexes.end(), it->second.begin(), it->second.end());
+    }
+
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+    StationInfoList stations;
+    stations.reserve(indexes.size());
+
+    for (auto index : indexes)
+      stations.push_back(&itsStations[index]);
+
+    return stations;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations with given icao codes
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStationsWithIcaos(const StringList &theIcaos) const
+{
+  return getStations(itsIcaoIndex, theIcaos);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations with given country codes, excluding stations
+ *        matching any of the given icao code filters
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStationsWithCountries(
+    const StringList &theCountryCodes, const StringList &theExcludeIcaoFilters) const
+{
+  try
+  {
+    auto stations = getStations(itsCountryIndex, theCountryCodes);
+
+    if (theExcludeIcaoFilters.empty())
+      return stations;
+
+    stations.erase(std::remove_if(stations.begin(),
+                                  stations.end(),
+                                  [&theExcludeIcaoFilters](const StationInfo *station)
+                                  {
+                                    for (const auto &filter : theExcludeIcaoFilters)
+                                      if (icaoFilterMatches(station->itsIcao, filter))
+                                        return true;
+
+                                    return false;
+                                  }),
+                   stations.end());
+
+    return stations;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations with given places (station names)
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStationsWithPlaces(const StringList &thePlaces) const
+{
+  return getStations(itsPlaceIndex, thePlaces);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations within given distance of given coordinates
+ *
+ * Mimics the database query: stations within max distance (ST_DWithin)
+ * of any coordinate, optionally limited to stations having
+ * RANK() OVER (PARTITION BY coordinate ORDER BY distance) <= N; since
+ * rank is calculated over the joined rows, duplicate coordinates
+ * multiply the rank of farther stations. For a station near multiple
+ * coordinates (DISTINCT ON (station_id)) distance and bearing are taken
+ * for the first coordinate.
+ */
+// ----------------------------------------------------------------------
+
+StationDistanceList StationCatalog::getStationsWithCoordinates(
+    const LonLatList &theLonLats,
+    double theMaxDistance,
+    unsigned int theNumberOfNearestStations,
+    bool theExcludeILStations) const
+{
+  try
+  {
+    // Unique coordinates in the order of appearance and their number of occurrences
+
+    std::vector<std::pair<LonLat, std::size_t>> coordinates;
+
+    for (const auto &lonlat : theLonLats)
+    {
+      LonLat coordinate(sqlValue(lonlat.itsLon, "%.10f"), sqlValue(lonlat.itsLat, "%.10f"));
+
+      auto it = std::find_if(coordinates.begin(),
+                             coordinates.end(),
+                             [&coordinate](const std::pair<LonLat, std::size_t> &other)
+                             {
+                               return ((other.first.itsLon == coordinate.itsLon) &&
+                                       (other.first.itsLat == coordinate.itsLat));
+                             });
+
+      if (it != coordinates.end())
+        it->second++;
+      else
+        coordinates.emplace_back(coordinate, 1);
+    }
+
+    const double maxDistance = std::nearbyint(theMaxDistance);
+
+    std::map<std::size_t, StationDistance> stations;
+    std::vector<std::size_t> indexes;
+    std::vector<std::pair<double, std::size_t>> distances;
+
+    for (const auto &coordinate : coordinates)
+    {
+      const auto &lonlat = coordinate.first;
+
+      indexes.clear();
+      distances.clear();
+
+      itsSpatialIndex.queryWithMargin(
+          lonlat.itsLon, lonlat.itsLat, lonlat.itsLon, lonlat.itsLat, maxDistance, indexes);
+
+      std::sort(indexes.begin(), indexes.end());
+      indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+      for (auto index : indexes)
+      {
+        const auto &station = itsStations[index];
+
+        // UPPER(icao_code) NOT LIKE 'IL%'
+
+        if (theExcludeILStations && icaoFilterMatches(station.itsIcao, "IL"))
+          continue;
+
+        double distance = geodesicDistance(
+            station.itsLongitude, station.itsLatitude, lonlat.itsLon, lonlat.itsLat);
+
+        if (distance <= maxDistance)
+          distances.emplace_back(distance, index);
+      }
+
+      if (theNumberOfNearestStations > 0)
+      {
+        std::sort(distances.begin(), distances.end());
+
+        std::size_t nCloser = 0;
+
+        for (std::size_t n = 0; (n < distances.size()); n++)
+        {
+          if ((n > 0) && (distances[n].first > distances[n - 1].first))
+            nCloser = n;
+
+          if ((1 + coordinate.second * nCloser) > theNumberOfNearestStations)
+          {
+            distances.resize(n);
+            break;
+          }
+        }
+      }
+
+      for (const auto &distance : distances)
+      {
+        const auto &station = itsStations[distance.second];
+
+        stations.emplace(
+            distance.second,
+            StationDistance{
+                &station,
+                distance.first / 1000,
+                planarAzimuth(
+                    station.itsLongitude, station.itsLatitude, lonlat.itsLon, lonlat.itsLat)});
+      }
+    }
+
+    StationDistanceList stationDistances;
+    stationDistances.reserve(stations.size());
+
+    for (const auto &station : stations)
+      stationDistances.push_back(station.second);
+
+    return stationDistances;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations within given distance of given bboxes
+ *
+ * Mimics the database query; the distance is the geodesic length of the
+ * shortest line between the station and the lon/lat box, i.e. distance to
+ * the station's coordinates clamped into the box
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStationsWithBBoxes(const BBoxList &theBBoxes,
+                                                      double theMaxDistance) const
+{
+  try
+  {
+    const double maxDistance = std::nearbyint(theMaxDistance);
+
+    std::vector<std::size_t> indexes;
+    std::vector<std::size_t> candidates;
+
+    for (const auto &bbox : theBBoxes)
+    {
+      const double west = sqlValue(bbox.itsWest, "%.10g");
+      const double east = sqlValue(bbox.itsEast, "%.10g");
+      const double south = sqlValue(bbox.itsSouth, "%.10g");
+      const double north = sqlValue(bbox.itsNorth, "%.10g");
+
+      const double minLon = std::min(west, east);
+      const double maxLon = std::max(west, east);
+      const double minLat = std::min(south, north);
+      const double maxLat = std::max(south, north);
+
+      candidates.clear();
+      itsSpatialIndex.queryWithMargin(minLon, minLat, maxLon, maxLat, maxDistance, candidates);
+
+      for (auto index : candidates)
+      {
+        const auto &station = itsStations[index];
+
+        double lon = std::min(std::max(station.itsLongitude, minLon), maxLon);
+        double lat = std::min(std::max(station.itsLatitude, minLat), maxLat);
+
+        if (geodesicDistance(station.itsLongitude, station.itsLatitude, lon, lat) <= maxDistance)
+          indexes.push_back(index);
+      }
+    }
+
+    std::sort(indexes.begin(), indexes.end());
+    indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+    StationInfoList stations;
+    stations.reserve(indexes.size());
+
+    for (auto index : indexes)
+      stations.push_back(&itsStations[index]);
+
+    return stations;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations within given distance of a route
+ *
+ * Mimics the database route query: the route is split into segments
+ * between consecutive points, and a station is near a segment if the
+ * geodesic distance to the (planar lon/lat) closest point of the segment
+ * is within the max distance. The stations are ordered by the index of
+ * the first segment they are near to and by geodesic distance to the
+ * start of the segment
+ */
+// ----------------------------------------------------------------------
+
+StationInfoList StationCatalog::getStationsWithRoute(const LonLatList &theRoute,
+                                                     double theMaxDistance) const
+{
+  try
+  {
+    const double maxDistance = std::nearbyint(theMaxDistance);
+
+    std::vector<LonLat> route(theRoute.begin(), theRoute.end());
+    std::vector<bool> selected(itsStations.size(), false);
+    std::vector<std::size_t> candidates;
+    std::vector<std::pair<double, std::size_t>> distances;
+
+    StationInfoList stations;
+
+    for (std::size_t n = 1; (n < route.size()); n++)
+    {
+      const auto &start = route[n - 1];
+      const auto &end = route[n];
+
+      candidates.clear();
+      distances.clear();
+
+      itsSpatialIndex.queryWithMargin(std::min(start.itsLon, end.itsLon),
+                                      std::min(start.itsLat, end.itsLat),
+                                      std::max(start.itsLon, end.itsLon),
+                                      std::max(start.itsLat, end.itsLat),
+                                      maxDistance,
+                                      candidates);
+
+      std::sort(candidates.begin(), candidates.end());
+      candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+      const double dLon = end.itsLon - start.itsLon;
+      const double dLat = end.itsLat - start.itsLat;
+      const double length2 = dLon * dLon + dLat * dLat;
+
+      for (auto index : candidates)
+      {
+        if (selected[index])
+          continue;
+
+        const auto &station = itsStations[index];
+
+        // Closest point of the segment (ST_ClosestPoint)
+
+        double fraction = 0;
+
+        if (length2 > 0)
+          fraction = std::min(std::max(((station.itsLongitude - start.itsLon) * dLon +
+                                        (station.itsLatitude - start.itsLat) * dLat) /
+                                           length2,
+                                       0.0),
+                              1.0);
+
+        if (geodesicDistance(station.itsLongitude,
+                             station.itsLatitude,
+                             start.itsLon + fraction * dLon,
+                             start.itsLat + fraction * dLat) > maxDistance)
+          continue;
+
+        distances.emplace_back(
+            geodesicDistance(start.itsLon, start.itsLat, station.itsLongitude, station.itsLatitude),
+            index);
+      }
+
+      std::sort(distances.begin(), distances.end());
+
+      for (const auto &distance : distances)
+      {
+        selected[distance.second] = true;
+        stations.push_back(&itsStations[distance.second]);
+      }
+    }
+
+    return stations;
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Check if icao code matches given icao code filter.
+ *
+ * Filters shorter than 4 letters are prefix matches (ILIKE 'filter%'),
+ * otherwise the code must match the filter (ILIKE 'filter')
+ */
+// ----------------------------------------------------------------------
+
+bool StationCatalog::icaoFilterMatches(const std::string &theIcao, const std::string &theFilter)
+{
+  if ((theFilter.size() < 4) ? (theIcao.size() < theFilter.size())
+                             : (theIcao.size() != theFilter.size()))
+    return false;
+
+  return (Fmi::ascii_toupper_copy(theIcao.substr(0, theFilter.size())) ==
+          Fmi::ascii_toupper_copy(theFilter));
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
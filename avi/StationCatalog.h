@@ -0,0 +1,121 @@
+// ======================================================================
+/*!
+ * \brief In-memory snapshot of avidb_stations
+ *
+ * The snapshot is immutable once constructed; the engine publishes a
+ * new snapshot (with incremented version) when the station table has
+ * been modified.
+ */
+// ======================================================================
+
+#pragma once
+
+#include "Engine.h"
+#include "StationIndex.h"
+#include <macgyver/DateTime.h>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+struct StationInfo
+{
+  StationIdType itsId = 0;
+  std::string itsIcao;
+  std::string itsName;
+  std::optional<int> itsElevation;
+  Fmi::DateTime itsValidFrom;
+  Fmi::DateTime itsValidTo;
+  Fmi::DateTime itsModified;
+  std::string itsCountryCode;
+  double itsLongitude = 0;
+  double itsLatitude = 0;
+  std::optional<int> itsFIRId;  // FIR containing the station (smallest id if overlapping)
+};
+
+using StationInfos = std::vector<StationInfo>;
+using StationInfoList = std::vector<const StationInfo *>;
+
+struct StationDistance
+{
+  const StationInfo *itsStation;
+  double itsDistance;                // Distance (km) to the coordinate
+  std::optional<double> itsBearing;  // Bearing (degrees) from station to the coordinate
+};
+
+using StationDistanceList = std::vector<StationDistance>;
+
+class StationCatalog
+{
+ public:
+  StationCatalog(StationInfos theStations, std::size_t theVersion);
+  StationCatalog() = delete;
+  StationCatalog(const StationCatalog &) = delete;
+  StationCatalog &operator=(const StationCatalog &) = delete;
+
+  std::size_t getVersion() const { return itsVersion; }
+  std::size_t size() const { return itsStations.size(); }
+  const Fmi::DateTime &getModifiedLast() const { return itsModifiedLast; }
+  const StationInfos &getStations() const { return itsStations; }
+
+  const StationInfo *getStation(StationIdType theStationId) const;
+
+  // Existence checks mimicking the sql used to validate location options
+
+  bool hasIcao(const std::string &theIcao) const;
+  bool hasCountry(const std::string &theCountryCode) const;
+  bool hasPlace(const std::string &thePlace) const;
+
+  // Station lookups; stations are returned in station id order
+
+  StationInfoList getStations(const StationIdList &theStationIds) const;
+  StationInfoList getStationsWithIcaos(const StringList &theIcaos) const;
+  StationInfoList getStationsWithCountries(const StringList &theCountryCodes,
+                                           const StringList &theExcludeIcaoFilters) const;
+  StationInfoList getStationsWithPlaces(const StringList &thePlaces) const;
+
+  // Spatial lookups mimicking the corresponding database queries; stations within given
+  // max distance (meters) of the coordinates (optionally limiting to the given number of
+  // nearest stations for each coordinate) or bboxes
+
+  StationDistanceList getStationsWithCoordinates(const LonLatList &theLonLats,
+                                                 double theMaxDistance,
+                                                 unsigned int theNumberOfNearestStations,
+                                                 bool theExcludeILStations) const;
+  StationInfoList getStationsWithBBoxes(const BBoxList &theBBoxes, double theMaxDistance) const;
+
+  // Stations within given max distance (meters) of a route (linestring) in route order, i.e.
+  // ordered by the index of the first route segment the station is near to and by the
+  // station's distance to the start of the segment
+
+  StationInfoList getStationsWithRoute(const LonLatList &theRoute, double theMaxDistance) const;
+
+  static bool icaoFilterMatches(const std::string &theIcao, const std::string &theFilter);
+
+ private:
+  using KeyIndex = std::map<std::string, std::vector<std::size_t>>;
+
+  StationInfoList getStations(const KeyIndex &theIndex, const StringList &theKeys) const;
+
+  StationInfos itsStations;  // Sorted by station id
+  std::size_t itsVersion;
+  Fmi::DateTime itsModifiedLast;
+
+  KeyIndex itsIcaoIndex;     // UPPER(icao_code)
+  KeyIndex itsCountryIndex;  // UPPER(country_code)
+  KeyIndex itsPlaceIndex;    // UPPER(BTRIM(name))
+
+  StationIndex itsSpatialIndex;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
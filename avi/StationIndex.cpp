@@ -0,0 +1,155 @@
+// ======================================================================
+
+#include "StationIndex.h"
+#include "Geodesy.h"
+#include <macgyver/Exception.h>
+#include <algorithm>
+#include <cmath>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build the tree
+ */
+// ----------------------------------------------------------------------
+
+StationIndex::StationIndex(std::vector<Point> thePoints) : itsPoints(std::move(thePoints))
+{
+  try
+  {
+    build(0, itsPoints.size(), 0);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Build subtree for given range; split alternately by longitude and latitude
+ */
+// ----------------------------------------------------------------------
+
+void StationIndex::build(std::size_t theBegin, std::size_t theEnd, int theDepth)
+{
+  if ((theEnd - theBegin) <= 1)
+    return;
+
+  const std::size_t middle = theBegin + (theEnd - theBegin) / 2;
+  const bool byLon = ((theDepth % 2) == 0);
+
+  std::nth_element(itsPoints.begin() + theBegin,
+                   itsPoints.begin() + middle,
+                   itsPoints.begin() + theEnd,
+                   [byLon](const Point &first, const Point &second)
+                   {
+                     return (byLon ? (first.itsLon < second.itsLon)
+                                   : (first.itsLat < second.itsLat));
+                   });
+
+  build(theBegin, middle, theDepth + 1);
+  build(middle + 1, theEnd, theDepth + 1);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations within given lon/lat rectangle
+ */
+// ----------------------------------------------------------------------
+
+void StationIndex::query(double theMinLon,
+                         double theMinLat,
+                         double theMaxLon,
+                         double theMaxLat,
+                         std::vector<std::size_t> &theIndexes) const
+{
+  query(0, itsPoints.size(), 0, theMinLon, theMinLat, theMaxLon, theMaxLat, theIndexes);
+}
+
+void StationIndex::query(std::size_t theBegin,
+                         std::size_t theEnd,
+                         int theDepth,
+                         double theMinLon,
+                         double theMinLat,
+                         double theMaxLon,
+                         double theMaxLat,
+                         std::vector<std::size_t> &theIndexes) const
+{
+  if (theBegin >= theEnd)
+    return;
+
+  const std::size_t middle = theBegin + (theEnd - theBegin) / 2;
+  const auto &point = itsPoints[middle];
+
+  if ((point.itsLon >= theMinLon) && (point.itsLon <= theMaxLon) && (point.itsLat >= theMinLat) &&
+      (point.itsLat <= theMaxLat))
+    theIndexes.push_back(point.itsIndex);
+
+  const bool byLon = ((theDepth % 2) == 0);
+  const double value = (byLon ? point.itsLon : point.itsLat);
+
+  if (value >= (byLon ? theMinLon : theMinLat))
+    query(theBegin, middle, theDepth + 1, theMinLon, theMinLat, theMaxLon, theMaxLat, theIndexes);
+
+  if (value <= (byLon ? theMaxLon : theMaxLat))
+    query(middle + 1, theEnd, theDepth + 1, theMinLon, theMinLat, theMaxLon, theMaxLat, theIndexes);
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Get stations possibly within given distance of given rectangle
+ */
+// ----------------------------------------------------------------------
+
+void StationIndex::queryWithMargin(double theMinLon,
+                                   double theMinLat,
+                                   double theMaxLon,
+                                   double theMaxLat,
+                                   double theDistance,
+                                   std::vector<std::size_t> &theIndexes) const
+{
+  try
+  {
+    double latDelta;
+    double lonDelta;
+
+    distanceBounds(std::max(fabs(theMinLat), fabs(theMaxLat)), theDistance, latDelta, lonDelta);
+
+    const double minLat = theMinLat - latDelta;
+    const double maxLat = theMaxLat + latDelta;
+    const double minLon = theMinLon - lonDelta;
+    const double maxLon = theMaxLon + lonDelta;
+
+    if ((lonDelta >= 180) || ((maxLon - minLon) >= 360))
+    {
+      query(-180, minLat, 180, maxLat, theIndexes);
+      return;
+    }
+
+    // Wrap over the antimeridian
+
+    query(std::max(minLon, -180.0), minLat, std::min(maxLon, 180.0), maxLat, theIndexes);
+
+    if (minLon < -180)
+      query(minLon + 360, minLat, 180, maxLat, theIndexes);
+
+    if (maxLon > 180)
+      query(-180, minLat, maxLon - 360, maxLat, theIndexes);
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
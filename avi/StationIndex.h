@@ -0,0 +1,73 @@
+// ======================================================================
+/*!
+ * \brief Static k-d tree over station coordinates
+ *
+ * The tree is built once for a station catalog snapshot and answers
+ * lon/lat rectangle queries; distance based searches use the rectangle
+ * query to get the candidate stations.
+ */
+// ======================================================================
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class StationIndex
+{
+ public:
+  struct Point
+  {
+    double itsLon;
+    double itsLat;
+    std::size_t itsIndex;  // Index of the station in catalog
+  };
+
+  StationIndex() = default;
+  StationIndex(std::vector<Point> thePoints);
+
+  // Get catalog indexes of stations within given lon/lat rectangle (bounds inclusive)
+
+  void query(double theMinLon,
+             double theMinLat,
+             double theMaxLon,
+             double theMaxLat,
+             std::vector<std::size_t> &theIndexes) const;
+
+  // Get catalog indexes of stations possibly within given distance (meters) of given
+  // lon/lat rectangle (or point); the area wraps over the antimeridian
+
+  void queryWithMargin(double theMinLon,
+                       double theMinLat,
+                       double theMaxLon,
+                       double theMaxLat,
+                       double theDistance,
+                       std::vector<std::size_t> &theIndexes) const;
+
+  std::size_t size() const { return itsPoints.size(); }
+
+ private:
+  void build(std::size_t theBegin, std::size_t theEnd, int theDepth);
+  void query(std::size_t theBegin,
+             std::size_t theEnd,
+             int theDepth,
+             double theMinLon,
+             double theMinLat,
+             double theMaxLon,
+             double theMaxLat,
+             std::vector<std::size_t> &theIndexes) const;
+
+  std::vector<Point> itsPoints;  // Implicit tree; node is the middle element of its range
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,134 @@
+// ======================================================================
+
+#include "WorkerPool.h"
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+// ----------------------------------------------------------------------
+/*!
+ * \brief Constructor; starts the worker threads
+ */
+// ----------------------------------------------------------------------
+
+WorkerPool::WorkerPool(std::size_t theThreadCount)
+{
+  try
+  {
+    if (theThreadCount == 0)
+      throw Fmi::Exception(BCP, "Worker pool must have at least one thread");
+
+    itsThreads.reserve(theThreadCount);
+
+    for (std::size_t i = 0; i < theThreadCount; i++)
+      itsThreads.emplace_back([this]() { run(); });
+  }
+  catch (...)
+  {
+    shutdown();
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Destructor; stops the worker threads
+ */
+// ----------------------------------------------------------------------
+
+WorkerPool::~WorkerPool()
+{
+  shutdown();
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Stop the worker threads and discard queued tasks
+ */
+// ----------------------------------------------------------------------
+
+void WorkerPool::shutdown()
+{
+  std::deque<std::function<void()>> tasks;
+
+  {
+    std::lock_guard<std::mutex> lock(itsMutex);
+    itsShutdownRequested = true;
+    tasks.swap(itsTasks);
+  }
+
+  itsCondition.notify_all();
+
+  for (auto &thread : itsThreads)
+    if (thread.joinable())
+      thread.join();
+
+  // Discarded tasks' futures report broken promise when the tasks are destroyed here
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Queue a task for execution
+ */
+// ----------------------------------------------------------------------
+
+void WorkerPool::post(std::function<void()> theTask)
+{
+  try
+  {
+    {
+      std::lock_guard<std::mutex> lock(itsMutex);
+
+      if (itsShutdownRequested)
+        throw Fmi::Exception(BCP, "Worker pool is shut down");
+
+      itsTasks.push_back(std::move(theTask));
+    }
+
+    itsCondition.notify_one();
+  }
+  catch (...)
+  {
+    throw Fmi::Exception::Trace(BCP, "Operation failed!");
+  }
+}
+
+// ----------------------------------------------------------------------
+/*!
+ * \brief Worker thread main loop
+ */
+// ----------------------------------------------------------------------
+
+void WorkerPool::run()
+{
+  while (true)
+  {
+    std::function<void()> task;
+
+    {
+      std::unique_lock<std::mutex> lock(itsMutex);
+
+      itsCondition.wait(lock, [this]() { return itsShutdownRequested || !itsTasks.empty(); });
+
+      if (itsShutdownRequested)
+        return;
+
+      task = std::move(itsTasks.front());
+      itsTasks.pop_front();
+    }
+
+    // Task errors are stored into the task's future by packaged_task
+
+    task();
+  }
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
@@ -0,0 +1,70 @@
+// ======================================================================
+/*!
+ * \brief Fixed size worker thread pool for asynchronous queries
+ *
+ * Tasks are executed in submission order by the first free worker.
+ * Tasks still queued at shutdown are discarded; the futures of
+ * discarded tasks report std::future_error (broken promise).
+ */
+// ======================================================================
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+class WorkerPool
+{
+ public:
+  explicit WorkerPool(std::size_t theThreadCount);
+  ~WorkerPool();
+
+  WorkerPool() = delete;
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+
+  // Execute the task in a worker thread; the future returns the task's result or error
+
+  template <typename T>
+  std::future<T> submit(std::function<T()> theTask)
+  {
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(theTask));
+    auto future = task->get_future();
+
+    post([task]() { (*task)(); });
+
+    return future;
+  }
+
+  void shutdown();
+
+  std::size_t size() const { return itsThreads.size(); }
+
+ private:
+  void post(std::function<void()> theTask);
+  void run();
+
+  std::vector<std::thread> itsThreads;
+  std::deque<std::function<void()>> itsTasks;
+  std::mutex itsMutex;
+  std::condition_variable itsCondition;
+  bool itsShutdownRequested = false;
+};
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
+
+// ======================================================================
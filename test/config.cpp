@@ -75,6 +75,46 @@ BOOST_AUTO_TEST_CASE(config_accessors,
   BOOST_CHECK(typeid(config.getMessageTypes()) == typeid(messageTypesEmpty));
   BOOST_CHECK_EQUAL(config.getMessageTypes().size(), 10);
 }
+BOOST_AUTO_TEST_CASE(config_message_type_rules,
+                     *boost::unit_test::depends_on("config_constructor_with_valid_file_exist"))
+{
+  const std::string filename = "cnf/valid.conf";
+  Config config(filename);
+  auto const &rules = config.getMessageTypeRules();
+
+  BOOST_CHECK(rules.getMessageType("UNKNOWN") == nullptr);
+
+  auto metrep = rules.getMessageTypeRule("METREP");
+  auto special = rules.getMessageTypeRule("SPECIAL");
+  BOOST_REQUIRE(metrep && special);
+  BOOST_CHECK(metrep->itsMessageType == special->itsMessageType);
+  BOOST_CHECK_EQUAL(metrep->itsGroup, special->itsGroup);
+  BOOST_CHECK(metrep->itsIndex != special->itsIndex);
+  BOOST_CHECK(rules.getMessageType("TAF")->getTimeRangeType() ==
+              TimeRangeType::MessageValidTimeRangeLatest);
+
+  // Fragment is built once for the set of known types, in configuration order
+
+  int builds = 0;
+  auto builder = [&builds](const std::list<std::string> &messageTypes)
+  {
+    builds++;
+    std::string fragment;
+    for (auto const &messageType : messageTypes)
+      fragment += (messageType + ";");
+    return fragment;
+  };
+  auto fragment = MessageTypeRules::Fragment::MessageTypeIn;
+
+  BOOST_CHECK_EQUAL(rules.getFragment(fragment, {"TAF", "METAR"}, 0, builder), "METAR;TAF;");
+  BOOST_CHECK_EQUAL(rules.getFragment(fragment, {"METAR", "TAF", "TAF"}, 0, builder),
+                    "METAR;TAF;");
+  BOOST_CHECK_EQUAL(builds, 1);
+  BOOST_CHECK_EQUAL(rules.getFragment(fragment, {"METAR", "TAF"}, 1, builder), "METAR;TAF;");
+  BOOST_CHECK_EQUAL(rules.getFragment(fragment, {}, 1, builder), "");
+  BOOST_CHECK_EQUAL(rules.getFragment(fragment, {"UNKNOWN"}, 1, builder), "UNKNOWN;");
+  BOOST_CHECK_EQUAL(builds, 4);
+}
 }  // namespace Avi
 }  // namespace Engine
 }  // namespace SmartMet
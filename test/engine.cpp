@@ -1405,6 +1405,60 @@ BOOST_AUTO_TEST_CASE(engine_querymessages_stationidlist_and_maxmessagestations,
   BOOST_CHECK_THROW(engine->queryMessages(stationIdList, queryOptions), Fmi::Exception);
 }
 
+BOOST_AUTO_TEST_CASE(engine_querymessages_pages,
+                     *boost::unit_test::depends_on(
+                         "engine_tests/engine_querymessages_stationidlist_with_multiple_stations"))
+{
+  BOOST_CHECK(engine);
+  StationIdList stationIdList = {8, 9, 10, 11};  //!< EFIV,EFJO,EFJY,EFKE
+  QueryOptions queryOptions;
+  queryOptions.itsTimeOptions.itsStartTime = "timestamptz '2015-11-17T00:10:00Z'";
+  queryOptions.itsTimeOptions.itsEndTime = "timestamptz '2015-11-17T00:30:00Z'";
+  queryOptions.itsParameters.push_back(allMessageParameters.front());
+  queryOptions.itsMaxMessageRows = 0;
+
+  // Collect (station,message) pairs in the order of the stations and messages
+
+  auto appendRows = [](StationQueryData &stationQueryData,
+                       std::list<std::pair<StationIdType, TimeSeries::Value>> &rows)
+  {
+    for (auto stationId : stationQueryData.itsStationIds)
+      for (auto const &value :
+           stationQueryData.itsValues[stationId][allMessageParameters.front()])
+        rows.emplace_back(stationId, value);
+  };
+
+  std::list<std::pair<StationIdType, TimeSeries::Value>> rows;
+  StationQueryData stationQueryData = engine->queryMessages(stationIdList, queryOptions);
+  appendRows(stationQueryData, rows);
+
+  // Pages are limited by page size and together contain all the messages in order
+
+  MessagePageToken pageToken;
+  pageToken.itsPageSize = 1;
+
+  std::list<std::pair<StationIdType, TimeSeries::Value>> pageRows;
+  size_t pages = 0;
+
+  while (!pageToken.itsLastPage)
+  {
+    auto page = engine->queryMessages(stationIdList, queryOptions, pageToken);
+    size_t pageRowCount = pageRows.size();
+
+    appendRows(page, pageRows);
+    BOOST_CHECK(pageRows.size() - pageRowCount <= pageToken.itsPageSize);
+
+    BOOST_REQUIRE(++pages <= rows.size() + 1);
+  }
+
+  BOOST_CHECK(pages > 1);
+  BOOST_CHECK(pageRows == rows);
+
+  pageToken = MessagePageToken();
+  BOOST_CHECK_THROW(engine->queryMessages(stationIdList, queryOptions, pageToken),
+                    Fmi::Exception);
+}
+
 BOOST_AUTO_TEST_CASE(engine_querymessages_locationsoptions_stationids_with_multiple_stations_fail,
                      *boost::unit_test::depends_on(
                          "engine_tests/engine_querymessages_queryoptions_starttime_endtime"))
@@ -1614,6 +1668,35 @@ BOOST_AUTO_TEST_CASE(engine_querymessages_queryoptions_maxmessagerows,
   BOOST_CHECK_THROW(engine->queryMessages(stationIdList, queryOptions), Fmi::Exception);
 }
 
+BOOST_AUTO_TEST_CASE(engine_streammessages_queryoptions_maxmessagerows,
+                     *boost::unit_test::depends_on(
+                         "engine_tests/engine_querymessages_queryoptions_maxmessagerows"))
+{
+  BOOST_CHECK(engine);
+  StationIdList stationIdList = {8};
+  QueryOptions queryOptions;
+  queryOptions.itsTimeOptions.itsStartTime = "timestamptz '2015-11-17T00:10:00Z'";
+  queryOptions.itsTimeOptions.itsEndTime = "timestamptz '2015-11-17T01:10:00Z'";
+  queryOptions.itsParameters.push_back(allMessageParameters.front());
+  queryOptions.itsMaxMessageRows = 2;
+
+  // Two messages between time interval
+  size_t rowCount = 0;
+
+  engine->streamMessages(stationIdList,
+                         queryOptions,
+                         [&rowCount](const StationQueryTable &batch)
+                         { rowCount += batch.getRowCount(); });
+  BOOST_CHECK_EQUAL(rowCount, 2);
+
+  // Greater than 0 value limits the number of messages in result
+  queryOptions.itsMaxMessageRows = 1;
+  BOOST_CHECK_THROW(engine->streamMessages(stationIdList,
+                                           queryOptions,
+                                           [](const StationQueryTable & /* batch */) {}),
+                    Fmi::Exception);
+}
+
 BOOST_AUTO_TEST_CASE(engine_querymessages_queryoptions_distinctmessages,
                      *boost::unit_test::depends_on(
                          "engine_tests/engine_querymessages_queryoptions_starttime_endtime"))
@@ -1780,6 +1863,81 @@ BOOST_AUTO_TEST_CASE(
   BOOST_CHECK_EQUAL(stationQueryData.itsValues.size(), 1);
 }
 
+BOOST_AUTO_TEST_CASE(
+    engine_querybatch_queryoptions_with_valid_values,
+    *boost::unit_test::depends_on(
+        "engine_tests/engine_querystationsandmessages_queryoptions_with_valid_values"))
+{
+  BOOST_CHECK(engine);
+  QueryOptions queryOptions;
+  queryOptions.itsParameters.push_back(allLocationParameters.front());
+  queryOptions.itsParameters.push_back(allMessageParameters.front());
+  queryOptions.itsTimeOptions.itsStartTime = "timestamptz '2015-11-17T00:10:00Z'";
+  queryOptions.itsTimeOptions.itsEndTime = "timestamptz '2015-11-17T01:10:00Z'";
+
+  // The requests differ only by location and are queried with single message query
+
+  std::vector<QueryOptions> queryOptionsList(2, queryOptions);
+  queryOptionsList[0].itsLocationOptions.itsStationIds.push_back(8);
+  queryOptionsList[1].itsLocationOptions.itsStationIds = {8, 9};
+
+  auto results = engine->queryBatch(queryOptionsList);
+  BOOST_REQUIRE_EQUAL(results.size(), 2);
+
+  for (std::size_t index = 0; index < results.size(); index++)
+  {
+    auto options = queryOptions;
+    options.itsLocationOptions.itsStationIds =
+        queryOptionsList[index].itsLocationOptions.itsStationIds;
+
+    StationQueryData stationQueryData = engine->queryStationsAndMessages(options);
+    BOOST_CHECK(results[index].itsStationIds == stationQueryData.itsStationIds);
+    BOOST_CHECK(results[index].itsValues == stationQueryData.itsValues);
+  }
+
+  // Requests are validated before querying
+
+  queryOptionsList[1].itsMessageTypes.push_back("XXXX");
+  BOOST_CHECK_THROW(engine->queryBatch(queryOptionsList), Fmi::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(
+    engine_querystationsandmessagesasync_queryoptions_with_valid_values,
+    *boost::unit_test::depends_on(
+        "engine_tests/engine_querystationsandmessages_queryoptions_with_valid_values"))
+{
+  BOOST_CHECK(engine);
+  QueryOptions queryOptions;
+  queryOptions.itsLocationOptions.itsStationIds.push_back(8);
+  queryOptions.itsParameters.push_back(allLocationParameters.front());
+  queryOptions.itsParameters.push_back(allMessageParameters.front());
+  queryOptions.itsTimeOptions.itsStartTime = "timestamptz '2015-11-17T00:10:00Z'";
+  queryOptions.itsTimeOptions.itsEndTime = "timestamptz '2015-11-17T01:10:00Z'";
+
+  auto stations = engine->queryStationsAsync(queryOptions);
+  auto stationsAndMessages = engine->queryStationsAndMessagesAsync(queryOptions);
+
+  BOOST_CHECK_EQUAL(stations.get().itsQueryData.itsStationIds.size(), 1);
+
+  // Query options are returned as modified by the query like with the synchronous query
+
+  auto result = stationsAndMessages.get();
+  auto syncQueryOptions = queryOptions;
+  engine->queryStationsAndMessages(syncQueryOptions);
+
+  BOOST_CHECK_EQUAL(result.itsQueryData.itsValues.size(), 1);
+  BOOST_CHECK(result.itsQueryOptions.itsMessageColumnSelected ==
+              syncQueryOptions.itsMessageColumnSelected);
+  BOOST_CHECK(result.itsQueryOptions.itsLocationOptions.itsStationIds ==
+              syncQueryOptions.itsLocationOptions.itsStationIds);
+
+  // Errors are returned thru the future
+
+  queryOptions.itsLocationOptions.itsStationIds = {-1};
+  auto failing = engine->queryStationsAsync(queryOptions);
+  BOOST_CHECK_THROW(failing.get(), Fmi::Exception);
+}
+
 //
 // Tests for Engine::joinStationAndMessageData method
 //
@@ -2202,6 +2360,107 @@ BOOST_AUTO_TEST_CASE(
   BOOST_CHECK_THROW(engine->queryRejectedMessages(queryOptions), Fmi::Exception);
 }
 
+BOOST_AUTO_TEST_CASE(
+    engine_streamrejectedmessages_queryoptions_maxmessagerows,
+    *boost::unit_test::depends_on(
+        "engine_tests/engine_queryrejectedmessages_queryoptions_produce_valid_response"))
+{
+  BOOST_CHECK(engine);
+
+  QueryOptions queryOptions;
+  queryOptions.itsParameters.push_back(allValidRejectedMessagesParameters.front());
+  queryOptions.itsTimeOptions.itsStartTime = "timestamptz '2015-11-20T22:00:00Z'";
+  queryOptions.itsTimeOptions.itsEndTime = "timestamptz '2015-11-20T22:10:00Z'";
+  queryOptions.itsMaxMessageRows = 12;
+
+  size_t rowCount = 0;
+
+  engine->streamRejectedMessages(queryOptions,
+                                 [&rowCount](const QueryData &queryData)
+                                 {
+                                   auto f = queryData.itsValues.find(
+                                       allValidRejectedMessagesParameters.front());
+                                   BOOST_REQUIRE(f != queryData.itsValues.end());
+                                   rowCount += f->second.size();
+                                 });
+  BOOST_CHECK_EQUAL(rowCount, 12);
+
+  queryOptions.itsMaxMessageRows = 5;
+  BOOST_CHECK_THROW(
+      engine->streamRejectedMessages(queryOptions, [](const QueryData & /* queryData */) {}),
+      Fmi::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(
+    engine_queryrejectedmessages_pages,
+    *boost::unit_test::depends_on(
+        "engine_tests/engine_queryrejectedmessages_queryoptions_produce_valid_response"))
+{
+  BOOST_CHECK(engine);
+
+  QueryOptions queryOptions;
+  queryOptions.itsParameters.push_back(allValidRejectedMessagesParameters.front());
+  queryOptions.itsTimeOptions.itsStartTime = "timestamptz '2015-11-20T22:00:00Z'";
+  queryOptions.itsTimeOptions.itsEndTime = "timestamptz '2015-11-20T22:10:00Z'";
+  queryOptions.itsMaxMessageRows = 0;
+
+  auto queryData = engine->queryRejectedMessages(queryOptions);
+  auto const &values = queryData.itsValues[allValidRejectedMessagesParameters.front()];
+
+  // Pages are limited by page size and together contain all the messages in order
+
+  RejectedMessagePageToken pageToken;
+  pageToken.itsPageSize = 5;
+
+  ValueVector pageValues;
+  size_t pages = 0;
+
+  while (!pageToken.itsLastPage)
+  {
+    auto page = engine->queryRejectedMessages(queryOptions, pageToken);
+    auto const &rows = page.itsValues[allValidRejectedMessagesParameters.front()];
+
+    BOOST_CHECK(rows.size() <= pageToken.itsPageSize);
+    pageValues.insert(pageValues.end(), rows.begin(), rows.end());
+
+    BOOST_REQUIRE(++pages <= values.size() + 1);
+  }
+
+  BOOST_CHECK(pages > 1);
+  BOOST_CHECK(!pageToken.itsFirstPage);
+  BOOST_CHECK(pageValues == values);
+
+  pageToken = RejectedMessagePageToken();
+  BOOST_CHECK_THROW(engine->queryRejectedMessages(queryOptions, pageToken), Fmi::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(engine_queryfirareas_tolerance)
+{
+  BOOST_CHECK(engine);
+
+  // Full resolution areas and the areas simplified with the configured tolerances
+
+  auto const &resolutions = engine->queryFIRAreaResolutions();
+  BOOST_REQUIRE_EQUAL(resolutions.size(), 3);
+
+  auto const &firAreas = engine->queryFIRAreas();
+  BOOST_REQUIRE(!firAreas.empty());
+  BOOST_REQUIRE_EQUAL(resolutions[0].itsAreas.size(), firAreas.size());
+  BOOST_CHECK(*(resolutions[0].itsAreas.begin()->second.itsGeoJSON) ==
+              firAreas.begin()->second.first);
+
+  // The largest tolerance not exceeding the given tolerance is selected
+
+  BOOST_CHECK_EQUAL(engine->queryFIRAreas(0).itsTolerance, 0);
+  BOOST_CHECK_EQUAL(engine->queryFIRAreas(0.005).itsTolerance, 0);
+  BOOST_CHECK_EQUAL(engine->queryFIRAreas(0.01).itsTolerance, 0.01);
+  BOOST_CHECK_EQUAL(engine->queryFIRAreas(0.03).itsTolerance, 0.01);
+  BOOST_CHECK_EQUAL(engine->queryFIRAreas(0.05).itsTolerance, 0.05);
+  BOOST_CHECK_EQUAL(engine->queryFIRAreas(10).itsTolerance, 0.05);
+
+  BOOST_CHECK_THROW(engine->queryFIRAreas(-0.01), Fmi::Exception);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 }  // namespace Avi
@@ -0,0 +1,71 @@
+#define BOOST_TEST_MODULE "FIRIndexClassModule"
+
+#include "FIRIndex.h"
+
+#include <boost/test/included/unit_test.hpp>
+#include <macgyver/Exception.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+// Square with a square hole, and a multipolygon of two squares
+
+const char *polygon =
+    "{\"type\":\"Polygon\",\"coordinates\":[[[20,60],[30,60],[30,70],[20,70],[20,60]],"
+    "[[24,64],[24,66],[26,66],[26,64],[24,64]]]}";
+const char *multiPolygon =
+    "{\"type\":\"MultiPolygon\",\"coordinates\":[[[[0,0],[10,0],[10,10],[0,10],[0,0]]],"
+    "[[[40, 0], [50, 0], [50, 10], [40, 10], [40, 0]]]]}";
+
+FIRQueryData firAreas()
+{
+  FIRQueryData firAreas;
+
+  firAreas.insert(std::make_pair(2, std::make_pair(polygon, BBox(20, 30, 60, 70))));
+  firAreas.insert(std::make_pair(1, std::make_pair(multiPolygon, BBox(0, 50, 0, 10))));
+
+  return firAreas;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(firindex_parserings)
+{
+  auto rings = FIRIndex::parseRings(polygon);
+  BOOST_REQUIRE_EQUAL(rings.size(), 2U);
+  BOOST_CHECK_EQUAL(rings[0].size(), 5U);
+  BOOST_CHECK_EQUAL(rings[1][1].itsLon, 24);
+  BOOST_CHECK_EQUAL(rings[1][1].itsLat, 66);
+
+  rings = FIRIndex::parseRings(multiPolygon);
+  BOOST_REQUIRE_EQUAL(rings.size(), 2U);
+  BOOST_CHECK_EQUAL(rings[1][2].itsLon, 50);
+
+  BOOST_CHECK_THROW(FIRIndex::parseRings("{\"type\":\"Polygon\"}"), Fmi::Exception);
+  BOOST_CHECK_THROW(FIRIndex::parseRings("{\"coordinates\":[[[1 2]]]}"), Fmi::Exception);
+  BOOST_CHECK_THROW(FIRIndex::parseRings("{\"coordinates\":[[[1,2]]"), Fmi::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(firindex_getfirid)
+{
+  FIRIndex firIndex(firAreas());
+  BOOST_CHECK_EQUAL(firIndex.size(), 2U);
+
+  BOOST_CHECK_EQUAL(firIndex.getFIRId(21, 61).value_or(0), 2);
+  BOOST_CHECK_EQUAL(firIndex.getFIRId(5, 5).value_or(0), 1);
+  BOOST_CHECK_EQUAL(firIndex.getFIRId(45, 5).value_or(0), 1);
+
+  // Within the hole, between the polygons and outside the areas
+
+  BOOST_CHECK(!firIndex.getFIRId(25, 65));
+  BOOST_CHECK(!firIndex.getFIRId(25, 5));
+  BOOST_CHECK(!firIndex.getFIRId(-5, 5));
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
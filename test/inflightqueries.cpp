@@ -0,0 +1,107 @@
+#define BOOST_TEST_MODULE "InFlightQueriesClassModule"
+
+#include "InFlightQueries.h"
+
+#include <boost/test/included/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+BOOST_AUTO_TEST_CASE(inflightqueries_coalesce)
+{
+  InFlightQueries inFlightQueries;
+  std::atomic<int> executions(0);
+  std::atomic<int> executed(0);
+  std::atomic<int> shared(0);
+  std::promise<void> started;
+  std::promise<void> release;
+  auto releaseFuture = release.get_future().share();
+
+  auto query = [&]()
+  {
+    if (executions++ == 0)
+      started.set_value();
+
+    releaseFuture.wait();
+
+    auto result = std::make_shared<QueryResultCache::Result>();
+    result->itsData.itsStationIds.push_back(1);
+    return QueryResultCache::ResultPtr(std::move(result));
+  };
+
+  std::vector<QueryResultCache::ResultPtr> results(4);
+  std::vector<std::thread> threads;
+
+  auto run = [&](std::size_t index)
+  {
+    bool wasExecuted = false;
+    bool wasShared = false;
+    results[index] = inFlightQueries.execute("key", query, wasExecuted, wasShared);
+
+    if (wasExecuted)
+      executed++;
+
+    if (wasShared)
+      shared++;
+  };
+
+  threads.emplace_back(run, 0);
+  started.get_future().wait();
+
+  for (std::size_t i = 1; i < results.size(); i++)
+    threads.emplace_back(run, i);
+
+  // Let the waiting callers reach the in-flight query before it completes
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  release.set_value();
+
+  for (auto &thread : threads)
+    thread.join();
+
+  BOOST_CHECK_EQUAL(executions.load(), 1);
+  BOOST_CHECK_EQUAL(executed.load(), 1);
+  BOOST_CHECK_EQUAL(shared.load(), static_cast<int>(results.size()));
+  BOOST_CHECK_EQUAL(inFlightQueries.size(), 0U);
+
+  for (const auto &result : results)
+    BOOST_CHECK(result == results[0]);
+}
+
+BOOST_AUTO_TEST_CASE(inflightqueries_error)
+{
+  InFlightQueries inFlightQueries;
+  bool executed = false;
+  bool shared = false;
+
+  BOOST_CHECK_THROW(inFlightQueries.execute(
+                        "key",
+                        []() -> QueryResultCache::ResultPtr
+                        { throw std::runtime_error("query failed"); },
+                        executed,
+                        shared),
+                    std::exception);
+  BOOST_CHECK(executed);
+  BOOST_CHECK_EQUAL(inFlightQueries.size(), 0U);
+
+  // Failed query is not shared with later callers; result of a single caller is not shared
+
+  auto result = inFlightQueries.execute(
+      "key", []() { return std::make_shared<QueryResultCache::Result>(); }, executed, shared);
+
+  BOOST_CHECK(executed);
+  BOOST_CHECK(!shared);
+  BOOST_CHECK(result);
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,245 @@
+#define BOOST_TEST_MODULE "LatestMessageCacheClassModule"
+
+#include "LatestMessageCache.h"
+
+#include <boost/test/included/unit_test.hpp>
+#include <macgyver/StringConversion.h>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+const std::string configFileName = "cnf/valid.conf";
+
+const Fmi::DateTime now(Fmi::Date(2024, 5, 10), Fmi::Hours(12) + Fmi::Minutes(30));
+
+LatestMessage message(long id,
+                      StationIdType stationId,
+                      int typeId,
+                      const std::string &type,
+                      const Fmi::DateTime &messageTime,
+                      const std::string &countryCode = "FI")
+{
+  LatestMessage message;
+  message.itsMessageId = id;
+  message.itsStationId = stationId;
+  message.itsTypeId = typeId;
+  message.itsType = type;
+  message.itsTypeUpper = type;
+  message.itsFormat = "TAC";
+  message.itsMessageTime = messageTime;
+  message.itsCreated = messageTime;
+  message.itsMETARPrefix = true;
+  message.itsIcao = "EF" + Fmi::to_string(stationId);
+  message.itsCountryCode = countryCode;
+  return message;
+}
+
+LatestMessage validMessage(long id,
+                           StationIdType stationId,
+                           int typeId,
+                           const std::string &type,
+                           const Fmi::DateTime &messageTime,
+                           const Fmi::DateTime &validFrom,
+                           const Fmi::DateTime &validTo)
+{
+  auto message = Avi::message(id, stationId, typeId, type, messageTime);
+  message.itsValidFrom = validFrom;
+  message.itsValidTo = validTo;
+  return message;
+}
+
+QueryOptions queryOptions(const StringList &messageTypes)
+{
+  QueryOptions queryOptions;
+  queryOptions.itsMessageTypes = messageTypes;
+  queryOptions.itsTimeOptions.itsObservationTime = "current_timestamp";
+  return queryOptions;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(latestmessagecache_likematches)
+{
+  BOOST_CHECK(LatestMessageCache::likeMatches("FBFI41EFKL", "FBFI41%"));
+  BOOST_CHECK(LatestMessageCache::likeMatches("FBFI41", "FBFI41%"));
+  BOOST_CHECK(LatestMessageCache::likeMatches("EFHK", "EF__"));
+  BOOST_CHECK(LatestMessageCache::likeMatches("EFHK", "%K"));
+  BOOST_CHECK(LatestMessageCache::likeMatches("A_B", "A\\_B"));
+  BOOST_CHECK(!LatestMessageCache::likeMatches("AXB", "A\\_B"));
+  BOOST_CHECK(!LatestMessageCache::likeMatches("FBFI42EFKL", "FBFI41%"));
+  BOOST_CHECK(!LatestMessageCache::likeMatches("EFHKX", "EF__"));
+  BOOST_CHECK(!LatestMessageCache::likeMatches("", "_"));
+}
+
+BOOST_AUTO_TEST_CASE(latestmessagecache_covers)
+{
+  const Config config(configFileName);
+  const StationIdList stationIds{1, 2};
+
+  BOOST_CHECK(LatestMessageCache::covers(stationIds, queryOptions({"METAR", "TAF"}), config));
+  BOOST_CHECK(!LatestMessageCache::covers(StationIdList(), queryOptions({"METAR"}), config));
+
+  // Types queried without 'latestmessage' and unknown types are not cached
+
+  BOOST_CHECK(!LatestMessageCache::covers(stationIds, queryOptions({"METAR", "ARS"}), config));
+  BOOST_CHECK(!LatestMessageCache::covers(stationIds, queryOptions({"UNKNOWN"}), config));
+  BOOST_CHECK(!LatestMessageCache::covers(stationIds, queryOptions({}), config));
+
+  // Only non edr current time queries
+
+  auto options = queryOptions({"METAR"});
+  options.itsTimeOptions.itsObservationTime = "timestamptz '2024-05-10T12:00:00Z'";
+  BOOST_CHECK(!LatestMessageCache::covers(stationIds, options, config));
+
+  options = queryOptions({"METAR"});
+  options.itsTimeOptions.itsMessageCreatedTime = "current_timestamp";
+  BOOST_CHECK(!LatestMessageCache::covers(stationIds, options, config));
+}
+
+BOOST_AUTO_TEST_CASE(latestmessagecache_messagetime)
+{
+  const Config config(configFileName);
+  LatestMessageCache cache(config);
+
+  auto notCreated = message(5, 1, 1, "METAR", now - Fmi::Minutes(5));
+  notCreated.itsCreated = now + Fmi::Minutes(1);
+  auto iwxxm = message(6, 1, 1, "METAR", now - Fmi::Minutes(10));
+  iwxxm.itsFormat = "IWXXM";
+  auto filtered = message(7, 2, 1, "METAR", now - Fmi::Minutes(10));
+  filtered.itsMETARPrefix = false;
+
+  cache.addMessages({message(1, 1, 1, "METAR", now - Fmi::Minutes(50)),
+                     message(2, 1, 1, "METAR", now - Fmi::Minutes(20)),
+                     message(3, 2, 1, "METAR", now - Fmi::Minutes(40)),
+                     message(4, 3, 1, "METAR", now - Fmi::Hours(3)),
+                     notCreated,
+                     iwxxm,
+                     filtered,
+                     message(2, 1, 1, "METAR", now - Fmi::Minutes(20))});
+
+  const StationIdList stationIds{1, 2, 3};
+
+  auto ids = cache.getLatestMessageIds(stationIds, queryOptions({"METAR"}), now, 0);
+  BOOST_CHECK((ids == std::vector<long>{2, 3}));
+
+  // Finnish METARs not starting with 'METAR' are returned only when not filtering
+
+  auto options = queryOptions({"METAR"});
+  options.itsFilterMETARs = false;
+
+  ids = cache.getLatestMessageIds(stationIds, options, now, 0);
+  BOOST_CHECK((ids == std::vector<long>{2, 7}));
+
+  options = queryOptions({"METAR"});
+  options.itsMessageFormat = "IWXXM";
+
+  ids = cache.getLatestMessageIds(stationIds, options, now, 0);
+  BOOST_CHECK((ids == std::vector<long>{6}));
+}
+
+BOOST_AUTO_TEST_CASE(latestmessagecache_messagevalidtime)
+{
+  const Config config(configFileName);
+  LatestMessageCache cache(config);
+
+  // NIL TAF (no valid time) is valid 'validityhours' from message time
+
+  cache.addMessages({validMessage(1,
+                                  1,
+                                  2,
+                                  "TAF",
+                                  now - Fmi::Hours(3),
+                                  now - Fmi::Hours(3),
+                                  now + Fmi::Hours(21)),
+                     validMessage(2,
+                                  1,
+                                  2,
+                                  "TAF",
+                                  now - Fmi::Hours(1),
+                                  now - Fmi::Hours(1),
+                                  now + Fmi::Hours(23)),
+                     validMessage(3,
+                                  2,
+                                  2,
+                                  "TAF",
+                                  now - Fmi::Hours(1),
+                                  now + Fmi::Hours(1),
+                                  now + Fmi::Hours(23)),
+                     message(4, 2, 2, "TAF", now - Fmi::Minutes(30)),
+                     message(5, 3, 2, "TAF", now - Fmi::Hours(5))});
+
+  auto ids = cache.getLatestMessageIds({1, 2, 3}, queryOptions({"TAF"}), now, 0);
+  BOOST_CHECK((ids == std::vector<long>{2, 4}));
+}
+
+BOOST_AUTO_TEST_CASE(latestmessagecache_validtime_groups)
+{
+  const Config config(configFileName);
+  LatestMessageCache cache(config);
+
+  cache.addMessages({validMessage(1,
+                                  1,
+                                  3,
+                                  "METREP",
+                                  now - Fmi::Hours(1),
+                                  now - Fmi::Hours(1),
+                                  now + Fmi::Hours(1)),
+                     validMessage(2,
+                                  1,
+                                  4,
+                                  "SPECIAL",
+                                  now - Fmi::Minutes(10),
+                                  now - Fmi::Minutes(10),
+                                  now + Fmi::Hours(1)),
+                     validMessage(3,
+                                  1,
+                                  3,
+                                  "METREP",
+                                  now - Fmi::Minutes(5),
+                                  now + Fmi::Minutes(5),
+                                  now + Fmi::Hours(1))});
+
+  // Latest message for the group is returned when all group's types are queried
+
+  auto ids = cache.getLatestMessageIds({1}, queryOptions({"METREP", "SPECIAL"}), now, 0);
+  BOOST_CHECK((ids == std::vector<long>{2}));
+
+  ids = cache.getLatestMessageIds({1}, queryOptions({"METREP"}), now, 0);
+  BOOST_CHECK((ids == std::vector<long>{1}));
+}
+
+BOOST_AUTO_TEST_CASE(latestmessagecache_messirpatterns)
+{
+  const Config config(configFileName);
+  LatestMessageCache cache(config);
+
+  std::vector<LatestMessage> messages;
+  int n = 1;
+
+  for (auto const &messir : {"FBFI41EFKL", "FBFI41EFKL", "FBFI42EFKL", "FBXX99"})
+  {
+    auto message = validMessage(n,
+                                1,
+                                5,
+                                "GAFOR",
+                                now - Fmi::Minutes(10 * n),
+                                now - Fmi::Hours(1),
+                                now + Fmi::Hours(1));
+    message.itsMessirHeading = messir;
+    messages.push_back(message);
+    n++;
+  }
+
+  cache.addMessages(messages);
+
+  auto ids = cache.getLatestMessageIds({1}, queryOptions({"GAFOR"}), now, 0);
+  BOOST_CHECK((ids == std::vector<long>{1, 3, 4}));
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
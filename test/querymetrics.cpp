@@ -0,0 +1,162 @@
+#define BOOST_TEST_MODULE "QueryMetricsClassModule"
+
+#include "QueryMetrics.h"
+
+#include <boost/test/included/unit_test.hpp>
+#include <thread>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+void sleep(int milliseconds)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+const QueryLatencies *find(const QueryMetricsData &metricsData, const std::string &method)
+{
+  for (const auto &latencies : metricsData)
+    if (latencies.itsMethod == method)
+      return &latencies;
+
+  return nullptr;
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(querymetrics_stages)
+{
+  QueryMetrics metrics;
+
+  {
+    QueryMetrics::Call call(metrics, "queryMessages", {"taf", "METAR", "TAF"});
+
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::MessageQuery);
+
+    {
+      QueryMetrics::StageTimer validationTimer(QueryMetrics::Stage::Validation);
+      sleep(20);
+    }
+
+    // Nested call is recorded as part of the outer call
+
+    QueryMetrics::Call nestedCall(metrics, "joinStationAndMessageData");
+    QueryMetrics::StageTimer joinTimer(QueryMetrics::Stage::Join);
+  }
+
+  auto metricsData = metrics.getMetrics();
+
+  BOOST_REQUIRE_EQUAL(metricsData.size(), 1);
+
+  const auto &latencies = metricsData.front();
+
+  BOOST_CHECK_EQUAL(latencies.itsMethod, "queryMessages");
+  BOOST_CHECK_EQUAL(latencies.itsMessageTypes, "METAR,TAF");
+
+  const auto &stages = latencies.itsStages;
+
+  BOOST_REQUIRE(stages.find("validation") != stages.end());
+  BOOST_REQUIRE(stages.find("messagequery") != stages.end());
+  BOOST_REQUIRE(stages.find("total") != stages.end());
+  BOOST_CHECK(stages.find("stationquery") == stages.end());
+
+  // Stage times are exclusive
+
+  const auto &validation = stages.at("validation");
+  const auto &messageQuery = stages.at("messagequery");
+  const auto &total = stages.at("total");
+
+  BOOST_CHECK_EQUAL(validation.itsCount, 1);
+  BOOST_CHECK_GE(validation.itsTotal, 20);
+  BOOST_CHECK_LT(messageQuery.itsTotal, validation.itsTotal);
+  BOOST_CHECK_GE(total.itsTotal, validation.itsTotal);
+
+  BOOST_REQUIRE_EQUAL(total.itsCounts.size(), total.itsBucketLimits.size() + 1);
+  BOOST_CHECK_EQUAL(total.itsCounts[5], 1);  // 20 - 50 ms
+}
+
+BOOST_AUTO_TEST_CASE(querymetrics_callscope)
+{
+  QueryMetrics metrics;
+
+  {
+    QueryMetrics::Call call(metrics, "queryStationsAndMessages", {"METAR"});
+
+    std::thread worker(
+        [&call]()
+        {
+          QueryMetrics::CallScope callScope(&call, nullptr);
+          QueryMetrics::StageTimer timer(QueryMetrics::Stage::ConnectionWait);
+        });
+    worker.join();
+
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::ConnectionWait);
+  }
+
+  // Timers without a call are not recorded
+
+  QueryMetrics::StageTimer timer(QueryMetrics::Stage::StationQuery);
+
+  auto metricsData = metrics.getMetrics();
+
+  const auto *latencies = find(metricsData, "queryStationsAndMessages");
+
+  BOOST_REQUIRE(latencies);
+  BOOST_REQUIRE(latencies->itsStages.find("connectionwait") != latencies->itsStages.end());
+  BOOST_CHECK_EQUAL(latencies->itsStages.at("connectionwait").itsCount, 1);
+  BOOST_CHECK_EQUAL(metricsData.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(querymetrics_callscope_nested)
+{
+  QueryMetrics metrics;
+
+  {
+    QueryMetrics::Call call(metrics, "queryMessages", {"METAR"});
+    QueryMetrics::StageTimer timer(QueryMetrics::Stage::MessageQuery);
+
+    // Worker's stage is nested under the calling thread's stage; the time spent waiting for
+    // the worker is not counted in the calling thread's stage
+
+    auto* callTimer = QueryMetrics::currentTimer();
+
+    std::thread worker(
+        [&call, callTimer]()
+        {
+          QueryMetrics::CallScope callScope(&call, callTimer);
+          QueryMetrics::StageTimer timer(QueryMetrics::Stage::ResultDecoding);
+          sleep(20);
+        });
+    worker.join();
+  }
+
+  auto metricsData = metrics.getMetrics();
+
+  const auto *latencies = find(metricsData, "queryMessages");
+
+  BOOST_REQUIRE(latencies);
+
+  const auto &stages = latencies->itsStages;
+
+  BOOST_REQUIRE(stages.find("resultdecoding") != stages.end());
+
+  // Message query's exclusive time may be zero and is then not recorded
+
+  auto messageQuery = stages.find("messagequery");
+  double messageQueryTotal = ((messageQuery != stages.end()) ? messageQuery->second.itsTotal : 0);
+
+  const auto &resultDecoding = stages.at("resultdecoding");
+  const auto &total = stages.at("total");
+
+  BOOST_CHECK_GE(resultDecoding.itsTotal, 20);
+  BOOST_CHECK_LT(messageQueryTotal, resultDecoding.itsTotal);
+  BOOST_CHECK_LE(resultDecoding.itsTotal + messageQueryTotal, total.itsTotal);
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,64 @@
+#define BOOST_TEST_MODULE "QueryParametersClassModule"
+
+#include "QueryParameters.h"
+
+#include <boost/test/included/unit_test.hpp>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+BOOST_AUTO_TEST_CASE(queryparameters_add)
+{
+  QueryParameters queryParameters;
+
+  BOOST_CHECK(queryParameters.empty());
+
+  BOOST_CHECK_EQUAL(queryParameters.add("TAC", "text"), "$1::text");
+  BOOST_CHECK_EQUAL(queryParameters.add(StationIdList{1, 22, 333}), "$2::integer[]");
+  BOOST_CHECK_EQUAL(queryParameters.add(std::vector<long>{}), "$3::bigint[]");
+  BOOST_CHECK_EQUAL(queryParameters.add(StringList{"EFHK", "a\"b", "c\\d"}), "$4::text[]");
+
+  const auto &values = queryParameters.getValues();
+
+  BOOST_REQUIRE_EQUAL(values.size(), 4);
+  BOOST_CHECK_EQUAL(values[0], "TAC");
+  BOOST_CHECK_EQUAL(values[1], "{1,22,333}");
+  BOOST_CHECK_EQUAL(values[2], "{}");
+  BOOST_CHECK_EQUAL(values[3], "{\"EFHK\",\"a\\\"b\",\"c\\\\d\"}");
+}
+
+BOOST_AUTO_TEST_CASE(queryparameters_addtime)
+{
+  QueryParameters queryParameters;
+
+  BOOST_CHECK_EQUAL(queryParameters.addTime(""), "");
+  BOOST_CHECK_EQUAL(queryParameters.addTime("current_timestamp"), "current_timestamp");
+  BOOST_CHECK(queryParameters.empty());
+
+  BOOST_CHECK_EQUAL(queryParameters.addTime("timestamptz '2024-05-10T12:00:00Z'"),
+                    "$1::timestamptz");
+  BOOST_REQUIRE_EQUAL(queryParameters.getValues().size(), 1);
+  BOOST_CHECK_EQUAL(queryParameters.getValues()[0], "2024-05-10T12:00:00Z");
+}
+
+BOOST_AUTO_TEST_CASE(queryparameters_set)
+{
+  QueryParameters queryParameters;
+
+  queryParameters.addTime("timestamptz '2024-05-10T12:00:00Z'");
+  queryParameters.addTime("timestamptz '2024-05-11T12:00:00Z'");
+  BOOST_CHECK_EQUAL(queryParameters.size(), 2);
+
+  queryParameters.set(1, "2024-05-10T18:00:00Z");
+  BOOST_CHECK_EQUAL(queryParameters.getValues()[0], "2024-05-10T12:00:00Z");
+  BOOST_CHECK_EQUAL(queryParameters.getValues()[1], "2024-05-10T18:00:00Z");
+
+  BOOST_CHECK_THROW(queryParameters.set(2, ""), Fmi::Exception);
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,124 @@
+#define BOOST_TEST_MODULE "QueryResultCacheClassModule"
+
+#include "QueryResultCache.h"
+
+#include <boost/test/included/unit_test.hpp>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+QueryResultCache::ResultPtr result(const std::string &message)
+{
+  auto result = std::make_shared<QueryResultCache::Result>();
+  result->itsData.itsStationIds.push_back(1);
+  result->itsData.itsValues[1]["message"].push_back(message);
+  return result;
+}
+
+std::string message(const QueryResultCache::ResultPtr &result)
+{
+  return std::get<std::string>(result->itsData.itsValues.at(1).at("message").front());
+}
+
+const auto expirationTime = QueryResultCache::Clock::now() + std::chrono::hours(1);
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(queryresultcache_key)
+{
+  QueryOptions queryOptions;
+  queryOptions.itsMessageTypes = {"METAR", "TAF"};
+  queryOptions.itsParameters = {"icao", "message"};
+  queryOptions.itsLocationOptions.itsIcaos = {"EFHK", "efro"};
+  queryOptions.itsTimeOptions.itsObservationTime = "current_timestamp";
+
+  auto key = QueryResultCache::key("queryStationsAndMessages", nullptr, queryOptions, 100);
+
+  // Icao codes and message types are sorted
+
+  auto options = queryOptions;
+  options.itsMessageTypes = {"taf", "METAR"};
+  options.itsLocationOptions.itsIcaos = {"EFRO", "EFHK", "EFHK"};
+
+  BOOST_CHECK_EQUAL(QueryResultCache::key("queryStationsAndMessages", nullptr, options, 100), key);
+
+  // Parameter order and time bucket of current time query matter
+
+  options = queryOptions;
+  options.itsParameters = {"message", "icao"};
+
+  BOOST_CHECK(QueryResultCache::key("queryStationsAndMessages", nullptr, options, 100) != key);
+  BOOST_CHECK(QueryResultCache::key("queryStationsAndMessages", nullptr, queryOptions, 101) !=
+              key);
+  BOOST_CHECK(QueryResultCache::key("queryMessages", nullptr, queryOptions, 100) != key);
+
+  // Time bucket is not used for fixed time queries
+
+  options = queryOptions;
+  options.itsTimeOptions.itsObservationTime = "timestamptz '2024-05-10T12:00:00Z'";
+
+  BOOST_CHECK(!QueryResultCache::isCurrentTimeQuery(options));
+  BOOST_CHECK_EQUAL(QueryResultCache::key("queryMessages", nullptr, options, 100),
+                    QueryResultCache::key("queryMessages", nullptr, options, 101));
+}
+
+BOOST_AUTO_TEST_CASE(queryresultcache_insert_invalidate)
+{
+  QueryResultCache cache(1024 * 1024);
+
+  auto generation = cache.getGeneration();
+
+  BOOST_CHECK(cache.insert("metar", {"METAR"}, expirationTime, result("M"), generation));
+  cache.insert("taf", {"taf"}, expirationTime, result("T"), generation);
+  cache.insert("all", {}, expirationTime, result("A"), generation);
+  cache.insert("expired", {"METAR"}, QueryResultCache::Clock::now(), result("E"), generation);
+
+  BOOST_REQUIRE(cache.find("metar"));
+  BOOST_CHECK_EQUAL(message(cache.find("metar")), "M");
+  BOOST_CHECK(!cache.find("expired"));
+  BOOST_CHECK(!cache.find("unknown"));
+
+  // Results of the invalidated types and for all types are removed
+
+  cache.invalidate({"TAF"});
+
+  BOOST_CHECK(cache.find("metar"));
+  BOOST_CHECK(!cache.find("taf"));
+  BOOST_CHECK(!cache.find("all"));
+
+  // Results of queries started before invalidation are not stored
+
+  BOOST_CHECK(!cache.insert("taf", {"TAF"}, expirationTime, result("T"), generation));
+  BOOST_CHECK(!cache.find("taf"));
+}
+
+BOOST_AUTO_TEST_CASE(queryresultcache_maxsize)
+{
+  auto size = QueryResultCache::resultSize(*result("M")) + 100;
+
+  QueryResultCache cache(2 * size);
+
+  auto generation = cache.getGeneration();
+
+  cache.insert("1", {"METAR"}, expirationTime, result("M"), generation);
+  cache.insert("2", {"METAR"}, expirationTime, result("M"), generation);
+
+  // Least recently used result is evicted
+
+  BOOST_CHECK(cache.find("1"));
+
+  cache.insert("3", {"METAR"}, expirationTime, result("M"), generation);
+
+  BOOST_CHECK(cache.find("1"));
+  BOOST_CHECK(!cache.find("2"));
+  BOOST_CHECK(cache.find("3"));
+  BOOST_CHECK(cache.size() <= 2 * size);
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,75 @@
+#define BOOST_TEST_MODULE "RouteCacheClassModule"
+
+#include "RouteCache.h"
+
+#include <boost/test/included/unit_test.hpp>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+BOOST_AUTO_TEST_CASE(routecache_key)
+{
+  RouteCache cache(10, 2);
+
+  auto route = cache.quantize(LonLatList{{24.9631, 60.3172}, {-0.001, 66.5649}});
+  BOOST_CHECK_EQUAL(cache.wkt(route), "LINESTRING(24.96 60.32,0.00 66.56)");
+
+  // Routes differing below the precision have the same key
+
+  auto key = RouteCache::key(route, 5000, MessageScope::StationScope);
+
+  auto other = cache.quantize(LonLatList{{24.9649, 60.3151}, {0.001, 66.5551}});
+
+  BOOST_CHECK_EQUAL(RouteCache::key(other, 5000.2, MessageScope::StationScope), key);
+  BOOST_CHECK(RouteCache::key(route, 6000, MessageScope::StationScope) != key);
+  BOOST_CHECK(RouteCache::key(route, 5000, MessageScope::FIRScope) != key);
+  BOOST_CHECK(RouteCache::key(cache.quantize(LonLatList{{24.97, 60.32}, {0, 66.56}}),
+                              5000,
+                              MessageScope::StationScope) != key);
+}
+
+BOOST_AUTO_TEST_CASE(routecache_find)
+{
+  RouteCache cache(2, 3);
+
+  cache.insert("a", 1, StationIdList{3, 1, 2});
+  cache.insert("b", 1, StationIdList{4});
+
+  auto stationIds = cache.find("a", 1);
+  BOOST_REQUIRE(stationIds);
+  BOOST_CHECK_EQUAL(stationIds->size(), 3U);
+  BOOST_CHECK_EQUAL(stationIds->front(), 3);
+
+  // Least recently used route is evicted
+
+  cache.insert("c", 1, StationIdList{5});
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK(!cache.find("b", 1));
+  BOOST_CHECK(cache.find("a", 1));
+
+  // Routes of other station catalog versions are not returned nor dropped by lookups
+
+  BOOST_CHECK(!cache.find("a", 2));
+  BOOST_CHECK(!cache.find("a", 0));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK(cache.find("a", 1));
+
+  // Routes are dropped when routes selected with newer version are stored; stations selected
+  // with older version are not stored
+
+  cache.insert("b", 2, StationIdList{1});
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(!cache.find("a", 1));
+  BOOST_CHECK(cache.find("b", 2));
+
+  cache.insert("a", 1, StationIdList{1});
+  BOOST_CHECK_EQUAL(cache.size(), 1U);
+  BOOST_CHECK(!cache.find("a", 2));
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
@@ -0,0 +1,203 @@
+#define BOOST_TEST_MODULE "StationCatalogClassModule"
+
+#include "StationCatalog.h"
+
+#include <boost/test/included/unit_test.hpp>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+namespace
+{
+StationInfo station(StationIdType id,
+                    const std::string &icao,
+                    const std::string &name,
+                    const std::string &countryCode)
+{
+  StationInfo station;
+  station.itsId = id;
+  station.itsIcao = icao;
+  station.itsName = name;
+  station.itsCountryCode = countryCode;
+  station.itsModified = Fmi::DateTime(Fmi::Date(2024, 1, id));
+  return station;
+}
+
+StationInfos stations()
+{
+  return {station(3, "EFRO", "Rovaniemi", "FI"),
+          station(1, "EFHK", "Helsinki-Vantaa", "FI"),
+          station(2, "ESSA", "Stockholm-Arlanda", "SE"),
+          station(4, "EFHF", "Helsinki-Malmi", "FI")};
+}
+
+StationInfo station(
+    StationIdType id, const std::string &icao, const std::string &name, double lon, double lat)
+{
+  auto station = Avi::station(id, icao, name, "FI");
+  station.itsLongitude = lon;
+  station.itsLatitude = lat;
+  return station;
+}
+
+StationInfos spatialStations()
+{
+  return {station(1, "EFHK", "Helsinki-Vantaa", 24.963, 60.317),
+          station(2, "EFHF", "Helsinki-Malmi", 25.043, 60.254),
+          station(3, "EFRO", "Rovaniemi", 25.844, 66.565),
+          station(4, "ILHE", "Helsinki Kaisaniemi", 24.944, 60.175),
+          station(5, "NZCH", "Christchurch", 172.532, -43.489),
+          station(6, "NZCI", "Chatham Islands", -176.457, -43.810)};
+}
+}  // namespace
+
+BOOST_AUTO_TEST_CASE(stationcatalog_constructor)
+{
+  const StationCatalog catalog(stations(), 7);
+
+  BOOST_CHECK_EQUAL(catalog.size(), 4);
+  BOOST_CHECK_EQUAL(catalog.getVersion(), 7);
+  BOOST_CHECK(catalog.getModifiedLast() == Fmi::DateTime(Fmi::Date(2024, 1, 4)));
+  BOOST_CHECK_EQUAL(catalog.getStations().front().itsId, 1);
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_getStation,
+                     *boost::unit_test::depends_on("stationcatalog_constructor"))
+{
+  const StationCatalog catalog(stations(), 1);
+
+  BOOST_REQUIRE(catalog.getStation(3) != nullptr);
+  BOOST_CHECK_EQUAL(catalog.getStation(3)->itsIcao, "EFRO");
+  BOOST_CHECK(catalog.getStation(5) == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_existence_checks,
+                     *boost::unit_test::depends_on("stationcatalog_constructor"))
+{
+  const StationCatalog catalog(stations(), 1);
+
+  BOOST_CHECK(catalog.hasIcao("efhk"));
+  BOOST_CHECK(not catalog.hasIcao("EFXX"));
+  BOOST_CHECK(catalog.hasPlace("rovaniemi"));
+  BOOST_CHECK(not catalog.hasPlace("Rovaniemi "));
+  BOOST_CHECK(catalog.hasCountry("SE"));
+  BOOST_CHECK(not catalog.hasCountry("se"));
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_lookups,
+                     *boost::unit_test::depends_on("stationcatalog_constructor"))
+{
+  const StationCatalog catalog(stations(), 1);
+
+  auto byIds = catalog.getStations(StationIdList{4, 2, 4, 9});
+  BOOST_REQUIRE_EQUAL(byIds.size(), 2);
+  BOOST_CHECK_EQUAL(byIds[0]->itsId, 2);
+  BOOST_CHECK_EQUAL(byIds[1]->itsId, 4);
+
+  auto byIcaos = catalog.getStationsWithIcaos(StringList{"efro", "ESSA"});
+  BOOST_REQUIRE_EQUAL(byIcaos.size(), 2);
+  BOOST_CHECK_EQUAL(byIcaos[0]->itsId, 2);
+  BOOST_CHECK_EQUAL(byIcaos[1]->itsId, 3);
+
+  auto byPlaces = catalog.getStationsWithPlaces(StringList{"HELSINKI-MALMI"});
+  BOOST_REQUIRE_EQUAL(byPlaces.size(), 1);
+  BOOST_CHECK_EQUAL(byPlaces[0]->itsIcao, "EFHF");
+
+  auto byCountries = catalog.getStationsWithCountries(StringList{"fi"}, StringList{"EFH"});
+  BOOST_REQUIRE_EQUAL(byCountries.size(), 1);
+  BOOST_CHECK_EQUAL(byCountries[0]->itsIcao, "EFRO");
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_coordinates,
+                     *boost::unit_test::depends_on("stationcatalog_constructor"))
+{
+  const StationCatalog catalog(spatialStations(), 1);
+
+  // Helsinki city center
+
+  auto stations = catalog.getStationsWithCoordinates(LonLatList{{24.94, 60.17}}, 25000, 0, false);
+  BOOST_REQUIRE_EQUAL(stations.size(), 3);
+  BOOST_CHECK_EQUAL(stations[0].itsStation->itsIcao, "EFHK");
+  BOOST_CHECK_CLOSE(stations[0].itsDistance, 16.3, 1);
+  BOOST_REQUIRE(stations[0].itsBearing);
+  BOOST_CHECK_CLOSE(*stations[0].itsBearing, 188.9, 1);
+  BOOST_CHECK_EQUAL(stations[2].itsStation->itsIcao, "ILHE");
+
+  stations = catalog.getStationsWithCoordinates(LonLatList{{24.94, 60.17}}, 25000, 2, true);
+  BOOST_REQUIRE_EQUAL(stations.size(), 2);
+  BOOST_CHECK_EQUAL(stations[0].itsStation->itsIcao, "EFHK");
+  BOOST_CHECK_EQUAL(stations[1].itsStation->itsIcao, "EFHF");
+
+  // Duplicate coordinates multiply the rank of farther stations
+
+  stations = catalog.getStationsWithCoordinates(
+      LonLatList{{24.94, 60.17}, {24.94, 60.17}}, 25000, 2, false);
+  BOOST_REQUIRE_EQUAL(stations.size(), 1);
+  BOOST_CHECK_EQUAL(stations[0].itsStation->itsIcao, "ILHE");
+
+  // Search area wraps over the antimeridian
+
+  stations = catalog.getStationsWithCoordinates(LonLatList{{179.9, -43.7}}, 400000, 0, false);
+  BOOST_REQUIRE_EQUAL(stations.size(), 1);
+  BOOST_CHECK_EQUAL(stations[0].itsStation->itsIcao, "NZCI");
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_bboxes,
+                     *boost::unit_test::depends_on("stationcatalog_constructor"))
+{
+  const StationCatalog catalog(spatialStations(), 1);
+
+  auto stations = catalog.getStationsWithBBoxes(BBoxList{{25.1, 24.9, 60.2, 60.4}}, 0);
+  BOOST_REQUIRE_EQUAL(stations.size(), 2);
+  BOOST_CHECK_EQUAL(stations[0]->itsIcao, "EFHK");
+  BOOST_CHECK_EQUAL(stations[1]->itsIcao, "EFHF");
+
+  stations = catalog.getStationsWithBBoxes(BBoxList{{25.1, 24.9, 60.2, 60.4}}, 5000);
+  BOOST_REQUIRE_EQUAL(stations.size(), 3);
+  BOOST_CHECK_EQUAL(stations[2]->itsIcao, "ILHE");
+
+  stations = catalog.getStationsWithBBoxes(BBoxList{{30, 20, 70, 80}}, 0);
+  BOOST_CHECK(stations.empty());
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_route,
+                     *boost::unit_test::depends_on("stationcatalog_constructor"))
+{
+  const StationCatalog catalog(spatialStations(), 1);
+
+  // Stations are ordered by distance to the start of the route
+
+  auto stations =
+      catalog.getStationsWithRoute(LonLatList{{25.844, 66.565}, {24.94, 60.17}}, 3000);
+  BOOST_REQUIRE_EQUAL(stations.size(), 3);
+  BOOST_CHECK_EQUAL(stations[0]->itsIcao, "EFRO");
+  BOOST_CHECK_EQUAL(stations[1]->itsIcao, "EFHK");
+  BOOST_CHECK_EQUAL(stations[2]->itsIcao, "ILHE");
+
+  // Stations near the first segment come first
+
+  stations = catalog.getStationsWithRoute(
+      LonLatList{{24.94, 60.18}, {25.844, 66.565}, {24.94, 60.17}}, 3000);
+  BOOST_REQUIRE_EQUAL(stations.size(), 3);
+  BOOST_CHECK_EQUAL(stations[0]->itsIcao, "ILHE");
+  BOOST_CHECK_EQUAL(stations[1]->itsIcao, "EFHK");
+  BOOST_CHECK_EQUAL(stations[2]->itsIcao, "EFRO");
+
+  stations = catalog.getStationsWithRoute(LonLatList{{30, 70}, {31, 71}}, 3000);
+  BOOST_CHECK(stations.empty());
+}
+
+BOOST_AUTO_TEST_CASE(stationcatalog_icaoFilterMatches)
+{
+  BOOST_CHECK(StationCatalog::icaoFilterMatches("EFHK", "EF"));
+  BOOST_CHECK(StationCatalog::icaoFilterMatches("EFHK", "efhk"));
+  BOOST_CHECK(not StationCatalog::icaoFilterMatches("EFHK", "ES"));
+  BOOST_CHECK(not StationCatalog::icaoFilterMatches("EFHKX", "EFHK"));
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet
@@ -184,6 +184,28 @@ BOOST_AUTO_TEST_CASE(stationquerydata_getValues,
   BOOST_CHECK_EQUAL(duplicate, true);
   BOOST_CHECK_EQUAL(queryValues.size(), 0);
 }
+
+BOOST_AUTO_TEST_CASE(stationquerytable_getStationQueryData)
+{
+  StationQueryTable stationQueryTable;
+  stationQueryTable.itsColumns.push_back(Column(ColumnType::Integer, "station_id", "stationid"));
+  stationQueryTable.itsColumns.push_back(Column(ColumnType::String, "message"));
+  stationQueryTable.itsColumnValues = {ValueVector{5, 5, 3}, ValueVector{"A", "B", "C"}};
+  stationQueryTable.itsStationRows = {{5, 0, 2}, {3, 2, 1}};
+  stationQueryTable.itsRowCount = 3;
+
+  BOOST_CHECK_EQUAL(stationQueryTable.getColumnIndex("message"), 1);
+  BOOST_CHECK_EQUAL(stationQueryTable.getColumnIndex("distance"), -1);
+  BOOST_CHECK_EQUAL(std::get<std::string>(stationQueryTable.getValue(2, 1)), "C");
+
+  auto stationQueryData = stationQueryTable.getStationQueryData();
+
+  BOOST_CHECK((stationQueryData.itsStationIds == StationIdList{5, 3}));
+  BOOST_CHECK_EQUAL(stationQueryData.itsColumns.size(), 2);
+  BOOST_CHECK_EQUAL(stationQueryData.itsValues[5]["message"].size(), 2);
+  BOOST_CHECK_EQUAL(std::get<std::string>(stationQueryData.itsValues[5]["message"][1]), "B");
+  BOOST_CHECK_EQUAL(stationQueryData.itsValues[3]["stationid"].size(), 1);
+}
 }  // namespace Avi
 }  // namespace Engine
 }  // namespace SmartMet
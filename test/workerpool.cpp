@@ -0,0 +1,78 @@
+#define BOOST_TEST_MODULE "WorkerPoolClassModule"
+
+#include "WorkerPool.h"
+
+#include <boost/test/included/unit_test.hpp>
+#include <chrono>
+#include <stdexcept>
+
+namespace SmartMet
+{
+namespace Engine
+{
+namespace Avi
+{
+BOOST_AUTO_TEST_CASE(workerpool_submit)
+{
+  WorkerPool workerPool(4);
+  BOOST_CHECK_EQUAL(workerPool.size(), 4U);
+
+  std::vector<std::future<int>> futures;
+
+  for (int i = 0; i < 100; i++)
+    futures.push_back(workerPool.submit<int>([i]() { return i * 2; }));
+
+  for (int i = 0; i < 100; i++)
+    BOOST_CHECK_EQUAL(futures[i].get(), i * 2);
+}
+
+BOOST_AUTO_TEST_CASE(workerpool_error)
+{
+  WorkerPool workerPool(1);
+
+  auto future = workerPool.submit<int>([]() -> int { throw std::runtime_error("failed"); });
+  BOOST_CHECK_THROW(future.get(), std::runtime_error);
+
+  // The worker survives the error
+
+  BOOST_CHECK_EQUAL(workerPool.submit<int>([]() { return 1; }).get(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(workerpool_shutdown)
+{
+  WorkerPool workerPool(1);
+  std::promise<void> started;
+  std::promise<void> release;
+  auto releaseFuture = release.get_future().share();
+
+  auto running = workerPool.submit<int>(
+      [&started, releaseFuture]()
+      {
+        started.set_value();
+        releaseFuture.wait();
+        return 1;
+      });
+  auto queued = workerPool.submit<int>([]() { return 2; });
+
+  started.get_future().wait();
+
+  std::thread releaser(
+      [&release]()
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        release.set_value();
+      });
+
+  workerPool.shutdown();
+  releaser.join();
+
+  // Running task completes, queued task is discarded and no more tasks are accepted
+
+  BOOST_CHECK_EQUAL(running.get(), 1);
+  BOOST_CHECK_THROW(queued.get(), std::future_error);
+  BOOST_CHECK_THROW(workerPool.submit<int>([]() { return 3; }), std::exception);
+}
+
+}  // namespace Avi
+}  // namespace Engine
+}  // namespace SmartMet